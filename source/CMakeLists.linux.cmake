@@ -26,6 +26,7 @@ set(OpenCV_STATIC ON)
 find_package(OpenCV REQUIRED COMPONENTS core calib3d imgcodecs imgproc dnn ml)
 set(wxWidgets_USE_STATIC ON)
 find_package(wxWidgets REQUIRED gl core base)
+find_package(OpenGL REQUIRED)
 
 add_library(onnxruntime SHARED IMPORTED)
 set_target_properties(onnxruntime PROPERTIES
@@ -52,6 +53,7 @@ list(APPEND PUBLIC_HEADER_LIST
 
 list(APPEND LINK_LIST 
 	opencv::opencv
+	OpenGL::GL
 	ofiq_lib
 	onnxruntime
 )
@@ -61,3 +63,5 @@ add_executable(OFIQDemonstrator ${SOURCE_DIR}/src/OFIQDemonstrator.cpp)
 set_target_properties(OFIQDemonstrator PROPERTIES RUNTIME_OUTPUT_DIRECTORY_RELEASE ${CMAKE_CURRENT_BINARY_DIR}/${CMAKE_BUILD_TYPE})
 set_target_properties(OFIQDemonstrator PROPERTIES RUNTIME_OUTPUT_DIRECTORY_DEBUG ${CMAKE_CURRENT_BINARY_DIR}/${CMAKE_BUILD_TYPE})
 target_link_libraries(OFIQDemonstrator PRIVATE ${wxWidgets_LIBRARIES} ${LINK_LIST})
+# The OpenGL canvas uses the OpenGL 2.1 entry points exported by libGL
+target_compile_definitions(OFIQDemonstrator PRIVATE GL_GLEXT_PROTOTYPES)
@@ -26,6 +26,7 @@ set(OpenCV_STATIC ON)
 find_package(OpenCV REQUIRED COMPONENTS core calib3d imgcodecs imgproc highgui dnn ml)
 set(wxWidgets_USE_STATIC ON)
 find_package(wxWidgets REQUIRED gl core base)
+find_package(OpenGL REQUIRED)
 
 add_library(onnxruntime SHARED IMPORTED)
 set_target_properties(onnxruntime PROPERTIES
@@ -56,6 +57,7 @@ list(APPEND PUBLIC_HEADER_LIST
 
 list(APPEND LINK_LIST 
 	opencv::opencv
+	OpenGL::GL
 )
 
 # add a test application
@@ -0,0 +1,258 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <OFIQBoundedQueue.h>
+#include <OFIQCommandLine.h>
+#include <OFIQMetrics.h>
+#include <OFIQOverlayRenderer.h>
+#include <OFIQShard.h>
+
+#include <opencv2/opencv.hpp>
+
+
+// Settings of the annotated images written by --batch --annotate-dir.
+struct OFIQAnnotationSettings
+{
+    std::string directory;
+    std::string format = "png";
+    int quality = -1;
+    size_t threads = 2;
+    size_t queueCapacity = 8;
+    OFIQOverlayOptions overlay;
+
+    static bool FromCommandLine(const OFIQCommandLine& commandLine, OFIQAnnotationSettings& settings, std::string& error)
+    {
+        settings = OFIQAnnotationSettings();
+        settings.directory = commandLine.GetString("annotate-dir");
+        settings.format = commandLine.GetString("annotate-format", "png");
+        if (settings.format == "jpeg")
+        {
+            settings.format = "jpg";
+        }
+        if (settings.format != "png" && settings.format != "jpg")
+        {
+            error = "Unsupported annotation format '" + settings.format + "', expected png or jpg.";
+            return false;
+        }
+        // Without --annotate-quality, quality stays -1 and the encoder default
+        // is used.
+        settings.quality = commandLine.GetInt("annotate-quality", -1);
+        int maxQuality = settings.format == "png" ? 9 : 100;
+        if (commandLine.HasOption("annotate-quality") && (settings.quality < 0 || settings.quality > maxQuality))
+        {
+            error = "--annotate-quality must be in [0, " + std::to_string(maxQuality) + "] for " + settings.format + ".";
+            return false;
+        }
+        settings.threads = static_cast<size_t>(std::max(1, commandLine.GetInt("encoder-threads", 2)));
+        settings.queueCapacity = static_cast<size_t>(std::max(1, commandLine.GetInt("encoder-queue", 8)));
+        return OFIQOverlayOptions::Parse(commandLine.GetString("annotate-layers", "faces,landmarks"), settings.overlay, error);
+    }
+
+    // The encoder parameters for cv::imwrite. PNG takes a compression level
+    // (0 fastest ... 9 smallest), JPEG a quality (0 ... 100).
+    std::vector<int> GetEncoderParameters() const
+    {
+        if (quality < 0)
+        {
+            return {};
+        }
+        if (format == "png")
+        {
+            return { cv::IMWRITE_PNG_COMPRESSION, quality };
+        }
+        return { cv::IMWRITE_JPEG_QUALITY, quality };
+    }
+};
+
+// Renders and encodes annotated images on a pool of encoder threads, so that
+// the assessment loop is not blocked by drawing, compression and disk writes.
+// The queue between the two is bounded: if the encoders fall behind, Submit
+// blocks, which keeps the number of decoded images held in memory limited.
+class OFIQAnnotationExport
+{
+public:
+    explicit OFIQAnnotationExport(const OFIQAnnotationSettings& settings)
+        : m_settings(settings)
+        , m_queue(settings.queueCapacity)
+        , m_queueGauge("ofiq_queue_depth", "Items waiting in a queue.", "queue=\"annotation\"",
+            [this] { return static_cast<double>(m_queue.Size()); })
+        , m_written(0)
+        , m_failed(0)
+        , m_blockedSeconds(0.0)
+        , m_encodeSeconds(0.0)
+    {
+        ;
+    }
+
+    ~OFIQAnnotationExport()
+    {
+        Finish();
+    }
+
+    bool Start(std::string& error)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(m_settings.directory, ec);
+        if (ec)
+        {
+            error = "Cannot create '" + m_settings.directory + "': " + ec.message();
+            return false;
+        }
+        for (size_t i = 0; i < m_settings.threads; i++)
+        {
+            m_threads.emplace_back(&OFIQAnnotationExport::EncoderLoop, this);
+        }
+        return true;
+    }
+
+    // Queues the annotated image of an item for writing. Blocks while the
+    // queue is full.
+    void Submit(const std::string& name, OFIQ::Image&& image, OFIQ::FaceImageQualityPreprocessingResult&& preprocessing)
+    {
+        Job job;
+        job.path = GetOutputPath(name);
+        job.image = std::move(image);
+        job.preprocessing = std::move(preprocessing);
+
+        auto start = std::chrono::steady_clock::now();
+        m_queue.Push(std::move(job));
+        m_blockedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Waits until all queued images have been written.
+    void Finish()
+    {
+        m_queue.Close();
+        for (auto& thread : m_threads)
+        {
+            thread.join();
+        }
+        m_threads.clear();
+    }
+
+    // Maps an image name to a file in the annotation directory, e.g.
+    // "a/img.jpg" to "a_img.jpg.png". Directory separators are replaced, so
+    // that images with the same file name in different directories do not
+    // overwrite each other, and the source extension is kept. Names that
+    // still map to the same file, e.g. "a/b_c.jpg" and "a_b/c.jpg", get a
+    // hash of the full name appended, and a counter if that is taken as
+    // well. Every name given out is recorded, so a later image cannot get
+    // it either. Called by the producer only.
+    std::string GetOutputPath(const std::string& name)
+    {
+        std::string baseName = name;
+        std::replace_if(baseName.begin(), baseName.end(),
+            [](char c) { return c == '/' || c == '\\' || c == ':'; }, '_');
+        baseName.erase(0, baseName.find_first_not_of('_'));
+        const unsigned int hash = static_cast<unsigned int>(OFIQShardSpec::Hash(name) & 0xffffffffu);
+        std::string fileName = baseName;
+        for (unsigned int attempt = 0; m_outputNames.emplace(fileName, name).first->second != name; attempt++)
+        {
+            char suffix[24];
+            if (attempt == 0)
+            {
+                snprintf(suffix, sizeof(suffix), "-%08x", hash);
+            }
+            else
+            {
+                snprintf(suffix, sizeof(suffix), "-%08x-%u", hash, attempt);
+            }
+            fileName = baseName + suffix;
+        }
+        return (std::filesystem::u8path(m_settings.directory) / std::filesystem::u8path(fileName + "." + m_settings.format)).u8string();
+    }
+
+    size_t GetWrittenCount() const
+    {
+        return m_written;
+    }
+
+    size_t GetFailedCount() const
+    {
+        return m_failed;
+    }
+
+    // Time the producer spent waiting for the encoders.
+    double GetBlockedSeconds() const
+    {
+        return m_blockedSeconds;
+    }
+
+    // Time spent rendering and encoding, summed over all encoder threads.
+    double GetEncodeSeconds() const
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        return m_encodeSeconds;
+    }
+
+private:
+    struct Job
+    {
+        std::string path;
+        OFIQ::Image image;
+        OFIQ::FaceImageQualityPreprocessingResult preprocessing;
+    };
+
+    void EncoderLoop()
+    {
+        std::vector<int> parameters = m_settings.GetEncoderParameters();
+        Job job;
+        while (m_queue.Pop(job))
+        {
+            auto start = std::chrono::steady_clock::now();
+            bool written = false;
+            try
+            {
+                cv::Mat annotated = OFIQOverlayRenderer::Render(job.image, job.preprocessing, m_settings.overlay);
+                auto encodeStart = std::chrono::steady_clock::now();
+                OFIQMetrics::Get().ObserveStage(OFIQStage::Render,
+                    std::chrono::duration<double>(encodeStart - start).count());
+                written = cv::imwrite(job.path, annotated, parameters);
+                OFIQMetrics::Get().ObserveStage(OFIQStage::Encode,
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - encodeStart).count());
+            }
+            catch (const std::exception& e)
+            {
+                std::cerr << "ERROR: " << job.path << ": " << e.what() << std::endl;
+            }
+            if (written)
+            {
+                m_written++;
+            }
+            else
+            {
+                m_failed++;
+                std::cerr << "ERROR: Cannot write annotated image '" << job.path << "'" << std::endl;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_statsMutex);
+                m_encodeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            job = Job();
+        }
+    }
+
+    OFIQAnnotationSettings m_settings;
+    OFIQBoundedQueue<Job> m_queue;
+    OFIQMetricsGauge m_queueGauge;
+    std::vector<std::thread> m_threads;
+    std::atomic<size_t> m_written;
+    std::atomic<size_t> m_failed;
+    double m_blockedSeconds;
+    double m_encodeSeconds;
+    mutable std::mutex m_statsMutex;
+    // The image name each output file name was first used for.
+    std::map<std::string, std::string> m_outputNames;
+};
@@ -0,0 +1,411 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+
+
+const std::map<int, std::string> measurementMapping = {
+    {0x41, "UnifiedQualityScore"},
+    {0x42, "BackgroundUniformity"},
+    {0x43, "IlluminationUniformity"},
+    {-0x44, "Luminance"},
+    {0x44, "LuminanceMean"},
+    {0x45, "LuminanceVariance"},
+    {0x46, "UnderExposurePrevention"},
+    {0x47, "OverExposurePrevention"},
+    {0x48, "DynamicRange"},
+    {0x49, "Sharpness"},
+    {0x4a, "CompressionArtifacts"},
+    {0x4b, "NaturalColour"},
+    {0x4c, "SingleFacePresent"},
+    {0x4d, "EyesOpen"},
+    {0x4e, "MouthClosed"},
+    {0x4f, "EyesVisible"},
+    {0x50, "MouthOcclusionPrevention"},
+    {0x51, "FaceOcclusionPrevention"},
+    {0x52, "InterEyeDistance"},
+    {0x53, "HeadSize"},
+    {-0x54, "CropOfTheFaceImage"},
+    {0x54, "LeftwardCropOfTheFaceImage"},
+    {0x55, "RightwardCropOfTheFaceImage"},
+    {0x56, "DownwardCropOfTheFaceImage"},
+    {0x57, "UpwardCropOfTheFaceImage"},
+    {-0x58, "HeadPose"},
+    {0x58, "HeadPoseYaw"},
+    {0x59, "HeadPosePitch"},
+    {0x5a, "HeadPoseRoll"},
+    {0x5b, "ExpressionNeutrality"},
+    {0x5c, "NoHeadCoverings"},
+    {-1, "NotSet"}
+};
+
+inline std::string GetMeasureName(OFIQ::QualityMeasure measure)
+{
+    auto it = measurementMapping.find(static_cast<int>(measure));
+    return it != measurementMapping.end() ? it->second : "NotSet";
+}
+
+// Writes quality assessments in the CSV layout of the "Export Assessment" menu
+// entry: the file name followed by the raw scores of all measures and then by
+// the scalar values of all measures. Batch runs with the pre-filter add the
+// status columns, see GetStatus.
+class OFIQAssessmentCsv
+{
+public:
+    static constexpr char separator = ';';
+
+    static const std::vector<std::string>& GetStatusColumns()
+    {
+        static const std::vector<std::string> columns = { "Status", "Reason" };
+        return columns;
+    }
+
+    // "assessed", "failed" or "rejected" (by the pre-filter), which tells
+    // apart rows without scores.
+    static std::string GetStatus(bool success, bool rejected)
+    {
+        return rejected ? "rejected" : (success ? "assessed" : "failed");
+    }
+
+    // Makes a message usable as a field.
+    static std::string ToField(const std::string& text)
+    {
+        std::string field = text;
+        for (auto& c : field)
+        {
+            if (c == separator || c == '\r' || c == '\n')
+            {
+                c = ' ';
+            }
+        }
+        return field;
+    }
+
+    static std::vector<OFIQ::QualityMeasure> GetMeasures(const OFIQ::FaceImageQualityAssessment& assessments)
+    {
+        std::vector<OFIQ::QualityMeasure> measures;
+        for (const auto& q : assessments.qAssessments)
+        {
+            measures.push_back(q.first);
+        }
+        return measures;
+    }
+
+    static void WriteHeader(
+        std::ostream& stream,
+        const std::vector<OFIQ::QualityMeasure>& measures,
+        const std::vector<std::string>& extraColumns = {})
+    {
+        stream << "Filename";
+
+        for (auto measure : measures)
+        {
+            stream << separator << GetMeasureName(measure);
+        }
+
+        for (auto measure : measures)
+        {
+            stream << separator << GetMeasureName(measure) << ".scalar";
+        }
+
+        for (const auto& column : extraColumns)
+        {
+            stream << separator << column;
+        }
+
+        stream << std::endl;
+    }
+
+    // Measures missing in the assessment are written with the default values
+    // of OFIQ::QualityMeasureResult, i.e. -1.
+    static void WriteRow(
+        std::ostream& stream,
+        const std::string& path,
+        const OFIQ::FaceImageQualityAssessment& assessments,
+        const std::vector<OFIQ::QualityMeasure>& measures,
+        const std::vector<std::string>& extraFields = {})
+    {
+        const OFIQ::QualityMeasureResult notAssessed;
+
+        stream << path;
+
+        for (auto measure : measures)
+        {
+            auto it = assessments.qAssessments.find(measure);
+            stream << separator << (it != assessments.qAssessments.end() ? it->second : notAssessed).rawScore;
+        }
+
+        for (auto measure : measures)
+        {
+            auto it = assessments.qAssessments.find(measure);
+            stream << separator << (it != assessments.qAssessments.end() ? it->second : notAssessed).scalar;
+        }
+
+        for (const auto& field : extraFields)
+        {
+            stream << separator << field;
+        }
+
+        stream << std::endl;
+    }
+
+    static std::vector<std::string> SplitLine(const std::string& line)
+    {
+        std::vector<std::string> fields;
+        size_t begin = 0;
+        while (true)
+        {
+            size_t end = line.find(separator, begin);
+            if (end == std::string::npos)
+            {
+                fields.push_back(line.substr(begin));
+                break;
+            }
+            fields.push_back(line.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return fields;
+    }
+
+    // Splits a header written by WriteHeader into the measures and the extra
+    // columns.
+    static bool ParseHeader(
+        const std::vector<std::string>& header,
+        std::vector<OFIQ::QualityMeasure>& measures,
+        std::vector<std::string>& extraColumns,
+        std::string& error)
+    {
+        measures.clear();
+        extraColumns.clear();
+        if (header.empty() || header[0] != "Filename")
+        {
+            error = "Not an assessment file header.";
+            return false;
+        }
+        size_t column = 1;
+        for (; column < header.size(); column++)
+        {
+            auto it = std::find_if(measurementMapping.begin(), measurementMapping.end(),
+                [&](const auto& entry) { return entry.second == header[column]; });
+            if (it == measurementMapping.end() || it->first == -1)
+            {
+                break;
+            }
+            measures.push_back(static_cast<OFIQ::QualityMeasure>(it->first));
+        }
+        for (size_t i = 0; i < measures.size(); i++, column++)
+        {
+            if (column >= header.size() || header[column] != GetMeasureName(measures[i]) + ".scalar")
+            {
+                error = "The scalar columns do not match the measures of the header.";
+                return false;
+            }
+        }
+        extraColumns.assign(header.begin() + static_cast<std::ptrdiff_t>(column), header.end());
+        return true;
+    }
+
+    // Reads a file written by WriteHeader/WriteRow.
+    static bool ReadFile(
+        const std::string& path,
+        std::vector<std::string>& header,
+        std::vector<std::vector<std::string>>& rows,
+        std::string& error)
+    {
+        std::ifstream stream(path.c_str());
+        if (!stream.is_open())
+        {
+            error = "Cannot open '" + path + "'";
+            return false;
+        }
+
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty())
+            {
+                continue;
+            }
+            if (header.empty())
+            {
+                header = SplitLine(line);
+                continue;
+            }
+            auto fields = SplitLine(line);
+            if (fields.size() != header.size())
+            {
+                error = "Unexpected number of columns in '" + path + "': " + line;
+                return false;
+            }
+            rows.push_back(fields);
+        }
+
+        if (header.empty() || header[0] != "Filename")
+        {
+            error = "'" + path + "' is not an assessment file.";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Streams the assessments of many images into one CSV file. The columns are
+// taken from the first image that has been assessed successfully; rows of
+// images failing before are kept back until the header is known.
+class OFIQAssessmentCsvWriter
+{
+public:
+    OFIQAssessmentCsvWriter() : m_stream(nullptr), m_rowCount(0), m_statusColumns(false) {}
+
+    explicit OFIQAssessmentCsvWriter(std::ostream& stream) : m_stream(&stream), m_rowCount(0), m_statusColumns(false) {}
+
+    ~OFIQAssessmentCsvWriter()
+    {
+        Finish();
+    }
+
+    void SetStream(std::ostream& stream)
+    {
+        m_stream = &stream;
+    }
+
+    // Adds the columns of OFIQAssessmentCsv::GetStatusColumns; must be set
+    // before the first row.
+    void SetStatusColumns(bool statusColumns)
+    {
+        m_statusColumns = statusColumns;
+    }
+
+    // Continues an existing file, to which the stream appends: the columns
+    // are taken from its header and no header is written. Fails if the file
+    // has no measure columns or its status columns do not match
+    // SetStatusColumns, which must be set before.
+    bool Continue(const std::string& path, std::string& error)
+    {
+        std::ifstream stream(path.c_str());
+        std::string line;
+        if (!stream.is_open() || !std::getline(stream, line))
+        {
+            error = "Cannot read '" + path + "'";
+            return false;
+        }
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+        std::vector<OFIQ::QualityMeasure> measures;
+        std::vector<std::string> extraColumns;
+        if (!OFIQAssessmentCsv::ParseHeader(OFIQAssessmentCsv::SplitLine(line), measures, extraColumns, error))
+        {
+            error = "Cannot continue '" + path + "': " + error;
+            return false;
+        }
+        if (measures.empty())
+        {
+            error = "Cannot continue '" + path + "', it has no measure columns.";
+            return false;
+        }
+        if (extraColumns != (m_statusColumns ? OFIQAssessmentCsv::GetStatusColumns() : std::vector<std::string>()))
+        {
+            error = "Cannot continue '" + path + "', its status columns do not match the pre-filter setting.";
+            return false;
+        }
+        m_measures = measures;
+        return true;
+    }
+
+    // status and reason are only written with SetStatusColumns.
+    void Write(
+        const std::string& path,
+        const OFIQ::FaceImageQualityAssessment& assessments,
+        const std::string& status = std::string(),
+        const std::string& reason = std::string())
+    {
+        m_rowCount++;
+        if (m_stream == nullptr)
+        {
+            return;
+        }
+
+        std::vector<std::string> extraFields;
+        if (m_statusColumns)
+        {
+            extraFields = { status, OFIQAssessmentCsv::ToField(reason) };
+        }
+
+        if (m_measures.empty())
+        {
+            if (assessments.qAssessments.empty())
+            {
+                m_pendingRows.push_back({ path, extraFields });
+                return;
+            }
+            m_measures = OFIQAssessmentCsv::GetMeasures(assessments);
+            WritePendingRows();
+        }
+
+        OFIQAssessmentCsv::WriteRow(*m_stream, path, assessments, m_measures, extraFields);
+    }
+
+    void Flush()
+    {
+        if (m_stream != nullptr)
+        {
+            m_stream->flush();
+        }
+    }
+
+    // Writes rows that are still waiting for the header. If no image has been
+    // assessed successfully, the header consists of the file name column only.
+    void Finish()
+    {
+        if (m_stream == nullptr)
+        {
+            return;
+        }
+        if (m_measures.empty() && !m_pendingRows.empty())
+        {
+            WritePendingRows();
+        }
+        m_stream->flush();
+    }
+
+    size_t GetRowCount() const
+    {
+        return m_rowCount;
+    }
+
+private:
+    struct PendingRow
+    {
+        std::string path;
+        std::vector<std::string> extraFields;
+    };
+
+    void WritePendingRows()
+    {
+        OFIQAssessmentCsv::WriteHeader(*m_stream, m_measures,
+            m_statusColumns ? OFIQAssessmentCsv::GetStatusColumns() : std::vector<std::string>());
+        for (const auto& row : m_pendingRows)
+        {
+            OFIQAssessmentCsv::WriteRow(*m_stream, row.path, OFIQ::FaceImageQualityAssessment(), m_measures, row.extraFields);
+        }
+        m_pendingRows.clear();
+    }
+
+    std::ostream* m_stream;
+    size_t m_rowCount;
+    bool m_statusColumns;
+    std::vector<OFIQ::QualityMeasure> m_measures;
+    std::vector<PendingRow> m_pendingRows;
+};
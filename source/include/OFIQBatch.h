@@ -0,0 +1,771 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+#include <image_io.h>
+
+#include <OFIQBufferPool.h>
+#include <OFIQAnnotationExport.h>
+#include <OFIQAssessmentCsv.h>
+#include <OFIQCommandLine.h>
+#include <OFIQDownscale.h>
+#include <OFIQMetrics.h>
+#include <OFIQPrefilter.h>
+#include <OFIQResultStore.h>
+#include <OFIQShard.h>
+#include <OFIQStreamingStats.h>
+#include <OFIQThreadPlacement.h>
+#include <OFIQWorkerProcess.h>
+
+
+// Creates and initializes an OFIQ instance from the path of a config file.
+inline std::shared_ptr<OFIQ::Interface> OFIQCreateInterface(const std::string& configPath, OFIQ::ReturnStatus& status)
+{
+    if (!std::filesystem::is_regular_file(configPath))
+    {
+        status = OFIQ::ReturnStatus(OFIQ::ReturnCode::MissingConfigParamError, "Not an existing file: " + configPath);
+        return nullptr;
+    }
+
+    auto path = std::filesystem::absolute(configPath);
+    auto configDir = path.parent_path().u8string();
+    auto configFile = path.filename().u8string();
+
+    std::shared_ptr<OFIQ::Interface> ofiqPtr = OFIQ::Interface::getImplementation();
+    status = ofiqPtr->initialize(configDir, configFile);
+    if (status.code != OFIQ::ReturnCode::Success)
+    {
+        return nullptr;
+    }
+    return ofiqPtr;
+}
+
+inline double OFIQSecondsSince(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Set by SIGINT and SIGTERM once OFIQInstallStopHandler has been called, so
+// that long-running headless modes can shut down cleanly.
+inline volatile std::sig_atomic_t& OFIQStopRequested()
+{
+    static volatile std::sig_atomic_t stopRequested = 0;
+    return stopRequested;
+}
+
+inline void OFIQInstallStopHandler()
+{
+    auto onSignal = [](int) { OFIQStopRequested() = 1; };
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+}
+
+// An image to be processed by a headless mode. The name is the path as given
+// in the manifest and is used in result files, so that results of different
+// machines can be merged even if they mount the images at different places.
+struct OFIQImageEntry
+{
+    std::string name;
+    std::string path;
+};
+
+// The images to be processed by the headless modes. The input is either a
+// directory, which is searched for image files, or a manifest, i.e. a text
+// file listing one image path per line. Relative paths in a manifest are
+// resolved against the directory of the manifest.
+class OFIQImageList
+{
+public:
+    static bool IsImageFile(const std::filesystem::path& path)
+    {
+        std::string extension = path.extension().u8string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return extension == ".png" || extension == ".jpg" || extension == ".jpeg"
+            || extension == ".bmp" || extension == ".jp2" || extension == ".tif" || extension == ".tiff";
+    }
+
+    static bool FromDirectory(const std::string& directory, std::vector<OFIQImageEntry>& images, std::string& error)
+    {
+        std::vector<std::string> paths;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, ec))
+        {
+            if (entry.is_regular_file() && IsImageFile(entry.path()))
+            {
+                paths.push_back(entry.path().u8string());
+            }
+        }
+        if (ec)
+        {
+            error = "Cannot read directory '" + directory + "': " + ec.message();
+            return false;
+        }
+        // Directory iteration order is not specified; sort to make runs reproducible.
+        std::sort(paths.begin(), paths.end());
+        for (const auto& path : paths)
+        {
+            images.push_back({ path, path });
+        }
+        return true;
+    }
+
+    static bool FromManifest(const std::string& manifest, std::vector<OFIQImageEntry>& images, std::string& error)
+    {
+        std::ifstream stream(manifest.c_str());
+        if (!stream.is_open())
+        {
+            error = "Cannot open manifest '" + manifest + "'";
+            return false;
+        }
+
+        auto baseDir = std::filesystem::absolute(manifest).parent_path();
+        std::string line;
+        while (std::getline(stream, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::filesystem::path path = std::filesystem::u8path(line);
+            if (path.is_relative())
+            {
+                path = baseDir / path;
+            }
+            images.push_back({ line, path.lexically_normal().u8string() });
+        }
+        return true;
+    }
+
+    static bool Collect(const std::string& input, std::vector<OFIQImageEntry>& images, std::string& error)
+    {
+        if (input.empty())
+        {
+            error = "No input given. Use --input <directory|manifest>.";
+            return false;
+        }
+        if (std::filesystem::is_directory(input))
+        {
+            return FromDirectory(input, images, error);
+        }
+        if (std::filesystem::is_regular_file(input))
+        {
+            return FromManifest(input, images, error);
+        }
+        error = "Input '" + input + "' is neither a directory nor a manifest file.";
+        return false;
+    }
+};
+
+// The outcome of processing one image in a headless mode.
+struct OFIQBatchItem
+{
+    std::string path;
+    bool success = false;
+    // Rejected by the pre-filter and therefore not assessed.
+    bool rejected = false;
+    std::string info;
+
+    OFIQ::Image image;
+    OFIQ::FaceImageQualityAssessment assessments;
+    OFIQ::FaceImageQualityPreprocessingResult preprocessing;
+    // Factor the image was reduced by before the assessment; the image and
+    // the preprocessing results are those of the reduced image.
+    double scale = 1.0;
+
+    double decodeSeconds = 0.0;
+    double prefilterSeconds = 0.0;
+    double downscaleSeconds = 0.0;
+    double assessSeconds = 0.0;
+    double exportSeconds = 0.0;
+    // Passing the request to a worker process and the result back.
+    double transferSeconds = 0.0;
+
+    double GetTotalSeconds() const
+    {
+        return decodeSeconds + prefilterSeconds + downscaleSeconds + assessSeconds + exportSeconds + transferSeconds;
+    }
+};
+
+// Loads and assesses images with one OFIQ instance, measuring the time spent
+// in each stage. With isolation, the instance runs in a worker process (see
+// OFIQWorkerProcess); only the assessments are passed back then, neither the
+// image nor the preprocessing results. With a pre-filter, images failing its
+// gates are rejected without being assessed; with a downscale cap, larger
+// images are reduced before the assessment.
+class OFIQBatchRunner
+{
+public:
+    OFIQBatchRunner()
+        : m_initSeconds(0.0)
+        , m_keepPreprocessing(false)
+        , m_keepImage(false)
+    {
+        ;
+    }
+
+    ~OFIQBatchRunner()
+    {
+        if (m_ofiqPtr != nullptr || IsIsolated())
+        {
+            OFIQMetrics::Get().AddWorker(-1);
+        }
+    }
+
+    OFIQBatchRunner(const OFIQBatchRunner&) = delete;
+    OFIQBatchRunner& operator=(const OFIQBatchRunner&) = delete;
+
+    bool Initialize(const std::string& configPath, std::string& error,
+        const OFIQIsolationSettings& isolation = OFIQIsolationSettings())
+    {
+        if (isolation.enabled)
+        {
+            return InitializeIsolated(configPath, isolation, error);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        OFIQ::ReturnStatus status(OFIQ::ReturnCode::Success);
+        m_ofiqPtr = OFIQCreateInterface(configPath, status);
+        m_initSeconds = OFIQSecondsSince(start);
+        if (m_ofiqPtr == nullptr)
+        {
+            error = "OFIQ initialization failed: " + status.info;
+            return false;
+        }
+        OFIQMetrics::Get().AddWorker(1);
+        return true;
+    }
+
+    // Request the preprocessing results (faces, landmarks, masks) in addition
+    // to the quality assessments.
+    void SetKeepPreprocessing(bool keepPreprocessing)
+    {
+        m_keepPreprocessing = keepPreprocessing;
+    }
+
+    // Keep the decoded image in the returned item, e.g. for rendering.
+    void SetKeepImage(bool keepImage)
+    {
+        m_keepImage = keepImage;
+    }
+
+    // Checks every image with the pre-filter before assessing it. With
+    // isolation, the settings must also be passed to the worker process (see
+    // OFIQIsolationSettings::workerArguments).
+    void SetPrefilter(const OFIQPrefilterSettings& prefilter)
+    {
+        m_prefilter = prefilter;
+    }
+
+    const OFIQPrefilterStats& GetPrefilterStats() const
+    {
+        return m_prefilterStats;
+    }
+
+    // Reduces images exceeding the cap before assessing them, after the
+    // pre-filter. With isolation, the settings must also be passed to the
+    // worker process.
+    void SetDownscale(const OFIQDownscaleSettings& downscale)
+    {
+        m_downscale = downscale;
+    }
+
+    double GetInitSeconds() const
+    {
+        return m_initSeconds;
+    }
+
+    std::shared_ptr<OFIQ::Interface> GetInterface() const
+    {
+        return m_ofiqPtr;
+    }
+
+    bool IsIsolated() const
+    {
+#if !defined(_WIN32)
+        return m_processPtr != nullptr;
+#else
+        return false;
+#endif
+    }
+
+#if !defined(_WIN32)
+    // The worker process if the runner is isolated, otherwise nullptr.
+    const OFIQWorkerProcess* GetWorkerProcess() const
+    {
+        return m_processPtr.get();
+    }
+#endif
+
+    OFIQBatchItem Process(const std::string& path)
+    {
+        OFIQBatchItem item;
+        item.path = path;
+#if !defined(_WIN32)
+        if (m_processPtr != nullptr)
+        {
+            ProcessIsolated(item);
+            return item;
+        }
+#endif
+
+        auto start = std::chrono::steady_clock::now();
+        OFIQ::ReturnStatus status = OFIQ_LIB::readImage(path, item.image);
+        item.decodeSeconds = OFIQSecondsSince(start);
+        OFIQMetrics::Get().ObserveStage(OFIQStage::Decode, item.decodeSeconds);
+        if (status.code != OFIQ::ReturnCode::Success)
+        {
+            item.info = "Loading image returned: " + status.info;
+            OFIQMetrics::Get().AddBusySeconds(item.decodeSeconds);
+            OFIQMetrics::Get().AddImage(false);
+            return item;
+        }
+
+        Assess(item);
+        OFIQMetrics::Get().AddBusySeconds(item.decodeSeconds);
+
+        if (!m_keepImage)
+        {
+            item.image = OFIQ::Image();
+        }
+        return item;
+    }
+
+    // Assesses item.image, which has already been decoded. Not available
+    // with isolation.
+    void Assess(OFIQBatchItem& item)
+    {
+        if (m_prefilter.enabled)
+        {
+            OFIQPrefilterResult result = OFIQPrefilter::Check(item.image, m_prefilter);
+            item.prefilterSeconds = result.seconds;
+            if (!result.passed)
+            {
+                item.rejected = true;
+                item.info = "Rejected by the pre-filter: " + result.reason;
+                OFIQMetrics::Get().AddBusySeconds(item.prefilterSeconds);
+                OFIQMetrics::Get().AddImage(true);
+                CountPrefilter(item);
+                return;
+            }
+        }
+
+        if (m_downscale.IsEnabled())
+        {
+            auto downscaleStart = std::chrono::steady_clock::now();
+            double scale = OFIQDownscale::GetScale(item.image.width, item.image.height, m_downscale.maxLongEdge);
+            if (OFIQDownscale::Apply(item.image, scale))
+            {
+                item.scale = scale;
+            }
+            item.downscaleSeconds = OFIQSecondsSince(downscaleStart);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        OFIQ::ReturnStatus status(OFIQ::ReturnCode::Success);
+        try
+        {
+            if (m_ofiqPtr == nullptr)
+            {
+                status = OFIQ::ReturnStatus(OFIQ::ReturnCode::UnknownError, "No OFIQ instance in this process");
+            }
+            else if (m_keepPreprocessing)
+            {
+                uint32_t resultRequestsMask = static_cast<int>(OFIQ::PreprocessingResultType::All);
+                status = m_ofiqPtr->vectorQualityWithPreprocessingResults(
+                    item.image, item.assessments, item.preprocessing, resultRequestsMask);
+            }
+            else
+            {
+                status = m_ofiqPtr->vectorQuality(item.image, item.assessments);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            status = OFIQ::ReturnStatus(OFIQ::ReturnCode::UnknownError, e.what());
+        }
+        item.assessSeconds = OFIQSecondsSince(start);
+
+        item.success = (status.code == OFIQ::ReturnCode::Success);
+        OFIQMetrics& metrics = OFIQMetrics::Get();
+        metrics.ObserveStage(OFIQStage::Assess, item.assessSeconds);
+        metrics.AddBusySeconds(item.prefilterSeconds + item.downscaleSeconds + item.assessSeconds);
+        metrics.AddImage(item.success);
+        if (!item.success)
+        {
+            item.info = "OFIQ assessment returned: " + status.info;
+        }
+        CountPrefilter(item);
+    }
+
+private:
+    void CountPrefilter(const OFIQBatchItem& item)
+    {
+        if (!m_prefilter.enabled)
+        {
+            return;
+        }
+        m_prefilterStats.checked++;
+        m_prefilterStats.prefilterSeconds += item.prefilterSeconds;
+        if (item.rejected)
+        {
+            m_prefilterStats.rejected++;
+            OFIQMetrics::Get().AddPrefilterRejection();
+        }
+        else if (item.success)
+        {
+            m_prefilterStats.assessed++;
+            m_prefilterStats.assessSeconds += item.assessSeconds;
+            OFIQMetrics::Get().AddPrefilterPass(item.assessSeconds);
+        }
+    }
+
+    bool InitializeIsolated(const std::string& configPath, const OFIQIsolationSettings& isolation, std::string& error)
+    {
+#if defined(_WIN32)
+        (void)configPath;
+        (void)isolation;
+        error = "Worker processes are not available on Windows.";
+        return false;
+#else
+        auto processPtr = std::make_unique<OFIQWorkerProcess>(isolation, configPath);
+        if (!processPtr->Start(error))
+        {
+            return false;
+        }
+        m_initSeconds = processPtr->GetInitSeconds();
+        m_processPtr = std::move(processPtr);
+        OFIQMetrics::Get().AddWorker(1);
+        return true;
+#endif
+    }
+
+#if !defined(_WIN32)
+    void ProcessIsolated(OFIQBatchItem& item)
+    {
+        OFIQWorkerResult result = m_processPtr->Process(item.path);
+        item.success = result.success;
+        item.rejected = result.rejected;
+        item.info = result.info;
+        item.assessments = std::move(result.assessments);
+        item.decodeSeconds = result.decodeSeconds;
+        item.prefilterSeconds = result.prefilterSeconds;
+        item.downscaleSeconds = result.downscaleSeconds;
+        item.assessSeconds = result.assessSeconds;
+        item.transferSeconds = std::max(0.0, result.roundTripSeconds - result.decodeSeconds
+            - result.prefilterSeconds - result.downscaleSeconds - result.assessSeconds);
+
+        OFIQMetrics& metrics = OFIQMetrics::Get();
+        if (result.decodeSeconds > 0.0)
+        {
+            metrics.ObserveStage(OFIQStage::Decode, item.decodeSeconds);
+        }
+        if (result.assessSeconds > 0.0)
+        {
+            metrics.ObserveStage(OFIQStage::Assess, item.assessSeconds);
+        }
+        metrics.AddBusySeconds(result.roundTripSeconds);
+        metrics.AddImage(item.success || item.rejected);
+        CountPrefilter(item);
+    }
+
+    std::unique_ptr<OFIQWorkerProcess> m_processPtr;
+#endif
+    std::shared_ptr<OFIQ::Interface> m_ofiqPtr;
+    double m_initSeconds;
+    bool m_keepPreprocessing;
+    bool m_keepImage;
+    OFIQPrefilterSettings m_prefilter;
+    OFIQPrefilterStats m_prefilterStats;
+    OFIQDownscaleSettings m_downscale;
+};
+
+// --batch: assesses all images of the input and writes the assessments into
+// one CSV file. With --shard i/N only the images of the given shard are
+// assessed; the results are written to a shard specific file that is
+// completed by a marker file (see OFIQShardSpec). With --prefilter, images
+// failing the pre-filter are written without scores and counted as rejected;
+// the CSV file gets the status columns to tell them from failed images.
+// With --result-store, the results are also appended to a result store (see
+// OFIQResultStore), which can replace the CSV file for large result sets.
+class OFIQBatch
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --batch --input <directory|manifest> --output <results.csv>" << std::endl
+            << "           [--config <ofiq_config.jaxn>] [--shard <index>/<count>] [--stats <stats.json>]" << std::endl
+            << "           [--result-store <directory> [--append]] (--output may be left out then)" << std::endl
+            << "           [--annotate-dir <directory> [--annotate-format <png|jpg>] [--annotate-quality <level>]" << std::endl
+            << "            [--annotate-layers <faces,landmarks,segmentation,occlusion,region>]" << std::endl
+            << "            [--encoder-threads <2>] [--encoder-queue <8>]]" << std::endl;
+        OFIQPrefilterSettings::PrintUsage(stream);
+        OFIQDownscaleSettings::PrintUsage(stream);
+        OFIQIsolationSettings::PrintUsage(stream);
+        OFIQThreadSettings::PrintUsage(stream);
+        stream << "           (--batch runs one worker; use --shard to spread a corpus over processes)" << std::endl;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::string input = commandLine.GetString("input", commandLine.GetString("manifest"));
+        std::vector<OFIQImageEntry> images;
+        if (!OFIQImageList::Collect(input, images, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::string outputPath = commandLine.GetString("output");
+        std::string storePath = commandLine.GetString("result-store");
+        if (outputPath.empty() && storePath.empty())
+        {
+            std::cerr << "ERROR: No output given." << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        bool sharded = commandLine.HasOption("shard");
+        if (sharded && outputPath.empty())
+        {
+            std::cerr << "ERROR: --shard requires --output." << std::endl;
+            return 1;
+        }
+        OFIQShardSpec shard;
+        if (sharded)
+        {
+            if (!OFIQShardSpec::Parse(commandLine.GetString("shard"), shard, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            std::vector<OFIQImageEntry> shardImages;
+            for (const auto& image : images)
+            {
+                if (shard.Contains(image.name))
+                {
+                    shardImages.push_back(image);
+                }
+            }
+            std::cout << "Shard " << shard.ToString() << ": " << shardImages.size()
+                << " of " << images.size() << " images." << std::endl;
+            images.swap(shardImages);
+            outputPath = shard.GetResultPath(outputPath);
+            std::filesystem::remove(OFIQShardSpec::GetMarkerPath(outputPath));
+        }
+
+        std::unique_ptr<OFIQAnnotationExport> annotationExport;
+        if (commandLine.HasOption("annotate-dir"))
+        {
+            OFIQAnnotationSettings settings;
+            if (!OFIQAnnotationSettings::FromCommandLine(commandLine, settings, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            annotationExport = std::make_unique<OFIQAnnotationExport>(settings);
+        }
+
+        // A worker process passes back only the assessments, so annotated
+        // images cannot be rendered from its results.
+        OFIQIsolationSettings isolation = OFIQIsolationSettings::FromCommandLine(commandLine);
+        if (isolation.enabled && annotationExport != nullptr)
+        {
+            std::cerr << "ERROR: --annotate-dir cannot be combined with --isolated." << std::endl;
+            return 1;
+        }
+
+        OFIQPrefilterSettings prefilter;
+        OFIQDownscaleSettings downscale;
+        if (!OFIQPrefilterSettings::FromCommandLine(commandLine, prefilter, error)
+            || !OFIQDownscaleSettings::FromCommandLine(commandLine, downscale, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        isolation.workerArguments = prefilter.ToArguments();
+        for (const auto& argument : downscale.ToArguments())
+        {
+            isolation.workerArguments.push_back(argument);
+        }
+
+        // The images are assessed and written in order by one OFIQ instance;
+        // the other thread options apply to it.
+        OFIQThreadSettings threadSettings = OFIQThreadSettings::FromCommandLine(commandLine);
+        if (threadSettings.workers > 1)
+        {
+            std::cerr << "ERROR: --batch runs a single worker and does not support --workers "
+                << threadSettings.workers << "; use --shard to run several processes, or --benchmark." << std::endl;
+            return 1;
+        }
+        OFIQThreadPlacement placement;
+        if (!placement.Initialize(threadSettings, error) || !placement.PinWorker(0, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(commandLine.GetString("config", "ofiq_config.jaxn"), error, isolation))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        runner.SetPrefilter(prefilter);
+        runner.SetDownscale(downscale);
+        if (annotationExport != nullptr)
+        {
+            if (!annotationExport->Start(error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            runner.SetKeepPreprocessing(true);
+            runner.SetKeepImage(true);
+        }
+
+        OFIQResultStoreWriter storeWriter;
+        if (!storePath.empty() && !storeWriter.Open(storePath, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        if (storeWriter.GetRowCount() > 0 && !commandLine.HasOption("append"))
+        {
+            // Unlike the CSV file, a store is not replaced; running the same
+            // batch again would add every image a second time.
+            std::cerr << "ERROR: Result store '" << storePath << "' already holds " << storeWriter.GetRowCount()
+                << " rows; use --append to add to them, e.g. to continue an interrupted run." << std::endl;
+            return 1;
+        }
+
+        size_t failed = 0;
+        size_t rejected = 0;
+        OFIQStreamingStats stats;
+        {
+            std::ofstream csvStream;
+            OFIQAssessmentCsvWriter csvWriter;
+            if (!outputPath.empty())
+            {
+                csvStream.open(outputPath.c_str());
+                if (!csvStream.is_open())
+                {
+                    std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+                    return 1;
+                }
+                csvWriter.SetStream(csvStream);
+                csvWriter.SetStatusColumns(prefilter.enabled);
+            }
+
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                auto item = runner.Process(images[i].path);
+                if (item.rejected)
+                {
+                    rejected++;
+                    std::cerr << "REJECTED: " << item.path << ": " << item.info << std::endl;
+                }
+                else if (!item.success)
+                {
+                    failed++;
+                    std::cerr << "ERROR: " << item.path << ": " << item.info << std::endl;
+                }
+                auto exportStart = std::chrono::steady_clock::now();
+                csvWriter.Write(images[i].name, item.assessments,
+                    OFIQAssessmentCsv::GetStatus(item.success, item.rejected), item.info);
+                if (!storePath.empty() && !storeWriter.Append(images[i].name, item.assessments, item.rejected, error))
+                {
+                    std::cerr << "ERROR: " << error << std::endl;
+                    return 1;
+                }
+                OFIQMetrics::Get().ObserveStage(OFIQStage::Export, OFIQSecondsSince(exportStart));
+                if (!item.rejected)
+                {
+                    stats.Add(item.assessments, item.success);
+                }
+                if (annotationExport != nullptr && item.image.data != nullptr)
+                {
+                    annotationExport->Submit(images[i].name, std::move(item.image), std::move(item.preprocessing));
+                }
+                std::cout << "[" << (i + 1) << "/" << images.size() << "] " << images[i].name << std::endl;
+            }
+            csvWriter.Finish();
+            if (annotationExport != nullptr)
+            {
+                annotationExport->Finish();
+            }
+
+            if (!outputPath.empty() && !csvStream.good())
+            {
+                std::cerr << "ERROR: Writing '" << outputPath << "' failed." << std::endl;
+                return 1;
+            }
+            if (!storePath.empty() && !storeWriter.Finish(error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+        }
+
+        if (sharded && !shard.WriteMarker(outputPath, input, images.size(), failed))
+        {
+            std::cerr << "ERROR: Cannot write completion marker for '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+
+        std::string statsPath = commandLine.GetString("stats");
+        if (!statsPath.empty())
+        {
+            OFIQJsonValue statsJson = stats.ToJson();
+            if (prefilter.enabled)
+            {
+                statsJson.Set("prefilter", runner.GetPrefilterStats().ToJson());
+            }
+            if (!statsJson.SaveToFile(statsPath))
+            {
+                std::cerr << "ERROR: Cannot write '" << statsPath << "'" << std::endl;
+                return 1;
+            }
+        }
+
+        std::cout << images.size() << " images assessed, " << failed << " failed." << std::endl;
+        if (prefilter.enabled)
+        {
+            const OFIQPrefilterStats& prefilterStats = runner.GetPrefilterStats();
+            std::cout << "Pre-filter: " << rejected << " images rejected in " << prefilterStats.prefilterSeconds
+                << " s, saving about " << prefilterStats.GetSavedSeconds() << " s of assessment." << std::endl;
+        }
+#if !defined(_WIN32)
+        if (runner.IsIsolated())
+        {
+            const OFIQWorkerProcess* processPtr = runner.GetWorkerProcess();
+            std::cout << "Worker process: " << processPtr->GetCrashCount() << " crashes, "
+                << processPtr->GetTimeoutCount() << " timeouts, " << processPtr->GetRestartCount() << " restarts." << std::endl;
+        }
+#endif
+        if (annotationExport != nullptr)
+        {
+            std::cout << annotationExport->GetWrittenCount() << " annotated images written, "
+                << annotationExport->GetFailedCount() << " failed (encoding "
+                << annotationExport->GetEncodeSeconds() << " s, waited for encoders "
+                << annotationExport->GetBlockedSeconds() << " s)." << std::endl;
+            std::cout << OFIQBufferPool::Get().GetStats().ToString() << "." << std::endl;
+        }
+        return 0;
+    }
+};
@@ -0,0 +1,516 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <OFIQBatch.h>
+#include <OFIQJson.h>
+#include <OFIQProcessMemory.h>
+#include <OFIQThreadPlacement.h>
+
+
+// --benchmark: runs a fixed image corpus through load, assessment and export
+// and reports throughput, per-image latency, initialization time and peak RSS
+// as JSON. If a baseline report is given, every metric is compared against it
+// and the process exits with code 2 if any metric regressed by more than the
+// configured relative tolerance. With --workers, the corpus is shared by
+// several OFIQ instances running in parallel; the thread settings are
+// recorded in the report so that placements can be compared. With --isolated,
+// every worker runs OFIQ in a worker process; the corpus is then run a second
+// time in process, and the report adds the throughput and latency of both
+// runs and the time spent passing requests and results between the
+// processes. With
+// --max-long-edge, the report adds the time spent reducing large images.
+class OFIQBenchmark
+{
+public:
+    // Exit code signalling a performance regression against the baseline.
+    static constexpr int regressionExitCode = 2;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --benchmark --input <directory|manifest>" << std::endl
+            << "           [--config <ofiq_config.jaxn>] [--output <results.csv>]" << std::endl
+            << "           [--report <report.json>] [--baseline <baseline.json>] [--tolerance <0.10>] [--allow-missing-metrics]" << std::endl
+            << "           [--warmup <images>] [--repeat <passes>]" << std::endl;
+        OFIQDownscaleSettings::PrintUsage(stream);
+        OFIQIsolationSettings::PrintUsage(stream);
+        OFIQThreadSettings::PrintUsage(stream);
+    }
+
+    // Linear interpolation between the closest ranks of the sorted values.
+    static double Percentile(std::vector<double> values, double percentile)
+    {
+        if (values.empty())
+        {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        double rank = percentile / 100.0 * static_cast<double>(values.size() - 1);
+        size_t lower = static_cast<size_t>(rank);
+        size_t upper = std::min(lower + 1, values.size() - 1);
+        double fraction = rank - static_cast<double>(lower);
+        return values[lower] + fraction * (values[upper] - values[lower]);
+    }
+
+    // The metrics of a report and whether a larger value is better.
+    struct Metric
+    {
+        const char* name;
+        bool higherIsBetter;
+    };
+
+    static const std::vector<Metric>& GetMetrics()
+    {
+        static const std::vector<Metric> metrics = {
+            { "images_per_second", true },
+            { "latency_p50_ms", false },
+            { "latency_p95_ms", false },
+            { "latency_p99_ms", false },
+            { "init_seconds", false },
+            { "peak_rss_bytes", false }
+        };
+        return metrics;
+    }
+
+    // Compares the metrics of a report with a baseline report. Returns false if
+    // any metric regressed by more than the tolerance. A metric the baseline
+    // lacks or has no positive value for, e.g. in an empty baseline or one of
+    // an incompatible version, cannot be compared; it is listed in missing
+    // and fails the comparison unless allowMissing is set.
+    static bool CompareWithBaseline(
+        const OFIQJsonValue& metrics,
+        const OFIQJsonValue& baselineMetrics,
+        double tolerance,
+        bool allowMissing,
+        OFIQJsonValue& comparison,
+        std::vector<std::string>& missing)
+    {
+        bool passed = true;
+        comparison = OFIQJsonValue::Object();
+        missing.clear();
+        for (const auto& metric : GetMetrics())
+        {
+            const auto& baselineValue = baselineMetrics.Get(metric.name);
+            const auto& value = metrics.Get(metric.name);
+            if (!baselineValue.IsNumber() || !value.IsNumber() || baselineValue.AsNumber() <= 0.0)
+            {
+                missing.push_back(metric.name);
+                passed = passed && allowMissing;
+                OFIQJsonValue entry = OFIQJsonValue::Object();
+                entry.Set("missing", true);
+                entry.Set("passed", allowMissing);
+                comparison.Set(metric.name, entry);
+                continue;
+            }
+
+            double baseline = baselineValue.AsNumber();
+            double current = value.AsNumber();
+            // Positive change means "worse" for every metric.
+            double change = metric.higherIsBetter ? (baseline - current) / baseline : (current - baseline) / baseline;
+            bool regressed = change > tolerance;
+            passed = passed && !regressed;
+
+            OFIQJsonValue entry = OFIQJsonValue::Object();
+            entry.Set("baseline", baseline);
+            entry.Set("current", current);
+            entry.Set("regression", change);
+            entry.Set("passed", !regressed);
+            comparison.Set(metric.name, entry);
+        }
+        return passed;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::vector<OFIQImageEntry> images;
+        if (!OFIQImageList::Collect(commandLine.GetString("input"), images, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+        if (images.empty())
+        {
+            std::cerr << "ERROR: The benchmark corpus is empty." << std::endl;
+            return 1;
+        }
+
+        const std::string configPath = commandLine.GetString("config", "ofiq_config.jaxn");
+        const int warmup = std::max(0, commandLine.GetInt("warmup", 1));
+        const int repeat = std::max(1, commandLine.GetInt("repeat", 1));
+        const double tolerance = commandLine.GetDouble("tolerance", 0.10);
+        OFIQDownscaleSettings downscale;
+        if (!OFIQDownscaleSettings::FromCommandLine(commandLine, downscale, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        OFIQIsolationSettings isolation = OFIQIsolationSettings::FromCommandLine(commandLine);
+        isolation.workerArguments = downscale.ToArguments();
+
+        OFIQThreadPlacement placement;
+        if (!placement.Initialize(OFIQThreadSettings::FromCommandLine(commandLine), error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        // Export into the requested file or, if none is given, into memory so
+        // that the export stage is part of the measurement in either case.
+        std::ofstream fileStream;
+        std::ostringstream memoryStream;
+        std::string outputPath = commandLine.GetString("output");
+        if (!outputPath.empty())
+        {
+            fileStream.open(outputPath.c_str());
+            if (!fileStream.is_open())
+            {
+                std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& csvStream = outputPath.empty() ? static_cast<std::ostream&>(memoryStream) : fileStream;
+        OFIQAssessmentCsvWriter csvWriter(csvStream);
+
+        Measurement measurement(placement.GetWorkerCount());
+        if (!Measure(images, configPath, warmup, repeat, downscale, isolation, placement, csvWriter, measurement, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        csvWriter.Finish();
+        const std::vector<double>& latencies = measurement.latencies;
+
+        OFIQJsonValue metrics = OFIQJsonValue::Object();
+        metrics.Set("images_per_second", measurement.GetImagesPerSecond());
+        metrics.Set("latency_p50_ms", Percentile(latencies, 50.0));
+        metrics.Set("latency_p95_ms", Percentile(latencies, 95.0));
+        metrics.Set("latency_p99_ms", Percentile(latencies, 99.0));
+        metrics.Set("init_seconds", measurement.initSeconds);
+        metrics.Set("peak_rss_bytes", static_cast<double>(OFIQProcessMemory::GetPeakRss()));
+
+        OFIQJsonValue stages = OFIQJsonValue::Object();
+        stages.Set("decode_p50_ms", Percentile(measurement.decodeSeconds, 50.0));
+        if (downscale.IsEnabled())
+        {
+            stages.Set("downscale_p50_ms", Percentile(measurement.downscaleSeconds, 50.0));
+        }
+        stages.Set("assess_p50_ms", Percentile(measurement.assessSeconds, 50.0));
+        stages.Set("export_p50_ms", Percentile(measurement.exportSeconds, 50.0));
+
+        OFIQJsonValue benchmark = OFIQJsonValue::Object();
+        benchmark.Set("config", configPath);
+        benchmark.Set("input", commandLine.GetString("input"));
+        benchmark.Set("corpus_size", images.size());
+        benchmark.Set("repeat", repeat);
+        benchmark.Set("warmup", warmup);
+        benchmark.Set("max_long_edge", downscale.maxLongEdge);
+        benchmark.Set("images", latencies.size());
+        benchmark.Set("failed", measurement.failed);
+        benchmark.Set("wall_seconds", measurement.wallSeconds);
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("benchmark", benchmark);
+        report.Set("metrics", metrics);
+        report.Set("stages", stages);
+        report.Set("threads", placement.ToJson());
+        if (isolation.enabled)
+        {
+            // The same corpus is run again with OFIQ in this process, so that
+            // the cost of isolation is measured and not estimated. The worker
+            // processes are ended first so they do not compete for the CPUs.
+            OFIQJsonValue isolationReport = GetIsolationReport(measurement);
+            measurement.workers.clear();
+            std::cerr << "Running the corpus in process for comparison ..." << std::endl;
+            OFIQIsolationSettings inProcessIsolation = isolation;
+            inProcessIsolation.enabled = false;
+            std::ostringstream inProcessStream;
+            OFIQAssessmentCsvWriter inProcessWriter(inProcessStream);
+            Measurement inProcess(placement.GetWorkerCount());
+            if (!Measure(images, configPath, warmup, repeat, downscale, inProcessIsolation, placement, inProcessWriter, inProcess, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            inProcessWriter.Finish();
+            AddInProcessComparison(measurement, inProcess, isolationReport);
+            report.Set("isolation", isolationReport);
+        }
+
+        int exitCode = 0;
+        std::string baselinePath = commandLine.GetString("baseline");
+        if (!baselinePath.empty())
+        {
+            OFIQJsonValue baseline;
+            if (!OFIQJsonValue::LoadFromFile(baselinePath, baseline, error))
+            {
+                std::cerr << "ERROR: Cannot read baseline: " << error << std::endl;
+                return 1;
+            }
+
+            OFIQJsonValue comparison;
+            std::vector<std::string> missing;
+            const bool allowMissing = commandLine.HasOption("allow-missing-metrics");
+            bool passed = CompareWithBaseline(metrics, baseline.Get("metrics"), tolerance, allowMissing, comparison, missing);
+            for (const auto& name : missing)
+            {
+                std::cerr << (allowMissing ? "WARNING" : "ERROR") << ": The baseline has no value for metric '" << name << "'"
+                    << (allowMissing ? "; it is not compared." : "; use --allow-missing-metrics to compare the others only.") << std::endl;
+            }
+            OFIQJsonValue baselineReport = OFIQJsonValue::Object();
+            baselineReport.Set("path", baselinePath);
+            baselineReport.Set("tolerance", tolerance);
+            baselineReport.Set("passed", passed);
+            baselineReport.Set("missing_metrics", missing.size());
+            baselineReport.Set("metrics", comparison);
+            report.Set("baseline", baselineReport);
+            if (baseline.Get("threads").ToString(false) != placement.ToJson().ToString(false))
+            {
+                std::cerr << "WARNING: The baseline was measured with different thread settings: "
+                    << baseline.Get("threads").ToString(false) << std::endl;
+            }
+            if (!passed)
+            {
+                exitCode = regressionExitCode;
+            }
+        }
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+            return 1;
+        }
+        std::cout << report.ToString();
+
+        if (exitCode == regressionExitCode)
+        {
+            std::cerr << "ERROR: Performance regressed beyond tolerance of " << tolerance
+                << ", or metrics are missing, against " << baselinePath << std::endl;
+        }
+        return exitCode;
+    }
+
+private:
+    // The OFIQ instance and the measurements of one worker thread.
+    struct Worker
+    {
+        OFIQBatchRunner runner;
+        bool initialized = false;
+        std::string error;
+        std::vector<double> latencies;
+        std::vector<double> decodeSeconds;
+        std::vector<double> downscaleSeconds;
+        std::vector<double> assessSeconds;
+        std::vector<double> exportSeconds;
+        std::vector<double> transferSeconds;
+        size_t failed = 0;
+    };
+
+    // The measurements of one run over the corpus, merged over all workers.
+    struct Measurement
+    {
+        explicit Measurement(size_t workerCount)
+            : workers(workerCount)
+        {
+            ;
+        }
+
+        std::vector<Worker> workers;
+        double initSeconds = 0.0;
+        double wallSeconds = 0.0;
+        std::vector<double> latencies;
+        std::vector<double> decodeSeconds;
+        std::vector<double> downscaleSeconds;
+        std::vector<double> assessSeconds;
+        std::vector<double> exportSeconds;
+        std::vector<double> transferSeconds;
+        size_t failed = 0;
+
+        double GetImagesPerSecond() const
+        {
+            return wallSeconds > 0.0 ? static_cast<double>(latencies.size()) / wallSeconds : 0.0;
+        }
+    };
+
+    // Initializes the workers of the measurement, warms them up and runs the
+    // corpus through them, exporting the results with the writer.
+    static bool Measure(
+        const std::vector<OFIQImageEntry>& images,
+        const std::string& configPath,
+        int warmup,
+        int repeat,
+        const OFIQDownscaleSettings& downscale,
+        const OFIQIsolationSettings& isolation,
+        const OFIQThreadPlacement& placement,
+        OFIQAssessmentCsvWriter& csvWriter,
+        Measurement& measurement,
+        std::string& error)
+    {
+        // Every worker pins its thread and initializes its own OFIQ instance,
+        // then warms up. The workers are initialized in parallel; the reported
+        // init time is that of the slowest worker.
+        std::vector<Worker>& workers = measurement.workers;
+        RunWorkers(workers, [&](size_t index, Worker& worker)
+            {
+                if (!placement.PinWorker(index, worker.error)
+                    || !worker.runner.Initialize(configPath, worker.error, isolation))
+                {
+                    return;
+                }
+                worker.runner.SetDownscale(downscale);
+                worker.initialized = true;
+                for (int i = 0; i < warmup; i++)
+                {
+                    worker.runner.Process(images[(index + i) % images.size()].path);
+                }
+            });
+
+        measurement.initSeconds = 0.0;
+        for (const auto& worker : workers)
+        {
+            if (!worker.initialized)
+            {
+                error = worker.error;
+                return false;
+            }
+            measurement.initSeconds = std::max(measurement.initSeconds, worker.runner.GetInitSeconds());
+        }
+
+        // The workers take the next image of the corpus until all passes are
+        // done. Results are exported in the order in which they complete.
+        std::atomic<size_t> next{ 0 };
+        std::mutex exportMutex;
+        const size_t total = images.size() * static_cast<size_t>(repeat);
+
+        auto start = std::chrono::steady_clock::now();
+        RunWorkers(workers, [&](size_t index, Worker& worker)
+            {
+                placement.PinWorker(index, worker.error);
+                for (size_t i = next++; i < total; i = next++)
+                {
+                    const auto& image = images[i % images.size()];
+                    auto item = worker.runner.Process(image.path);
+
+                    // Only the export itself counts; waiting for another
+                    // worker to finish its export is not part of the latency.
+                    {
+                        std::lock_guard<std::mutex> lock(exportMutex);
+                        auto exportStart = std::chrono::steady_clock::now();
+                        csvWriter.Write(image.name, item.assessments);
+                        item.exportSeconds = OFIQSecondsSince(exportStart);
+                    }
+
+                    if (!item.success)
+                    {
+                        worker.failed++;
+                    }
+                    worker.latencies.push_back(item.GetTotalSeconds() * 1000.0);
+                    worker.decodeSeconds.push_back(item.decodeSeconds * 1000.0);
+                    worker.downscaleSeconds.push_back(item.downscaleSeconds * 1000.0);
+                    worker.assessSeconds.push_back(item.assessSeconds * 1000.0);
+                    worker.exportSeconds.push_back(item.exportSeconds * 1000.0);
+                    worker.transferSeconds.push_back(item.transferSeconds * 1000.0);
+                }
+            });
+        measurement.wallSeconds = OFIQSecondsSince(start);
+
+        for (const auto& worker : workers)
+        {
+            measurement.transferSeconds.insert(measurement.transferSeconds.end(), worker.transferSeconds.begin(), worker.transferSeconds.end());
+            measurement.latencies.insert(measurement.latencies.end(), worker.latencies.begin(), worker.latencies.end());
+            measurement.decodeSeconds.insert(measurement.decodeSeconds.end(), worker.decodeSeconds.begin(), worker.decodeSeconds.end());
+            measurement.downscaleSeconds.insert(measurement.downscaleSeconds.end(), worker.downscaleSeconds.begin(), worker.downscaleSeconds.end());
+            measurement.assessSeconds.insert(measurement.assessSeconds.end(), worker.assessSeconds.begin(), worker.assessSeconds.end());
+            measurement.exportSeconds.insert(measurement.exportSeconds.end(), worker.exportSeconds.begin(), worker.exportSeconds.end());
+            measurement.failed += worker.failed;
+        }
+        return true;
+    }
+
+    // The worker processes of an isolated run: the transfer time per image,
+    // its share of the time spent decoding and assessing, and the crashes,
+    // timeouts and restarts.
+    static OFIQJsonValue GetIsolationReport(const Measurement& measurement)
+    {
+        double processingSum = 0.0;
+        double transferSum = 0.0;
+        for (size_t i = 0; i < measurement.transferSeconds.size(); i++)
+        {
+            processingSum += measurement.decodeSeconds[i] + measurement.assessSeconds[i];
+            transferSum += measurement.transferSeconds[i];
+        }
+
+        OFIQJsonValue isolation = OFIQJsonValue::Object();
+        isolation.Set("processes", measurement.workers.size());
+        isolation.Set("transfer_p50_ms", Percentile(measurement.transferSeconds, 50.0));
+        isolation.Set("transfer_p95_ms", Percentile(measurement.transferSeconds, 95.0));
+        isolation.Set("transfer_share_percent", processingSum > 0.0 ? 100.0 * transferSum / processingSum : 0.0);
+#if !defined(_WIN32)
+        size_t crashes = 0;
+        size_t timeouts = 0;
+        size_t restarts = 0;
+        for (const auto& worker : measurement.workers)
+        {
+            const OFIQWorkerProcess* processPtr = worker.runner.GetWorkerProcess();
+            if (processPtr != nullptr)
+            {
+                crashes += processPtr->GetCrashCount();
+                timeouts += processPtr->GetTimeoutCount();
+                restarts += processPtr->GetRestartCount();
+            }
+        }
+        isolation.Set("crashes", crashes);
+        isolation.Set("timeouts", timeouts);
+        isolation.Set("restarts", restarts);
+#endif
+        return isolation;
+    }
+
+    // Adds the throughput and latency of the in-process run of the same
+    // corpus and what isolation costs against it.
+    static void AddInProcessComparison(const Measurement& isolated, const Measurement& inProcess, OFIQJsonValue& isolation)
+    {
+        double isolatedRate = isolated.GetImagesPerSecond();
+        double inProcessRate = inProcess.GetImagesPerSecond();
+        isolation.Set("images_per_second", isolatedRate);
+        isolation.Set("in_process_images_per_second", inProcessRate);
+        isolation.Set("overhead_percent", inProcessRate > 0.0 ? 100.0 * (inProcessRate - isolatedRate) / inProcessRate : 0.0);
+        for (double percentile : { 50.0, 95.0, 99.0 })
+        {
+            std::string suffix = "p" + std::to_string(static_cast<int>(percentile)) + "_ms";
+            double isolatedLatency = Percentile(isolated.latencies, percentile);
+            double inProcessLatency = Percentile(inProcess.latencies, percentile);
+            isolation.Set("latency_" + suffix, isolatedLatency);
+            isolation.Set("in_process_latency_" + suffix, inProcessLatency);
+            isolation.Set("latency_overhead_" + suffix, isolatedLatency - inProcessLatency);
+        }
+        isolation.Set("in_process_failed", inProcess.failed);
+    }
+
+    // Runs the function for every worker on a thread of its own and waits
+    // until all are done.
+    template<typename Function>
+    static void RunWorkers(std::vector<Worker>& workers, Function function)
+    {
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            threads.emplace_back([&function, &workers, i]() { function(i, workers[i]); });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+    }
+};
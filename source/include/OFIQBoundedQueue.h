@@ -0,0 +1,90 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+// A thread-safe FIFO queue with a fixed capacity. Push blocks while the queue
+// is full, which propagates backpressure to the producer; TryPush fails
+// instead. After Close, pushing fails and Pop drains the remaining items.
+template <typename T>
+class OFIQBoundedQueue
+{
+public:
+    explicit OFIQBoundedQueue(size_t capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+        , m_closed(false)
+    {
+        ;
+    }
+
+    bool Push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+        {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    bool TryPush(T item)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed || m_items.size() >= m_capacity)
+        {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty.
+    bool Pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+        {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    size_t Capacity() const
+    {
+        return m_capacity;
+    }
+
+private:
+    const size_t m_capacity;
+    bool m_closed;
+    std::deque<T> m_items;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+};
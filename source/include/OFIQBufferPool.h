@@ -0,0 +1,257 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQJson.h>
+
+
+// Counters of OFIQBufferPool.
+struct OFIQBufferPoolStats
+{
+    // Pooled requests served from a cached buffer, and those that allocated.
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Returned buffers freed because the cache was full.
+    uint64_t dropped = 0;
+    size_t cachedBytes = 0;
+    size_t inUseBytes = 0;
+    size_t capacityBytes = 0;
+
+    double GetHitRate() const
+    {
+        uint64_t requests = hits + misses;
+        return requests > 0 ? static_cast<double>(hits) / static_cast<double>(requests) : 0.0;
+    }
+
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("hits", static_cast<size_t>(hits));
+        json.Set("misses", static_cast<size_t>(misses));
+        json.Set("dropped", static_cast<size_t>(dropped));
+        json.Set("hit_rate", GetHitRate());
+        json.Set("cached_bytes", cachedBytes);
+        json.Set("in_use_bytes", inUseBytes);
+        json.Set("capacity_bytes", capacityBytes);
+        return json;
+    }
+
+    std::string ToString() const
+    {
+        std::ostringstream stream;
+        stream << "Buffer pool: " << hits << " hits, " << misses << " misses ("
+            << static_cast<int>(GetHitRate() * 100.0 + 0.5) << "% hit rate), "
+            << (cachedBytes >> 20) << " MiB cached, " << (inUseBytes >> 20) << " MiB in use";
+        return stream.str();
+    }
+};
+
+// A process-wide pool of large image buffers. Buffers are grouped into size
+// classes (four per power of two, so at most a quarter of a buffer is unused)
+// and returned buffers are kept for the next request of the same class, up to
+// a total capacity. In steady state, e.g. when rendering one image after the
+// other at the same size, every request is served from the pool.
+//
+// The pool is a cv::MatAllocator: matrices created by CreateMat take their
+// memory from the pool and give it back when their last reference goes away.
+// Acquire hands out plain buffers, e.g. for OFIQ::Image::data. Requests below
+// 64 KiB are not pooled.
+class OFIQBufferPool : public cv::MatAllocator
+{
+public:
+    static constexpr size_t minPooledBytes = 64 * 1024;
+
+    // The pool is never destroyed, so buffers may be returned at any time,
+    // also by static objects during shutdown.
+    static OFIQBufferPool& Get()
+    {
+        static OFIQBufferPool* pool = new OFIQBufferPool();
+        return *pool;
+    }
+
+    // A matrix of the given size and type with memory from the pool.
+    cv::Mat CreateMat(int rows, int cols, int type)
+    {
+        cv::Mat mat;
+        mat.allocator = this;
+        mat.create(rows, cols, type);
+        return mat;
+    }
+
+    std::shared_ptr<uint8_t> Acquire(size_t size)
+    {
+        return std::shared_ptr<uint8_t>(Take(size), [size](uint8_t* data) { OFIQBufferPool::Get().Give(data, size); });
+    }
+
+    // Limits the memory kept for reuse; 0 disables caching.
+    void SetCapacity(size_t capacityBytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.capacityBytes = capacityBytes;
+        FreeCached(capacityBytes);
+    }
+
+    // Frees all cached buffers, e.g. after a large image has been closed.
+    void Trim()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        FreeCached(0);
+    }
+
+    OFIQBufferPoolStats GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_stats;
+    }
+
+    // The size of the buffers of the class a request falls into.
+    static size_t GetSizeClass(size_t size)
+    {
+        if (size < minPooledBytes)
+        {
+            return size;
+        }
+        size_t power = minPooledBytes;
+        while (power <= size / 2)
+        {
+            power *= 2;
+        }
+        size_t step = power / 4;
+        return (size + step - 1) / step * step;
+    }
+
+    // cv::MatAllocator, following cv::StdMatAllocator.
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+        cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; i--)
+        {
+            if (step != nullptr)
+            {
+                if (data != nullptr && step[i] != CV_AUTOSTEP)
+                {
+                    total = step[i];
+                }
+                else
+                {
+                    step[i] = total;
+                }
+            }
+            total *= sizes[i];
+        }
+
+        cv::UMatData* matData = new cv::UMatData(this);
+        matData->size = total;
+        if (data != nullptr)
+        {
+            matData->data = matData->origdata = static_cast<uint8_t*>(data);
+            matData->flags |= cv::UMatData::USER_ALLOCATED;
+        }
+        else
+        {
+            matData->data = matData->origdata = const_cast<OFIQBufferPool*>(this)->Take(total);
+        }
+        return matData;
+    }
+
+    bool allocate(cv::UMatData* matData, cv::AccessFlag, cv::UMatUsageFlags) const override
+    {
+        return matData != nullptr;
+    }
+
+    void deallocate(cv::UMatData* matData) const override
+    {
+        if (matData == nullptr)
+        {
+            return;
+        }
+        if (!(matData->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            const_cast<OFIQBufferPool*>(this)->Give(matData->origdata, matData->size);
+            matData->origdata = nullptr;
+        }
+        delete matData;
+    }
+
+private:
+    OFIQBufferPool()
+    {
+        m_stats.capacityBytes = 256 * 1024 * 1024;
+    }
+
+    uint8_t* Take(size_t size)
+    {
+        size_t sizeClass = GetSizeClass(size);
+        if (sizeClass < minPooledBytes)
+        {
+            return static_cast<uint8_t*>(cv::fastMalloc(sizeClass));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.inUseBytes += sizeClass;
+            auto it = m_free.find(sizeClass);
+            if (it != m_free.end() && !it->second.empty())
+            {
+                uint8_t* data = it->second.back();
+                it->second.pop_back();
+                m_stats.cachedBytes -= sizeClass;
+                m_stats.hits++;
+                return data;
+            }
+            m_stats.misses++;
+        }
+        return static_cast<uint8_t*>(cv::fastMalloc(sizeClass));
+    }
+
+    void Give(uint8_t* data, size_t size)
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+        size_t sizeClass = GetSizeClass(size);
+        if (sizeClass >= minPooledBytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stats.inUseBytes -= sizeClass;
+            if (m_stats.cachedBytes + sizeClass <= m_stats.capacityBytes)
+            {
+                m_free[sizeClass].push_back(data);
+                m_stats.cachedBytes += sizeClass;
+                return;
+            }
+            m_stats.dropped++;
+        }
+        cv::fastFree(data);
+    }
+
+    // Frees cached buffers, largest first, until at most the given number of
+    // bytes is cached. Called with the mutex held.
+    void FreeCached(size_t keepBytes)
+    {
+        for (auto it = m_free.rbegin(); it != m_free.rend() && m_stats.cachedBytes > keepBytes; ++it)
+        {
+            while (!it->second.empty() && m_stats.cachedBytes > keepBytes)
+            {
+                cv::fastFree(it->second.back());
+                it->second.pop_back();
+                m_stats.cachedBytes -= it->first;
+            }
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::map<size_t, std::vector<uint8_t*>> m_free;
+    OFIQBufferPoolStats m_stats;
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+// Command line of the demonstrator. If one of the headless modes (e.g. --batch)
+// is given, the demonstrator runs without creating any window.
+//
+// Options are given as "--name value" or "--name=value", everything else is
+// collected as positional argument.
+class OFIQCommandLine
+{
+public:
+    OFIQCommandLine(int argc, char** argv)
+    {
+        std::vector<std::string> args;
+        for (int i = 1; i < argc; i++)
+        {
+            args.push_back(argv[i]);
+        }
+        Parse(argc > 0 ? argv[0] : "", args);
+    }
+
+    OFIQCommandLine(const std::string& programPath, const std::vector<std::string>& args)
+    {
+        Parse(programPath, args);
+    }
+
+    // Names of the options selecting a headless mode.
+    static const std::set<std::string>& GetModeNames()
+    {
+        static const std::set<std::string> modeNames = {
+            "batch",
+            "benchmark",
+            "compare",
+            "downscale-compare",
+            "merge",
+            "serve",
+            "shm-ingest",
+            "shm-producer",
+            "soak",
+            "store",
+            "watch",
+            "worker"
+        };
+        return modeNames;
+    }
+
+    bool IsHeadless() const
+    {
+        return !m_mode.empty();
+    }
+
+    const std::string& GetMode() const
+    {
+        return m_mode;
+    }
+
+    const std::string& GetProgramPath() const
+    {
+        return m_programPath;
+    }
+
+    const std::vector<std::string>& GetPositional() const
+    {
+        return m_positional;
+    }
+
+    bool HasOption(const std::string& name) const
+    {
+        return m_options.find(name) != m_options.end();
+    }
+
+    std::string GetString(const std::string& name, const std::string& defaultValue = "") const
+    {
+        auto it = m_options.find(name);
+        return (it == m_options.end() || it->second.empty()) ? defaultValue : it->second;
+    }
+
+    int GetInt(const std::string& name, int defaultValue) const
+    {
+        auto value = GetString(name);
+        return value.empty() ? defaultValue : std::stoi(value);
+    }
+
+    double GetDouble(const std::string& name, double defaultValue) const
+    {
+        auto value = GetString(name);
+        return value.empty() ? defaultValue : std::stod(value);
+    }
+
+    // Returns the command line as it has to be passed to a child process of the
+    // same mode, i.e. without the program path.
+    const std::vector<std::string>& GetArguments() const
+    {
+        return m_arguments;
+    }
+
+private:
+    void Parse(const std::string& programPath, const std::vector<std::string>& args)
+    {
+        m_programPath = programPath;
+        m_arguments = args;
+
+        for (size_t i = 0; i < args.size(); i++)
+        {
+            const std::string& arg = args[i];
+            if (arg.size() <= 2 || arg.compare(0, 2, "--") != 0)
+            {
+                m_positional.push_back(arg);
+                continue;
+            }
+
+            std::string name = arg.substr(2);
+            std::string value;
+            auto separator = name.find('=');
+            if (separator != std::string::npos)
+            {
+                value = name.substr(separator + 1);
+                name = name.substr(0, separator);
+            }
+            else if (GetModeNames().count(name) == 0
+                && i + 1 < args.size()
+                && args[i + 1].compare(0, 2, "--") != 0)
+            {
+                value = args[++i];
+            }
+
+            if (m_mode.empty() && GetModeNames().count(name) != 0)
+            {
+                m_mode = name;
+            }
+            m_options[name] = value;
+        }
+    }
+
+    std::string m_programPath;
+    std::string m_mode;
+    std::vector<std::string> m_arguments;
+    std::vector<std::string> m_positional;
+    std::map<std::string, std::string> m_options;
+};
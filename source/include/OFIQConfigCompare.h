@@ -0,0 +1,597 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQBatch.h>
+#include <OFIQCommandLine.h>
+#include <OFIQJson.h>
+
+
+// The mapping of a raw score to the scalar quality value as configured under
+// params.measures.<measure>.Sigmoid:
+//     scalar = h * (a + s / (1 + exp((x0 - raw) / w)))
+// rounded if "round" is set and clamped to [0, 100].
+struct OFIQSigmoidMapping
+{
+    double h = 100.0;
+    double a = 0.0;
+    double s = 1.0;
+    double x0 = 0.0;
+    double w = 1.0;
+    bool round = true;
+
+    // Whether the config sets every parameter of the mapping. OFIQ falls back
+    // to per-measure built-in values for missing ones, which are not known
+    // here, so only complete mappings can be evaluated outside OFIQ.
+    static bool IsComplete(const OFIQJsonValue& sigmoid)
+    {
+        if (!sigmoid.IsObject())
+        {
+            return false;
+        }
+        for (const char* parameter : { "h", "a", "s", "x0", "w" })
+        {
+            if (!sigmoid.Get(parameter).IsNumber())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Takes "round" from the defaults if the config does not set it.
+    static OFIQSigmoidMapping FromJson(const OFIQJsonValue& sigmoid, const OFIQSigmoidMapping& defaults)
+    {
+        OFIQSigmoidMapping mapping = defaults;
+        mapping.h = sigmoid.Get("h").AsNumber(defaults.h);
+        mapping.a = sigmoid.Get("a").AsNumber(defaults.a);
+        mapping.s = sigmoid.Get("s").AsNumber(defaults.s);
+        mapping.x0 = sigmoid.Get("x0").AsNumber(defaults.x0);
+        mapping.w = sigmoid.Get("w").AsNumber(defaults.w);
+        mapping.round = sigmoid.Get("round").AsBool(defaults.round);
+        return mapping;
+    }
+
+    double Map(double rawScore) const
+    {
+        double scalar = h * (a + s / (1.0 + std::exp((x0 - rawScore) / w)));
+        if (round)
+        {
+            scalar = std::round(scalar);
+        }
+        return std::clamp(scalar, 0.0, 100.0);
+    }
+};
+
+// How the scores of a config variant are obtained from the base run. If the
+// variant only changes quality mappings, the raw scores of the base run are
+// re-mapped; the raw scores depend on the preprocessing (face detection,
+// landmarks, segmentation) and the models only, so nothing is recomputed. This
+// requires h, a, s, x0 and w to be set in the base and in the variant. Any
+// other change requires running OFIQ with the variant.
+struct OFIQConfigVariant
+{
+    std::string path;
+    std::string name;
+    std::map<std::string, OFIQSigmoidMapping> remappedMeasures;
+    std::vector<std::string> rerunReasons;
+
+    bool NeedsRerun() const
+    {
+        return !rerunReasons.empty();
+    }
+
+    static bool Load(const std::string& path, const OFIQJsonValue& base, OFIQConfigVariant& variant, std::string& error)
+    {
+        OFIQJsonValue config;
+        if (!OFIQJsonValue::LoadFromFile(path, config, error))
+        {
+            error = "Cannot read variant '" + path + "': " + error;
+            return false;
+        }
+        variant = OFIQConfigVariant();
+        variant.path = path;
+        variant.name = std::filesystem::path(path).stem().u8string();
+
+        std::vector<std::string> changes;
+        Diff(base, config, "", changes);
+
+        std::set<std::string> measureNames;
+        for (const auto& [id, name] : measurementMapping)
+        {
+            measureNames.insert(name);
+        }
+
+        const std::string measuresPrefix = "params.measures.";
+        for (const auto& change : changes)
+        {
+            // params.measures.<measure>.Sigmoid[.<parameter>]
+            std::string measure;
+            if (change.compare(0, measuresPrefix.size(), measuresPrefix) == 0)
+            {
+                size_t end = change.find('.', measuresPrefix.size());
+                measure = change.substr(measuresPrefix.size(), end == std::string::npos ? std::string::npos : end - measuresPrefix.size());
+                std::string rest = end == std::string::npos ? "" : change.substr(end + 1);
+                if (measureNames.count(measure) == 0 || (rest != "Sigmoid" && rest.compare(0, 8, "Sigmoid.") != 0))
+                {
+                    measure.clear();
+                }
+            }
+            if (measure.empty())
+            {
+                variant.rerunReasons.push_back(change);
+                continue;
+            }
+            const OFIQJsonValue& baseSigmoid = base.GetPath(measuresPrefix + measure + ".Sigmoid");
+            const OFIQJsonValue& variantSigmoid = config.GetPath(measuresPrefix + measure + ".Sigmoid");
+            if (!OFIQSigmoidMapping::IsComplete(baseSigmoid) || !OFIQSigmoidMapping::IsComplete(variantSigmoid))
+            {
+                variant.rerunReasons.push_back(change + " (Sigmoid not fully set in base and variant)");
+                continue;
+            }
+            OFIQSigmoidMapping defaults = OFIQSigmoidMapping::FromJson(baseSigmoid, OFIQSigmoidMapping());
+            variant.remappedMeasures[measure] = OFIQSigmoidMapping::FromJson(variantSigmoid, defaults);
+        }
+        return true;
+    }
+
+    // Computes the assessments of the variant from those of the base config.
+    void Remap(OFIQ::FaceImageQualityAssessment& assessments) const
+    {
+        for (auto& [measure, result] : assessments.qAssessments)
+        {
+            auto it = remappedMeasures.find(GetMeasureName(measure));
+            if (it != remappedMeasures.end() && result.code == OFIQ::QualityMeasureReturnCode::Success)
+            {
+                result.scalar = it->second.Map(result.rawScore);
+            }
+        }
+    }
+
+private:
+    // Collects the dot separated paths at which two configs differ.
+    static void Diff(const OFIQJsonValue& base, const OFIQJsonValue& variant, const std::string& path, std::vector<std::string>& changes)
+    {
+        if (base.IsObject() && variant.IsObject())
+        {
+            std::set<std::string> keys;
+            for (const auto& member : base.GetMembers())
+            {
+                keys.insert(member.first);
+            }
+            for (const auto& member : variant.GetMembers())
+            {
+                keys.insert(member.first);
+            }
+            for (const auto& key : keys)
+            {
+                Diff(base.Get(key), variant.Get(key), path.empty() ? key : path + "." + key, changes);
+            }
+        }
+        else if (base.ToString(false) != variant.ToString(false))
+        {
+            changes.push_back(path);
+        }
+    }
+};
+
+// Per-measure differences between the scalar values of the base config and
+// a variant, over the images that both assessed successfully.
+struct OFIQMeasureDelta
+{
+    size_t count = 0;
+    size_t changed = 0;
+    double baseSum = 0.0;
+    double variantSum = 0.0;
+    double maxAbsDelta = 0.0;
+
+    void Add(double baseScalar, double variantScalar)
+    {
+        double delta = variantScalar - baseScalar;
+        count++;
+        changed += delta != 0.0 ? 1 : 0;
+        baseSum += baseScalar;
+        variantSum += variantScalar;
+        maxAbsDelta = std::max(maxAbsDelta, std::abs(delta));
+    }
+
+    double GetBaseMean() const { return count > 0 ? baseSum / count : 0.0; }
+    double GetVariantMean() const { return count > 0 ? variantSum / count : 0.0; }
+    double GetMeanDelta() const { return GetVariantMean() - GetBaseMean(); }
+};
+
+// --compare: compares config variants with a base config on one corpus. The
+// expensive part, preprocessing and computing the raw scores, runs once with
+// the base config; variants that only change quality mappings are scored by
+// re-mapping the stored raw scores. OFIQ offers no entry point to assess
+// from a stored preprocessing result, so variants changing anything else
+// (models, detector or measure parameters) are run in full. The output is a
+// per-measure table of the scalar values of the base and every variant with
+// their deltas, and a JSON report including the time saved compared to
+// running every variant in full.
+class OFIQConfigCompare
+{
+public:
+    static constexpr int defaultVerifyCount = 5;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --compare --input <directory|manifest> --config <base.jaxn>" << std::endl
+            << "           --variants <variant.jaxn>[,<variant.jaxn>...] --output <deltas.csv>" << std::endl
+            << "           [--report <report.json>] [--verify <" << defaultVerifyCount << ">]" << std::endl
+            << "       --verify reruns the first images with every re-mapped variant to check the re-mapping;" << std::endl
+            << "       a variant whose re-mapped scalars deviate is run in full. 0 skips the check." << std::endl;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::vector<OFIQImageEntry> images;
+        if (!OFIQImageList::Collect(commandLine.GetString("input"), images, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        const std::string configPath = commandLine.GetString("config", "ofiq_config.jaxn");
+        const std::string outputPath = commandLine.GetString("output");
+        const size_t verifyCount = static_cast<size_t>(std::max(0, commandLine.GetInt("verify", defaultVerifyCount)));
+        OFIQJsonValue baseConfig;
+        if (!OFIQJsonValue::LoadFromFile(configPath, baseConfig, error))
+        {
+            std::cerr << "ERROR: Cannot read '" << configPath << "': " << error << std::endl;
+            return 1;
+        }
+
+        std::vector<OFIQConfigVariant> variants;
+        std::stringstream variantList(commandLine.GetString("variants"));
+        std::string variantPath;
+        while (std::getline(variantList, variantPath, ','))
+        {
+            OFIQConfigVariant variant;
+            if (!variantPath.empty() && !OFIQConfigVariant::Load(variantPath, baseConfig, variant, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            if (!variantPath.empty())
+            {
+                variants.push_back(variant);
+            }
+        }
+        if (variants.empty() || outputPath.empty())
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        for (const auto& variant : variants)
+        {
+            std::cout << variant.name << ": ";
+            if (variant.NeedsRerun())
+            {
+                std::cout << "full run, changes " << variant.rerunReasons.front()
+                    << (variant.rerunReasons.size() > 1 ? " and more" : "") << std::endl;
+            }
+            else
+            {
+                std::cout << "re-mapping " << variant.remappedMeasures.size() << " measures" << std::endl;
+            }
+        }
+
+        // Base run
+        std::vector<OFIQ::FaceImageQualityAssessment> baseResults;
+        std::vector<bool> baseSuccess;
+        double baseInitSeconds = 0.0;
+        double baseImageSeconds = 0.0;
+        if (!RunConfig(configPath, images, images.size(), baseResults, baseSuccess, baseInitSeconds, baseImageSeconds, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Base config: " << images.size() << " images in " << baseImageSeconds << " s" << std::endl;
+
+        OFIQJsonValue variantReports = OFIQJsonValue::Array();
+        std::vector<std::map<std::string, OFIQMeasureDelta>> deltas(variants.size());
+        double actualSeconds = baseInitSeconds + baseImageSeconds;
+        for (size_t v = 0; v < variants.size(); v++)
+        {
+            auto& variant = variants[v];
+            std::vector<OFIQ::FaceImageQualityAssessment> results;
+            std::vector<bool> success;
+            double initSeconds = 0.0;
+            double imageSeconds = 0.0;
+            double verifySeconds = 0.0;
+            size_t verifiedImages = 0;
+            double maxDeviation = 0.0;
+            if (!variant.NeedsRerun())
+            {
+                auto start = std::chrono::steady_clock::now();
+                results = baseResults;
+                success = baseSuccess;
+                for (auto& assessments : results)
+                {
+                    variant.Remap(assessments);
+                }
+                imageSeconds = OFIQSecondsSince(start);
+
+                verifiedImages = std::min(verifyCount, images.size());
+                if (verifiedImages > 0)
+                {
+                    if (!Verify(variant, images, verifiedImages, results, maxDeviation, verifySeconds, error))
+                    {
+                        std::cerr << "ERROR: " << error << std::endl;
+                        return 1;
+                    }
+                    if (maxDeviation > maxVerifyDeviation)
+                    {
+                        std::cerr << "WARNING: Re-mapped scalars of " << variant.name
+                            << " deviate from a full run by up to " << maxDeviation << "; running it in full." << std::endl;
+                        variant.rerunReasons.push_back("re-mapped scalars deviate by up to " + std::to_string(maxDeviation));
+                    }
+                }
+            }
+            if (variant.NeedsRerun())
+            {
+                if (!RunConfig(variant.path, images, images.size(), results, success, initSeconds, imageSeconds, error))
+                {
+                    std::cerr << "ERROR: " << error << std::endl;
+                    return 1;
+                }
+            }
+            actualSeconds += initSeconds + imageSeconds + verifySeconds;
+            std::cout << variant.name << ": " << images.size() << " images in " << imageSeconds << " s" << std::endl;
+
+            for (size_t i = 0; i < images.size(); i++)
+            {
+                if (!baseSuccess[i] || !success[i])
+                {
+                    continue;
+                }
+                for (const auto& [measure, baseResult] : baseResults[i].qAssessments)
+                {
+                    auto it = results[i].qAssessments.find(measure);
+                    if (it != results[i].qAssessments.end()
+                        && baseResult.code == OFIQ::QualityMeasureReturnCode::Success
+                        && it->second.code == OFIQ::QualityMeasureReturnCode::Success)
+                    {
+                        deltas[v][GetMeasureName(measure)].Add(baseResult.scalar, it->second.scalar);
+                    }
+                }
+            }
+
+            OFIQJsonValue report = OFIQJsonValue::Object();
+            report.Set("config", variant.path);
+            report.Set("mode", variant.NeedsRerun() ? "full run" : "re-mapped");
+            OFIQJsonValue reasons = OFIQJsonValue::Array();
+            for (const auto& reason : variant.rerunReasons)
+            {
+                reasons.Append(reason);
+            }
+            report.Set("full_run_reasons", reasons);
+            report.Set("seconds", initSeconds + imageSeconds + verifySeconds);
+            if (verifiedImages > 0)
+            {
+                report.Set("verified_images", verifiedImages);
+                report.Set("verify_max_deviation", maxDeviation);
+            }
+            variantReports.Append(report);
+        }
+
+        // Every variant run in full would cost as much as the base run.
+        double naiveSeconds = (baseInitSeconds + baseImageSeconds) * static_cast<double>(variants.size() + 1);
+
+        if (!WriteDeltas(outputPath, variants, deltas))
+        {
+            std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+
+        OFIQJsonValue timing = OFIQJsonValue::Object();
+        timing.Set("base_init_seconds", baseInitSeconds);
+        timing.Set("base_images_seconds", baseImageSeconds);
+        timing.Set("actual_seconds", actualSeconds);
+        timing.Set("naive_seconds_estimate", naiveSeconds);
+        timing.Set("saved_seconds", naiveSeconds - actualSeconds);
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("config", configPath);
+        report.Set("input", commandLine.GetString("input"));
+        report.Set("images", images.size());
+        report.Set("timing", timing);
+        report.Set("variants", variantReports);
+        report.Set("measures", DeltasToJson(variants, deltas));
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+            return 1;
+        }
+
+        std::cout << "Done in " << actualSeconds << " s; running every variant in full would take about "
+            << naiveSeconds << " s (saved " << naiveSeconds - actualSeconds << " s)." << std::endl;
+        return 0;
+    }
+
+private:
+    // Largest difference between re-mapped and computed scalars that is
+    // taken as rounding noise.
+    static constexpr double maxVerifyDeviation = 1e-6;
+
+    // Assesses the first count images with the given config.
+    static bool RunConfig(
+        const std::string& configPath,
+        const std::vector<OFIQImageEntry>& images,
+        size_t count,
+        std::vector<OFIQ::FaceImageQualityAssessment>& results,
+        std::vector<bool>& success,
+        double& initSeconds,
+        double& imageSeconds,
+        std::string& error)
+    {
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(configPath, error))
+        {
+            error = configPath + ": " + error;
+            return false;
+        }
+        initSeconds = runner.GetInitSeconds();
+        imageSeconds = 0.0;
+        results.clear();
+        success.clear();
+        for (size_t i = 0; i < count; i++)
+        {
+            auto item = runner.Process(images[i].path);
+            if (!item.success)
+            {
+                std::cerr << "ERROR: " << item.path << ": " << item.info << std::endl;
+            }
+            imageSeconds += item.GetTotalSeconds();
+            results.push_back(item.assessments);
+            success.push_back(item.success);
+        }
+        return true;
+    }
+
+    // Runs the variant in full on the first images and returns the largest
+    // difference to the re-mapped scalar values.
+    static bool Verify(
+        const OFIQConfigVariant& variant,
+        const std::vector<OFIQImageEntry>& images,
+        size_t count,
+        const std::vector<OFIQ::FaceImageQualityAssessment>& remapped,
+        double& maxDeviation,
+        double& seconds,
+        std::string& error)
+    {
+        std::vector<OFIQ::FaceImageQualityAssessment> results;
+        std::vector<bool> success;
+        double initSeconds = 0.0;
+        double imageSeconds = 0.0;
+        if (!RunConfig(variant.path, images, count, results, success, initSeconds, imageSeconds, error))
+        {
+            return false;
+        }
+        seconds = initSeconds + imageSeconds;
+        maxDeviation = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            for (const auto& [measure, result] : results[i].qAssessments)
+            {
+                auto it = remapped[i].qAssessments.find(measure);
+                if (success[i] && it != remapped[i].qAssessments.end())
+                {
+                    maxDeviation = std::max(maxDeviation, std::abs(result.scalar - it->second.scalar));
+                }
+            }
+        }
+        return true;
+    }
+
+    static std::vector<std::string> GetMeasureNames(const std::vector<std::map<std::string, OFIQMeasureDelta>>& deltas)
+    {
+        std::set<std::string> names;
+        for (const auto& variantDeltas : deltas)
+        {
+            for (const auto& entry : variantDeltas)
+            {
+                names.insert(entry.first);
+            }
+        }
+        return std::vector<std::string>(names.begin(), names.end());
+    }
+
+    static bool WriteDeltas(
+        const std::string& path,
+        const std::vector<OFIQConfigVariant>& variants,
+        const std::vector<std::map<std::string, OFIQMeasureDelta>>& deltas)
+    {
+        const char separator = OFIQAssessmentCsv::separator;
+        std::ofstream stream(path.c_str());
+        if (!stream.is_open())
+        {
+            return false;
+        }
+
+        stream << "Measure" << separator << "base.mean";
+        for (const auto& variant : variants)
+        {
+            stream << separator << variant.name << ".mean"
+                << separator << variant.name << ".delta"
+                << separator << variant.name << ".max_abs_delta"
+                << separator << variant.name << ".changed";
+        }
+        stream << std::endl;
+
+        for (const auto& name : GetMeasureNames(deltas))
+        {
+            // The base mean is the same for all variants unless a variant
+            // failed on other images; take it from the first variant.
+            double baseMean = 0.0;
+            for (const auto& variantDeltas : deltas)
+            {
+                auto it = variantDeltas.find(name);
+                if (it != variantDeltas.end())
+                {
+                    baseMean = it->second.GetBaseMean();
+                    break;
+                }
+            }
+            stream << name << separator << baseMean;
+            for (const auto& variantDeltas : deltas)
+            {
+                auto it = variantDeltas.find(name);
+                OFIQMeasureDelta delta = it != variantDeltas.end() ? it->second : OFIQMeasureDelta();
+                stream << separator << delta.GetVariantMean()
+                    << separator << delta.GetMeanDelta()
+                    << separator << delta.maxAbsDelta
+                    << separator << delta.changed;
+            }
+            stream << std::endl;
+        }
+        return stream.good();
+    }
+
+    static OFIQJsonValue DeltasToJson(
+        const std::vector<OFIQConfigVariant>& variants,
+        const std::vector<std::map<std::string, OFIQMeasureDelta>>& deltas)
+    {
+        OFIQJsonValue measures = OFIQJsonValue::Object();
+        for (const auto& name : GetMeasureNames(deltas))
+        {
+            OFIQJsonValue measure = OFIQJsonValue::Object();
+            for (size_t v = 0; v < variants.size(); v++)
+            {
+                auto it = deltas[v].find(name);
+                if (it == deltas[v].end())
+                {
+                    continue;
+                }
+                OFIQJsonValue entry = OFIQJsonValue::Object();
+                entry.Set("images", it->second.count);
+                entry.Set("base_mean", it->second.GetBaseMean());
+                entry.Set("mean", it->second.GetVariantMean());
+                entry.Set("delta", it->second.GetMeanDelta());
+                entry.Set("max_abs_delta", it->second.maxAbsDelta);
+                entry.Set("changed", it->second.changed);
+                measure.Set(variants[v].name, entry);
+            }
+            measures.Set(name, measure);
+        }
+        return measures;
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQBufferPool.h>
+
+
+// Helpers for showing images that are too large to be displayed at full
+// resolution within a memory budget. The display path then works from a
+// reduced proxy of the image and its masks, and from full-resolution crops of
+// the parts in view. OFIQ always gets the original pixels.
+class OFIQDisplayProxy
+{
+public:
+    // The display path holds about this many buffers of the image size with
+    // three bytes per pixel (rendered image, image for the view and the
+    // overlay of a mask while it is blended).
+    static constexpr double buffersPerImage = 3.0;
+
+    // Returns the scale at which the display buffers of an image of the given
+    // size fit into the budget, or 1.0 if the full resolution fits.
+    static double GetProxyScale(uint16_t width, uint16_t height, size_t budgetBytes)
+    {
+        double bytes = buffersPerImage * 3.0 * width * height;
+        if (bytes <= static_cast<double>(budgetBytes) || bytes == 0.0)
+        {
+            return 1.0;
+        }
+        return std::sqrt(static_cast<double>(budgetBytes) / bytes);
+    }
+
+    // Creates the proxy of an image and its masks at the given scale. The
+    // image is reduced by area averaging, the masks by nearest neighbour so
+    // labels are not mixed. Faces and landmarks are not copied, as the view
+    // draws them in image coordinates.
+    static void Create(
+        const OFIQ::Image& image,
+        const OFIQ::FaceImageQualityPreprocessingResult& preprocessing,
+        double scale,
+        OFIQ::Image& proxyImage,
+        OFIQ::FaceImageQualityPreprocessingResult& proxyPreprocessing)
+    {
+        int width = std::max(1, static_cast<int>(std::round(image.width * scale)));
+        int height = std::max(1, static_cast<int>(std::round(image.height * scale)));
+        int channels = image.depth / 8;
+        proxyImage = Resize(image.data.get(), image.width, image.height, channels, width, height, cv::INTER_AREA);
+        proxyPreprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+        proxyPreprocessing.m_segmentationMaskPtr = ResizeMask(preprocessing.m_segmentationMaskPtr, image, width, height);
+        proxyPreprocessing.m_occlusionMaskPtr = ResizeMask(preprocessing.m_occlusionMaskPtr, image, width, height);
+        proxyPreprocessing.m_landmarkedRegionPtr = ResizeMask(preprocessing.m_landmarkedRegionPtr, image, width, height);
+    }
+
+    // Copies a region (in image coordinates) of an image and its masks.
+    static void Crop(
+        const OFIQ::Image& image,
+        const OFIQ::FaceImageQualityPreprocessingResult& preprocessing,
+        const cv::Rect& region,
+        OFIQ::Image& cropImage,
+        OFIQ::FaceImageQualityPreprocessingResult& cropPreprocessing)
+    {
+        int channels = image.depth / 8;
+        cropImage = CropPlane(image.data, image.width, channels, region);
+        cropImage.depth = image.depth;
+        cropPreprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+        cropPreprocessing.m_segmentationMaskPtr = CropPlane(preprocessing.m_segmentationMaskPtr, image.width, 1, region).data;
+        cropPreprocessing.m_occlusionMaskPtr = CropPlane(preprocessing.m_occlusionMaskPtr, image.width, 1, region).data;
+        cropPreprocessing.m_landmarkedRegionPtr = CropPlane(preprocessing.m_landmarkedRegionPtr, image.width, 1, region).data;
+    }
+
+private:
+    static std::shared_ptr<uint8_t> Allocate(size_t size)
+    {
+        return OFIQBufferPool::Get().Acquire(size);
+    }
+
+    static OFIQ::Image Resize(const uint8_t* data, int width, int height, int channels, int newWidth, int newHeight, int interpolation)
+    {
+        auto resized = Allocate(static_cast<size_t>(newWidth) * newHeight * channels);
+        int type = channels == 3 ? CV_8UC3 : CV_8UC1;
+        cv::Mat source(height, width, type, const_cast<uint8_t*>(data));
+        cv::Mat target(newHeight, newWidth, type, resized.get());
+        cv::resize(source, target, cv::Size(newWidth, newHeight), 0, 0, interpolation);
+        return OFIQ::Image(static_cast<uint16_t>(newWidth), static_cast<uint16_t>(newHeight), static_cast<uint8_t>(channels * 8), resized);
+    }
+
+    static std::shared_ptr<uint8_t> ResizeMask(const std::shared_ptr<uint8_t>& mask, const OFIQ::Image& image, int width, int height)
+    {
+        if (mask == nullptr)
+        {
+            return nullptr;
+        }
+        return Resize(mask.get(), image.width, image.height, 1, width, height, cv::INTER_NEAREST).data;
+    }
+
+    static OFIQ::Image CropPlane(const std::shared_ptr<uint8_t>& data, int width, int channels, const cv::Rect& region)
+    {
+        OFIQ::Image crop(static_cast<uint16_t>(region.width), static_cast<uint16_t>(region.height), static_cast<uint8_t>(channels * 8), nullptr);
+        if (data == nullptr)
+        {
+            return crop;
+        }
+        size_t rowBytes = static_cast<size_t>(region.width) * channels;
+        crop.data = Allocate(rowBytes * region.height);
+        for (int y = 0; y < region.height; y++)
+        {
+            const uint8_t* source = data.get() + (static_cast<size_t>(region.y + y) * width + region.x) * channels;
+            memcpy(crop.data.get() + y * rowBytes, source, rowBytes);
+        }
+        return crop;
+    }
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQDisplayProxy.h>
+#include <OFIQOverlayRenderer.h>
+
+
+// The image the view is rendered from: the shown image with its mask layers
+// blended in, at full resolution or as a proxy if the image exceeds the
+// display memory budget (see OFIQDisplayProxy). Faces and landmarks are not
+// part of it, the view draws them as vectors.
+//
+// This is the part of showing an image that does not need wxWidgets, so that
+// --soak runs the same code as the GUI.
+class OFIQDisplaySource
+{
+public:
+    OFIQDisplaySource()
+        : m_proxyScale(1.0)
+        , m_budgetBytes(0)
+        , m_layers(-1)
+    {
+        ;
+    }
+
+    // Renders the display image again if the image, the masks, the mask
+    // layers or the budget have changed since the last render, and returns
+    // whether it did. proxyCreated tells that a new proxy has been created
+    // for it.
+    bool Update(
+        const OFIQ::Image& image,
+        const OFIQ::FaceImageQualityPreprocessingResult& preprocessing,
+        OFIQOverlayOptions options,
+        size_t budgetBytes,
+        bool& proxyCreated)
+    {
+        proxyCreated = false;
+        std::vector<std::shared_ptr<uint8_t>> data = {
+            image.data,
+            preprocessing.m_segmentationMaskPtr,
+            preprocessing.m_occlusionMaskPtr,
+            preprocessing.m_landmarkedRegionPtr };
+        int layers = (options.original ? 1 : 0) | (options.segmentationMask ? 2 : 0)
+            | (options.occlusionMask ? 4 : 0) | (options.landmarkedRegion ? 8 : 0);
+        bool contentChanged = data != m_data || budgetBytes != m_budgetBytes;
+        if (!contentChanged && layers == m_layers)
+        {
+            return false;
+        }
+
+        m_data = data;
+        m_budgetBytes = budgetBytes;
+        m_layers = layers;
+        if (contentChanged)
+        {
+            m_proxyScale = OFIQDisplayProxy::GetProxyScale(image.width, image.height, budgetBytes);
+            m_proxyImage = OFIQ::Image();
+            m_proxyPreprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+            if (m_proxyScale < 1.0)
+            {
+                OFIQDisplayProxy::Create(image, preprocessing, m_proxyScale, m_proxyImage, m_proxyPreprocessing);
+                proxyCreated = true;
+            }
+        }
+
+        options.faces = false;
+        options.landmarks = false;
+        // Returning the previous image to the buffer pool first lets the
+        // render reuse it.
+        m_image.release();
+        if (m_proxyScale < 1.0)
+        {
+            m_image = OFIQOverlayRenderer::Render(m_proxyImage, m_proxyPreprocessing, options);
+        }
+        else
+        {
+            m_image = OFIQOverlayRenderer::Render(image, preprocessing, options);
+        }
+        return true;
+    }
+
+    // Copies the display image as RGB into data, which holds three bytes
+    // for each of its pixels without row padding.
+    void CopyRgb(uint8_t* data) const
+    {
+        cv::Mat rgb(m_image.rows, m_image.cols, CV_8UC3, data);
+        cv::cvtColor(m_image, rgb, cv::COLOR_BGR2RGB);
+    }
+
+    // Releases the display image and the proxy.
+    void Clear()
+    {
+        m_image.release();
+        m_proxyScale = 1.0;
+        m_proxyImage = OFIQ::Image();
+        m_proxyPreprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+        m_data.clear();
+        m_budgetBytes = 0;
+        m_layers = -1;
+    }
+
+    // The display image in BGR order.
+    const cv::Mat& GetImage() const
+    {
+        return m_image;
+    }
+
+    // Scale of the display image relative to the shown image, 1.0 unless
+    // it is a proxy.
+    double GetProxyScale() const
+    {
+        return m_proxyScale;
+    }
+
+    const OFIQ::Image& GetProxyImage() const
+    {
+        return m_proxyImage;
+    }
+
+private:
+    cv::Mat m_image;
+    double m_proxyScale;
+    OFIQ::Image m_proxyImage;
+    OFIQ::FaceImageQualityPreprocessingResult m_proxyPreprocessing;
+    // The content m_image was rendered from.
+    std::vector<std::shared_ptr<uint8_t>> m_data;
+    size_t m_budgetBytes;
+    int m_layers;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQBufferPool.h>
+#include <OFIQCommandLine.h>
+#include <OFIQImageConversion.h>
+
+
+// Cap on the size of the images passed to OFIQ. The face detector, the
+// landmark and segmentation models work on inputs of a few hundred pixels,
+// so most of the time spent on very large images goes into resampling and
+// the measures computed on the full image, with little effect on the scores.
+struct OFIQDownscaleSettings
+{
+    // Maximum length of the longer image edge in pixels, 0 for no cap.
+    int maxLongEdge = 0;
+
+    bool IsEnabled() const
+    {
+        return maxLongEdge > 0;
+    }
+
+    static bool FromCommandLine(const OFIQCommandLine& commandLine, OFIQDownscaleSettings& settings, std::string& error)
+    {
+        settings = OFIQDownscaleSettings();
+        settings.maxLongEdge = commandLine.GetInt("max-long-edge", 0);
+        if (settings.maxLongEdge < 0 || (settings.maxLongEdge > 0 && settings.maxLongEdge < 64))
+        {
+            error = "--max-long-edge must be at least 64.";
+            return false;
+        }
+        return true;
+    }
+
+    // The options giving these settings, e.g. to pass them on to a worker
+    // process.
+    std::vector<std::string> ToArguments() const
+    {
+        if (!IsEnabled())
+        {
+            return {};
+        }
+        return { "--max-long-edge", std::to_string(maxLongEdge) };
+    }
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "           [--max-long-edge <pixels>]" << std::endl;
+    }
+};
+
+// Reduces OFIQ images with area resampling, which averages all source pixels
+// of a target pixel and so does not alias like nearest or bilinear
+// resampling when shrinking by large factors.
+class OFIQDownscale
+{
+public:
+    // The factor to reduce an image of the given size by, 1 if it does not
+    // exceed the caps. ied and maxIed are the inter-eye distance and its cap
+    // in pixels, 0 if not known or not capped.
+    static double GetScale(int width, int height, int maxLongEdge, double ied = 0.0, double maxIed = 0.0)
+    {
+        double scale = 1.0;
+        int longEdge = std::max(width, height);
+        if (maxLongEdge > 0 && longEdge > maxLongEdge)
+        {
+            scale = std::min(scale, static_cast<double>(maxLongEdge) / longEdge);
+        }
+        if (maxIed > 0.0 && ied > maxIed)
+        {
+            scale = std::min(scale, maxIed / ied);
+        }
+        return scale;
+    }
+
+    // Replaces image by a copy reduced by scale, held in a buffer of
+    // OFIQBufferPool. Images are left unchanged for a scale of 1 or more.
+    static bool Apply(OFIQ::Image& image, double scale)
+    {
+        if (scale >= 1.0)
+        {
+            return true;
+        }
+        if (image.data == nullptr || (image.depth != 8 && image.depth != 24))
+        {
+            return false;
+        }
+        int width = std::max(1, static_cast<int>(image.width * scale + 0.5));
+        int height = std::max(1, static_cast<int>(image.height * scale + 0.5));
+        int channels = image.depth / 8;
+        std::shared_ptr<uint8_t> data = OFIQBufferPool::Get().Acquire(static_cast<size_t>(width) * height * channels);
+        cv::Mat reduced(height, width, channels == 3 ? CV_8UC3 : CV_8UC1, data.get());
+        cv::resize(OFIQImageConversion::WrapOfiqImage(image), reduced, reduced.size(), 0.0, 0.0, cv::INTER_AREA);
+        image = OFIQ::Image(static_cast<uint16_t>(width), static_cast<uint16_t>(height), image.depth, data);
+        return true;
+    }
+};
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+#include <image_io.h>
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQBatch.h>
+#include <OFIQCommandLine.h>
+#include <OFIQConfigCompare.h>
+#include <OFIQDownscale.h>
+#include <OFIQJson.h>
+
+
+// --downscale-compare: measures what capping the image size costs in scores
+// and saves in time, to choose a --max-long-edge that does not change the
+// outcomes. Every image is decoded once and assessed at full size and then
+// reduced to each cap and assessed again. The inter-eye distance caps use the
+// distance OFIQ measured at full size; they cannot be applied before the
+// assessment in the other modes, as the landmarks are only known afterwards.
+//
+// Writes one row per image and cap with the times and the largest score
+// difference, and a JSON report with the per-measure deltas of every cap
+// and the number of images whose outcome changed by more than the tolerance.
+class OFIQDownscaleCompare
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --downscale-compare --input <directory|manifest> --output <images.csv>" << std::endl
+            << "           [--max-long-edge <pixels>[,<pixels>...]] [--max-ied <pixels>[,<pixels>...]]" << std::endl
+            << "           [--config <ofiq_config.jaxn>] [--report <report.json>] [--tolerance <1>]" << std::endl
+            << "       At least one cap must be given. The tolerance is in points of the scalar values." << std::endl;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::vector<OFIQImageEntry> images;
+        if (!OFIQImageList::Collect(commandLine.GetString("input"), images, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::vector<Cap> caps;
+        if (!ParseCaps(commandLine.GetString("max-long-edge"), false, caps, error)
+            || !ParseCaps(commandLine.GetString("max-ied"), true, caps, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        const std::string outputPath = commandLine.GetString("output");
+        if (caps.empty() || outputPath.empty())
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+        const double tolerance = std::max(0.0, commandLine.GetDouble("tolerance", 1.0));
+
+        std::ofstream csvStream(outputPath.c_str());
+        if (!csvStream.is_open())
+        {
+            std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+        const char separator = OFIQAssessmentCsv::separator;
+        csvStream << "Filename" << separator << "Cap" << separator << "Width" << separator << "Height"
+            << separator << "InterEyeDistance" << separator << "Scale" << separator << "UncappedSeconds"
+            << separator << "CappedSeconds" << separator << "UnifiedQualityScore.delta"
+            << separator << "MaxAbsDelta" << separator << "MaxAbsDeltaMeasure" << separator << "Success" << std::endl;
+
+        const std::string configPath = commandLine.GetString("config", "ofiq_config.jaxn");
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(configPath, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        size_t failed = 0;
+        bool warmedUp = false;
+        for (size_t i = 0; i < images.size(); i++)
+        {
+            OFIQ::Image image;
+            OFIQ::ReturnStatus status = OFIQ_LIB::readImage(images[i].path, image);
+            if (status.code != OFIQ::ReturnCode::Success)
+            {
+                failed++;
+                std::cerr << "ERROR: " << images[i].path << ": Loading image returned: " << status.info << std::endl;
+                continue;
+            }
+
+            // The first assessment also loads the models into the caches
+            // and would distort the comparison.
+            if (!warmedUp)
+            {
+                OFIQBatchItem warmup;
+                warmup.image = image;
+                runner.Assess(warmup);
+                warmedUp = true;
+            }
+
+            OFIQBatchItem uncapped;
+            uncapped.image = image;
+            runner.Assess(uncapped);
+            if (!uncapped.success)
+            {
+                failed++;
+                std::cerr << "ERROR: " << images[i].path << ": " << uncapped.info << std::endl;
+                continue;
+            }
+            double ied = GetRawScore(uncapped.assessments, OFIQ::QualityMeasure::InterEyeDistance);
+
+            for (auto& cap : caps)
+            {
+                double scale = OFIQDownscale::GetScale(image.width, image.height, cap.maxLongEdge, ied, cap.maxIed);
+                OFIQBatchItem capped;
+                if (scale < 1.0)
+                {
+                    capped.image = image;
+                    auto start = std::chrono::steady_clock::now();
+                    OFIQDownscale::Apply(capped.image, scale);
+                    capped.downscaleSeconds = OFIQSecondsSince(start);
+                    runner.Assess(capped);
+                    cap.scaled++;
+                }
+                else
+                {
+                    // Not reduced: the outcome is the uncapped one.
+                    capped.success = true;
+                    capped.assessments = uncapped.assessments;
+                    capped.assessSeconds = uncapped.assessSeconds;
+                }
+                cap.images++;
+                cap.uncappedSeconds += uncapped.assessSeconds;
+                cap.cappedSeconds += capped.downscaleSeconds + capped.assessSeconds;
+
+                double maxAbsDelta = 0.0;
+                std::string maxAbsDeltaMeasure;
+                if (capped.success)
+                {
+                    for (const auto& [measure, result] : uncapped.assessments.qAssessments)
+                    {
+                        auto it = capped.assessments.qAssessments.find(measure);
+                        if (it == capped.assessments.qAssessments.end()
+                            || result.code != OFIQ::QualityMeasureReturnCode::Success
+                            || it->second.code != OFIQ::QualityMeasureReturnCode::Success)
+                        {
+                            continue;
+                        }
+                        cap.deltas[GetMeasureName(measure)].Add(result.scalar, it->second.scalar);
+                        double delta = std::abs(it->second.scalar - result.scalar);
+                        if (delta > maxAbsDelta)
+                        {
+                            maxAbsDelta = delta;
+                            maxAbsDeltaMeasure = GetMeasureName(measure);
+                        }
+                    }
+                }
+                else
+                {
+                    cap.failed++;
+                }
+                if (!capped.success || maxAbsDelta > tolerance)
+                {
+                    cap.outcomeChanged++;
+                }
+
+                csvStream << images[i].name << separator << cap.name << separator << image.width << separator << image.height
+                    << separator << ied << separator << scale << separator << uncapped.assessSeconds
+                    << separator << capped.downscaleSeconds + capped.assessSeconds
+                    << separator << GetScalarDelta(uncapped.assessments, capped.assessments, OFIQ::QualityMeasure::UnifiedQualityScore)
+                    << separator << maxAbsDelta << separator << maxAbsDeltaMeasure
+                    << separator << (capped.success ? 1 : 0) << std::endl;
+            }
+            std::cout << "[" << (i + 1) << "/" << images.size() << "] " << images[i].name << std::endl;
+        }
+
+        if (!csvStream.good())
+        {
+            std::cerr << "ERROR: Writing '" << outputPath << "' failed." << std::endl;
+            return 1;
+        }
+
+        OFIQJsonValue capReports = OFIQJsonValue::Object();
+        for (const auto& cap : caps)
+        {
+            capReports.Set(cap.name, cap.ToJson());
+            std::cout << cap.name << ": " << cap.scaled << " of " << cap.images << " images reduced, "
+                << cap.cappedSeconds << " s instead of " << cap.uncappedSeconds << " s, "
+                << cap.outcomeChanged << " changed by more than " << tolerance << " (" << cap.failed << " failed)." << std::endl;
+        }
+
+        OFIQJsonValue summary = OFIQJsonValue::Object();
+        summary.Set("config", configPath);
+        summary.Set("input", commandLine.GetString("input"));
+        summary.Set("images", images.size());
+        summary.Set("failed", failed);
+        summary.Set("tolerance", tolerance);
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("downscale_compare", summary);
+        report.Set("caps", capReports);
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+private:
+    // One cap to compare, either on the long edge or on the inter-eye
+    // distance, with its results over all images.
+    struct Cap
+    {
+        std::string name;
+        int maxLongEdge = 0;
+        double maxIed = 0.0;
+
+        size_t images = 0;
+        size_t scaled = 0;
+        size_t failed = 0;
+        size_t outcomeChanged = 0;
+        double uncappedSeconds = 0.0;
+        double cappedSeconds = 0.0;
+        std::map<std::string, OFIQMeasureDelta> deltas;
+
+        OFIQJsonValue ToJson() const
+        {
+            OFIQJsonValue json = OFIQJsonValue::Object();
+            json.Set("max_long_edge", maxLongEdge);
+            json.Set("max_ied", maxIed);
+            json.Set("images", images);
+            json.Set("reduced", scaled);
+            json.Set("failed", failed);
+            json.Set("outcome_changed", outcomeChanged);
+            json.Set("uncapped_seconds", uncappedSeconds);
+            json.Set("capped_seconds", cappedSeconds);
+            json.Set("speedup", cappedSeconds > 0.0 ? uncappedSeconds / cappedSeconds : 0.0);
+
+            OFIQJsonValue measures = OFIQJsonValue::Object();
+            for (const auto& [measure, delta] : deltas)
+            {
+                OFIQJsonValue entry = OFIQJsonValue::Object();
+                entry.Set("images", delta.count);
+                entry.Set("uncapped_mean", delta.GetBaseMean());
+                entry.Set("mean", delta.GetVariantMean());
+                entry.Set("delta", delta.GetMeanDelta());
+                entry.Set("max_abs_delta", delta.maxAbsDelta);
+                entry.Set("changed", delta.changed);
+                measures.Set(measure, entry);
+            }
+            json.Set("measures", measures);
+            return json;
+        }
+    };
+
+    static bool ParseCaps(const std::string& list, bool ied, std::vector<Cap>& caps, std::string& error)
+    {
+        std::stringstream stream(list);
+        std::string value;
+        while (std::getline(stream, value, ','))
+        {
+            if (value.empty())
+            {
+                continue;
+            }
+            char* end = nullptr;
+            double pixels = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || pixels < (ied ? 1.0 : 64.0))
+            {
+                error = std::string("Invalid ") + (ied ? "--max-ied" : "--max-long-edge") + " value '" + value + "'.";
+                return false;
+            }
+            Cap cap;
+            if (ied)
+            {
+                cap.name = "ied_" + value;
+                cap.maxIed = pixels;
+            }
+            else
+            {
+                cap.name = "long_edge_" + value;
+                cap.maxLongEdge = static_cast<int>(pixels);
+            }
+            caps.push_back(cap);
+        }
+        return true;
+    }
+
+    static double GetRawScore(const OFIQ::FaceImageQualityAssessment& assessments, OFIQ::QualityMeasure measure)
+    {
+        auto it = assessments.qAssessments.find(measure);
+        if (it == assessments.qAssessments.end() || it->second.code != OFIQ::QualityMeasureReturnCode::Success)
+        {
+            return 0.0;
+        }
+        return it->second.rawScore;
+    }
+
+    static double GetScalarDelta(
+        const OFIQ::FaceImageQualityAssessment& uncapped,
+        const OFIQ::FaceImageQualityAssessment& capped,
+        OFIQ::QualityMeasure measure)
+    {
+        auto base = uncapped.qAssessments.find(measure);
+        auto it = capped.qAssessments.find(measure);
+        if (base == uncapped.qAssessments.end() || it == capped.qAssessments.end())
+        {
+            return 0.0;
+        }
+        return it->second.scalar - base->second.scalar;
+    }
+};
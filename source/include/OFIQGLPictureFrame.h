@@ -0,0 +1,640 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <wx/wx.h>
+#include <wx/glcanvas.h>
+#include <ofiq_lib.h>
+
+#include <OFIQOverlayRenderer.h>
+
+#include <opencv2/opencv.hpp>
+
+#if defined(__APPLE__)
+#include <OpenGL/gl.h>
+#else
+#include <GL/gl.h>
+#endif
+
+// The canvas only needs OpenGL 2.1 and GLSL 1.20, which every driver
+// including Mesa's software rasteriser (llvmpipe) provides. Linux builds
+// define GL_GLEXT_PROTOTYPES and macOS declares OpenGL 2.1 in its headers;
+// on Windows, opengl32 only exports OpenGL 1.1 and the remaining entry points
+// are loaded once a context is current.
+#if defined(_WIN32)
+typedef char GLchar;
+#define OFIQ_GL_FUNCTIONS(X) \
+    X(GLuint, glCreateShader, (GLenum type)) \
+    X(void, glShaderSource, (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length)) \
+    X(void, glCompileShader, (GLuint shader)) \
+    X(void, glGetShaderiv, (GLuint shader, GLenum pname, GLint* params)) \
+    X(void, glGetShaderInfoLog, (GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)) \
+    X(void, glDeleteShader, (GLuint shader)) \
+    X(GLuint, glCreateProgram, (void)) \
+    X(void, glAttachShader, (GLuint program, GLuint shader)) \
+    X(void, glLinkProgram, (GLuint program)) \
+    X(void, glGetProgramiv, (GLuint program, GLenum pname, GLint* params)) \
+    X(void, glGetProgramInfoLog, (GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)) \
+    X(void, glDeleteProgram, (GLuint program)) \
+    X(void, glUseProgram, (GLuint program)) \
+    X(GLint, glGetUniformLocation, (GLuint program, const GLchar* name)) \
+    X(void, glUniform1i, (GLint location, GLint v0)) \
+    X(void, glUniform1f, (GLint location, GLfloat v0)) \
+    X(void, glActiveTexture, (GLenum texture))
+
+#define OFIQ_GL_DECLARE(ret, name, args) inline ret (APIENTRY* name) args = nullptr;
+OFIQ_GL_FUNCTIONS(OFIQ_GL_DECLARE)
+#undef OFIQ_GL_DECLARE
+
+inline bool OFIQLoadGLFunctions()
+{
+    bool loaded = true;
+#define OFIQ_GL_LOAD(ret, name, args) \
+    name = reinterpret_cast<decltype(name)>(wglGetProcAddress(#name)); \
+    loaded = loaded && name != nullptr;
+    OFIQ_GL_FUNCTIONS(OFIQ_GL_LOAD)
+#undef OFIQ_GL_LOAD
+    return loaded;
+}
+#else
+inline bool OFIQLoadGLFunctions()
+{
+    return true;
+}
+#endif
+
+#ifndef GL_CLAMP_TO_EDGE
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+#ifndef GL_TEXTURE0
+#define GL_TEXTURE0 0x84C0
+#endif
+#ifndef GL_FRAGMENT_SHADER
+#define GL_FRAGMENT_SHADER 0x8B30
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+
+// An alternative to OFIQPictureFrame that renders with OpenGL. The image and
+// the masks are uploaded once as textures; zooming, panning and blending the
+// mask layers happen on the GPU, so toggling a layer or changing the zoom
+// does not touch the pixels on the CPU. Face boxes and landmarks are drawn
+// as geometry on top.
+//
+// Zoom with the mouse wheel, pan by dragging with the left or middle button.
+class OFIQGLPictureFrame : public wxGLCanvas
+{
+public:
+    OFIQGLPictureFrame(wxWindow* parent)
+        : wxGLCanvas(parent, wxID_ANY, nullptr, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE)
+        , m_context(nullptr)
+        , m_initialized(false)
+        , m_program(0)
+        , m_imageTexture(0)
+        , m_paletteTexture(0)
+        , m_width(0)
+        , m_height(0)
+        , m_uploadScale(1.0)
+        , m_scale(1.0)
+        , m_offsetX(0.0)
+        , m_offsetY(0.0)
+        , m_dragging(false)
+        , m_scaleOwner(nullptr)
+        , m_onScaleBinding(nullptr)
+    {
+        for (auto& texture : m_maskTextures)
+        {
+            texture = 0;
+        }
+        m_layerAlpha[0] = m_layerAlpha[1] = m_layerAlpha[2] = 0.3f;
+
+        Bind(wxEVT_PAINT, &OFIQGLPictureFrame::OnPaint, this);
+        Bind(wxEVT_SIZE, [this](wxSizeEvent& event) { ClampOffset(); Refresh(false); event.Skip(); });
+        Bind(wxEVT_MOUSEWHEEL, &OFIQGLPictureFrame::OnMouseWheel, this);
+        Bind(wxEVT_LEFT_DOWN, &OFIQGLPictureFrame::OnMouse, this);
+        Bind(wxEVT_LEFT_UP, &OFIQGLPictureFrame::OnMouse, this);
+        Bind(wxEVT_MIDDLE_DOWN, &OFIQGLPictureFrame::OnMouse, this);
+        Bind(wxEVT_MIDDLE_UP, &OFIQGLPictureFrame::OnMouse, this);
+        Bind(wxEVT_MOTION, &OFIQGLPictureFrame::OnMouse, this);
+        Bind(wxEVT_ERASE_BACKGROUND, [](wxEraseEvent&) {});
+    }
+
+    ~OFIQGLPictureFrame()
+    {
+        if (m_context != nullptr)
+        {
+            SetCurrent(*m_context);
+            ReleaseTextures();
+            if (m_program != 0)
+            {
+                glDeleteProgram(m_program);
+            }
+            if (m_paletteTexture != 0)
+            {
+                glDeleteTextures(1, &m_paletteTexture);
+            }
+            delete m_context;
+        }
+    }
+
+    // Sets the image and the preprocessing results. Textures are only
+    // uploaded again if the image or one of the masks has changed.
+    void SetContent(const OFIQ::Image& image, const OFIQ::FaceImageQualityPreprocessingResult& preprocessing)
+    {
+        bool imageChanged = image.data != m_image.data || image.width != m_width || image.height != m_height;
+        bool masksChanged = imageChanged
+            || preprocessing.m_segmentationMaskPtr != m_preprocessing.m_segmentationMaskPtr
+            || preprocessing.m_occlusionMaskPtr != m_preprocessing.m_occlusionMaskPtr
+            || preprocessing.m_landmarkedRegionPtr != m_preprocessing.m_landmarkedRegionPtr;
+
+        m_image = image;
+        m_preprocessing = preprocessing;
+        m_width = image.width;
+        m_height = image.height;
+        m_imageDirty = m_imageDirty || imageChanged;
+        m_masksDirty = m_masksDirty || masksChanged;
+        if (imageChanged)
+        {
+            m_offsetX = 0.0;
+            m_offsetY = 0.0;
+        }
+        Refresh(false);
+    }
+
+    void SetLayers(const OFIQOverlayOptions& options)
+    {
+        m_options = options;
+        Refresh(false);
+    }
+
+    // Sets the opacity of the segmentation (0), occlusion (1) and landmarked
+    // region (2) layers.
+    void SetLayerAlpha(int layer, float alpha)
+    {
+        if (layer >= 0 && layer < 3)
+        {
+            m_layerAlpha[layer] = std::clamp(alpha, 0.0f, 1.0f);
+            Refresh(false);
+        }
+    }
+
+    void SetScale(double scale)
+    {
+        m_scale = std::clamp(scale, 0.01, 64.0);
+        ClampOffset();
+        Refresh(false);
+    }
+
+    double GetScale() const
+    {
+        return m_scale;
+    }
+
+    // Called when the scale is changed with the mouse wheel.
+    void BindScale(void* owner, void (*onScaleBinding)(void*, double))
+    {
+        m_scaleOwner = owner;
+        m_onScaleBinding = onScaleBinding;
+    }
+
+    // Creates the context and the shader program on first use; returns false
+    // if OpenGL 2.1 is not available, see GetError.
+    bool IsSupported()
+    {
+        return EnsureInitialized();
+    }
+
+    const std::string& GetError() const
+    {
+        return m_error;
+    }
+
+private:
+    bool EnsureInitialized()
+    {
+        if (m_initialized)
+        {
+            return m_program != 0;
+        }
+        if (!IsShownOnScreen())
+        {
+            return false;
+        }
+        m_initialized = true;
+
+        m_context = new wxGLContext(this);
+        if (!m_context->IsOK() || !SetCurrent(*m_context))
+        {
+            m_error = "Cannot create an OpenGL context.";
+            return false;
+        }
+        if (!OFIQLoadGLFunctions())
+        {
+            m_error = "OpenGL 2.1 is not available.";
+            return false;
+        }
+
+        const char* vertexSource =
+            "#version 120\n"
+            "varying vec2 uv;\n"
+            "void main()\n"
+            "{\n"
+            "    uv = gl_MultiTexCoord0.xy;\n"
+            "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+            "}\n";
+        const char* fragmentSource =
+            "#version 120\n"
+            "uniform sampler2D image;\n"
+            "uniform sampler2D segmentation;\n"
+            "uniform sampler2D occlusion;\n"
+            "uniform sampler2D region;\n"
+            "uniform sampler2D palette;\n"
+            "uniform float showOriginal;\n"
+            "uniform float segmentationAlpha;\n"
+            "uniform float occlusionAlpha;\n"
+            "uniform float regionAlpha;\n"
+            "varying vec2 uv;\n"
+            "void main()\n"
+            "{\n"
+            "    vec3 color = mix(vec3(1.0), texture2D(image, uv).rgb, showOriginal);\n"
+            "    float label = floor(texture2D(segmentation, uv).r * 255.0 + 0.5);\n"
+            "    vec3 labelColor = texture2D(palette, vec2((label + 0.5) / 256.0, 0.5)).rgb;\n"
+            "    color = mix(color, labelColor, segmentationAlpha);\n"
+            "    float occluded = step(0.5 / 255.0, texture2D(occlusion, uv).r);\n"
+            "    color = mix(color, mix(vec3(1.0), vec3(1.0, 0.0, 0.0), occluded), occlusionAlpha);\n"
+            "    float inRegion = step(0.5 / 255.0, texture2D(region, uv).r);\n"
+            "    color = mix(color, mix(vec3(1.0), vec3(0.0, 0.0, 1.0), inRegion), regionAlpha);\n"
+            "    gl_FragColor = vec4(color, 1.0);\n"
+            "}\n";
+
+        GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+        GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+        if (vertexShader != 0 && fragmentShader != 0)
+        {
+            m_program = glCreateProgram();
+            glAttachShader(m_program, vertexShader);
+            glAttachShader(m_program, fragmentShader);
+            glLinkProgram(m_program);
+            GLint linked = 0;
+            glGetProgramiv(m_program, GL_LINK_STATUS, &linked);
+            if (!linked)
+            {
+                m_error = "Linking the shader program failed: " + GetInfoLog(m_program, false);
+                glDeleteProgram(m_program);
+                m_program = 0;
+            }
+        }
+        if (vertexShader != 0)
+        {
+            glDeleteShader(vertexShader);
+        }
+        if (fragmentShader != 0)
+        {
+            glDeleteShader(fragmentShader);
+        }
+        if (m_program == 0)
+        {
+            return false;
+        }
+
+        CreatePalette();
+        return true;
+    }
+
+    GLuint CompileShader(GLenum type, const char* source)
+    {
+        GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        GLint compiled = 0;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled)
+        {
+            m_error = "Compiling a shader failed: " + GetInfoLog(shader, true);
+            glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    static std::string GetInfoLog(GLuint object, bool isShader)
+    {
+        GLint length = 0;
+        if (isShader)
+        {
+            glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+        }
+        else
+        {
+            glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+        }
+        std::vector<GLchar> log(static_cast<size_t>(std::max(length, 1)), '\0');
+        if (isShader)
+        {
+            glGetShaderInfoLog(object, static_cast<GLsizei>(log.size()), nullptr, log.data());
+        }
+        else
+        {
+            glGetProgramInfoLog(object, static_cast<GLsizei>(log.size()), nullptr, log.data());
+        }
+        return std::string(log.data());
+    }
+
+    // The colours of the face parsing labels, see
+    // OFIQOverlayRenderer::GetSegmentationColor.
+    void CreatePalette()
+    {
+        std::vector<uint8_t> palette(256 * 3);
+        for (int label = 0; label < 256; label++)
+        {
+            cv::Vec3b color = OFIQOverlayRenderer::GetSegmentationColor(static_cast<uint8_t>(label));
+            palette[label * 3 + 0] = color[2];
+            palette[label * 3 + 1] = color[1];
+            palette[label * 3 + 2] = color[0];
+        }
+        m_paletteTexture = CreateTexture(256, 1, GL_RGB, palette.data(), GL_NEAREST);
+    }
+
+    static GLuint CreateTexture(int width, int height, GLenum format, const uint8_t* data, GLint filter)
+    {
+        GLuint texture = 0;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        return texture;
+    }
+
+    // Uploads an 8-bit single or three channel image, reduced if it exceeds
+    // the maximum texture size of the driver.
+    GLuint UploadImage(const uint8_t* data, int channels, bool isLabel)
+    {
+        cv::Mat source(m_height, m_width, channels == 3 ? CV_8UC3 : CV_8UC1, const_cast<uint8_t*>(data));
+        cv::Mat upload = source;
+        if (m_uploadScale < 1.0)
+        {
+            cv::resize(source, upload, cv::Size(), m_uploadScale, m_uploadScale, isLabel ? cv::INTER_NEAREST : cv::INTER_AREA);
+        }
+        GLenum format = channels == 3 ? GL_RGB : GL_LUMINANCE;
+        return CreateTexture(upload.cols, upload.rows, format, upload.ptr<uint8_t>(0), isLabel ? GL_NEAREST : GL_LINEAR);
+    }
+
+    void ReleaseTextures()
+    {
+        if (m_imageTexture != 0)
+        {
+            glDeleteTextures(1, &m_imageTexture);
+            m_imageTexture = 0;
+        }
+        for (auto& texture : m_maskTextures)
+        {
+            if (texture != 0)
+            {
+                glDeleteTextures(1, &texture);
+                texture = 0;
+            }
+        }
+    }
+
+    void UploadTextures()
+    {
+        if (m_imageDirty)
+        {
+            GLint maxSize = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            int longEdge = std::max<int>(m_width, m_height);
+            m_uploadScale = (maxSize > 0 && longEdge > maxSize) ? static_cast<double>(maxSize) / longEdge : 1.0;
+
+            if (m_imageTexture != 0)
+            {
+                glDeleteTextures(1, &m_imageTexture);
+                m_imageTexture = 0;
+            }
+            if (m_image.data != nullptr)
+            {
+                m_imageTexture = UploadImage(m_image.data.get(), m_image.depth / 8, false);
+            }
+            m_imageDirty = false;
+        }
+        if (m_masksDirty)
+        {
+            const std::shared_ptr<uint8_t>* masks[3] = {
+                &m_preprocessing.m_segmentationMaskPtr,
+                &m_preprocessing.m_occlusionMaskPtr,
+                &m_preprocessing.m_landmarkedRegionPtr };
+            for (int i = 0; i < 3; i++)
+            {
+                if (m_maskTextures[i] != 0)
+                {
+                    glDeleteTextures(1, &m_maskTextures[i]);
+                    m_maskTextures[i] = 0;
+                }
+                if (*masks[i] != nullptr)
+                {
+                    m_maskTextures[i] = UploadImage(masks[i]->get(), 1, true);
+                }
+            }
+            m_masksDirty = false;
+        }
+    }
+
+    void OnPaint(wxPaintEvent& event)
+    {
+        wxPaintDC dc(this);
+        if (!EnsureInitialized())
+        {
+            return;
+        }
+        SetCurrent(*m_context);
+        UploadTextures();
+
+        const wxSize size = GetClientSize();
+        const double contentScale = GetContentScaleFactor();
+        glViewport(0, 0, static_cast<GLsizei>(size.x * contentScale), static_cast<GLsizei>(size.y * contentScale));
+        glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        if (m_imageTexture != 0 || m_width > 0)
+        {
+            // Image coordinates: the view shows the image from the offset on,
+            // one image pixel covering m_scale window pixels.
+            glMatrixMode(GL_PROJECTION);
+            glLoadIdentity();
+            glOrtho(0.0, size.x, size.y, 0.0, -1.0, 1.0);
+            glMatrixMode(GL_MODELVIEW);
+            glLoadIdentity();
+            glTranslated(-m_offsetX, -m_offsetY, 0.0);
+            glScaled(m_scale, m_scale, 1.0);
+
+            DrawImage();
+            DrawGeometry();
+        }
+
+        glFlush();
+        SwapBuffers();
+    }
+
+    void DrawImage()
+    {
+        glUseProgram(m_program);
+        GLuint textures[5] = { m_imageTexture, m_maskTextures[0], m_maskTextures[1], m_maskTextures[2], m_paletteTexture };
+        const char* names[5] = { "image", "segmentation", "occlusion", "region", "palette" };
+        for (int i = 0; i < 5; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glUniform1i(glGetUniformLocation(m_program, names[i]), i);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        bool showOriginal = m_options.original && m_imageTexture != 0;
+        glUniform1f(glGetUniformLocation(m_program, "showOriginal"), showOriginal ? 1.0f : 0.0f);
+        bool enabled[3] = { m_options.segmentationMask, m_options.occlusionMask, m_options.landmarkedRegion };
+        const char* alphaNames[3] = { "segmentationAlpha", "occlusionAlpha", "regionAlpha" };
+        for (int i = 0; i < 3; i++)
+        {
+            float alpha = (enabled[i] && m_maskTextures[i] != 0) ? m_layerAlpha[i] : 0.0f;
+            glUniform1f(glGetUniformLocation(m_program, alphaNames[i]), alpha);
+        }
+
+        glBegin(GL_QUADS);
+        glTexCoord2f(0.0f, 0.0f);
+        glVertex2f(0.0f, 0.0f);
+        glTexCoord2f(1.0f, 0.0f);
+        glVertex2f(static_cast<float>(m_width), 0.0f);
+        glTexCoord2f(1.0f, 1.0f);
+        glVertex2f(static_cast<float>(m_width), static_cast<float>(m_height));
+        glTexCoord2f(0.0f, 1.0f);
+        glVertex2f(0.0f, static_cast<float>(m_height));
+        glEnd();
+        glUseProgram(0);
+    }
+
+    // Face boxes and landmarks with the colours of OFIQOverlayRenderer. Line
+    // width and point size are given in window pixels, so they stay readable
+    // at every zoom level.
+    void DrawGeometry()
+    {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        if (m_options.faces)
+        {
+            glColor3ub(255, 0, 0);
+            glLineWidth(2.0f);
+            for (const auto& face : m_preprocessing.m_faces)
+            {
+                glBegin(GL_LINE_LOOP);
+                glVertex2f(face.xleft, face.ytop);
+                glVertex2f(face.xleft + face.width, face.ytop);
+                glVertex2f(face.xleft + face.width, face.ytop + face.height);
+                glVertex2f(face.xleft, face.ytop + face.height);
+                glEnd();
+            }
+        }
+        if (m_options.landmarks)
+        {
+            const auto& landmarks = m_preprocessing.m_landmarks.landmarks;
+            glPointSize(4.0f);
+            glBegin(GL_POINTS);
+            for (size_t i = 0; i < landmarks.size(); i++)
+            {
+                cv::Vec3b color = OFIQOverlayRenderer::GetLandmarkColor(i);
+                glColor3ub(color[2], color[1], color[0]);
+                glVertex2f(landmarks[i].x + 0.5f, landmarks[i].y + 0.5f);
+            }
+            glEnd();
+        }
+        glColor3ub(255, 255, 255);
+    }
+
+    void OnMouseWheel(wxMouseEvent& event)
+    {
+        // Zoom around the position of the mouse.
+        double factor = event.GetWheelRotation() > 0 ? 1.1 : 1.0 / 1.1;
+        wxPoint position = event.GetPosition();
+        double imageX = (position.x + m_offsetX) / m_scale;
+        double imageY = (position.y + m_offsetY) / m_scale;
+        m_scale = std::clamp(m_scale * factor, 0.01, 64.0);
+        m_offsetX = imageX * m_scale - position.x;
+        m_offsetY = imageY * m_scale - position.y;
+        ClampOffset();
+        Refresh(false);
+        if (m_onScaleBinding != nullptr)
+        {
+            (m_onScaleBinding)(m_scaleOwner, m_scale);
+        }
+    }
+
+    void OnMouse(wxMouseEvent& event)
+    {
+        if (event.LeftDown() || event.MiddleDown())
+        {
+            m_dragging = true;
+            m_dragStart = event.GetPosition();
+            CaptureMouse();
+        }
+        else if ((event.LeftUp() || event.MiddleUp()) && m_dragging)
+        {
+            m_dragging = false;
+            if (HasCapture())
+            {
+                ReleaseMouse();
+            }
+        }
+        else if (event.Dragging() && m_dragging)
+        {
+            wxPoint position = event.GetPosition();
+            m_offsetX -= position.x - m_dragStart.x;
+            m_offsetY -= position.y - m_dragStart.y;
+            m_dragStart = position;
+            ClampOffset();
+            Refresh(false);
+        }
+        event.Skip();
+    }
+
+    void ClampOffset()
+    {
+        const wxSize size = GetClientSize();
+        double maxX = std::max(0.0, m_width * m_scale - size.x);
+        double maxY = std::max(0.0, m_height * m_scale - size.y);
+        m_offsetX = std::clamp(m_offsetX, 0.0, maxX);
+        m_offsetY = std::clamp(m_offsetY, 0.0, maxY);
+    }
+
+    wxGLContext* m_context;
+    bool m_initialized;
+    std::string m_error;
+    GLuint m_program;
+    GLuint m_imageTexture;
+    GLuint m_maskTextures[3];
+    GLuint m_paletteTexture;
+    float m_layerAlpha[3];
+
+    OFIQ::Image m_image;
+    OFIQ::FaceImageQualityPreprocessingResult m_preprocessing;
+    OFIQOverlayOptions m_options;
+    uint16_t m_width;
+    uint16_t m_height;
+    bool m_imageDirty = false;
+    bool m_masksDirty = false;
+    double m_uploadScale;
+
+    double m_scale;
+    double m_offsetX;
+    double m_offsetY;
+    bool m_dragging;
+    wxPoint m_dragStart;
+    void* m_scaleOwner;
+    void (*m_onScaleBinding)(void*, double);
+};
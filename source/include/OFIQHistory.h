@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <OFIQSession.h>
+
+
+// The images recently shown in the image view, with their assessments, so
+// that going back to an image does not need OFIQ again. Every entry is kept
+// in the binary session layout (see OFIQSession): scores, faces and
+// landmarks take a few hundred bytes and the masks are run-length coded.
+// The image itself is not kept and is read from its file again.
+//
+// Navigation works like in a web browser: visiting an image drops the
+// entries ahead of the current one. The oldest entries are dropped when
+// there are more than maxEntries or they take more than maxBytes.
+class OFIQHistory
+{
+public:
+    explicit OFIQHistory(size_t maxEntries = 50, size_t maxBytes = 64 * 1024 * 1024)
+        : m_maxEntries(std::max<size_t>(1, maxEntries))
+        , m_maxBytes(maxBytes)
+        , m_current(0)
+        , m_bytes(0)
+    {
+        ;
+    }
+
+    // Adds a newly shown image after the current entry.
+    void Visit(const OFIQSessionData& session)
+    {
+        while (m_entries.size() > (m_entries.empty() ? 0 : m_current + 1))
+        {
+            m_bytes -= m_entries.back().GetBytes();
+            m_entries.pop_back();
+        }
+        m_entries.emplace_back();
+        m_bytes += m_entries.back().GetBytes();
+        m_current = m_entries.size() - 1;
+        Store(m_entries.back(), session);
+        Trim();
+    }
+
+    // Stores the current state of the image of the current entry, e.g.
+    // after it has been assessed.
+    void Update(const OFIQSessionData& session)
+    {
+        if (m_entries.empty() || m_entries[m_current].imagePath != session.imagePath)
+        {
+            return;
+        }
+        Store(m_entries[m_current], session);
+        Trim();
+    }
+
+    // Whether there is an entry offset steps from the current one, -1 being
+    // back and 1 forward.
+    bool CanGo(int offset) const
+    {
+        long long target = static_cast<long long>(m_current) + offset;
+        return !m_entries.empty() && target >= 0 && target < static_cast<long long>(m_entries.size());
+    }
+
+    // Decodes the entry offset steps away from the current one, without
+    // moving to it. imageChanged tells that the image file has been modified
+    // since the entry was stored; its assessment no longer applies then.
+    // Call Move once the entry has been shown, so that the position stays on
+    // the image shown if that fails.
+    bool Peek(int offset, OFIQSessionData& session, bool& imageChanged, std::string& error) const
+    {
+        if (!CanGo(offset))
+        {
+            error = offset < 0 ? "No previous image." : "No next image.";
+            return false;
+        }
+        const Entry& entry = m_entries[m_current + offset];
+        if (!OFIQSession::Decode(entry.data.data(), entry.data.size(), session, error))
+        {
+            return false;
+        }
+        std::filesystem::file_time_type modified;
+        imageChanged = !GetModified(entry.imagePath, modified) || modified != entry.modified;
+        return true;
+    }
+
+    // Makes the entry offset steps away the current one.
+    void Move(int offset)
+    {
+        if (CanGo(offset))
+        {
+            m_current += offset;
+        }
+    }
+
+    // Position of the current entry, 1-based, and number of entries.
+    size_t GetPosition() const
+    {
+        return m_entries.empty() ? 0 : m_current + 1;
+    }
+
+    size_t GetCount() const
+    {
+        return m_entries.size();
+    }
+
+    // Memory taken by all entries.
+    size_t GetBytes() const
+    {
+        return m_bytes;
+    }
+
+private:
+    struct Entry
+    {
+        std::string imagePath;
+        std::filesystem::file_time_type modified;
+        std::vector<uint8_t> data;
+
+        size_t GetBytes() const
+        {
+            return sizeof(Entry) + imagePath.capacity() + data.capacity();
+        }
+    };
+
+    static bool GetModified(const std::string& path, std::filesystem::file_time_type& modified)
+    {
+        std::error_code ec;
+        modified = std::filesystem::last_write_time(path, ec);
+        return !ec;
+    }
+
+    void Store(Entry& entry, const OFIQSessionData& session)
+    {
+        m_bytes -= entry.GetBytes();
+        entry.imagePath = session.imagePath;
+        GetModified(session.imagePath, entry.modified);
+        entry.data = OFIQSession::Encode(session);
+        entry.data.shrink_to_fit();
+        m_bytes += entry.GetBytes();
+    }
+
+    // Drops the oldest entries, but never the current one.
+    void Trim()
+    {
+        while (m_current > 0 && (m_entries.size() > m_maxEntries || m_bytes > m_maxBytes))
+        {
+            m_bytes -= m_entries.front().GetBytes();
+            m_entries.pop_front();
+            m_current--;
+        }
+    }
+
+    size_t m_maxEntries;
+    size_t m_maxBytes;
+    std::deque<Entry> m_entries;
+    size_t m_current;
+    size_t m_bytes;
+};
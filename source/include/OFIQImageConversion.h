@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQBufferPool.h>
+
+
+// Conversions between OpenCV images (BGR or grey) and OFIQ images (RGB or grey).
+class OFIQImageConversion
+{
+public:
+    // Copies a decoded 8-bit image into an OFIQ image. The pixels are held in
+    // a buffer of OFIQBufferPool.
+    static bool ToOfiqImage(const cv::Mat& cvImage, OFIQ::Image& image)
+    {
+        if (cvImage.empty() || cvImage.depth() != CV_8U
+            || cvImage.cols > UINT16_MAX || cvImage.rows > UINT16_MAX)
+        {
+            return false;
+        }
+
+        cv::Mat converted;
+        if (cvImage.channels() == 3 || cvImage.channels() == 4)
+        {
+            converted = OFIQBufferPool::Get().CreateMat(cvImage.rows, cvImage.cols, CV_8UC3);
+        }
+        switch (cvImage.channels())
+        {
+        case 1:
+            converted = cvImage;
+            break;
+        case 3:
+            cv::cvtColor(cvImage, converted, cv::COLOR_BGR2RGB);
+            break;
+        case 4:
+            cv::cvtColor(cvImage, converted, cv::COLOR_BGRA2RGB);
+            break;
+        default:
+            return false;
+        }
+
+        size_t rowBytes = static_cast<size_t>(converted.cols) * converted.channels();
+        std::shared_ptr<uint8_t> data = OFIQBufferPool::Get().Acquire(rowBytes * converted.rows);
+        for (int y = 0; y < converted.rows; y++)
+        {
+            memcpy(data.get() + y * rowBytes, converted.ptr(y), rowBytes);
+        }
+
+        image = OFIQ::Image(
+            static_cast<uint16_t>(converted.cols),
+            static_cast<uint16_t>(converted.rows),
+            static_cast<uint8_t>(8 * converted.channels()),
+            data);
+        return true;
+    }
+
+    // Decodes an encoded image (JPEG, PNG, ...) held in memory.
+    static bool Decode(const std::vector<uint8_t>& bytes, OFIQ::Image& image)
+    {
+        if (bytes.empty())
+        {
+            return false;
+        }
+        cv::Mat encoded(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<uint8_t*>(bytes.data()));
+        cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_ANYCOLOR);
+        return ToOfiqImage(decoded, image);
+    }
+
+    // Wraps the pixels of an OFIQ image without copying.
+    static cv::Mat WrapOfiqImage(const OFIQ::Image& image)
+    {
+        int channels = image.depth / 8;
+        return cv::Mat(image.height, image.width, channels == 3 ? CV_8UC3 : CV_8UC1, image.data.get());
+    }
+};
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// A minimal JSON value used for the reports and requests of the headless modes.
+// Objects keep the insertion order of their members. The parser also accepts
+// comments (// and /* */) so that it can read JAXN files such as ofiq_config.jaxn
+// as long as they stick to plain JSON values.
+class OFIQJsonValue
+{
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    OFIQJsonValue() : m_type(Type::Null), m_bool(false), m_number(0.0) {}
+    OFIQJsonValue(bool value) : m_type(Type::Bool), m_bool(value), m_number(0.0) {}
+    OFIQJsonValue(double value) : m_type(Type::Number), m_bool(false), m_number(value) {}
+    OFIQJsonValue(int value) : m_type(Type::Number), m_bool(false), m_number(value) {}
+    OFIQJsonValue(size_t value) : m_type(Type::Number), m_bool(false), m_number(static_cast<double>(value)) {}
+    OFIQJsonValue(const std::string& value) : m_type(Type::String), m_bool(false), m_number(0.0), m_string(value) {}
+    OFIQJsonValue(const char* value) : m_type(Type::String), m_bool(false), m_number(0.0), m_string(value) {}
+
+    static OFIQJsonValue Array()
+    {
+        OFIQJsonValue value;
+        value.m_type = Type::Array;
+        return value;
+    }
+
+    static OFIQJsonValue Object()
+    {
+        OFIQJsonValue value;
+        value.m_type = Type::Object;
+        return value;
+    }
+
+    Type GetType() const { return m_type; }
+    bool IsNull() const { return m_type == Type::Null; }
+    bool IsNumber() const { return m_type == Type::Number; }
+    bool IsString() const { return m_type == Type::String; }
+    bool IsObject() const { return m_type == Type::Object; }
+    bool IsArray() const { return m_type == Type::Array; }
+
+    bool AsBool(bool defaultValue = false) const { return m_type == Type::Bool ? m_bool : defaultValue; }
+    double AsNumber(double defaultValue = 0.0) const { return m_type == Type::Number ? m_number : defaultValue; }
+    const std::string& AsString() const { return m_string; }
+
+    // Array access
+    size_t Size() const { return m_type == Type::Object ? m_members.size() : m_items.size(); }
+    const OFIQJsonValue& At(size_t index) const { return m_items.at(index); }
+    OFIQJsonValue& Append(const OFIQJsonValue& value)
+    {
+        m_type = Type::Array;
+        m_items.push_back(value);
+        return m_items.back();
+    }
+
+    // Object access
+    const std::vector<std::pair<std::string, OFIQJsonValue>>& GetMembers() const { return m_members; }
+
+    bool Has(const std::string& key) const
+    {
+        return Find(key) != nullptr;
+    }
+
+    // Returns the member with the given key or a null value if there is none.
+    const OFIQJsonValue& Get(const std::string& key) const
+    {
+        static const OFIQJsonValue nullValue;
+        auto member = Find(key);
+        return member != nullptr ? *member : nullValue;
+    }
+
+    // Follows a dot separated path, e.g. "params.measures.Sharpness".
+    const OFIQJsonValue& GetPath(const std::string& path) const
+    {
+        const OFIQJsonValue* current = this;
+        size_t begin = 0;
+        while (begin <= path.size())
+        {
+            size_t end = path.find('.', begin);
+            if (end == std::string::npos)
+            {
+                end = path.size();
+            }
+            current = &current->Get(path.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return *current;
+    }
+
+    OFIQJsonValue& Set(const std::string& key, const OFIQJsonValue& value)
+    {
+        m_type = Type::Object;
+        for (auto& member : m_members)
+        {
+            if (member.first == key)
+            {
+                member.second = value;
+                return member.second;
+            }
+        }
+        m_members.emplace_back(key, value);
+        return m_members.back().second;
+    }
+
+    std::string ToString(bool pretty = true) const
+    {
+        std::ostringstream stream;
+        Write(stream, pretty, 0);
+        if (pretty)
+        {
+            stream << "\n";
+        }
+        return stream.str();
+    }
+
+    bool SaveToFile(const std::string& path, bool pretty = true) const
+    {
+        std::ofstream stream(path.c_str());
+        if (!stream.is_open())
+        {
+            return false;
+        }
+        stream << ToString(pretty);
+        return stream.good();
+    }
+
+    static bool Parse(const std::string& text, OFIQJsonValue& value, std::string& error)
+    {
+        size_t position = 0;
+        try
+        {
+            value = ParseValue(text, position);
+            SkipWhitespace(text, position);
+            if (position != text.size())
+            {
+                throw std::runtime_error("unexpected trailing characters");
+            }
+        }
+        catch (const std::exception& e)
+        {
+            error = std::string(e.what()) + " at offset " + std::to_string(position);
+            return false;
+        }
+        return true;
+    }
+
+    static bool LoadFromFile(const std::string& path, OFIQJsonValue& value, std::string& error)
+    {
+        std::ifstream stream(path.c_str(), std::ios::binary);
+        if (!stream.is_open())
+        {
+            error = "cannot open '" + path + "'";
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << stream.rdbuf();
+        return Parse(buffer.str(), value, error);
+    }
+
+    static std::string Escape(const std::string& text)
+    {
+        std::string escaped;
+        escaped.reserve(text.size() + 2);
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\r': escaped += "\\r"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                }
+                else
+                {
+                    escaped += c;
+                }
+            }
+        }
+        return escaped;
+    }
+
+private:
+    const OFIQJsonValue* Find(const std::string& key) const
+    {
+        for (const auto& member : m_members)
+        {
+            if (member.first == key)
+            {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+
+    void Write(std::ostream& stream, bool pretty, int indent) const
+    {
+        const std::string newline = pretty ? "\n" : "";
+        const std::string innerIndent = pretty ? std::string(2 * (indent + 1), ' ') : "";
+        const std::string outerIndent = pretty ? std::string(2 * indent, ' ') : "";
+
+        switch (m_type)
+        {
+        case Type::Null:
+            stream << "null";
+            break;
+        case Type::Bool:
+            stream << (m_bool ? "true" : "false");
+            break;
+        case Type::Number:
+            if (std::isfinite(m_number))
+            {
+                char buffer[32];
+                snprintf(buffer, sizeof(buffer), "%.10g", m_number);
+                stream << buffer;
+            }
+            else
+            {
+                stream << "null";
+            }
+            break;
+        case Type::String:
+            stream << '"' << Escape(m_string) << '"';
+            break;
+        case Type::Array:
+            stream << "[";
+            for (size_t i = 0; i < m_items.size(); i++)
+            {
+                stream << (i == 0 ? "" : ",") << newline << innerIndent;
+                m_items[i].Write(stream, pretty, indent + 1);
+            }
+            stream << (m_items.empty() ? "" : newline + outerIndent) << "]";
+            break;
+        case Type::Object:
+            stream << "{";
+            for (size_t i = 0; i < m_members.size(); i++)
+            {
+                stream << (i == 0 ? "" : ",") << newline << innerIndent;
+                stream << '"' << Escape(m_members[i].first) << "\":" << (pretty ? " " : "");
+                m_members[i].second.Write(stream, pretty, indent + 1);
+            }
+            stream << (m_members.empty() ? "" : newline + outerIndent) << "}";
+            break;
+        }
+    }
+
+    static void SkipWhitespace(const std::string& text, size_t& position)
+    {
+        while (position < text.size())
+        {
+            char c = text[position];
+            if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+            {
+                position++;
+            }
+            else if (c == '/' && position + 1 < text.size() && text[position + 1] == '/')
+            {
+                position = text.find('\n', position);
+                if (position == std::string::npos)
+                {
+                    position = text.size();
+                }
+            }
+            else if (c == '/' && position + 1 < text.size() && text[position + 1] == '*')
+            {
+                position = text.find("*/", position + 2);
+                if (position == std::string::npos)
+                {
+                    throw std::runtime_error("unterminated comment");
+                }
+                position += 2;
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+
+    static std::string ParseString(const std::string& text, size_t& position)
+    {
+        char quote = text[position++];
+        std::string result;
+        while (position < text.size() && text[position] != quote)
+        {
+            char c = text[position++];
+            if (c == '\\' && position < text.size())
+            {
+                char e = text[position++];
+                switch (e)
+                {
+                case 'n': result += '\n'; break;
+                case 'r': result += '\r'; break;
+                case 't': result += '\t'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'u':
+                {
+                    if (position + 4 > text.size())
+                    {
+                        throw std::runtime_error("invalid unicode escape");
+                    }
+                    unsigned long code = std::strtoul(text.substr(position, 4).c_str(), nullptr, 16);
+                    position += 4;
+                    if (code < 0x80)
+                    {
+                        result += static_cast<char>(code);
+                    }
+                    else if (code < 0x800)
+                    {
+                        result += static_cast<char>(0xc0 | (code >> 6));
+                        result += static_cast<char>(0x80 | (code & 0x3f));
+                    }
+                    else
+                    {
+                        result += static_cast<char>(0xe0 | (code >> 12));
+                        result += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                        result += static_cast<char>(0x80 | (code & 0x3f));
+                    }
+                    break;
+                }
+                default: result += e; break;
+                }
+            }
+            else
+            {
+                result += c;
+            }
+        }
+        if (position >= text.size())
+        {
+            throw std::runtime_error("unterminated string");
+        }
+        position++;
+        return result;
+    }
+
+    static OFIQJsonValue ParseValue(const std::string& text, size_t& position)
+    {
+        SkipWhitespace(text, position);
+        if (position >= text.size())
+        {
+            throw std::runtime_error("unexpected end of input");
+        }
+
+        char c = text[position];
+        if (c == '{')
+        {
+            OFIQJsonValue object = Object();
+            position++;
+            SkipWhitespace(text, position);
+            while (position < text.size() && text[position] != '}')
+            {
+                std::string key;
+                if (text[position] == '"' || text[position] == '\'')
+                {
+                    key = ParseString(text, position);
+                }
+                else
+                {
+                    // JAXN allows unquoted identifiers as keys.
+                    size_t begin = position;
+                    while (position < text.size() && (isalnum(static_cast<unsigned char>(text[position])) || text[position] == '_'))
+                    {
+                        position++;
+                    }
+                    if (begin == position)
+                    {
+                        throw std::runtime_error("expected object key");
+                    }
+                    key = text.substr(begin, position - begin);
+                }
+                SkipWhitespace(text, position);
+                if (position >= text.size() || text[position] != ':')
+                {
+                    throw std::runtime_error("expected ':'");
+                }
+                position++;
+                object.Set(key, ParseValue(text, position));
+                SkipWhitespace(text, position);
+                if (position < text.size() && text[position] == ',')
+                {
+                    position++;
+                    SkipWhitespace(text, position);
+                }
+            }
+            if (position >= text.size())
+            {
+                throw std::runtime_error("unterminated object");
+            }
+            position++;
+            return object;
+        }
+        if (c == '[')
+        {
+            OFIQJsonValue array = Array();
+            position++;
+            SkipWhitespace(text, position);
+            while (position < text.size() && text[position] != ']')
+            {
+                array.Append(ParseValue(text, position));
+                SkipWhitespace(text, position);
+                if (position < text.size() && text[position] == ',')
+                {
+                    position++;
+                    SkipWhitespace(text, position);
+                }
+            }
+            if (position >= text.size())
+            {
+                throw std::runtime_error("unterminated array");
+            }
+            position++;
+            return array;
+        }
+        if (c == '"' || c == '\'')
+        {
+            return OFIQJsonValue(ParseString(text, position));
+        }
+        if (text.compare(position, 4, "true") == 0)
+        {
+            position += 4;
+            return OFIQJsonValue(true);
+        }
+        if (text.compare(position, 5, "false") == 0)
+        {
+            position += 5;
+            return OFIQJsonValue(false);
+        }
+        if (text.compare(position, 4, "null") == 0)
+        {
+            position += 4;
+            return OFIQJsonValue();
+        }
+
+        const char* begin = text.c_str() + position;
+        char* end = nullptr;
+        double number = std::strtod(begin, &end);
+        if (end == begin)
+        {
+            throw std::runtime_error("unexpected character");
+        }
+        position += static_cast<size_t>(end - begin);
+        return OFIQJsonValue(number);
+    }
+
+    Type m_type;
+    bool m_bool;
+    double m_number;
+    std::string m_string;
+    std::vector<OFIQJsonValue> m_items;
+    std::vector<std::pair<std::string, OFIQJsonValue>> m_members;
+};
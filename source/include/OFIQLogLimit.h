@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+
+// Keeps a log within a size limit by dropping its oldest lines, so that the
+// log of a GUI that runs for days does not grow without bounds. Once the log
+// exceeds the limit, it is cut back to three quarters of it, so that lines
+// are not dropped one by one with every new line.
+class OFIQLogLimit
+{
+public:
+    // Default limit of the log window in characters.
+    static constexpr size_t defaultMaxCharacters = 1024 * 1024;
+
+    // Number of leading characters to remove from the log text, 0 while it
+    // is within maxCharacters. The cut is made after a line break.
+    static size_t GetTrimLength(const std::string& text, size_t maxCharacters)
+    {
+        if (text.size() <= maxCharacters)
+        {
+            return 0;
+        }
+        size_t cut = text.size() - maxCharacters / 4 * 3;
+        size_t lineEnd = text.find('\n', cut);
+        return lineEnd == std::string::npos ? text.size() : lineEnd + 1;
+    }
+
+    // Appends a line to a log kept in a string.
+    static void Append(std::string& text, const std::string& line, size_t maxCharacters)
+    {
+        text += line;
+        text += '\n';
+        text.erase(0, GetTrimLength(text, maxCharacters));
+    }
+};
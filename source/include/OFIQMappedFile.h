@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// A read-only memory mapping of a whole file.
+class OFIQMappedFile
+{
+public:
+    OFIQMappedFile()
+        : m_data(nullptr)
+        , m_size(0)
+    {
+        ;
+    }
+
+    ~OFIQMappedFile()
+    {
+        Close();
+    }
+
+    OFIQMappedFile(const OFIQMappedFile&) = delete;
+    OFIQMappedFile& operator=(const OFIQMappedFile&) = delete;
+
+    bool Open(const std::string& path, std::string& error)
+    {
+        Close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &size))
+        {
+            error = "Cannot open '" + path + "'";
+            if (file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file);
+            }
+            return false;
+        }
+        m_size = static_cast<size_t>(size.QuadPart);
+        if (m_size > 0)
+        {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping != nullptr)
+            {
+                m_data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0)
+        {
+            error = "Cannot open '" + path + "': " + strerror(errno);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return false;
+        }
+        m_size = static_cast<size_t>(status.st_size);
+        if (m_size > 0)
+        {
+            void* data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            m_data = data == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(data);
+        }
+        close(fd);
+#endif
+        if (m_size > 0 && m_data == nullptr)
+        {
+            error = "Cannot map '" + path + "'";
+            m_size = 0;
+            return false;
+        }
+        return true;
+    }
+
+    void Close()
+    {
+        if (m_data != nullptr)
+        {
+#if defined(_WIN32)
+            UnmapViewOfFile(m_data);
+#else
+            munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+        }
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const uint8_t* GetData() const
+    {
+        return m_data;
+    }
+
+    size_t GetSize() const
+    {
+        return m_size;
+    }
+
+private:
+    const uint8_t* m_data;
+    size_t m_size;
+};
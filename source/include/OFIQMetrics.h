@@ -0,0 +1,543 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <OFIQBufferPool.h>
+#include <OFIQCommandLine.h>
+#include <OFIQProcessMemory.h>
+
+
+// Processing stages timed per image.
+enum class OFIQStage
+{
+    Decode = 0,
+    Assess,
+    Render,
+    Encode,
+    Export
+};
+
+constexpr size_t OFIQStageCount = 5;
+
+inline const char* GetStageName(OFIQStage stage)
+{
+    static const char* names[OFIQStageCount] = { "decode", "assess", "render", "encode", "export" };
+    return names[static_cast<size_t>(stage)];
+}
+
+// Process-wide counters and histograms in the Prometheus text format.
+//
+// Recording is cheap: every thread accumulates into a shard of its own, which
+// only that thread writes, so recording needs neither locks nor atomic
+// read-modify-write operations. Rendering sums the shards. Shards are kept
+// when their thread ends, so counters never go backwards. Gauges such as
+// queue depths are sampled from functions registered with OFIQMetricsGauge.
+class OFIQMetrics
+{
+public:
+    // Upper bounds of the latency histogram buckets in seconds.
+    static constexpr std::array<double, 14> bucketBounds = {
+        0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0
+    };
+
+    static OFIQMetrics& Get()
+    {
+        static OFIQMetrics metrics;
+        return metrics;
+    }
+
+    void AddImage(bool success)
+    {
+        Shard& shard = GetShard();
+        Increment(shard.processed, 1);
+        if (!success)
+        {
+            Increment(shard.failed, 1);
+        }
+    }
+
+    void ObserveStage(OFIQStage stage, double seconds)
+    {
+        Histogram& histogram = GetShard().stages[static_cast<size_t>(stage)];
+        size_t bucket = 0;
+        while (bucket < bucketBounds.size() && seconds > bucketBounds[bucket])
+        {
+            bucket++;
+        }
+        Increment(histogram.buckets[bucket], 1);
+        Increment(histogram.sumNanoseconds, ToNanoseconds(seconds));
+    }
+
+    // Time a worker spent processing images; divided by the wall time and
+    // the number of workers, this is the worker utilisation.
+    void AddBusySeconds(double seconds)
+    {
+        Increment(GetShard().busyNanoseconds, ToNanoseconds(seconds));
+    }
+
+    // An image rejected by the pre-filter without assessment.
+    void AddPrefilterRejection()
+    {
+        Increment(GetShard().prefilterRejected, 1);
+    }
+
+    // An image that passed the pre-filter and was assessed successfully. The
+    // saved time is estimated from the mean assessment time of these when
+    // the metrics are rendered, like OFIQPrefilterStats::GetSavedSeconds.
+    void AddPrefilterPass(double assessSeconds)
+    {
+        Shard& shard = GetShard();
+        Increment(shard.prefilterPassed, 1);
+        Increment(shard.prefilterPassedNanoseconds, ToNanoseconds(assessSeconds));
+    }
+
+    void AddWorker(int count)
+    {
+        m_workers += count;
+    }
+
+    std::string Render()
+    {
+        std::vector<const Shard*> shards;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& shard : m_shards)
+            {
+                shards.push_back(shard.get());
+            }
+        }
+
+        uint64_t processed = 0;
+        uint64_t failed = 0;
+        uint64_t busyNanoseconds = 0;
+        uint64_t prefilterRejected = 0;
+        uint64_t prefilterPassed = 0;
+        uint64_t prefilterPassedNanoseconds = 0;
+        std::array<std::array<uint64_t, bucketBounds.size() + 1>, OFIQStageCount> buckets{};
+        std::array<uint64_t, OFIQStageCount> sumNanoseconds{};
+        for (const Shard* shard : shards)
+        {
+            processed += shard->processed.load(std::memory_order_relaxed);
+            failed += shard->failed.load(std::memory_order_relaxed);
+            busyNanoseconds += shard->busyNanoseconds.load(std::memory_order_relaxed);
+            prefilterRejected += shard->prefilterRejected.load(std::memory_order_relaxed);
+            prefilterPassed += shard->prefilterPassed.load(std::memory_order_relaxed);
+            prefilterPassedNanoseconds += shard->prefilterPassedNanoseconds.load(std::memory_order_relaxed);
+            for (size_t stage = 0; stage < OFIQStageCount; stage++)
+            {
+                const Histogram& histogram = shard->stages[stage];
+                for (size_t bucket = 0; bucket < buckets[stage].size(); bucket++)
+                {
+                    buckets[stage][bucket] += histogram.buckets[bucket].load(std::memory_order_relaxed);
+                }
+                sumNanoseconds[stage] += histogram.sumNanoseconds.load(std::memory_order_relaxed);
+            }
+        }
+
+        std::ostringstream stream;
+        WriteHeader(stream, "ofiq_images_processed_total", "counter", "Images processed.");
+        stream << "ofiq_images_processed_total " << processed << "\n";
+        WriteHeader(stream, "ofiq_images_failed_total", "counter", "Images whose decoding or assessment failed.");
+        stream << "ofiq_images_failed_total " << failed << "\n";
+
+        WriteHeader(stream, "ofiq_stage_duration_seconds", "histogram", "Time per image and processing stage.");
+        for (size_t stage = 0; stage < OFIQStageCount; stage++)
+        {
+            const std::string label = std::string("stage=\"") + GetStageName(static_cast<OFIQStage>(stage)) + "\"";
+            uint64_t cumulative = 0;
+            for (size_t bucket = 0; bucket < buckets[stage].size(); bucket++)
+            {
+                cumulative += buckets[stage][bucket];
+                stream << "ofiq_stage_duration_seconds_bucket{" << label << ",le=\""
+                    << (bucket < bucketBounds.size() ? FormatNumber(bucketBounds[bucket]) : std::string("+Inf"))
+                    << "\"} " << cumulative << "\n";
+            }
+            stream << "ofiq_stage_duration_seconds_sum{" << label << "} " << FormatNumber(sumNanoseconds[stage] * 1e-9) << "\n";
+            stream << "ofiq_stage_duration_seconds_count{" << label << "} " << cumulative << "\n";
+        }
+
+        WriteHeader(stream, "ofiq_prefilter_rejected_total", "counter", "Images rejected by the pre-filter without assessment.");
+        stream << "ofiq_prefilter_rejected_total " << prefilterRejected << "\n";
+        // A gauge, as the estimate changes with the mean assessment time.
+        double meanAssessSeconds = prefilterPassed > 0 ? prefilterPassedNanoseconds * 1e-9 / prefilterPassed : 0.0;
+        WriteHeader(stream, "ofiq_prefilter_saved_seconds", "gauge",
+            "Estimated assessment time saved by the pre-filter: rejected images times the mean assessment time of the accepted ones.");
+        stream << "ofiq_prefilter_saved_seconds " << FormatNumber(prefilterRejected * meanAssessSeconds) << "\n";
+
+        WriteHeader(stream, "ofiq_worker_busy_seconds_total", "counter", "Time all workers spent processing images.");
+        stream << "ofiq_worker_busy_seconds_total " << FormatNumber(busyNanoseconds * 1e-9) << "\n";
+        WriteHeader(stream, "ofiq_workers", "gauge", "Initialized OFIQ instances.");
+        stream << "ofiq_workers " << m_workers.load() << "\n";
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::string lastName;
+            for (const auto& [id, gauge] : m_gauges)
+            {
+                if (gauge.name != lastName)
+                {
+                    WriteHeader(stream, gauge.name, "gauge", gauge.help);
+                    lastName = gauge.name;
+                }
+                stream << gauge.name << (gauge.labels.empty() ? "" : "{" + gauge.labels + "}")
+                    << " " << FormatNumber(gauge.function()) << "\n";
+            }
+        }
+
+        OFIQBufferPoolStats pool = OFIQBufferPool::Get().GetStats();
+        WriteHeader(stream, "ofiq_buffer_pool_hits_total", "counter", "Image buffers served from the buffer pool.");
+        stream << "ofiq_buffer_pool_hits_total " << pool.hits << "\n";
+        WriteHeader(stream, "ofiq_buffer_pool_misses_total", "counter", "Image buffers the buffer pool had to allocate.");
+        stream << "ofiq_buffer_pool_misses_total " << pool.misses << "\n";
+        WriteHeader(stream, "ofiq_buffer_pool_cached_bytes", "gauge", "Memory kept by the buffer pool for reuse.");
+        stream << "ofiq_buffer_pool_cached_bytes " << pool.cachedBytes << "\n";
+
+        WriteHeader(stream, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+        stream << "process_resident_memory_bytes " << OFIQProcessMemory::GetCurrentRss() << "\n";
+        WriteHeader(stream, "ofiq_peak_resident_memory_bytes", "gauge", "Peak resident memory size in bytes.");
+        stream << "ofiq_peak_resident_memory_bytes " << OFIQProcessMemory::GetPeakRss() << "\n";
+        return stream.str();
+    }
+
+private:
+    friend class OFIQMetricsGauge;
+
+    struct Histogram
+    {
+        std::array<std::atomic<uint64_t>, bucketBounds.size() + 1> buckets{};
+        std::atomic<uint64_t> sumNanoseconds{ 0 };
+    };
+
+    struct Shard
+    {
+        std::atomic<uint64_t> processed{ 0 };
+        std::atomic<uint64_t> failed{ 0 };
+        std::atomic<uint64_t> busyNanoseconds{ 0 };
+        std::atomic<uint64_t> prefilterRejected{ 0 };
+        std::atomic<uint64_t> prefilterPassed{ 0 };
+        std::atomic<uint64_t> prefilterPassedNanoseconds{ 0 };
+        std::array<Histogram, OFIQStageCount> stages;
+    };
+
+    struct Gauge
+    {
+        std::string name;
+        std::string help;
+        std::string labels;
+        std::function<double()> function;
+    };
+
+    OFIQMetrics()
+        : m_workers(0)
+        , m_nextGaugeId(0)
+    {
+        ;
+    }
+
+    Shard& GetShard()
+    {
+        thread_local Shard* shard = nullptr;
+        if (shard == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shards.push_back(std::make_unique<Shard>());
+            shard = m_shards.back().get();
+        }
+        return *shard;
+    }
+
+    // Only the owning thread writes a shard, so a relaxed load and store
+    // suffice; readers may see a slightly older value.
+    static void Increment(std::atomic<uint64_t>& value, uint64_t amount)
+    {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static uint64_t ToNanoseconds(double seconds)
+    {
+        return seconds > 0.0 ? static_cast<uint64_t>(seconds * 1e9) : 0;
+    }
+
+    static std::string FormatNumber(double value)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.9g", value);
+        return buffer;
+    }
+
+    static void WriteHeader(std::ostream& stream, const std::string& name, const char* type, const std::string& help)
+    {
+        stream << "# HELP " << name << " " << help << "\n" << "# TYPE " << name << " " << type << "\n";
+    }
+
+    std::atomic<int> m_workers;
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    // Ordered by name and registration, so that samples of one metric are
+    // rendered together.
+    std::map<std::pair<std::string, int>, Gauge> m_gauges;
+    int m_nextGaugeId;
+};
+
+// A gauge sampled from a function while the object is alive, e.g. the depth
+// of a queue. The labels are given in Prometheus syntax, e.g. queue="batch".
+class OFIQMetricsGauge
+{
+public:
+    OFIQMetricsGauge(const std::string& name, const std::string& help, const std::string& labels, std::function<double()> function)
+    {
+        OFIQMetrics& metrics = OFIQMetrics::Get();
+        std::lock_guard<std::mutex> lock(metrics.m_mutex);
+        m_key = std::make_pair(name, metrics.m_nextGaugeId++);
+        metrics.m_gauges[m_key] = OFIQMetrics::Gauge{ name, help, labels, std::move(function) };
+    }
+
+    ~OFIQMetricsGauge()
+    {
+        OFIQMetrics& metrics = OFIQMetrics::Get();
+        std::lock_guard<std::mutex> lock(metrics.m_mutex);
+        metrics.m_gauges.erase(m_key);
+    }
+
+    OFIQMetricsGauge(const OFIQMetricsGauge&) = delete;
+    OFIQMetricsGauge& operator=(const OFIQMetricsGauge&) = delete;
+
+private:
+    std::pair<std::string, int> m_key;
+};
+
+// Publishes OFIQMetrics while a headless mode runs: on GET /metrics of a
+// local HTTP port (--metrics-port, not available on Windows) and/or by
+// writing a file for the textfile collector of the node exporter
+// (--metrics-file, every --metrics-interval seconds and at the end). The file
+// is replaced atomically, so the collector never reads a partial file.
+class OFIQMetricsExporter
+{
+public:
+    OFIQMetricsExporter()
+        : m_port(0)
+        , m_intervalSeconds(15.0)
+        , m_listenFd(-1)
+        , m_stop(false)
+    {
+        ;
+    }
+
+    ~OFIQMetricsExporter()
+    {
+        Stop();
+    }
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "       Any mode: [--metrics-port <port>] [--metrics-file <path.prom> [--metrics-interval <15>]]" << std::endl;
+    }
+
+    bool Start(const OFIQCommandLine& commandLine, std::string& error)
+    {
+        m_port = commandLine.GetInt("metrics-port", 0);
+        m_filePath = commandLine.GetString("metrics-file");
+        m_intervalSeconds = std::max(1.0, commandLine.GetDouble("metrics-interval", 15.0));
+        if (m_port > 0 && !Listen(error))
+        {
+            return false;
+        }
+        if (m_port > 0 || !m_filePath.empty())
+        {
+            m_thread = std::thread(&OFIQMetricsExporter::Loop, this);
+        }
+        return true;
+    }
+
+    void Stop()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wakeUp.notify_all();
+            m_thread.join();
+        }
+#if !defined(_WIN32)
+        if (m_listenFd >= 0)
+        {
+            close(m_listenFd);
+            m_listenFd = -1;
+        }
+#endif
+        if (!m_filePath.empty())
+        {
+            WriteFile();
+            m_filePath.clear();
+        }
+    }
+
+private:
+    void Loop()
+    {
+        auto nextWrite = std::chrono::steady_clock::now();
+        while (true)
+        {
+            if (!m_filePath.empty() && std::chrono::steady_clock::now() >= nextWrite)
+            {
+                WriteFile();
+                nextWrite = std::chrono::steady_clock::now()
+                    + std::chrono::milliseconds(static_cast<int64_t>(m_intervalSeconds * 1000.0));
+            }
+            if (m_listenFd >= 0)
+            {
+                Serve(200);
+            }
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_wakeUp.wait_for(lock, std::chrono::milliseconds(m_listenFd >= 0 ? 0 : 200), [this] { return m_stop; }))
+            {
+                return;
+            }
+        }
+    }
+
+    void WriteFile()
+    {
+        std::string temporaryPath = m_filePath + ".tmp";
+        FILE* file = fopen(temporaryPath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            std::cerr << "ERROR: Cannot write '" << temporaryPath << "'" << std::endl;
+            return;
+        }
+        std::string text = OFIQMetrics::Get().Render();
+        bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+        written = fclose(file) == 0 && written;
+        if (!written || std::rename(temporaryPath.c_str(), m_filePath.c_str()) != 0)
+        {
+            std::cerr << "ERROR: Cannot write '" << m_filePath << "'" << std::endl;
+        }
+    }
+
+#if defined(_WIN32)
+    bool Listen(std::string& error)
+    {
+        error = "--metrics-port is only supported on Linux and macOS; use --metrics-file.";
+        return false;
+    }
+
+    void Serve(int)
+    {
+    }
+#else
+    // Listens on the loopback interface only.
+    bool Listen(std::string& error)
+    {
+        m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(m_port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (m_listenFd < 0
+            || setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+            || bind(m_listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(m_listenFd, 16) != 0)
+        {
+            error = "Cannot listen on port " + std::to_string(m_port) + " for metrics.";
+            if (m_listenFd >= 0)
+            {
+                close(m_listenFd);
+                m_listenFd = -1;
+            }
+            return false;
+        }
+        return true;
+    }
+
+    // Answers the pending scrapes, waiting at most the given time for one.
+    void Serve(int timeoutMilliseconds)
+    {
+        pollfd pfd = { m_listenFd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeoutMilliseconds) <= 0)
+        {
+            return;
+        }
+        int fd = accept(m_listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return;
+        }
+
+        // Read the request line; scrapers send small GET requests.
+        std::string request;
+        char buffer[1024];
+        pollfd clientPfd = { fd, POLLIN, 0 };
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192 && poll(&clientPfd, 1, 1000) > 0)
+        {
+            ssize_t count = read(fd, buffer, sizeof(buffer));
+            if (count <= 0)
+            {
+                break;
+            }
+            request.append(buffer, static_cast<size_t>(count));
+        }
+
+        std::string status = "200 OK";
+        std::string body;
+        if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0)
+        {
+            body = OFIQMetrics::Get().Render();
+        }
+        else
+        {
+            status = "404 Not Found";
+            body = "Not found\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+        size_t written = 0;
+        while (written < response.size())
+        {
+            ssize_t count = send(fd, response.data() + written, response.size() - written, MSG_NOSIGNAL);
+            if (count <= 0)
+            {
+                break;
+            }
+            written += static_cast<size_t>(count);
+        }
+        close(fd);
+    }
+#endif
+
+    int m_port;
+    std::string m_filePath;
+    double m_intervalSeconds;
+    int m_listenFd;
+    bool m_stop;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::thread m_thread;
+};
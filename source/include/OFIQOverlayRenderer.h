@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQBufferPool.h>
+
+
+// The layers drawn by OFIQOverlayRenderer.
+struct OFIQOverlayOptions
+{
+    bool original = true;
+    bool faces = true;
+    bool landmarks = false;
+    bool segmentationMask = false;
+    bool occlusionMask = false;
+    bool landmarkedRegion = false;
+
+    // Parses a comma separated list of the layers "faces", "landmarks",
+    // "segmentation", "occlusion" and "region". The original image is always
+    // drawn.
+    static bool Parse(const std::string& text, OFIQOverlayOptions& options, std::string& error)
+    {
+        options = OFIQOverlayOptions();
+        options.faces = false;
+        std::stringstream stream(text);
+        std::string layer;
+        while (std::getline(stream, layer, ','))
+        {
+            if (layer == "faces")
+            {
+                options.faces = true;
+            }
+            else if (layer == "landmarks")
+            {
+                options.landmarks = true;
+            }
+            else if (layer == "segmentation")
+            {
+                options.segmentationMask = true;
+            }
+            else if (layer == "occlusion")
+            {
+                options.occlusionMask = true;
+            }
+            else if (layer == "region")
+            {
+                options.landmarkedRegion = true;
+            }
+            else if (!layer.empty())
+            {
+                error = "Unknown layer '" + layer + "', expected faces, landmarks, segmentation, occlusion or region.";
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Draws the preprocessing results of an assessment (face boxes, landmarks,
+// segmentation and occlusion masks, landmarked region) into a BGR image. Used
+// for the image view and for annotated images written by --batch. The image
+// and the mask overlays take their memory from OFIQBufferPool.
+class OFIQOverlayRenderer
+{
+public:
+    static cv::Mat Render(
+        const OFIQ::Image& image,
+        const OFIQ::FaceImageQualityPreprocessingResult& preprocessing,
+        const OFIQOverlayOptions& options)
+    {
+        cv::Mat cvImage = OFIQBufferPool::Get().CreateMat(image.height, image.width, CV_8UC3);
+        DrawOriginal(cvImage, image, options.original);
+        if (options.faces)
+        {
+            DrawFaces(cvImage, preprocessing);
+        }
+        if (options.landmarks)
+        {
+            DrawLandmarks(cvImage, preprocessing);
+        }
+        if (options.segmentationMask)
+        {
+            BlendSegmentationMask(cvImage, preprocessing.m_segmentationMaskPtr.get());
+        }
+        if (options.occlusionMask)
+        {
+            BlendMask(cvImage, preprocessing.m_occlusionMaskPtr.get(), cv::Vec3b(0, 0, 255));
+        }
+        if (options.landmarkedRegion)
+        {
+            BlendMask(cvImage, preprocessing.m_landmarkedRegionPtr.get(), cv::Vec3b(255, 0, 0));
+        }
+        return cvImage;
+    }
+
+    static void DrawOriginal(cv::Mat& cvImage, const OFIQ::Image& image, bool showOriginal)
+    {
+        if (!showOriginal || image.data == nullptr)
+        {
+            cvImage.setTo(cv::Scalar(255, 255, 255));
+            return;
+        }
+
+        bool isRGB = (image.depth / 8 == 3);
+        cv::Mat original(image.height, image.width, isRGB ? CV_8UC3 : CV_8UC1, image.data.get());
+        cv::cvtColor(original, cvImage, isRGB ? cv::COLOR_RGB2BGR : cv::COLOR_GRAY2BGR);
+    }
+
+    static void DrawFaces(cv::Mat& cvImage, const OFIQ::FaceImageQualityPreprocessingResult& preprocessing)
+    {
+        const cv::Scalar faceColour(0, 0, 255);
+        int thickness = (int)std::ceil(0.01 * std::min(cvImage.rows, cvImage.cols));
+
+        for (const auto& face : preprocessing.m_faces)
+        {
+            cv::Rect cvRect(face.xleft, face.ytop, face.width, face.height);
+            cv::rectangle(cvImage, cvRect, faceColour, thickness);
+        }
+    }
+
+    static void DrawLandmarks(cv::Mat& cvImage, const OFIQ::FaceImageQualityPreprocessingResult& preprocessing)
+    {
+        const int radius = GetLandmarkRadius(cvImage.cols, cvImage.rows);
+        const auto& landmarks = preprocessing.m_landmarks.landmarks;
+
+        for (size_t lm_label = 0; lm_label < landmarks.size(); lm_label++)
+        {
+            const auto& lm = landmarks[lm_label];
+            cv::circle(cvImage, cv::Point(lm.x, lm.y), radius, GetLandmarkColor(lm_label), -1);
+        }
+    }
+
+    // Radius of the landmark dots in image pixels.
+    static int GetLandmarkRadius(int width, int height)
+    {
+        return (int)std::ceil(0.005 * std::min(width, height));
+    }
+
+    // BGR colour of a landmark of the 98 point scheme by its index.
+    static cv::Vec3b GetLandmarkColor(size_t lm_label)
+    {
+        const cv::Vec3b FACE_CONTOUR_COLOR(255, 255, 0);
+        const cv::Vec3b EYE_BROWS_COLOR(255, 0, 0);
+        const cv::Vec3b NOSE_COLOR(0, 0, 0);
+        const cv::Vec3b OUTER_BOUNDARY_OF_EYES_COLOR(128, 0, 128);
+        const cv::Vec3b OUTER_BOUNDARY_OF_LIPS_COLOR(0, 0, 255);
+        const cv::Vec3b INNER_BOUNDARY_OF_LIPS_COLOR(0, 255, 0);
+        const cv::Vec3b PUPILS_COLOR(255, 255, 255);
+
+        if (lm_label < 33)
+        {
+            return FACE_CONTOUR_COLOR;
+        }
+        else if (lm_label < 47)
+        {
+            return EYE_BROWS_COLOR;
+        }
+        else if (lm_label < 60)
+        {
+            return NOSE_COLOR;
+        }
+        else if (lm_label < 76)
+        {
+            return OUTER_BOUNDARY_OF_EYES_COLOR;
+        }
+        else if (lm_label < 88)
+        {
+            return OUTER_BOUNDARY_OF_LIPS_COLOR;
+        }
+        else if (lm_label < 96)
+        {
+            return INNER_BOUNDARY_OF_LIPS_COLOR;
+        }
+        return PUPILS_COLOR;
+    }
+
+    // BGR colour of a face parsing label as used by the segmentation model;
+    // unknown labels are white.
+    static cv::Vec3b GetSegmentationColor(uint8_t label)
+    {
+        const static int labelCount = 24;
+        const static cv::Vec3b colorMap[] = {
+            cv::Vec3b(128, 128, 128), // 0: background
+            cv::Vec3b(255, 85, 0), // 1: face_skin
+            cv::Vec3b(255, 170, 0), // 2: left eye brow
+            cv::Vec3b(255, 0, 85), // 3: right eye brow
+            cv::Vec3b(255, 0, 170), // 4: left eye
+            cv::Vec3b(0, 255, 0), // 5: right eye
+            cv::Vec3b(0, 255, 255), // 6: eyeglasses
+            cv::Vec3b(170, 255, 0), // 7: left ear
+            cv::Vec3b(0, 255, 85), // 8: right ear
+            cv::Vec3b(0, 255, 170), // 9: earring
+            cv::Vec3b(0, 0, 255), // 10: nose
+            cv::Vec3b(85, 0, 255), // 11: mouth
+            cv::Vec3b(170, 0, 255), // 12: upper lip
+            cv::Vec3b(0, 85, 255), // 13: lower lip
+            cv::Vec3b(0, 170, 255), // 14: neck
+            cv::Vec3b(255, 255, 0), // 15: necklace
+            cv::Vec3b(255, 255, 85), // 16: clothing
+            cv::Vec3b(255, 255, 170), // 17: hair
+            cv::Vec3b(255, 0, 255), // 18: head covering
+            cv::Vec3b(255, 85, 255), // 19:
+            cv::Vec3b(255, 170, 255), // 20:
+            cv::Vec3b(85, 255, 255), // 21:
+            cv::Vec3b(170, 255, 255), // 22:
+            cv::Vec3b(85, 255, 0) }; // 23:
+
+        return label < labelCount ? colorMap[label] : cv::Vec3b(255, 255, 255);
+    }
+
+    // Blends the face parsing labels with the colours of the segmentation
+    // model. The mask has the size of the image.
+    static void BlendSegmentationMask(cv::Mat& cvImage, const uint8_t* mask)
+    {
+        if (mask == nullptr)
+        {
+            return;
+        }
+
+        int height = cvImage.rows;
+        int width = cvImage.cols;
+        cv::Mat overlay = OFIQBufferPool::Get().CreateMat(height, width, CV_8UC3);
+        for (int y = 0; y < height; y++)
+        {
+            cv::Vec3b* row = overlay.ptr<cv::Vec3b>(y);
+            const uint8_t* labels = mask + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; x++)
+            {
+                row[x] = GetSegmentationColor(labels[x]);
+            }
+        }
+        Blend(cvImage, overlay);
+    }
+
+    // Blends a binary mask of the size of the image: set pixels in the given
+    // colour, the others in white.
+    static void BlendMask(cv::Mat& cvImage, const uint8_t* mask, const cv::Vec3b& foregroundColor)
+    {
+        if (mask == nullptr)
+        {
+            return;
+        }
+
+        const cv::Vec3b backgroundColor(255, 255, 255);
+        int height = cvImage.rows;
+        int width = cvImage.cols;
+        cv::Mat overlay = OFIQBufferPool::Get().CreateMat(height, width, CV_8UC3);
+        for (int y = 0; y < height; y++)
+        {
+            cv::Vec3b* row = overlay.ptr<cv::Vec3b>(y);
+            const uint8_t* values = mask + static_cast<size_t>(y) * width;
+            for (int x = 0; x < width; x++)
+            {
+                row[x] = values[x] ? foregroundColor : backgroundColor;
+            }
+        }
+        Blend(cvImage, overlay);
+    }
+
+private:
+    static void Blend(cv::Mat& cvImage, const cv::Mat& overlay)
+    {
+        double alpha = 0.3;
+        double beta = 1.0 - alpha;
+        cv::addWeighted(overlay, alpha, cvImage, beta, 0.0, cvImage);
+    }
+};
@@ -1,7 +1,18 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
 #include <wx/wx.h>
 #include <wx/sizer.h>
+#include <wx/graphics.h>
+#include <ofiq_lib.h>
+
+#include <OFIQOverlayRenderer.h>
 
 
 // A scrolled window for showing an image.
@@ -11,6 +22,19 @@ public:
     OFIQPictureFrame()
         : wxScrolledWindow()
         , m_bitmap(1, 1)
+        , m_scale(1.0)
+        , m_selecting(false)
+        , m_selectionOwner(nullptr)
+        , m_onSelectionBinding(nullptr)
+        , m_showFaces(false)
+        , m_showLandmarks(false)
+        , m_viewportMode(false)
+        , m_sourceScale(1.0)
+        , m_tileOwner(nullptr)
+        , m_onTileBinding(nullptr)
+        , m_tileCacheBytes(0)
+        , m_tileCacheCapacity(64 * 1024 * 1024)
+        , m_showingTiles(false)
     {
         ;
     }
@@ -21,11 +45,22 @@ public:
     }
 
     void LoadImage(wxImage& image, double scale = 1.0 ) {
+        m_viewportMode = false;
+        m_source = wxImage();
+        m_showingTiles = false;
         int scaled_width = static_cast<int>(image.GetWidth() * scale);
         int scaled_height = static_cast<int>(image.GetHeight() * scale);
         if (scaled_width > 0 && scaled_height > 0)
         {
-            m_bitmap = wxBitmap(image.Scale(scaled_width, scaled_height, wxIMAGE_QUALITY_HIGH));
+            if (scaled_width == image.GetWidth() && scaled_height == image.GetHeight())
+            {
+                m_bitmap = wxBitmap(image);
+            }
+            else
+            {
+                m_bitmap = wxBitmap(image.Scale(scaled_width, scaled_height, wxIMAGE_QUALITY_HIGH));
+            }
+            m_scale = scale;
             SetVirtualSize(scaled_width, scaled_height);
             wxClientDC dc(this);
             PrepareDC(dc);
@@ -35,6 +70,7 @@ public:
         else
         {
             m_bitmap = wxBitmap(1,1);
+            m_scale = 1.0;
             SetVirtualSize(1, 1);
             wxClientDC dc(this);
             PrepareDC(dc);
@@ -43,13 +79,177 @@ public:
         }
     }
 
+    // Shows an image without keeping a bitmap of the whole scaled image: only
+    // the part in view is scaled when painting. The source shows an image of
+    // the given size at sourceScale (1.0, or less for a reduced proxy). If the
+    // view needs more detail than the source has and a tile callback is
+    // bound, the part in view is drawn from full-resolution tiles instead.
+    void LoadSource(const wxImage& source, double sourceScale, const wxSize& imageSize, double scale)
+    {
+        int scaled_width = std::max(1, static_cast<int>(imageSize.x * scale));
+        int scaled_height = std::max(1, static_cast<int>(imageSize.y * scale));
+        m_viewportMode = true;
+        m_source = source;
+        m_sourceScale = sourceScale;
+        m_sourceImageSize = imageSize;
+        m_bitmap = wxBitmap(1, 1);
+        m_scale = scale;
+        SetVirtualSize(scaled_width, scaled_height);
+        SetScrollbars(1, 1, scaled_width, scaled_height, 0, 0);
+        Refresh();
+    }
+
+    // Registers a callback that renders a region (in image coordinates) at
+    // full resolution, see LoadSource.
+    void BindTiles(void* owner, wxImage (*onTileBinding)(void*, const wxRect&))
+    {
+        m_tileOwner = owner;
+        m_onTileBinding = onTileBinding;
+    }
+
+    // Drops the cached tiles; to be called when the rendered content changes.
+    void ClearTiles()
+    {
+        m_tiles.clear();
+        m_tileIndex.clear();
+        m_tileCacheBytes = 0;
+        Refresh();
+    }
+
+    void SetTileCacheCapacity(size_t bytes)
+    {
+        m_tileCacheCapacity = bytes;
+    }
+
+    // Returns true if the last paint drew full-resolution tiles.
+    bool IsShowingTiles() const
+    {
+        return m_showingTiles;
+    }
+
+    static constexpr int tileSize = 512;
+
+    // Registers a callback invoked with the selected region in image coordinates
+    // once the left mouse button is released. A plain click yields an empty
+    // region located at the clicked pixel.
+    void BindSelection(void* owner, void (*onSelectionBinding)(void*, const wxRect&))
+    {
+        m_selectionOwner = owner;
+        m_onSelectionBinding = onSelectionBinding;
+    }
+
+    // Sets the highlighted region (in image coordinates).
+    void SetSelection(const wxRect& selection)
+    {
+        m_selection = selection;
+        Refresh();
+    }
+
+    void ClearSelection()
+    {
+        m_selecting = false;
+        m_selection = wxRect();
+        Refresh();
+    }
+
+    const wxRect& GetSelection() const
+    {
+        return m_selection;
+    }
+
+    // Sets the face boxes and landmarks of an image of the given size. They
+    // are kept as geometry and drawn on top of the bitmap at the current
+    // scale, so showing or hiding them does not touch the bitmap.
+    void SetGeometry(const OFIQ::FaceImageQualityPreprocessingResult& preprocessing, const wxSize& imageSize)
+    {
+        m_faces = preprocessing.m_faces;
+        m_landmarks = preprocessing.m_landmarks.landmarks;
+        m_imageSize = imageSize;
+        Refresh();
+    }
+
+    void ShowGeometry(bool faces, bool landmarks)
+    {
+        m_showFaces = faces;
+        m_showLandmarks = landmarks;
+        Refresh();
+    }
+
 protected:
     wxBitmap m_bitmap;
+    double m_scale;
+
+    bool m_selecting;
+    wxPoint m_selectionStart;
+    wxRect m_selection;
+    void* m_selectionOwner;
+    void (*m_onSelectionBinding)(void*, const wxRect&);
+
+    std::vector<OFIQ::BoundingBox> m_faces;
+    std::vector<OFIQ::LandmarkPoint> m_landmarks;
+    wxSize m_imageSize;
+    bool m_showFaces;
+    bool m_showLandmarks;
+
+    bool m_viewportMode;
+    wxImage m_source;
+    double m_sourceScale;
+    wxSize m_sourceImageSize;
+    void* m_tileOwner;
+    wxImage (*m_onTileBinding)(void*, const wxRect&);
+    // Tiles in least recently used order (front) with an index by position.
+    std::list<std::pair<std::pair<int, int>, wxImage>> m_tiles;
+    std::map<std::pair<int, int>, std::list<std::pair<std::pair<int, int>, wxImage>>::iterator> m_tileIndex;
+    size_t m_tileCacheBytes;
+    size_t m_tileCacheCapacity;
+    bool m_showingTiles;
+
+    wxPoint ToImagePosition(int x, int y) const
+    {
+        return wxPoint(
+            static_cast<int>(std::floor(x / m_scale)),
+            static_cast<int>(std::floor(y / m_scale)));
+    }
+
+    void UpdateSelection(wxMouseEvent& event, int x, int y)
+    {
+        if (event.LeftDown())
+        {
+            m_selecting = true;
+            m_selectionStart = ToImagePosition(x, y);
+            m_selection = wxRect(m_selectionStart, wxSize(0, 0));
+            Refresh();
+        }
+        else if (m_selecting && event.Dragging() && event.LeftIsDown())
+        {
+            m_selection = wxRect(m_selectionStart, ToImagePosition(x, y));
+            Refresh();
+        }
+        else if (m_selecting && event.LeftUp())
+        {
+            m_selecting = false;
+            auto position = ToImagePosition(x, y);
+            if (position == m_selectionStart)
+            {
+                m_selection = wxRect(position, wxSize(0, 0));
+            }
+            else
+            {
+                m_selection = wxRect(m_selectionStart, position);
+            }
+            Refresh();
+            if (m_onSelectionBinding != nullptr)
+            {
+                (m_onSelectionBinding)(m_selectionOwner, m_selection);
+            }
+        }
+    }
 
 public:
     void OnMouse(wxMouseEvent& event) {
         int xx, yy;
         CalcUnscrolledPosition(event.GetX(), event.GetY(), &xx, &yy);
+        UpdateSelection(event, xx, yy);
         event.m_x = xx; 
         event.m_y = yy;
         event.ResumePropagation(1); // Pass along mouse events (e.g. to parent)
@@ -58,9 +258,175 @@ public:
 
 protected:
     void OnPaint(wxPaintEvent& event) {
+        // The scroll offset is applied explicitly instead of with PrepareDC,
+        // as graphics contexts do not take the device origin of the DC into
+        // account on all platforms.
         wxPaintDC dc(this);
-        PrepareDC(dc);
-        dc.DrawBitmap(m_bitmap, 0, 0, true);
+        wxPoint origin = CalcScrolledPosition(wxPoint(0, 0));
+        if (m_viewportMode)
+        {
+            DrawViewport(dc, origin);
+        }
+        else
+        {
+            dc.DrawBitmap(m_bitmap, origin.x, origin.y, true);
+        }
+        DrawGeometry(dc, origin);
+        if (!m_selection.IsEmpty())
+        {
+            dc.SetPen(wxPen(*wxGREEN, 2, wxPENSTYLE_SHORT_DASH));
+            dc.SetBrush(*wxTRANSPARENT_BRUSH);
+            dc.DrawRectangle(
+                origin.x + static_cast<int>(m_selection.x * m_scale),
+                origin.y + static_cast<int>(m_selection.y * m_scale),
+                static_cast<int>(m_selection.width * m_scale),
+                static_cast<int>(m_selection.height * m_scale));
+        }
+    }
+
+    // Returns the part of the image (in image coordinates) that is in view.
+    wxRect GetVisibleImageRect(const wxPoint& origin) const
+    {
+        const wxSize size = GetClientSize();
+        int left = static_cast<int>(std::floor(-origin.x / m_scale));
+        int top = static_cast<int>(std::floor(-origin.y / m_scale));
+        int right = static_cast<int>(std::ceil((size.x - origin.x) / m_scale));
+        int bottom = static_cast<int>(std::ceil((size.y - origin.y) / m_scale));
+        return wxRect(wxPoint(left, top), wxPoint(right, bottom)).Intersect(wxRect(m_sourceImageSize));
+    }
+
+    // Scales a part of an image to the view and draws it at the position of
+    // the given image region.
+    void DrawScaled(wxPaintDC& dc, const wxPoint& origin, const wxImage& image, const wxRect& part, const wxRect& region)
+    {
+        int x0 = static_cast<int>(std::floor(region.x * m_scale));
+        int y0 = static_cast<int>(std::floor(region.y * m_scale));
+        int x1 = static_cast<int>(std::floor((region.x + region.width) * m_scale));
+        int y1 = static_cast<int>(std::floor((region.y + region.height) * m_scale));
+        if (x1 <= x0 || y1 <= y0 || part.IsEmpty())
+        {
+            return;
+        }
+        // Enlarged pixels stay sharp, reductions are filtered.
+        wxImageResizeQuality quality = (x1 - x0) >= part.width ? wxIMAGE_QUALITY_NORMAL : wxIMAGE_QUALITY_HIGH;
+        wxImage scaled = image.GetSubImage(part).Scale(x1 - x0, y1 - y0, quality);
+        dc.DrawBitmap(wxBitmap(scaled), origin.x + x0, origin.y + y0, false);
+    }
+
+    void DrawViewport(wxPaintDC& dc, const wxPoint& origin)
+    {
+        wxRect visible = GetVisibleImageRect(origin);
+        m_showingTiles = m_sourceScale < 1.0 && m_scale > m_sourceScale && m_onTileBinding != nullptr;
+        if (visible.IsEmpty())
+        {
+            return;
+        }
+
+        if (!m_showingTiles)
+        {
+            if (!m_source.IsOk())
+            {
+                return;
+            }
+            // The source pixels covering the visible part; the region is
+            // snapped to whole source pixels.
+            int left = static_cast<int>(std::floor(visible.x * m_sourceScale));
+            int top = static_cast<int>(std::floor(visible.y * m_sourceScale));
+            int right = std::min(m_source.GetWidth(), static_cast<int>(std::ceil((visible.x + visible.width) * m_sourceScale)));
+            int bottom = std::min(m_source.GetHeight(), static_cast<int>(std::ceil((visible.y + visible.height) * m_sourceScale)));
+            wxRect part(left, top, right - left, bottom - top);
+            wxRect region(
+                static_cast<int>(std::floor(left / m_sourceScale)),
+                static_cast<int>(std::floor(top / m_sourceScale)),
+                static_cast<int>(std::ceil(right / m_sourceScale)) - static_cast<int>(std::floor(left / m_sourceScale)),
+                static_cast<int>(std::ceil(bottom / m_sourceScale)) - static_cast<int>(std::floor(top / m_sourceScale)));
+            DrawScaled(dc, origin, m_source, part, region);
+            return;
+        }
+
+        for (int ty = visible.y / tileSize; ty * tileSize < visible.y + visible.height; ty++)
+        {
+            for (int tx = visible.x / tileSize; tx * tileSize < visible.x + visible.width; tx++)
+            {
+                wxRect tileRect = wxRect(tx * tileSize, ty * tileSize, tileSize, tileSize).Intersect(wxRect(m_sourceImageSize));
+                const wxImage& tile = GetTile(tx, ty, tileRect);
+                if (!tile.IsOk())
+                {
+                    continue;
+                }
+                wxRect region = tileRect.Intersect(visible);
+                wxRect part(region.x - tileRect.x, region.y - tileRect.y, region.width, region.height);
+                DrawScaled(dc, origin, tile, part, region);
+            }
+        }
+    }
+
+    const wxImage& GetTile(int tx, int ty, const wxRect& tileRect)
+    {
+        auto key = std::make_pair(tx, ty);
+        auto found = m_tileIndex.find(key);
+        if (found != m_tileIndex.end())
+        {
+            m_tiles.splice(m_tiles.end(), m_tiles, found->second);
+            return found->second->second;
+        }
+
+        wxImage tile = (m_onTileBinding)(m_tileOwner, tileRect);
+        size_t bytes = tile.IsOk() ? static_cast<size_t>(tile.GetWidth()) * tile.GetHeight() * 3 : 0;
+        while (!m_tiles.empty() && m_tileCacheBytes + bytes > m_tileCacheCapacity)
+        {
+            const wxImage& evicted = m_tiles.front().second;
+            m_tileCacheBytes -= evicted.IsOk() ? static_cast<size_t>(evicted.GetWidth()) * evicted.GetHeight() * 3 : 0;
+            m_tileIndex.erase(m_tiles.front().first);
+            m_tiles.pop_front();
+        }
+        m_tiles.emplace_back(key, tile);
+        m_tileIndex[key] = std::prev(m_tiles.end());
+        m_tileCacheBytes += bytes;
+        return m_tiles.back().second;
+    }
+
+    // Draws the face boxes and landmarks at view resolution. Line widths and
+    // dot sizes follow those of OFIQOverlayRenderer at the current scale, but
+    // never get thinner than two pixels on screen.
+    void DrawGeometry(wxPaintDC& dc, const wxPoint& origin)
+    {
+        if ((!m_showFaces || m_faces.empty()) && (!m_showLandmarks || m_landmarks.empty()))
+        {
+            return;
+        }
+        std::unique_ptr<wxGraphicsContext> gc(wxGraphicsContext::Create(dc));
+        if (!gc)
+        {
+            return;
+        }
+        gc->Translate(origin.x, origin.y);
+        const int shortEdge = std::min(m_imageSize.x, m_imageSize.y);
+
+        if (m_showFaces)
+        {
+            double thickness = std::max(2.0, std::ceil(0.01 * shortEdge) * m_scale);
+            gc->SetPen(wxPen(*wxRED, static_cast<int>(std::round(thickness))));
+            gc->SetBrush(*wxTRANSPARENT_BRUSH);
+            for (const auto& face : m_faces)
+            {
+                gc->DrawRectangle(face.xleft * m_scale, face.ytop * m_scale, face.width * m_scale, face.height * m_scale);
+            }
+        }
+
+        if (m_showLandmarks)
+        {
+            double radius = std::max(2.0, OFIQOverlayRenderer::GetLandmarkRadius(m_imageSize.x, m_imageSize.y) * m_scale);
+            gc->SetPen(*wxTRANSPARENT_PEN);
+            for (size_t i = 0; i < m_landmarks.size(); i++)
+            {
+                cv::Vec3b color = OFIQOverlayRenderer::GetLandmarkColor(i);
+                gc->SetBrush(wxBrush(wxColour(color[2], color[1], color[0])));
+                double x = (m_landmarks[i].x + 0.5) * m_scale;
+                double y = (m_landmarks[i].y + 0.5) * m_scale;
+                gc->DrawEllipse(x - radius, y - radius, 2.0 * radius, 2.0 * radius);
+            }
+        }
     }
 private:
     DECLARE_EVENT_TABLE()
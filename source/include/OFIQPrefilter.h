@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQCommandLine.h>
+#include <OFIQImageConversion.h>
+#include <OFIQJson.h>
+
+
+// Gates of the pre-filter, which rejects images that cannot give a usable
+// assessment before OFIQ runs on them: too small, nearly black or white, or
+// heavily blurred. All gates are off with a value of 0.
+struct OFIQPrefilterSettings
+{
+    bool enabled = false;
+    // Minimum length of the shorter image edge in pixels.
+    int minEdge = 160;
+    // Range of the mean luminance, 0 ... 255.
+    double minLuminance = 20.0;
+    double maxLuminance = 235.0;
+    // Maximum fraction of pixels that are black (<= 5) or white (>= 250).
+    double maxClipped = 0.8;
+    // Minimum variance of the Laplacian of the analysis copy; low values mean
+    // that there are hardly any edges, e.g. because of motion blur.
+    double minSharpness = 5.0;
+    // Long edge of the copy the statistics are computed on.
+    int analysisEdge = 256;
+
+    static bool FromCommandLine(const OFIQCommandLine& commandLine, OFIQPrefilterSettings& settings, std::string& error)
+    {
+        settings = OFIQPrefilterSettings();
+        settings.enabled = commandLine.HasOption("prefilter");
+        settings.minEdge = std::max(0, commandLine.GetInt("prefilter-min-edge", settings.minEdge));
+        settings.minLuminance = commandLine.GetDouble("prefilter-min-luminance", settings.minLuminance);
+        settings.maxLuminance = commandLine.GetDouble("prefilter-max-luminance", settings.maxLuminance);
+        settings.maxClipped = commandLine.GetDouble("prefilter-max-clipped", settings.maxClipped);
+        settings.minSharpness = std::max(0.0, commandLine.GetDouble("prefilter-min-sharpness", settings.minSharpness));
+        settings.analysisEdge = commandLine.GetInt("prefilter-analysis-edge", settings.analysisEdge);
+        if (settings.maxLuminance > 0.0 && settings.minLuminance > settings.maxLuminance)
+        {
+            error = "--prefilter-min-luminance must not be greater than --prefilter-max-luminance.";
+            return false;
+        }
+        if (settings.analysisEdge < 32)
+        {
+            error = "--prefilter-analysis-edge must be at least 32.";
+            return false;
+        }
+        return true;
+    }
+
+    // The options giving these settings, e.g. to pass them on to a worker
+    // process.
+    std::vector<std::string> ToArguments() const
+    {
+        if (!enabled)
+        {
+            return {};
+        }
+        return { "--prefilter",
+            "--prefilter-min-edge", std::to_string(minEdge),
+            "--prefilter-min-luminance", std::to_string(minLuminance),
+            "--prefilter-max-luminance", std::to_string(maxLuminance),
+            "--prefilter-max-clipped", std::to_string(maxClipped),
+            "--prefilter-min-sharpness", std::to_string(minSharpness),
+            "--prefilter-analysis-edge", std::to_string(analysisEdge) };
+    }
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "           [--prefilter [--prefilter-min-edge <160>] [--prefilter-min-luminance <20>]" << std::endl
+            << "            [--prefilter-max-luminance <235>] [--prefilter-max-clipped <0.8>]" << std::endl
+            << "            [--prefilter-min-sharpness <5>] [--prefilter-analysis-edge <256>]]" << std::endl;
+    }
+};
+
+// The statistics of one image and whether it passed the gates.
+struct OFIQPrefilterResult
+{
+    bool passed = true;
+    std::string reason;
+    int width = 0;
+    int height = 0;
+    double meanLuminance = 0.0;
+    double clippedFraction = 0.0;
+    double sharpness = 0.0;
+    double seconds = 0.0;
+};
+
+// Computes the pre-filter statistics on a grey copy of the image reduced to
+// the analysis size with area resampling. Reducing the image first keeps the
+// cost at a fraction of a millisecond regardless of the image size, and also
+// makes the sharpness comparable between images of different resolutions.
+// Resampling, the luminance conversion and the Laplacian are vectorized by
+// OpenCV.
+class OFIQPrefilter
+{
+public:
+    static OFIQPrefilterResult Check(const OFIQ::Image& image, const OFIQPrefilterSettings& settings)
+    {
+        auto start = std::chrono::steady_clock::now();
+        OFIQPrefilterResult result;
+        result.width = image.width;
+        result.height = image.height;
+        if (settings.minEdge > 0 && std::min(result.width, result.height) < settings.minEdge)
+        {
+            result.passed = false;
+            result.reason = "image of " + std::to_string(result.width) + "x" + std::to_string(result.height)
+                + " pixels is smaller than " + std::to_string(settings.minEdge) + " pixels";
+            result.seconds = GetSecondsSince(start);
+            return result;
+        }
+
+        cv::Mat grey = GetAnalysisImage(image, settings.analysisEdge);
+        if (grey.empty())
+        {
+            result.passed = false;
+            result.reason = "unsupported image format";
+            result.seconds = GetSecondsSince(start);
+            return result;
+        }
+
+        std::array<uint32_t, 256> histogram{};
+        for (int y = 0; y < grey.rows; y++)
+        {
+            const uint8_t* row = grey.ptr<uint8_t>(y);
+            for (int x = 0; x < grey.cols; x++)
+            {
+                histogram[row[x]]++;
+            }
+        }
+        double pixels = static_cast<double>(grey.total());
+        double sum = 0.0;
+        uint64_t clipped = 0;
+        for (int value = 0; value < 256; value++)
+        {
+            sum += static_cast<double>(value) * histogram[value];
+            if (value <= 5 || value >= 250)
+            {
+                clipped += histogram[value];
+            }
+        }
+        result.meanLuminance = sum / pixels;
+        result.clippedFraction = clipped / pixels;
+
+        cv::Mat laplacian;
+        cv::Laplacian(grey, laplacian, CV_16S);
+        cv::Scalar mean;
+        cv::Scalar deviation;
+        cv::meanStdDev(laplacian, mean, deviation);
+        result.sharpness = deviation[0] * deviation[0];
+
+        if (settings.minLuminance > 0.0 && result.meanLuminance < settings.minLuminance)
+        {
+            result.reason = "mean luminance " + Format(result.meanLuminance) + " is below " + Format(settings.minLuminance);
+        }
+        else if (settings.maxLuminance > 0.0 && result.meanLuminance > settings.maxLuminance)
+        {
+            result.reason = "mean luminance " + Format(result.meanLuminance) + " is above " + Format(settings.maxLuminance);
+        }
+        else if (settings.maxClipped > 0.0 && result.clippedFraction > settings.maxClipped)
+        {
+            result.reason = Format(100.0 * result.clippedFraction) + "% of the pixels are black or white";
+        }
+        else if (settings.minSharpness > 0.0 && result.sharpness < settings.minSharpness)
+        {
+            result.reason = "sharpness " + Format(result.sharpness) + " is below " + Format(settings.minSharpness);
+        }
+        result.passed = result.reason.empty();
+        result.seconds = GetSecondsSince(start);
+        return result;
+    }
+
+private:
+    static cv::Mat GetAnalysisImage(const OFIQ::Image& image, int analysisEdge)
+    {
+        if (image.data == nullptr || (image.depth != 8 && image.depth != 24))
+        {
+            return cv::Mat();
+        }
+        cv::Mat wrapped = OFIQImageConversion::WrapOfiqImage(image);
+        cv::Mat reduced = wrapped;
+        int longEdge = std::max(wrapped.cols, wrapped.rows);
+        if (longEdge > analysisEdge)
+        {
+            double scale = static_cast<double>(analysisEdge) / longEdge;
+            cv::resize(wrapped, reduced, cv::Size(), scale, scale, cv::INTER_AREA);
+        }
+        if (reduced.channels() == 1)
+        {
+            return reduced;
+        }
+        cv::Mat grey;
+        cv::cvtColor(reduced, grey, cv::COLOR_RGB2GRAY);
+        return grey;
+    }
+
+    static double GetSecondsSince(const std::chrono::steady_clock::time_point& start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    static std::string Format(double value)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.1f", value);
+        return buffer;
+    }
+};
+
+// Counts of the pre-filter over a run. The inference time saved is estimated
+// from the mean assessment time of the images that were assessed.
+struct OFIQPrefilterStats
+{
+    size_t checked = 0;
+    size_t rejected = 0;
+    double prefilterSeconds = 0.0;
+    size_t assessed = 0;
+    double assessSeconds = 0.0;
+
+    double GetMeanAssessSeconds() const
+    {
+        return assessed > 0 ? assessSeconds / assessed : 0.0;
+    }
+
+    double GetSavedSeconds() const
+    {
+        return rejected * GetMeanAssessSeconds();
+    }
+
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("checked", checked);
+        json.Set("rejected", rejected);
+        json.Set("prefilter_seconds", prefilterSeconds);
+        json.Set("mean_assess_seconds", GetMeanAssessSeconds());
+        json.Set("estimated_saved_seconds", GetSavedSeconds());
+        return json;
+    }
+};
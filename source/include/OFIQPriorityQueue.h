@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include <OFIQJson.h>
+#include <OFIQStreamingStats.h>
+
+
+// Scheduling classes of OFIQPriorityQueue, highest priority first.
+enum class OFIQPriority
+{
+    Interactive = 0,
+    Batch = 1
+};
+
+constexpr size_t OFIQPriorityCount = 2;
+
+inline const char* GetPriorityName(OFIQPriority priority)
+{
+    return priority == OFIQPriority::Interactive ? "interactive" : "batch";
+}
+
+inline bool ParsePriority(const std::string& name, OFIQPriority& priority)
+{
+    for (size_t i = 0; i < OFIQPriorityCount; i++)
+    {
+        if (name == GetPriorityName(static_cast<OFIQPriority>(i)))
+        {
+            priority = static_cast<OFIQPriority>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Time the items of one class waited in the queue.
+struct OFIQQueueWaitStats
+{
+    uint64_t count = 0;
+    double totalSeconds = 0.0;
+    double maxSeconds = 0.0;
+    double lastSeconds = 0.0;
+    OFIQQuantileSketch sketch;
+
+    void Add(double seconds)
+    {
+        count++;
+        totalSeconds += seconds;
+        maxSeconds = std::max(maxSeconds, seconds);
+        lastSeconds = seconds;
+        sketch.Add(seconds);
+    }
+
+    double GetMeanSeconds() const
+    {
+        return count > 0 ? totalSeconds / static_cast<double>(count) : 0.0;
+    }
+
+    double GetQuantileSeconds(double quantile) const
+    {
+        return count > 0 ? sketch.GetQuantile(quantile) : 0.0;
+    }
+
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("count", static_cast<size_t>(count));
+        json.Set("mean_ms", GetMeanSeconds() * 1000.0);
+        json.Set("p50_ms", GetQuantileSeconds(0.50) * 1000.0);
+        json.Set("p95_ms", GetQuantileSeconds(0.95) * 1000.0);
+        json.Set("max_ms", maxSeconds * 1000.0);
+        return json;
+    }
+};
+
+// A thread-safe queue with one FIFO per priority class. Pop always takes the
+// oldest item of the highest non-empty class, so an interactive item is handed
+// to the next free consumer ahead of all waiting batch items. Each class has
+// its own capacity: Push blocks while the class is full, TryPush fails
+// instead. The time every item waited is recorded per class. After Close,
+// pushing fails and Pop drains the remaining items.
+template <typename T>
+class OFIQPriorityQueue
+{
+public:
+    OFIQPriorityQueue(size_t interactiveCapacity, size_t batchCapacity)
+        : m_capacities{ std::max<size_t>(interactiveCapacity, 1), std::max<size_t>(batchCapacity, 1) }
+        , m_closed(false)
+    {
+        ;
+    }
+
+    bool Push(OFIQPriority priority, T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto& items = m_items[Index(priority)];
+        m_notFull.wait(lock, [&] { return m_closed || items.size() < m_capacities[Index(priority)]; });
+        if (m_closed)
+        {
+            return false;
+        }
+        items.emplace_back(std::move(item), std::chrono::steady_clock::now());
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    bool TryPush(OFIQPriority priority, T item)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& items = m_items[Index(priority)];
+        if (m_closed || items.size() >= m_capacities[Index(priority)])
+        {
+            return false;
+        }
+        items.emplace_back(std::move(item), std::chrono::steady_clock::now());
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty. Otherwise returns the
+    // item, its class and the time it waited.
+    bool Pop(T& item, OFIQPriority& priority, double& waitSeconds)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !IsEmpty(); });
+        for (size_t i = 0; i < OFIQPriorityCount; i++)
+        {
+            if (m_items[i].empty())
+            {
+                continue;
+            }
+            auto& front = m_items[i].front();
+            item = std::move(front.first);
+            waitSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - front.second).count();
+            priority = static_cast<OFIQPriority>(i);
+            m_items[i].pop_front();
+            m_waits[i].Add(waitSeconds);
+            m_notFull.notify_all();
+            return true;
+        }
+        return false;
+    }
+
+    bool Pop(T& item)
+    {
+        OFIQPriority priority;
+        double waitSeconds;
+        return Pop(item, priority, waitSeconds);
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+    }
+
+    size_t Size(OFIQPriority priority) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items[Index(priority)].size();
+    }
+
+    size_t Size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t size = 0;
+        for (const auto& items : m_items)
+        {
+            size += items.size();
+        }
+        return size;
+    }
+
+    size_t Capacity(OFIQPriority priority) const
+    {
+        return m_capacities[Index(priority)];
+    }
+
+    OFIQQueueWaitStats GetWaitStats(OFIQPriority priority) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_waits[Index(priority)];
+    }
+
+    // The queue depth and wait times of every class, for reports.
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        for (size_t i = 0; i < OFIQPriorityCount; i++)
+        {
+            auto priority = static_cast<OFIQPriority>(i);
+            OFIQJsonValue entry = GetWaitStats(priority).ToJson();
+            entry.Set("queue_depth", Size(priority));
+            entry.Set("queue_capacity", Capacity(priority));
+            json.Set(GetPriorityName(priority), entry);
+        }
+        return json;
+    }
+
+private:
+    static size_t Index(OFIQPriority priority)
+    {
+        return static_cast<size_t>(priority);
+    }
+
+    bool IsEmpty() const
+    {
+        for (const auto& items : m_items)
+        {
+            if (!items.empty())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const std::array<size_t, OFIQPriorityCount> m_capacities;
+    bool m_closed;
+    std::array<std::deque<std::pair<T, std::chrono::steady_clock::time_point>>, OFIQPriorityCount> m_items;
+    std::array<OFIQQueueWaitStats, OFIQPriorityCount> m_waits;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+};
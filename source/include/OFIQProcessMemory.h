@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#include <mach/mach.h>
+#include <sys/resource.h>
+#else
+#include <malloc.h>
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#define OFIQ_HAVE_MALLINFO2 1
+#endif
+
+
+// Resident set size and heap usage of the running process.
+class OFIQProcessMemory
+{
+public:
+    // Current resident set size in bytes, 0 if unknown.
+    static uint64_t GetCurrentRss()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.WorkingSetSize;
+        }
+        return 0;
+#elif defined(__APPLE__)
+        mach_task_basic_info info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS)
+        {
+            return info.resident_size;
+        }
+        return 0;
+#else
+        return ReadProcStatus("VmRSS:");
+#endif
+    }
+
+    // Peak resident set size in bytes, 0 if unknown.
+    static uint64_t GetPeakRss()
+    {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#elif defined(__APPLE__)
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+        {
+            return static_cast<uint64_t>(usage.ru_maxrss); // bytes on macOS
+        }
+        return 0;
+#else
+        uint64_t peak = ReadProcStatus("VmHWM:");
+        if (peak == 0)
+        {
+            struct rusage usage;
+            if (getrusage(RUSAGE_SELF, &usage) == 0)
+            {
+                peak = static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes on Linux
+            }
+        }
+        return peak;
+#endif
+    }
+
+    // Bytes allocated from the C heap and not yet freed, 0 if unknown. Unlike
+    // the RSS, this does not include memory the allocator keeps for reuse.
+    static uint64_t GetHeapInUse()
+    {
+#if defined(OFIQ_HAVE_MALLINFO2)
+        struct mallinfo2 info = mallinfo2();
+        return static_cast<uint64_t>(info.uordblks) + static_cast<uint64_t>(info.hblkhd);
+#elif defined(__APPLE__)
+        malloc_statistics_t statistics;
+        malloc_zone_statistics(nullptr, &statistics);
+        return static_cast<uint64_t>(statistics.size_in_use);
+#else
+        return 0;
+#endif
+    }
+
+    // Returns memory the allocator keeps for reuse to the system where
+    // possible, so that the RSS follows the memory actually in use.
+    static void ReleaseFreeHeap()
+    {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#endif
+    }
+
+private:
+#if !defined(_WIN32) && !defined(__APPLE__)
+    static uint64_t ReadProcStatus(const char* key)
+    {
+        uint64_t value = 0;
+        FILE* file = fopen("/proc/self/status", "r");
+        if (file == nullptr)
+        {
+            return value;
+        }
+        char line[256];
+        size_t keyLength = strlen(key);
+        while (fgets(line, sizeof(line), file) != nullptr)
+        {
+            if (strncmp(line, key, keyLength) == 0)
+            {
+                unsigned long long kilobytes = 0;
+                if (sscanf(line + keyLength, "%llu", &kilobytes) == 1)
+                {
+                    value = static_cast<uint64_t>(kilobytes) * 1024;
+                }
+                break;
+            }
+        }
+        fclose(file);
+        return value;
+    }
+#endif
+};
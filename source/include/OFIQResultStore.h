@@ -0,0 +1,1148 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ofiq_lib.h>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQCommandLine.h>
+#include <OFIQJson.h>
+#include <OFIQMappedFile.h>
+
+
+// A columnar store of assessment results for result sets too large for CSV
+// files. A store is a directory:
+//
+//   store.json                 format, version, byte order, measures and the
+//                              number of committed rows
+//   <measure>.raw.f64          raw score per row, double
+//   <measure>.scalar.f32       scalar value per row, float
+//   <measure>.code.u8          OFIQ::QualityMeasureReturnCode per row, or
+//                              rejectedCode for images rejected by the
+//                              pre-filter
+//   paths.bin                  the image paths, concatenated
+//   paths.end.u64              end offset of the path of every row in paths.bin
+//
+// Every column is a plain array in the byte order of the machine, so it is
+// used in place once the file is mapped, and a scan over one measure only
+// reads that measure's pages. Rows are appended in blocks: the columns are
+// written first and store.json, replaced atomically, commits the new row
+// count last. Data behind the committed rows, e.g. after a crash, is ignored
+// by readers and cut off when the store is opened for appending again. A store
+// has one writer at a time, which holds an exclusive lock on store.lock.
+class OFIQResultStoreLayout
+{
+public:
+    static constexpr int version = 1;
+
+    // Return code of all measures of an image the pre-filter rejected; OFIQ
+    // never assessed it, which no OFIQ::QualityMeasureReturnCode expresses.
+    static constexpr uint8_t rejectedCode = 0xff;
+
+    static std::string GetMetaPath(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "store.json").u8string();
+    }
+
+    static std::string GetRawPath(const std::string& directory, const std::string& measure)
+    {
+        return (std::filesystem::path(directory) / (measure + ".raw.f64")).u8string();
+    }
+
+    static std::string GetScalarPath(const std::string& directory, const std::string& measure)
+    {
+        return (std::filesystem::path(directory) / (measure + ".scalar.f32")).u8string();
+    }
+
+    static std::string GetCodePath(const std::string& directory, const std::string& measure)
+    {
+        return (std::filesystem::path(directory) / (measure + ".code.u8")).u8string();
+    }
+
+    static std::string GetLockPath(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "store.lock").u8string();
+    }
+
+    static std::string GetPathsPath(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "paths.bin").u8string();
+    }
+
+    static std::string GetPathEndsPath(const std::string& directory)
+    {
+        return (std::filesystem::path(directory) / "paths.end.u64").u8string();
+    }
+
+    static bool IsStore(const std::string& directory)
+    {
+        return std::filesystem::is_regular_file(GetMetaPath(directory));
+    }
+
+    static bool IsLittleEndian()
+    {
+        const uint16_t value = 1;
+        uint8_t first = 0;
+        memcpy(&first, &value, 1);
+        return first == 1;
+    }
+
+    static bool FindMeasure(const std::string& name, OFIQ::QualityMeasure& measure)
+    {
+        for (const auto& [id, measureName] : measurementMapping)
+        {
+            if (measureName == name && id != -1)
+            {
+                measure = static_cast<OFIQ::QualityMeasure>(id);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool LoadMeta(const std::string& directory, std::vector<std::string>& measures, size_t& rows, std::string& error)
+    {
+        OFIQJsonValue meta;
+        if (!OFIQJsonValue::LoadFromFile(GetMetaPath(directory), meta, error))
+        {
+            error = "Cannot read result store '" + directory + "': " + error;
+            return false;
+        }
+        if (meta.Get("format").AsString() != "ofiq-result-store" || meta.Get("version").AsNumber() != version)
+        {
+            error = "'" + directory + "' is not a result store of version " + std::to_string(version) + ".";
+            return false;
+        }
+        if (meta.Get("little_endian").AsBool() != IsLittleEndian())
+        {
+            error = "Result store '" + directory + "' was written with a different byte order.";
+            return false;
+        }
+        measures.clear();
+        const OFIQJsonValue& measureList = meta.Get("measures");
+        for (size_t i = 0; i < measureList.Size(); i++)
+        {
+            measures.push_back(measureList.At(i).AsString());
+        }
+        rows = static_cast<size_t>(meta.Get("rows").AsNumber());
+        return true;
+    }
+
+    static bool SaveMeta(const std::string& directory, const std::vector<std::string>& measures, size_t rows, std::string& error)
+    {
+        OFIQJsonValue measureList = OFIQJsonValue::Array();
+        for (const auto& measure : measures)
+        {
+            measureList.Append(measure);
+        }
+        OFIQJsonValue meta = OFIQJsonValue::Object();
+        meta.Set("format", "ofiq-result-store");
+        meta.Set("version", version);
+        meta.Set("little_endian", IsLittleEndian());
+        meta.Set("rows", rows);
+        meta.Set("measures", measureList);
+
+        std::string metaPath = GetMetaPath(directory);
+        std::string temporaryPath = metaPath + ".tmp";
+        std::error_code ec;
+        if (!meta.SaveToFile(temporaryPath))
+        {
+            error = "Cannot write '" + temporaryPath + "'";
+            return false;
+        }
+        std::filesystem::rename(temporaryPath, metaPath, ec);
+        if (ec)
+        {
+            error = "Cannot replace '" + metaPath + "': " + ec.message();
+            return false;
+        }
+        return true;
+    }
+};
+
+// The exclusive lock of the writer of a result store. It is released when the
+// process ends, so a crashed writer does not leave the store locked.
+class OFIQResultStoreLock
+{
+public:
+    OFIQResultStoreLock()
+#if defined(_WIN32)
+        : m_handle(INVALID_HANDLE_VALUE)
+#else
+        : m_fd(-1)
+#endif
+    {
+        ;
+    }
+
+    ~OFIQResultStoreLock()
+    {
+        Release();
+    }
+
+    OFIQResultStoreLock(const OFIQResultStoreLock&) = delete;
+    OFIQResultStoreLock& operator=(const OFIQResultStoreLock&) = delete;
+
+    // Fails without waiting if another writer holds the lock.
+    bool Acquire(const std::string& directory, std::string& error)
+    {
+        Release();
+        const std::string path = OFIQResultStoreLayout::GetLockPath(directory);
+#if defined(_WIN32)
+        m_handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_handle == INVALID_HANDLE_VALUE)
+        {
+            error = GetLastError() == ERROR_SHARING_VIOLATION
+                ? "Result store '" + directory + "' is in use by another writer."
+                : "Cannot create '" + path + "'";
+            return false;
+        }
+#else
+        m_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            error = "Cannot create '" + path + "': " + strerror(errno);
+            return false;
+        }
+        if (flock(m_fd, LOCK_EX | LOCK_NB) != 0)
+        {
+            error = errno == EWOULDBLOCK
+                ? "Result store '" + directory + "' is in use by another writer."
+                : "Cannot lock '" + path + "': " + strerror(errno);
+            Release();
+            return false;
+        }
+#endif
+        return true;
+    }
+
+    void Release()
+    {
+#if defined(_WIN32)
+        if (m_handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_handle);
+            m_handle = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (m_fd >= 0)
+        {
+            close(m_fd);
+            m_fd = -1;
+        }
+#endif
+    }
+
+private:
+#if defined(_WIN32)
+    HANDLE m_handle;
+#else
+    int m_fd;
+#endif
+};
+
+// Appends assessment results to a result store. Rows are buffered and written
+// every flushRows rows and by Flush. As with OFIQAssessmentCsvWriter, the
+// measures of a new store are taken from the first image that has been
+// assessed successfully, unless they are set before.
+class OFIQResultStoreWriter
+{
+public:
+    static constexpr size_t flushRows = 4096;
+
+    OFIQResultStoreWriter()
+        : m_pathsBase(0)
+        , m_committedRows(0)
+        , m_pendingRows(0)
+        , m_measuresKnown(false)
+        , m_recoveryPending(false)
+    {
+        ;
+    }
+
+    ~OFIQResultStoreWriter()
+    {
+        std::string error;
+        Finish(error);
+    }
+
+    OFIQResultStoreWriter(const OFIQResultStoreWriter&) = delete;
+    OFIQResultStoreWriter& operator=(const OFIQResultStoreWriter&) = delete;
+
+    // Opens the store in the directory for appending, or creates it. Fails if
+    // another writer has the store open.
+    bool Open(const std::string& directory, std::string& error)
+    {
+        m_directory.clear();
+        m_lock.Release();
+        m_columns.clear();
+        m_paths.clear();
+        m_pathEnds.clear();
+        m_pendingCodes.clear();
+        m_pathsBase = 0;
+        m_pendingRows = 0;
+        m_committedRows = 0;
+        m_measuresKnown = false;
+        m_recoveryPending = false;
+
+        std::error_code ec;
+        std::filesystem::create_directories(directory, ec);
+        if (ec)
+        {
+            error = "Cannot create result store '" + directory + "': " + ec.message();
+            return false;
+        }
+        if (!m_lock.Acquire(directory, error))
+        {
+            return false;
+        }
+        m_directory = directory;
+        if (!OFIQResultStoreLayout::IsStore(directory))
+        {
+            return true;
+        }
+
+        std::vector<std::string> measures;
+        if (!OFIQResultStoreLayout::LoadMeta(directory, measures, m_committedRows, error)
+            || !SetMeasures(measures, error))
+        {
+            return false;
+        }
+        return Recover(error);
+    }
+
+    // Sets the measures of a new store, e.g. from the header of a CSV file.
+    bool SetMeasures(const std::vector<std::string>& measures, std::string& error)
+    {
+        if (m_measuresKnown)
+        {
+            error = "The measures of the result store are already set.";
+            return false;
+        }
+        for (const auto& name : measures)
+        {
+            Column column;
+            column.name = name;
+            if (!OFIQResultStoreLayout::FindMeasure(name, column.measure))
+            {
+                error = "Unknown measure '" + name + "' in result store.";
+                return false;
+            }
+            m_columns.push_back(column);
+        }
+        m_measuresKnown = true;
+        // Rows appended before the measures were known have no results.
+        for (auto& column : m_columns)
+        {
+            const OFIQ::QualityMeasureResult notAssessed;
+            column.raw.assign(m_pendingRows, notAssessed.rawScore);
+            column.scalar.assign(m_pendingRows, static_cast<float>(notAssessed.scalar));
+            column.code = m_pendingCodes;
+        }
+        m_pendingCodes.clear();
+        return true;
+    }
+
+    // Appends a row; measures of the store missing in the assessment are
+    // stored with the defaults of OFIQ::QualityMeasureResult. All measures of
+    // a rejected row get OFIQResultStoreLayout::rejectedCode.
+    bool Append(const std::string& path, const OFIQ::FaceImageQualityAssessment& assessments, bool rejected, std::string& error)
+    {
+        if (!m_measuresKnown && !assessments.qAssessments.empty())
+        {
+            std::vector<std::string> measures;
+            for (auto measure : OFIQAssessmentCsv::GetMeasures(assessments))
+            {
+                measures.push_back(GetMeasureName(measure));
+            }
+            if (!SetMeasures(measures, error))
+            {
+                return false;
+            }
+        }
+
+        const OFIQ::QualityMeasureResult notAssessed;
+        if (!m_measuresKnown)
+        {
+            m_pendingCodes.push_back(rejected ? OFIQResultStoreLayout::rejectedCode : static_cast<uint8_t>(notAssessed.code));
+        }
+        for (auto& column : m_columns)
+        {
+            auto it = assessments.qAssessments.find(column.measure);
+            const OFIQ::QualityMeasureResult& result = it != assessments.qAssessments.end() ? it->second : notAssessed;
+            column.raw.push_back(result.rawScore);
+            column.scalar.push_back(static_cast<float>(result.scalar));
+            column.code.push_back(rejected ? OFIQResultStoreLayout::rejectedCode : static_cast<uint8_t>(result.code));
+        }
+        AppendPath(path);
+        return m_pendingRows < flushRows || !m_measuresKnown || Flush(error);
+    }
+
+    // Appends a row given as the results of the store's measures in order.
+    bool Append(const std::string& path, const std::vector<OFIQ::QualityMeasureResult>& results, std::string& error)
+    {
+        if (!m_measuresKnown || results.size() != m_columns.size())
+        {
+            error = "The row does not match the measures of the result store.";
+            return false;
+        }
+        for (size_t i = 0; i < m_columns.size(); i++)
+        {
+            m_columns[i].raw.push_back(results[i].rawScore);
+            m_columns[i].scalar.push_back(static_cast<float>(results[i].scalar));
+            m_columns[i].code.push_back(static_cast<uint8_t>(results[i].code));
+        }
+        AppendPath(path);
+        return m_pendingRows < flushRows || Flush(error);
+    }
+
+    // Writes the buffered rows and commits them. Rows are kept back while
+    // the measures are not known. If writing fails, the files are cut back
+    // to the committed rows, so that the rows can be flushed again without
+    // the columns getting out of step.
+    bool Flush(std::string& error)
+    {
+        if (m_directory.empty() || !m_measuresKnown
+            || (m_pendingRows == 0 && OFIQResultStoreLayout::IsStore(m_directory)))
+        {
+            return true;
+        }
+        if (m_recoveryPending && !Recover(error))
+        {
+            return false;
+        }
+        m_recoveryPending = false;
+        if (!WritePendingRows(error))
+        {
+            std::string recoverError;
+            m_recoveryPending = !Recover(recoverError);
+            if (m_recoveryPending)
+            {
+                error += " " + recoverError;
+            }
+            return false;
+        }
+        m_committedRows += m_pendingRows;
+        m_pendingRows = 0;
+        m_pathsBase += m_paths.size();
+        for (auto& column : m_columns)
+        {
+            column.raw.clear();
+            column.scalar.clear();
+            column.code.clear();
+        }
+        m_paths.clear();
+        m_pathEnds.clear();
+        return true;
+    }
+
+    // Writes rows that are still waiting for the measures, without results,
+    // and flushes.
+    bool Finish(std::string& error)
+    {
+        if (!m_measuresKnown && m_pendingRows > 0 && !SetMeasures({}, error))
+        {
+            return false;
+        }
+        return Flush(error);
+    }
+
+    size_t GetRowCount() const
+    {
+        return m_committedRows + m_pendingRows;
+    }
+
+private:
+    struct Column
+    {
+        std::string name;
+        OFIQ::QualityMeasure measure = OFIQ::QualityMeasure::NotSet;
+        std::vector<double> raw;
+        std::vector<float> scalar;
+        std::vector<uint8_t> code;
+    };
+
+    void AppendPath(const std::string& path)
+    {
+        m_paths.insert(m_paths.end(), path.begin(), path.end());
+        m_pathEnds.push_back(m_pathsBase + m_paths.size());
+        m_pendingRows++;
+    }
+
+    // Appends the buffered rows to the files and commits them in the meta
+    // file.
+    bool WritePendingRows(std::string& error)
+    {
+        for (const auto& column : m_columns)
+        {
+            if (!AppendToFile(OFIQResultStoreLayout::GetRawPath(m_directory, column.name), column.raw, error)
+                || !AppendToFile(OFIQResultStoreLayout::GetScalarPath(m_directory, column.name), column.scalar, error)
+                || !AppendToFile(OFIQResultStoreLayout::GetCodePath(m_directory, column.name), column.code, error))
+            {
+                return false;
+            }
+        }
+        if (!AppendToFile(OFIQResultStoreLayout::GetPathsPath(m_directory), m_paths, error)
+            || !AppendToFile(OFIQResultStoreLayout::GetPathEndsPath(m_directory), m_pathEnds, error))
+        {
+            return false;
+        }
+
+        std::vector<std::string> measures;
+        for (const auto& column : m_columns)
+        {
+            measures.push_back(column.name);
+        }
+        return OFIQResultStoreLayout::SaveMeta(m_directory, measures, m_committedRows + m_pendingRows, error);
+    }
+
+    // Cuts off data behind the committed rows left by an interrupted or
+    // failed flush.
+    bool Recover(std::string& error)
+    {
+        for (const auto& column : m_columns)
+        {
+            if (!Truncate(OFIQResultStoreLayout::GetRawPath(m_directory, column.name), m_committedRows * sizeof(double), error)
+                || !Truncate(OFIQResultStoreLayout::GetScalarPath(m_directory, column.name), m_committedRows * sizeof(float), error)
+                || !Truncate(OFIQResultStoreLayout::GetCodePath(m_directory, column.name), m_committedRows, error))
+            {
+                return false;
+            }
+        }
+        std::string pathEndsPath = OFIQResultStoreLayout::GetPathEndsPath(m_directory);
+        if (!Truncate(pathEndsPath, m_committedRows * sizeof(uint64_t), error))
+        {
+            return false;
+        }
+        m_pathsBase = 0;
+        if (m_committedRows > 0)
+        {
+            std::ifstream stream(pathEndsPath.c_str(), std::ios::binary);
+            stream.seekg(static_cast<std::streamoff>((m_committedRows - 1) * sizeof(uint64_t)));
+            if (!stream.read(reinterpret_cast<char*>(&m_pathsBase), sizeof(m_pathsBase)))
+            {
+                error = "Cannot read '" + pathEndsPath + "'";
+                return false;
+            }
+        }
+        return Truncate(OFIQResultStoreLayout::GetPathsPath(m_directory), m_pathsBase, error);
+    }
+
+    static bool Truncate(const std::string& path, uint64_t size, std::string& error)
+    {
+        std::error_code ec;
+        uint64_t fileSize = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+        if (ec || fileSize < size)
+        {
+            error = "Result store file '" + path + "' is shorter than its committed rows.";
+            return false;
+        }
+        if (fileSize > size)
+        {
+            std::filesystem::resize_file(path, size, ec);
+            if (ec)
+            {
+                error = "Cannot truncate '" + path + "': " + ec.message();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    static bool AppendToFile(const std::string& path, const std::vector<T>& values, std::string& error)
+    {
+        FILE* file = fopen(path.c_str(), "ab");
+        if (file == nullptr)
+        {
+            error = "Cannot write '" + path + "'";
+            return false;
+        }
+        bool written = values.empty() || fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+        written = fclose(file) == 0 && written;
+        if (!written)
+        {
+            error = "Writing '" + path + "' failed.";
+        }
+        return written;
+    }
+
+    OFIQResultStoreLock m_lock;
+    std::string m_directory;
+    std::vector<Column> m_columns;
+    std::vector<char> m_paths;
+    std::vector<uint64_t> m_pathEnds;
+    // Codes of the rows appended before the measures were known.
+    std::vector<uint8_t> m_pendingCodes;
+    uint64_t m_pathsBase;
+    size_t m_committedRows;
+    size_t m_pendingRows;
+    bool m_measuresKnown;
+    // A failed flush could not be cut back; it is retried before the next
+    // flush.
+    bool m_recoveryPending;
+};
+
+// A condition on one measure, e.g. "UnifiedQualityScore<30" on the scalar
+// values or "Sharpness.raw>=0.4" on the raw scores. Rows where the measure
+// was not assessed successfully never match.
+struct OFIQResultFilter
+{
+    enum class Operator { Less, LessEqual, Greater, GreaterEqual, Equal, NotEqual };
+
+    std::string measure;
+    bool raw = false;
+    Operator op = Operator::Less;
+    double value = 0.0;
+
+    static bool Parse(const std::string& text, OFIQResultFilter& filter, std::string& error)
+    {
+        filter = OFIQResultFilter();
+        size_t position = text.find_first_of("<>=!");
+        if (position == std::string::npos || position == 0)
+        {
+            error = "Invalid filter '" + text + "', expected e.g. UnifiedQualityScore<30.";
+            return false;
+        }
+        filter.measure = Trim(text.substr(0, position));
+        std::string rawSuffix = ".raw";
+        std::string scalarSuffix = ".scalar";
+        if (EndsWith(filter.measure, rawSuffix))
+        {
+            filter.raw = true;
+            filter.measure.resize(filter.measure.size() - rawSuffix.size());
+        }
+        else if (EndsWith(filter.measure, scalarSuffix))
+        {
+            filter.measure.resize(filter.measure.size() - scalarSuffix.size());
+        }
+
+        static const std::vector<std::pair<std::string, Operator>> operators = {
+            { "<=", Operator::LessEqual }, { ">=", Operator::GreaterEqual }, { "==", Operator::Equal },
+            { "!=", Operator::NotEqual }, { "<", Operator::Less }, { ">", Operator::Greater }, { "=", Operator::Equal }
+        };
+        size_t valuePosition = std::string::npos;
+        for (const auto& [token, op] : operators)
+        {
+            if (text.compare(position, token.size(), token) == 0)
+            {
+                filter.op = op;
+                valuePosition = position + token.size();
+                break;
+            }
+        }
+        std::string value = valuePosition == std::string::npos ? std::string() : Trim(text.substr(valuePosition));
+        char* end = nullptr;
+        filter.value = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end != '\0')
+        {
+            error = "Invalid filter '" + text + "', expected e.g. UnifiedQualityScore<30.";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static std::string Trim(const std::string& text)
+    {
+        size_t begin = text.find_first_not_of(" \t");
+        size_t end = text.find_last_not_of(" \t");
+        return begin == std::string::npos ? std::string() : text.substr(begin, end - begin + 1);
+    }
+
+    static bool EndsWith(const std::string& text, const std::string& suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+};
+
+// Read access to a result store. All columns are mapped into memory when the
+// store is opened; nothing is read until a column is used.
+class OFIQResultStore
+{
+public:
+    OFIQResultStore()
+        : m_rows(0)
+    {
+        ;
+    }
+
+    bool Open(const std::string& directory, std::string& error)
+    {
+        m_columns.clear();
+        if (!OFIQResultStoreLayout::LoadMeta(directory, m_measures, m_rows, error))
+        {
+            return false;
+        }
+        for (const auto& name : m_measures)
+        {
+            auto column = std::make_unique<Column>();
+            if (!OFIQResultStoreLayout::FindMeasure(name, column->measure))
+            {
+                error = "Unknown measure '" + name + "' in result store.";
+                return false;
+            }
+            if (!Map(column->raw, OFIQResultStoreLayout::GetRawPath(directory, name), sizeof(double), error)
+                || !Map(column->scalar, OFIQResultStoreLayout::GetScalarPath(directory, name), sizeof(float), error)
+                || !Map(column->code, OFIQResultStoreLayout::GetCodePath(directory, name), 1, error))
+            {
+                return false;
+            }
+            m_columns.push_back(std::move(column));
+        }
+        if (!Map(m_pathEnds, OFIQResultStoreLayout::GetPathEndsPath(directory), sizeof(uint64_t), error)
+            || !m_paths.Open(OFIQResultStoreLayout::GetPathsPath(directory), error))
+        {
+            return false;
+        }
+        if (m_rows > 0 && GetPathEnds()[m_rows - 1] > m_paths.GetSize())
+        {
+            error = "Result store file '" + OFIQResultStoreLayout::GetPathsPath(directory) + "' is shorter than its committed rows.";
+            return false;
+        }
+        return true;
+    }
+
+    size_t GetRowCount() const
+    {
+        return m_rows;
+    }
+
+    const std::vector<std::string>& GetMeasures() const
+    {
+        return m_measures;
+    }
+
+    // Index of the measure in GetMeasures(), -1 if the store does not have it.
+    int FindMeasure(const std::string& name) const
+    {
+        auto it = std::find(m_measures.begin(), m_measures.end(), name);
+        return it != m_measures.end() ? static_cast<int>(it - m_measures.begin()) : -1;
+    }
+
+    const double* GetRawScores(size_t measure) const
+    {
+        return reinterpret_cast<const double*>(m_columns[measure]->raw.GetData());
+    }
+
+    const float* GetScalars(size_t measure) const
+    {
+        return reinterpret_cast<const float*>(m_columns[measure]->scalar.GetData());
+    }
+
+    const uint8_t* GetCodes(size_t measure) const
+    {
+        return m_columns[measure]->code.GetData();
+    }
+
+    // Whether the pre-filter rejected the image of the row.
+    bool IsRejected(size_t row) const
+    {
+        return !m_columns.empty() && GetCodes(0)[row] == OFIQResultStoreLayout::rejectedCode;
+    }
+
+    std::string GetPath(size_t row) const
+    {
+        const uint64_t* ends = GetPathEnds();
+        uint64_t begin = row > 0 ? ends[row - 1] : 0;
+        return std::string(reinterpret_cast<const char*>(m_paths.GetData()) + begin, static_cast<size_t>(ends[row] - begin));
+    }
+
+    OFIQ::FaceImageQualityAssessment GetAssessments(size_t row) const
+    {
+        OFIQ::FaceImageQualityAssessment assessments;
+        for (size_t i = 0; i < m_columns.size(); i++)
+        {
+            OFIQ::QualityMeasureResult result;
+            result.rawScore = GetRawScores(i)[row];
+            result.scalar = GetScalars(i)[row];
+            result.code = static_cast<OFIQ::QualityMeasureReturnCode>(GetCodes(i)[row]);
+            assessments.qAssessments[m_columns[i]->measure] = result;
+        }
+        return assessments;
+    }
+
+    // The rows matching the filter, in ascending order. The comparison runs
+    // over blocks of the mapped column into a mask without branches, which
+    // the compiler vectorizes; only the matching rows are collected.
+    bool Select(const OFIQResultFilter& filter, std::vector<size_t>& rows, std::string& error) const
+    {
+        rows.clear();
+        int measure = FindMeasure(filter.measure);
+        if (measure < 0)
+        {
+            error = "The result store has no measure '" + filter.measure + "'.";
+            return false;
+        }
+        const uint8_t* codes = GetCodes(measure);
+        if (filter.raw)
+        {
+            Scan(GetRawScores(measure), codes, filter.op, filter.value, rows);
+        }
+        else
+        {
+            Scan(GetScalars(measure), codes, filter.op, static_cast<float>(filter.value), rows);
+        }
+        return true;
+    }
+
+private:
+    struct Column
+    {
+        OFIQ::QualityMeasure measure = OFIQ::QualityMeasure::NotSet;
+        OFIQMappedFile raw;
+        OFIQMappedFile scalar;
+        OFIQMappedFile code;
+    };
+
+    bool Map(OFIQMappedFile& file, const std::string& path, size_t width, std::string& error) const
+    {
+        if (m_rows == 0 && !std::filesystem::exists(path))
+        {
+            return true;
+        }
+        if (!file.Open(path, error))
+        {
+            return false;
+        }
+        if (file.GetSize() < m_rows * width)
+        {
+            error = "Result store file '" + path + "' is shorter than its committed rows.";
+            return false;
+        }
+        return true;
+    }
+
+    const uint64_t* GetPathEnds() const
+    {
+        return reinterpret_cast<const uint64_t*>(m_pathEnds.GetData());
+    }
+
+    template <typename T>
+    void Scan(const T* values, const uint8_t* codes, OFIQResultFilter::Operator op, T value, std::vector<size_t>& rows) const
+    {
+        using Operator = OFIQResultFilter::Operator;
+        switch (op)
+        {
+        case Operator::Less:
+            ScanBlocks(values, codes, rows, [value](T v) { return v < value; });
+            break;
+        case Operator::LessEqual:
+            ScanBlocks(values, codes, rows, [value](T v) { return v <= value; });
+            break;
+        case Operator::Greater:
+            ScanBlocks(values, codes, rows, [value](T v) { return v > value; });
+            break;
+        case Operator::GreaterEqual:
+            ScanBlocks(values, codes, rows, [value](T v) { return v >= value; });
+            break;
+        case Operator::Equal:
+            ScanBlocks(values, codes, rows, [value](T v) { return v == value; });
+            break;
+        case Operator::NotEqual:
+            ScanBlocks(values, codes, rows, [value](T v) { return v != value; });
+            break;
+        }
+    }
+
+    template <typename T, typename Compare>
+    void ScanBlocks(const T* values, const uint8_t* codes, std::vector<size_t>& rows, Compare compare) const
+    {
+        constexpr size_t blockRows = 4096;
+        const uint8_t success = static_cast<uint8_t>(OFIQ::QualityMeasureReturnCode::Success);
+        uint8_t mask[blockRows];
+        for (size_t begin = 0; begin < m_rows; begin += blockRows)
+        {
+            const size_t count = std::min(blockRows, m_rows - begin);
+            const T* blockValues = values + begin;
+            const uint8_t* blockCodes = codes + begin;
+            for (size_t i = 0; i < count; i++)
+            {
+                mask[i] = static_cast<uint8_t>(compare(blockValues[i])) & static_cast<uint8_t>(blockCodes[i] == success);
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                if (mask[i] != 0)
+                {
+                    rows.push_back(begin + i);
+                }
+            }
+        }
+    }
+
+    std::vector<std::string> m_measures;
+    std::vector<std::unique_ptr<Column>> m_columns;
+    OFIQMappedFile m_paths;
+    OFIQMappedFile m_pathEnds;
+    size_t m_rows;
+};
+
+// --store: converts between assessment CSV files and result stores and
+// selects rows of a store by a filter on one measure.
+//
+// The CSV layout has no return codes. On import, a measure whose raw score
+// and scalar value are both -1 is taken as not assessed, any other as
+// successfully assessed, and all measures of rows with the status "rejected"
+// get OFIQResultStoreLayout::rejectedCode; on export, the codes are dropped
+// and the status columns are written if the store has rejected rows. The
+// reason of a rejection is not kept in the store.
+class OFIQResultStoreTool
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --store --input <results.csv> --output <store directory>" << std::endl
+            << "       OFIQDemonstrator --store --input <store directory> --output <results.csv> [--filter <condition>]" << std::endl
+            << "       OFIQDemonstrator --store --input <store directory> --filter <condition>" << std::endl
+            << "       A condition compares the scalar values or raw scores of one measure," << std::endl
+            << "       e.g. \"UnifiedQualityScore<30\" or \"Sharpness.raw>=0.4\"." << std::endl
+            << "       Without --output, the paths of the matching rows are printed." << std::endl;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string input = commandLine.GetString("input");
+        std::string output = commandLine.GetString("output");
+        if (input.empty() || (output.empty() && !commandLine.HasOption("filter")))
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::string error;
+        if (!OFIQResultStoreLayout::IsStore(input))
+        {
+            if (output.empty() || !Import(input, output, error))
+            {
+                std::cerr << "ERROR: " << (error.empty() ? "--output is required to import '" + input + "'." : error) << std::endl;
+                return 1;
+            }
+            return 0;
+        }
+
+        OFIQResultStore store;
+        if (!store.Open(input, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        std::vector<size_t> rows;
+        bool filtered = commandLine.HasOption("filter");
+        if (filtered)
+        {
+            OFIQResultFilter filter;
+            auto start = std::chrono::steady_clock::now();
+            if (!OFIQResultFilter::Parse(commandLine.GetString("filter"), filter, error)
+                || !store.Select(filter, rows, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cerr << rows.size() << " of " << store.GetRowCount() << " rows match (scanned in "
+                << seconds * 1000.0 << " ms)." << std::endl;
+        }
+
+        if (output.empty())
+        {
+            for (size_t row : rows)
+            {
+                std::cout << store.GetPath(row) << "\n";
+            }
+            std::cout.flush();
+            return 0;
+        }
+
+        if (!Export(store, filtered ? &rows : nullptr, output))
+        {
+            std::cerr << "ERROR: Cannot write '" << output << "'" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+private:
+    static bool Import(const std::string& csvPath, const std::string& directory, std::string& error)
+    {
+        std::ifstream stream(csvPath.c_str());
+        if (!stream.is_open())
+        {
+            error = "Cannot open '" + csvPath + "'";
+            return false;
+        }
+        std::string line;
+        std::vector<std::string> header;
+        while (header.empty() && std::getline(stream, line))
+        {
+            TrimLine(line);
+            if (!line.empty())
+            {
+                header = OFIQAssessmentCsv::SplitLine(line);
+            }
+        }
+        // Filename, the raw scores of n measures, then their scalar values,
+        // optionally followed by the status columns.
+        const auto& statusColumns = OFIQAssessmentCsv::GetStatusColumns();
+        const bool hasStatus = header.size() > statusColumns.size()
+            && std::equal(statusColumns.begin(), statusColumns.end(), header.end() - statusColumns.size());
+        const size_t valueColumns = header.size() - 1 - (hasStatus ? statusColumns.size() : 0);
+        if (header.empty() || header[0] != "Filename" || valueColumns % 2 != 0)
+        {
+            error = "'" + csvPath + "' is not an assessment file.";
+            return false;
+        }
+        const size_t measureCount = valueColumns / 2;
+        std::vector<std::string> measures(header.begin() + 1, header.begin() + 1 + measureCount);
+
+        OFIQResultStoreWriter writer;
+        if (!writer.Open(directory, error))
+        {
+            return false;
+        }
+        if (writer.GetRowCount() > 0)
+        {
+            error = "'" + directory + "' already contains a result store.";
+            return false;
+        }
+        if (!writer.SetMeasures(measures, error))
+        {
+            return false;
+        }
+
+        std::vector<OFIQ::QualityMeasureResult> results(measureCount);
+        while (std::getline(stream, line))
+        {
+            TrimLine(line);
+            if (line.empty())
+            {
+                continue;
+            }
+            auto fields = OFIQAssessmentCsv::SplitLine(line);
+            if (fields.size() != header.size())
+            {
+                error = "Unexpected number of columns in '" + csvPath + "': " + line;
+                return false;
+            }
+            const bool rejected = hasStatus && fields[1 + valueColumns] == OFIQAssessmentCsv::GetStatus(false, true);
+            for (size_t i = 0; i < measureCount; i++)
+            {
+                results[i].rawScore = std::strtod(fields[1 + i].c_str(), nullptr);
+                results[i].scalar = std::strtod(fields[1 + measureCount + i].c_str(), nullptr);
+                if (rejected)
+                {
+                    results[i].code = static_cast<OFIQ::QualityMeasureReturnCode>(OFIQResultStoreLayout::rejectedCode);
+                }
+                else
+                {
+                    results[i].code = results[i].rawScore == -1.0 && results[i].scalar == -1.0
+                        ? OFIQ::QualityMeasureReturnCode::NotInitialized
+                        : OFIQ::QualityMeasureReturnCode::Success;
+                }
+            }
+            if (!writer.Append(fields[0], results, error))
+            {
+                return false;
+            }
+        }
+        if (!writer.Finish(error))
+        {
+            return false;
+        }
+        std::cout << writer.GetRowCount() << " rows of " << measureCount << " measures imported into '" << directory << "'." << std::endl;
+        return true;
+    }
+
+    // Writes the given rows, or all rows, in the CSV layout of
+    // OFIQAssessmentCsv.
+    static bool Export(const OFIQResultStore& store, const std::vector<size_t>* rows, const std::string& csvPath)
+    {
+        std::ofstream stream(csvPath.c_str());
+        if (!stream.is_open())
+        {
+            return false;
+        }
+        const char separator = OFIQAssessmentCsv::separator;
+        const auto& measures = store.GetMeasures();
+        size_t count = rows != nullptr ? rows->size() : store.GetRowCount();
+        bool hasStatus = false;
+        for (size_t i = 0; i < count && !hasStatus; i++)
+        {
+            hasStatus = store.IsRejected(rows != nullptr ? (*rows)[i] : i);
+        }
+
+        stream << "Filename";
+        for (const auto& measure : measures)
+        {
+            stream << separator << measure;
+        }
+        for (const auto& measure : measures)
+        {
+            stream << separator << measure << ".scalar";
+        }
+        if (hasStatus)
+        {
+            for (const auto& column : OFIQAssessmentCsv::GetStatusColumns())
+            {
+                stream << separator << column;
+            }
+        }
+        stream << "\n";
+
+        const uint8_t success = static_cast<uint8_t>(OFIQ::QualityMeasureReturnCode::Success);
+        for (size_t i = 0; i < count; i++)
+        {
+            size_t row = rows != nullptr ? (*rows)[i] : i;
+            bool assessed = false;
+            stream << store.GetPath(row);
+            for (size_t m = 0; m < measures.size(); m++)
+            {
+                stream << separator << store.GetRawScores(m)[row];
+                assessed = assessed || store.GetCodes(m)[row] == success;
+            }
+            for (size_t m = 0; m < measures.size(); m++)
+            {
+                stream << separator << static_cast<double>(store.GetScalars(m)[row]);
+            }
+            if (hasStatus)
+            {
+                // The reason is not kept in the store.
+                stream << separator << OFIQAssessmentCsv::GetStatus(assessed, store.IsRejected(row)) << separator;
+            }
+            stream << "\n";
+        }
+        stream.flush();
+        std::cout << count << " rows exported to '" << csvPath << "'." << std::endl;
+        return stream.good();
+    }
+
+    static void TrimLine(std::string& line)
+    {
+        if (!line.empty() && line.back() == '\r')
+        {
+            line.pop_back();
+        }
+    }
+};
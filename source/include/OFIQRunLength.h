@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Run-length coding of 8-bit masks. Each run is stored as its value followed
+// by its length as LEB128 variable-length integer, so that the large uniform
+// areas of segmentation and occlusion masks take a few bytes each.
+class OFIQRunLength
+{
+public:
+    static std::vector<uint8_t> Encode(const uint8_t* data, size_t count)
+    {
+        std::vector<uint8_t> encoded;
+        size_t i = 0;
+        while (i < count)
+        {
+            uint8_t value = data[i];
+            size_t run = 1;
+            while (i + run < count && data[i + run] == value)
+            {
+                run++;
+            }
+            encoded.push_back(value);
+            for (size_t length = run; ; length >>= 7)
+            {
+                if (length < 0x80)
+                {
+                    encoded.push_back(static_cast<uint8_t>(length));
+                    break;
+                }
+                encoded.push_back(static_cast<uint8_t>(0x80 | (length & 0x7f)));
+            }
+            i += run;
+        }
+        return encoded;
+    }
+
+    // Number of values described by the encoded data, without decoding it;
+    // returns false if the encoded data is truncated.
+    static bool GetDecodedSize(const uint8_t* encoded, size_t encodedSize, size_t& count)
+    {
+        count = 0;
+        size_t position = 0;
+        while (position < encodedSize)
+        {
+            // Skip the value of the run.
+            position++;
+            size_t run = 0;
+            if (!GetRun(encoded, encodedSize, position, run) || run > SIZE_MAX - count)
+            {
+                return false;
+            }
+            count += run;
+        }
+        return true;
+    }
+
+    // Decodes exactly count values; returns false if the encoded data is
+    // truncated or does not describe count values.
+    static bool Decode(const uint8_t* encoded, size_t encodedSize, uint8_t* data, size_t count)
+    {
+        size_t position = 0;
+        size_t written = 0;
+        while (position < encodedSize)
+        {
+            uint8_t value = encoded[position++];
+            size_t run = 0;
+            if (!GetRun(encoded, encodedSize, position, run) || run > count - written)
+            {
+                return false;
+            }
+            std::fill(data + written, data + written + run, value);
+            written += run;
+        }
+        return written == count;
+    }
+
+private:
+    // Reads the LEB128 length of a run at position and moves past it.
+    static bool GetRun(const uint8_t* encoded, size_t encodedSize, size_t& position, size_t& run)
+    {
+        run = 0;
+        for (unsigned int shift = 0; ; shift += 7)
+        {
+            if (position == encodedSize || shift >= 8 * sizeof(size_t))
+            {
+                return false;
+            }
+            uint8_t byte = encoded[position++];
+            run |= static_cast<size_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+            {
+                return true;
+            }
+        }
+    }
+};
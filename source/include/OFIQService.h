@@ -0,0 +1,651 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <OFIQBatch.h>
+#include <OFIQCommandLine.h>
+#include <OFIQImageConversion.h>
+#include <OFIQJson.h>
+#include <OFIQMetrics.h>
+#include <OFIQPriorityQueue.h>
+#include <OFIQThreadPlacement.h>
+
+
+// Converts quality assessments into the "scores" object of a JSON response.
+inline OFIQJsonValue OFIQAssessmentsToJson(const OFIQ::FaceImageQualityAssessment& assessments)
+{
+    OFIQJsonValue scores = OFIQJsonValue::Object();
+    for (const auto& [measure, result] : assessments.qAssessments)
+    {
+        OFIQJsonValue score = OFIQJsonValue::Object();
+        score.Set("rawScore", result.rawScore);
+        score.Set("scalar", result.scalar);
+        score.Set("code", static_cast<int>(result.code));
+        scores.Set(GetMeasureName(measure), score);
+    }
+    return scores;
+}
+
+#if !defined(_WIN32)
+
+// One client connection of the service. Requests are read by a dedicated
+// thread; responses are written by the workers, possibly out of order, so
+// clients should tag their requests with an "id".
+class OFIQServiceConnection
+{
+public:
+    // Longest request line accepted; longer lines would let a client grow
+    // the read buffer without bound.
+    static constexpr size_t maxLineLength = 65536;
+
+    explicit OFIQServiceConnection(int fd) : m_fd(fd), m_lineTooLong(false) {}
+
+    ~OFIQServiceConnection()
+    {
+        close(m_fd);
+    }
+
+    int GetFd() const
+    {
+        return m_fd;
+    }
+
+    bool WriteLine(const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        std::string data = line + "\n";
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t count = write(m_fd, data.data() + written, data.size() - written);
+            if (count <= 0)
+            {
+                return false;
+            }
+            written += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    // Returns false at the end of the stream, on errors and on lines longer
+    // than maxLineLength, see IsLineTooLong.
+    bool ReadLine(std::string& line)
+    {
+        while (true)
+        {
+            auto end = m_buffer.find('\n');
+            if ((end == std::string::npos ? m_buffer.size() : end) > maxLineLength)
+            {
+                m_lineTooLong = true;
+                return false;
+            }
+            if (end != std::string::npos)
+            {
+                line = m_buffer.substr(0, end);
+                m_buffer.erase(0, end + 1);
+                return true;
+            }
+            if (!Fill())
+            {
+                return false;
+            }
+        }
+    }
+
+    bool IsLineTooLong() const
+    {
+        return m_lineTooLong;
+    }
+
+    bool ReadBytes(size_t count, std::vector<uint8_t>& bytes)
+    {
+        bytes.clear();
+        bytes.reserve(count);
+        while (bytes.size() < count)
+        {
+            if (m_buffer.empty() && !Fill())
+            {
+                return false;
+            }
+            size_t take = std::min(count - bytes.size(), m_buffer.size());
+            bytes.insert(bytes.end(), m_buffer.begin(), m_buffer.begin() + take);
+            m_buffer.erase(0, take);
+        }
+        return true;
+    }
+
+private:
+    bool Fill()
+    {
+        char chunk[65536];
+        ssize_t count = read(m_fd, chunk, sizeof(chunk));
+        if (count <= 0)
+        {
+            return false;
+        }
+        m_buffer.append(chunk, static_cast<size_t>(count));
+        return true;
+    }
+
+    int m_fd;
+    bool m_lineTooLong;
+    std::string m_buffer;
+    std::mutex m_writeMutex;
+};
+
+struct OFIQServiceRequest
+{
+    std::shared_ptr<OFIQServiceConnection> connection;
+    OFIQJsonValue id;
+    std::string path;
+    std::vector<uint8_t> bytes;
+    OFIQPriority priority = OFIQPriority::Interactive;
+    std::chrono::steady_clock::time_point received;
+};
+
+#endif
+
+// --serve: keeps OFIQ initialized and assesses images on request.
+//
+// The service listens on a Unix domain socket. Each request is one line of
+// JSON, either {"id": ..., "path": "/path/to/image.jpg"} or
+// {"id": ..., "bytes": <n>} followed by exactly n bytes of an encoded image.
+// Each response is one line of JSON holding the scores of all measures and
+// the time spent waiting in the queue, decoding and assessing. Requests are
+// processed by --workers OFIQ instances; if --queue requests are already
+// waiting, further requests are rejected with status "busy". Requests with
+// "priority": "batch" wait in a queue of their own and are only taken by a
+// worker when no interactive request (the default) is waiting.
+// {"command": "stats"} returns the counters of the service and the wait
+// times per priority.
+class OFIQService
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --serve --socket <socket path> [--config <ofiq_config.jaxn>]" << std::endl
+            << "           [--queue <16>] [--max-bytes <67108864>]" << std::endl;
+        OFIQThreadSettings::PrintUsage(stream);
+    }
+
+#if defined(_WIN32)
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::cerr << "ERROR: --serve is only supported on Linux and macOS." << std::endl;
+        return 1;
+    }
+#else
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string socketPath = commandLine.GetString("socket");
+        if (socketPath.empty())
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::string error;
+        OFIQThreadPlacement placement;
+        if (!placement.Initialize(OFIQThreadSettings::FromCommandLine(commandLine), error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        OFIQService service(
+            commandLine.GetString("config", "ofiq_config.jaxn"),
+            placement,
+            static_cast<size_t>(std::max(1, commandLine.GetInt("queue", 16))),
+            static_cast<size_t>(std::max(1.0, commandLine.GetDouble("max-bytes", 64.0 * 1024 * 1024))));
+        return service.Serve(socketPath);
+    }
+
+private:
+    OFIQService(const std::string& configPath, const OFIQThreadPlacement& placement, size_t queueCapacity, size_t maxBytes)
+        : m_configPath(configPath)
+        , m_placement(placement)
+        , m_workerCount(placement.GetWorkerCount())
+        , m_maxBytes(maxBytes)
+        , m_queue(queueCapacity, queueCapacity)
+        , m_processed(0)
+        , m_failed(0)
+        , m_rejected(0)
+    {
+        ;
+    }
+
+    int Serve(const std::string& socketPath)
+    {
+        OFIQMetricsGauge interactiveGauge("ofiq_queue_depth", "Items waiting in a queue.", "queue=\"interactive\"",
+            [this] { return static_cast<double>(m_queue.Size(OFIQPriority::Interactive)); });
+        OFIQMetricsGauge batchGauge("ofiq_queue_depth", "Items waiting in a queue.", "queue=\"batch\"",
+            [this] { return static_cast<double>(m_queue.Size(OFIQPriority::Batch)); });
+        std::cout << "Threads: " << m_placement.ToString() << std::endl;
+        for (size_t i = 0; i < m_workerCount; i++)
+        {
+            // Initialize on a thread pinned like the worker, so that the
+            // inference threads created by OFIQ inherit its CPUs.
+            std::string error;
+            auto runner = std::make_unique<OFIQBatchRunner>();
+            std::thread([&]()
+                {
+                    if (m_placement.PinWorker(i, error))
+                    {
+                        runner->Initialize(m_configPath, error);
+                    }
+                }).join();
+            if (runner->GetInterface() == nullptr)
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+            std::cout << "Worker " << i << " initialized in " << runner->GetInitSeconds() << " s" << std::endl;
+            m_runners.push_back(std::move(runner));
+        }
+
+        sockaddr_un address{};
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            std::cerr << "ERROR: Socket path too long: " << socketPath << std::endl;
+            return 1;
+        }
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        // Only a stale socket of an earlier run is replaced, never a file
+        // named by a mistyped --socket.
+        struct stat existing;
+        if (lstat(socketPath.c_str(), &existing) == 0)
+        {
+            if (!S_ISSOCK(existing.st_mode))
+            {
+                std::cerr << "ERROR: '" << socketPath << "' exists and is not a socket." << std::endl;
+                return 1;
+            }
+            unlink(socketPath.c_str());
+        }
+
+        int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0
+            || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listenFd, 64) != 0)
+        {
+            std::cerr << "ERROR: Cannot listen on '" << socketPath << "': " << strerror(errno) << std::endl;
+            if (listenFd >= 0)
+            {
+                close(listenFd);
+            }
+            return 1;
+        }
+
+        std::signal(SIGPIPE, SIG_IGN);
+        OFIQInstallStopHandler();
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < m_workerCount; i++)
+        {
+            workers.emplace_back(&OFIQService::WorkerLoop, this, i);
+        }
+
+        std::cout << "Listening on '" << socketPath << "' with " << m_workerCount << " workers" << std::endl;
+
+        std::list<Reader> readers;
+        while (!OFIQStopRequested())
+        {
+            // Join the readers of closed connections.
+            for (auto it = readers.begin(); it != readers.end();)
+            {
+                if (*it->done)
+                {
+                    it->thread.join();
+                    it = readers.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+
+            pollfd pollFd{ listenFd, POLLIN, 0 };
+            if (poll(&pollFd, 1, 200) <= 0)
+            {
+                continue;
+            }
+            int clientFd = accept(listenFd, nullptr, nullptr);
+            if (clientFd < 0)
+            {
+                continue;
+            }
+            auto connection = std::make_shared<OFIQServiceConnection>(clientFd);
+            Reader reader;
+            reader.connection = connection;
+            reader.done = std::make_shared<std::atomic<bool>>(false);
+            reader.thread = std::thread(&OFIQService::ReaderLoop, this, connection, reader.done);
+            readers.push_back(std::move(reader));
+        }
+
+        std::cout << "Shutting down ..." << std::endl;
+        close(listenFd);
+        unlink(socketPath.c_str());
+
+        // Unblock the readers, then let the workers drain the queue.
+        for (auto& reader : readers)
+        {
+            if (auto connection = reader.connection.lock())
+            {
+                shutdown(connection->GetFd(), SHUT_RD);
+            }
+        }
+        for (auto& reader : readers)
+        {
+            reader.thread.join();
+        }
+        m_queue.Close();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+
+        std::cout << m_processed << " requests processed, " << m_failed << " failed, "
+            << m_rejected << " rejected." << std::endl;
+        return 0;
+    }
+
+    struct Reader
+    {
+        std::thread thread;
+        std::weak_ptr<OFIQServiceConnection> connection;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    void ReaderLoop(std::shared_ptr<OFIQServiceConnection> connection, std::shared_ptr<std::atomic<bool>> done)
+    {
+        ReadRequests(connection);
+        if (connection->IsLineTooLong())
+        {
+            // The rest of the line cannot be skipped reliably, so the
+            // connection is dropped once pending responses are written.
+            connection->WriteLine(ErrorResponse(OFIQJsonValue(), "error", "Request line longer than "
+                + std::to_string(OFIQServiceConnection::maxLineLength) + " bytes."));
+            shutdown(connection->GetFd(), SHUT_RD);
+        }
+        *done = true;
+    }
+
+    void ReadRequests(const std::shared_ptr<OFIQServiceConnection>& connection)
+    {
+        std::string line;
+        while (connection->ReadLine(line))
+        {
+            if (line.empty() || line == "\r")
+            {
+                continue;
+            }
+
+            OFIQJsonValue message;
+            std::string error;
+            if (!OFIQJsonValue::Parse(line, message, error) || !message.IsObject())
+            {
+                connection->WriteLine(ErrorResponse(OFIQJsonValue(), "error", "Invalid request: " + error));
+                continue;
+            }
+
+            OFIQServiceRequest request;
+            request.connection = connection;
+            request.id = message.Get("id");
+            request.received = std::chrono::steady_clock::now();
+            if (message.Has("priority") && !ParsePriority(message.Get("priority").AsString(), request.priority))
+            {
+                connection->WriteLine(ErrorResponse(request.id, "error", "Unknown priority."));
+                continue;
+            }
+
+            if (message.Get("command").AsString() == "stats")
+            {
+                connection->WriteLine(StatsResponse(request.id));
+                continue;
+            }
+
+            if (message.Get("path").IsString())
+            {
+                request.path = message.Get("path").AsString();
+            }
+            else if (message.Get("bytes").IsNumber())
+            {
+                double count = message.Get("bytes").AsNumber();
+                if (count <= 0 || count > static_cast<double>(m_maxBytes))
+                {
+                    // The payload cannot be skipped reliably, so the connection is dropped.
+                    connection->WriteLine(ErrorResponse(request.id, "error", "Invalid number of bytes."));
+                    return;
+                }
+                if (!connection->ReadBytes(static_cast<size_t>(count), request.bytes))
+                {
+                    return;
+                }
+            }
+            else
+            {
+                connection->WriteLine(ErrorResponse(request.id, "error", "Request needs \"path\" or \"bytes\"."));
+                continue;
+            }
+
+            OFIQJsonValue id = request.id;
+            OFIQPriority priority = request.priority;
+            if (!m_queue.TryPush(priority, std::move(request)))
+            {
+                m_rejected++;
+                connection->WriteLine(ErrorResponse(id, "busy", "Queue is full."));
+            }
+        }
+    }
+
+    void WorkerLoop(size_t workerIndex)
+    {
+        std::string error;
+        if (!m_placement.PinWorker(workerIndex, error))
+        {
+            std::cerr << "WARNING: " << error << std::endl;
+        }
+        OFIQBatchRunner& runner = *m_runners[workerIndex];
+        OFIQServiceRequest request;
+        while (m_queue.Pop(request))
+        {
+            auto start = std::chrono::steady_clock::now();
+            double queueSeconds = std::chrono::duration<double>(start - request.received).count();
+
+            OFIQBatchItem item;
+            if (!request.path.empty())
+            {
+                item = runner.Process(request.path);
+            }
+            else
+            {
+                auto decodeStart = std::chrono::steady_clock::now();
+                bool decoded = OFIQImageConversion::Decode(request.bytes, item.image);
+                item.decodeSeconds = OFIQSecondsSince(decodeStart);
+                OFIQMetrics::Get().ObserveStage(OFIQStage::Decode, item.decodeSeconds);
+                OFIQMetrics::Get().AddBusySeconds(item.decodeSeconds);
+                if (decoded)
+                {
+                    runner.Assess(item);
+                }
+                else
+                {
+                    item.info = "Cannot decode image bytes.";
+                    OFIQMetrics::Get().AddImage(false);
+                }
+                request.bytes.clear();
+            }
+
+            OFIQJsonValue response = OFIQJsonValue::Object();
+            response.Set("id", request.id);
+            response.Set("status", item.success ? "ok" : "error");
+            if (!item.success)
+            {
+                response.Set("error", item.info);
+                m_failed++;
+            }
+            response.Set("worker", workerIndex);
+            response.Set("priority", GetPriorityName(request.priority));
+            response.Set("scores", OFIQAssessmentsToJson(item.assessments));
+
+            OFIQJsonValue timing = OFIQJsonValue::Object();
+            timing.Set("queue_ms", queueSeconds * 1000.0);
+            timing.Set("decode_ms", item.decodeSeconds * 1000.0);
+            timing.Set("assess_ms", item.assessSeconds * 1000.0);
+            timing.Set("total_ms", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - request.received).count());
+            response.Set("timing", timing);
+
+            m_processed++;
+            request.connection->WriteLine(response.ToString(false));
+            request.connection.reset();
+        }
+    }
+
+    static std::string ErrorResponse(const OFIQJsonValue& id, const std::string& status, const std::string& error)
+    {
+        OFIQJsonValue response = OFIQJsonValue::Object();
+        response.Set("id", id);
+        response.Set("status", status);
+        response.Set("error", error);
+        return response.ToString(false);
+    }
+
+    std::string StatsResponse(const OFIQJsonValue& id)
+    {
+        OFIQJsonValue response = OFIQJsonValue::Object();
+        response.Set("id", id);
+        response.Set("status", "ok");
+        response.Set("workers", m_workerCount);
+        response.Set("threads", m_placement.ToJson());
+        response.Set("queue_depth", m_queue.Size());
+        response.Set("queue_capacity", m_queue.Capacity(OFIQPriority::Batch));
+        response.Set("queues", m_queue.ToJson());
+        response.Set("processed", static_cast<size_t>(m_processed));
+        response.Set("failed", static_cast<size_t>(m_failed));
+        response.Set("rejected", static_cast<size_t>(m_rejected));
+        return response.ToString(false);
+    }
+
+    std::string m_configPath;
+    OFIQThreadPlacement m_placement;
+    size_t m_workerCount;
+    size_t m_maxBytes;
+    std::vector<std::unique_ptr<OFIQBatchRunner>> m_runners;
+    OFIQPriorityQueue<OFIQServiceRequest> m_queue;
+    std::atomic<size_t> m_processed;
+    std::atomic<size_t> m_failed;
+    std::atomic<size_t> m_rejected;
+#endif
+};
+
+// --worker: the child side of OFIQWorkerProcess, started by the headless
+// modes with --isolated. Initializes OFIQ, reports readiness and then
+// assesses one image per request line on the connection given by
+// --worker-fd, until the parent closes it.
+class OFIQWorker
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --worker --worker-fd <fd> [--config <ofiq_config.jaxn>]" << std::endl;
+        OFIQPrefilterSettings::PrintUsage(stream);
+        OFIQDownscaleSettings::PrintUsage(stream);
+        stream << "       (started by the headless modes with --isolated)" << std::endl;
+    }
+
+#if defined(_WIN32)
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::cerr << "ERROR: --worker is only supported on Linux and macOS." << std::endl;
+        return 1;
+    }
+#else
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        int fd = commandLine.GetInt("worker-fd", -1);
+        if (fd < 0)
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        // Ctrl+C reaches the whole process group; the parent decides when
+        // its workers stop by closing the connection.
+        std::signal(SIGINT, SIG_IGN);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        OFIQServiceConnection connection(fd);
+        std::string error;
+        OFIQPrefilterSettings prefilter;
+        OFIQDownscaleSettings downscale;
+        OFIQBatchRunner runner;
+        bool initialized = OFIQPrefilterSettings::FromCommandLine(commandLine, prefilter, error)
+            && OFIQDownscaleSettings::FromCommandLine(commandLine, downscale, error)
+            && runner.Initialize(commandLine.GetString("config", "ofiq_config.jaxn"), error);
+        runner.SetPrefilter(prefilter);
+        runner.SetDownscale(downscale);
+
+        OFIQJsonValue ready = OFIQJsonValue::Object();
+        ready.Set("ready", initialized);
+        ready.Set("init_seconds", runner.GetInitSeconds());
+        if (!initialized)
+        {
+            ready.Set("error", error);
+        }
+        if (!connection.WriteLine(ready.ToString(false)) || !initialized)
+        {
+            return 1;
+        }
+
+        std::string line;
+        while (connection.ReadLine(line))
+        {
+            OFIQJsonValue request;
+            OFIQJsonValue response = OFIQJsonValue::Object();
+            if (!OFIQJsonValue::Parse(line, request, error) || !request.Get("path").IsString())
+            {
+                response.Set("success", false);
+                response.Set("info", "Invalid request: " + line);
+            }
+            else
+            {
+                auto item = runner.Process(request.Get("path").AsString());
+                response.Set("success", item.success);
+                response.Set("rejected", item.rejected);
+                response.Set("info", item.info);
+                response.Set("decode_seconds", item.decodeSeconds);
+                response.Set("prefilter_seconds", item.prefilterSeconds);
+                response.Set("downscale_seconds", item.downscaleSeconds);
+                response.Set("assess_seconds", item.assessSeconds);
+                response.Set("scores", OFIQAssessmentsToJson(item.assessments));
+            }
+            if (!connection.WriteLine(response.ToString(false)))
+            {
+                break;
+            }
+        }
+        return 0;
+    }
+#endif
+};
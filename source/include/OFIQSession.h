@@ -0,0 +1,358 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <OFIQMappedFile.h>
+#include <OFIQRunLength.h>
+
+
+// The state of the image view that is needed to show an assessment again
+// without running OFIQ: the image path and a hash of its content, the
+// quality assessments and the preprocessing results.
+struct OFIQSessionData
+{
+    std::string imagePath;
+    uint64_t imageHash = 0;
+    uint16_t width = 0;
+    uint16_t height = 0;
+    OFIQ::FaceImageQualityAssessment assessments;
+    OFIQ::FaceImageQualityPreprocessingResult preprocessing;
+};
+
+// Binary session files (*.ofiqs).
+//
+// Layout (little endian):
+//   char[8]  magic "OFIQSES\0"
+//   uint32   version
+//   string   image path (uint32 length + UTF-8 bytes)
+//   uint64   FNV-1a hash of the image file
+//   uint16   width, height
+//   box      bounding box of the assessment
+//   uint32   number of measures, each int32 measure, double raw score,
+//            double scalar, int32 return code
+//   uint32   number of faces, each a box
+//   uint8    landmark type, uint32 number of landmarks, each int16 x, y
+//   3 masks  segmentation, occlusion, landmarked region, each uint8 present
+//            flag, uint64 encoded size and the run-length coded mask
+//            (see OFIQRunLength) of width * height bytes
+// where a box is int16 x, y, width, height and uint8 face detector.
+//
+// Sessions are opened through a memory mapping, and the masks are decoded
+// directly from the mapped file. Encode and Decode convert a session to and
+// from this layout in memory, e.g. for the history of the image view.
+class OFIQSession
+{
+public:
+    static constexpr uint32_t version = 1;
+
+    static bool Save(const std::string& path, const OFIQSessionData& session, std::string& error)
+    {
+        std::vector<uint8_t> buffer = Encode(session);
+        std::ofstream stream(path.c_str(), std::ios::binary);
+        stream.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        if (!stream.good())
+        {
+            error = "Cannot write session '" + path + "'";
+            return false;
+        }
+        return true;
+    }
+
+    static bool Load(const std::string& path, OFIQSessionData& session, std::string& error)
+    {
+        OFIQMappedFile file;
+        if (!file.Open(path, error))
+        {
+            return false;
+        }
+        if (!Decode(file.GetData(), file.GetSize(), session, error))
+        {
+            error = "Session file '" + path + "': " + error;
+            return false;
+        }
+        return true;
+    }
+
+    static std::vector<uint8_t> Encode(const OFIQSessionData& session)
+    {
+        Writer writer;
+        writer.PutBytes(GetMagic(), sizeof(magicBytes));
+        writer.Put(version);
+        writer.PutString(session.imagePath);
+        writer.Put(session.imageHash);
+        writer.Put(session.width);
+        writer.Put(session.height);
+        writer.PutBox(session.assessments.boundingBox);
+
+        writer.Put(static_cast<uint32_t>(session.assessments.qAssessments.size()));
+        for (const auto& [measure, result] : session.assessments.qAssessments)
+        {
+            writer.Put(static_cast<int32_t>(measure));
+            writer.Put(result.rawScore);
+            writer.Put(result.scalar);
+            writer.Put(static_cast<int32_t>(result.code));
+        }
+
+        const auto& preprocessing = session.preprocessing;
+        writer.Put(static_cast<uint32_t>(preprocessing.m_faces.size()));
+        for (const auto& face : preprocessing.m_faces)
+        {
+            writer.PutBox(face);
+        }
+
+        writer.Put(static_cast<uint8_t>(preprocessing.m_landmarks.type));
+        writer.Put(static_cast<uint32_t>(preprocessing.m_landmarks.landmarks.size()));
+        for (const auto& landmark : preprocessing.m_landmarks.landmarks)
+        {
+            writer.Put(landmark.x);
+            writer.Put(landmark.y);
+        }
+
+        size_t maskSize = static_cast<size_t>(session.width) * session.height;
+        writer.PutMask(preprocessing.m_segmentationMaskPtr.get(), maskSize);
+        writer.PutMask(preprocessing.m_occlusionMaskPtr.get(), maskSize);
+        writer.PutMask(preprocessing.m_landmarkedRegionPtr.get(), maskSize);
+        return writer.TakeBuffer();
+    }
+
+    static bool Decode(const uint8_t* data, size_t size, OFIQSessionData& session, std::string& error)
+    {
+        Reader reader(data, size);
+        const uint8_t* magic = reader.GetBytes(sizeof(magicBytes));
+        if (magic == nullptr || memcmp(magic, GetMagic(), sizeof(magicBytes)) != 0)
+        {
+            error = "Not an OFIQ session.";
+            return false;
+        }
+        uint32_t fileVersion = 0;
+        if (!reader.Get(fileVersion) || fileVersion != version)
+        {
+            error = "Unsupported session version " + std::to_string(fileVersion) + ".";
+            return false;
+        }
+
+        session = OFIQSessionData();
+        bool valid = reader.GetString(session.imagePath)
+            && reader.Get(session.imageHash)
+            && reader.Get(session.width)
+            && reader.Get(session.height)
+            && reader.GetBox(session.assessments.boundingBox);
+
+        uint32_t count = 0;
+        valid = valid && reader.Get(count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            int32_t measure = 0;
+            int32_t code = 0;
+            OFIQ::QualityMeasureResult result;
+            valid = reader.Get(measure) && reader.Get(result.rawScore) && reader.Get(result.scalar) && reader.Get(code);
+            result.code = static_cast<OFIQ::QualityMeasureReturnCode>(code);
+            session.assessments.qAssessments[static_cast<OFIQ::QualityMeasure>(measure)] = result;
+        }
+
+        auto& preprocessing = session.preprocessing;
+        valid = valid && reader.Get(count);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            OFIQ::BoundingBox face;
+            valid = reader.GetBox(face);
+            preprocessing.m_faces.push_back(face);
+        }
+
+        uint8_t landmarkType = 0;
+        valid = valid && reader.Get(landmarkType) && reader.Get(count);
+        preprocessing.m_landmarks.type = static_cast<OFIQ::LandmarkType>(landmarkType);
+        for (uint32_t i = 0; valid && i < count; i++)
+        {
+            OFIQ::LandmarkPoint landmark;
+            valid = reader.Get(landmark.x) && reader.Get(landmark.y);
+            preprocessing.m_landmarks.landmarks.push_back(landmark);
+        }
+
+        size_t maskSize = static_cast<size_t>(session.width) * session.height;
+        valid = valid
+            && reader.GetMask(preprocessing.m_segmentationMaskPtr, maskSize)
+            && reader.GetMask(preprocessing.m_occlusionMaskPtr, maskSize)
+            && reader.GetMask(preprocessing.m_landmarkedRegionPtr, maskSize);
+        if (!valid)
+        {
+            error = "The session is truncated or corrupt.";
+            return false;
+        }
+        return true;
+    }
+
+    // 64-bit FNV-1a hash of the content of a file, used to detect that the
+    // image of a session has changed since the session was saved.
+    static bool HashFile(const std::string& path, uint64_t& hash, std::string& error)
+    {
+        OFIQMappedFile file;
+        if (!file.Open(path, error))
+        {
+            return false;
+        }
+        hash = 14695981039346656037ull;
+        const uint8_t* data = file.GetData();
+        for (size_t i = 0; i < file.GetSize(); i++)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return true;
+    }
+
+private:
+    static constexpr char magicBytes[8] = { 'O', 'F', 'I', 'Q', 'S', 'E', 'S', '\0' };
+
+    static const uint8_t* GetMagic()
+    {
+        return reinterpret_cast<const uint8_t*>(magicBytes);
+    }
+
+    class Writer
+    {
+    public:
+        template <typename T>
+        void Put(const T& value)
+        {
+            PutBytes(reinterpret_cast<const uint8_t*>(&value), sizeof(T));
+        }
+
+        void PutBytes(const uint8_t* data, size_t size)
+        {
+            m_buffer.insert(m_buffer.end(), data, data + size);
+        }
+
+        void PutString(const std::string& text)
+        {
+            Put(static_cast<uint32_t>(text.size()));
+            PutBytes(reinterpret_cast<const uint8_t*>(text.data()), text.size());
+        }
+
+        void PutBox(const OFIQ::BoundingBox& box)
+        {
+            Put(box.xleft);
+            Put(box.ytop);
+            Put(box.width);
+            Put(box.height);
+            Put(static_cast<uint8_t>(box.faceDetector));
+        }
+
+        void PutMask(const uint8_t* mask, size_t size)
+        {
+            Put(static_cast<uint8_t>(mask != nullptr ? 1 : 0));
+            if (mask == nullptr)
+            {
+                return;
+            }
+            std::vector<uint8_t> encoded = OFIQRunLength::Encode(mask, size);
+            Put(static_cast<uint64_t>(encoded.size()));
+            PutBytes(encoded.data(), encoded.size());
+        }
+
+        std::vector<uint8_t> TakeBuffer()
+        {
+            return std::move(m_buffer);
+        }
+
+    private:
+        std::vector<uint8_t> m_buffer;
+    };
+
+    class Reader
+    {
+    public:
+        Reader(const uint8_t* data, size_t size)
+            : m_data(data)
+            , m_size(size)
+            , m_position(0)
+        {
+            ;
+        }
+
+        const uint8_t* GetBytes(size_t size)
+        {
+            if (size > m_size - m_position)
+            {
+                return nullptr;
+            }
+            const uint8_t* bytes = m_data + m_position;
+            m_position += size;
+            return bytes;
+        }
+
+        template <typename T>
+        bool Get(T& value)
+        {
+            const uint8_t* bytes = GetBytes(sizeof(T));
+            if (bytes == nullptr)
+            {
+                return false;
+            }
+            memcpy(&value, bytes, sizeof(T));
+            return true;
+        }
+
+        bool GetString(std::string& text)
+        {
+            uint32_t size = 0;
+            const uint8_t* bytes = nullptr;
+            if (!Get(size) || (bytes = GetBytes(size)) == nullptr)
+            {
+                return false;
+            }
+            text.assign(reinterpret_cast<const char*>(bytes), size);
+            return true;
+        }
+
+        bool GetBox(OFIQ::BoundingBox& box)
+        {
+            uint8_t detector = 0;
+            bool valid = Get(box.xleft) && Get(box.ytop) && Get(box.width) && Get(box.height) && Get(detector);
+            box.faceDetector = static_cast<OFIQ::FaceDetectorType>(detector);
+            return valid;
+        }
+
+        bool GetMask(std::shared_ptr<uint8_t>& mask, size_t size)
+        {
+            uint8_t present = 0;
+            if (!Get(present))
+            {
+                return false;
+            }
+            mask.reset();
+            if (present == 0)
+            {
+                return true;
+            }
+            uint64_t encodedSize = 0;
+            const uint8_t* encoded = nullptr;
+            if (!Get(encodedSize) || encodedSize > m_size || (encoded = GetBytes(static_cast<size_t>(encodedSize))) == nullptr)
+            {
+                return false;
+            }
+            // The mask is only allocated once the stored runs are known to
+            // cover width * height values, so that a corrupt header cannot
+            // cause a huge allocation.
+            size_t decodedSize = 0;
+            if (!OFIQRunLength::GetDecodedSize(encoded, static_cast<size_t>(encodedSize), decodedSize) || decodedSize != size)
+            {
+                return false;
+            }
+            mask.reset(new uint8_t[size], std::default_delete<uint8_t[]>());
+            return OFIQRunLength::Decode(encoded, static_cast<size_t>(encodedSize), mask.get(), size);
+        }
+
+    private:
+        const uint8_t* m_data;
+        size_t m_size;
+        size_t m_position;
+    };
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <OFIQJson.h>
+
+
+// Deterministic partitioning of a manifest for multi-node batch runs. An image
+// is assigned to a shard by a 64-bit FNV-1a hash of its manifest entry, which
+// gives the same partition on every machine, compiler and standard library
+// (unlike std::hash).
+class OFIQShardSpec
+{
+public:
+    OFIQShardSpec() : m_index(0), m_count(1) {}
+
+    OFIQShardSpec(uint32_t index, uint32_t count) : m_index(index), m_count(count) {}
+
+    // Parses "i/N" with 0 <= i < N.
+    static bool Parse(const std::string& text, OFIQShardSpec& spec, std::string& error)
+    {
+        auto separator = text.find('/');
+        if (separator == std::string::npos)
+        {
+            error = "Invalid shard '" + text + "', expected <index>/<count>.";
+            return false;
+        }
+        try
+        {
+            long index = std::stol(text.substr(0, separator));
+            long count = std::stol(text.substr(separator + 1));
+            if (count < 1 || index < 0 || index >= count)
+            {
+                error = "Invalid shard '" + text + "', the index must be in [0, count).";
+                return false;
+            }
+            spec = OFIQShardSpec(static_cast<uint32_t>(index), static_cast<uint32_t>(count));
+        }
+        catch (const std::exception&)
+        {
+            error = "Invalid shard '" + text + "', expected <index>/<count>.";
+            return false;
+        }
+        return true;
+    }
+
+    static uint64_t Hash(const std::string& text)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static uint32_t GetShardOf(const std::string& entry, uint32_t count)
+    {
+        return static_cast<uint32_t>(Hash(entry) % count);
+    }
+
+    bool Contains(const std::string& entry) const
+    {
+        return GetShardOf(entry, m_count) == m_index;
+    }
+
+    uint32_t GetIndex() const { return m_index; }
+    uint32_t GetCount() const { return m_count; }
+
+    std::string ToString() const
+    {
+        return std::to_string(m_index) + "/" + std::to_string(m_count);
+    }
+
+    // results.csv -> results.shard-2-of-8.csv
+    std::string GetResultPath(const std::string& outputPath) const
+    {
+        std::filesystem::path path = std::filesystem::u8path(outputPath);
+        std::string name = path.stem().u8string() + ".shard-" + std::to_string(m_index)
+            + "-of-" + std::to_string(m_count) + path.extension().u8string();
+        return path.replace_filename(std::filesystem::u8path(name)).u8string();
+    }
+
+    // The completion marker is written next to the result file once all
+    // images of the shard have been processed.
+    static std::string GetMarkerPath(const std::string& resultPath)
+    {
+        return resultPath + ".done";
+    }
+
+    bool WriteMarker(const std::string& resultPath, const std::string& manifest, size_t images, size_t failed) const
+    {
+        OFIQJsonValue marker = OFIQJsonValue::Object();
+        marker.Set("shard", static_cast<int>(m_index));
+        marker.Set("shards", static_cast<int>(m_count));
+        marker.Set("manifest", manifest);
+        marker.Set("results", std::filesystem::u8path(resultPath).filename().u8string());
+        marker.Set("images", images);
+        marker.Set("failed", failed);
+        marker.Set("completed", static_cast<double>(std::time(nullptr)));
+        return marker.SaveToFile(GetMarkerPath(resultPath));
+    }
+
+private:
+    uint32_t m_index;
+    uint32_t m_count;
+};
@@ -0,0 +1,240 @@
+#pragma once
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQBatch.h>
+#include <OFIQJson.h>
+#include <OFIQShard.h>
+
+
+// --merge: combines the result files of a sharded batch run into one CSV file
+// in the layout of the "Export Assessment" menu entry. Shards without
+// completion marker, images listed in the manifest but missing in all shards
+// and images contained in more than one shard are reported; in any of these
+// cases the process exits with code 3.
+class OFIQShardMerge
+{
+public:
+    static constexpr int incompleteExitCode = 3;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --merge --output <merged.csv> [--manifest <manifest>]" << std::endl
+            << "           [--results <results.csv> --shards <count>] [<shard result> ...]" << std::endl
+            << "       --results/--shards locate the files written by --batch --output <results.csv> --shard i/<count>." << std::endl;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+
+        std::vector<std::string> shardPaths = commandLine.GetPositional();
+        if (commandLine.HasOption("shards"))
+        {
+            int count = commandLine.GetInt("shards", 0);
+            std::string results = commandLine.GetString("results");
+            if (count < 1 || results.empty())
+            {
+                std::cerr << "ERROR: --shards requires a positive count and --results." << std::endl;
+                PrintUsage(std::cerr);
+                return 1;
+            }
+            for (int i = 0; i < count; i++)
+            {
+                shardPaths.push_back(OFIQShardSpec(i, count).GetResultPath(results));
+            }
+        }
+
+        std::string outputPath = commandLine.GetString("output");
+        if (shardPaths.empty() || outputPath.empty())
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::vector<std::string> columns;
+        std::vector<std::string> order;
+        std::map<std::string, std::map<std::string, std::string>> values;
+        std::map<std::string, size_t> occurrences;
+        std::vector<std::string> incompleteShards;
+
+        for (const auto& shardPath : shardPaths)
+        {
+            if (!std::filesystem::is_regular_file(shardPath))
+            {
+                std::cerr << "ERROR: Missing shard result '" << shardPath << "'" << std::endl;
+                incompleteShards.push_back(shardPath);
+                continue;
+            }
+            if (!std::filesystem::is_regular_file(OFIQShardSpec::GetMarkerPath(shardPath)))
+            {
+                std::cerr << "WARNING: Shard '" << shardPath << "' has no completion marker." << std::endl;
+                incompleteShards.push_back(shardPath);
+            }
+
+            std::vector<std::string> header;
+            std::vector<std::vector<std::string>> shardRows;
+            if (!OFIQAssessmentCsv::ReadFile(shardPath, header, shardRows, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+
+            // The layout of the first shard with assessed measures is used;
+            // columns of the other shards are matched by name.
+            if (columns.size() < header.size())
+            {
+                if (columns.size() > 1)
+                {
+                    std::cerr << "WARNING: '" << shardPath << "' has more columns than the previous shards." << std::endl;
+                }
+                columns = header;
+            }
+
+            for (const auto& fields : shardRows)
+            {
+                const std::string& name = fields[0];
+                if (occurrences[name]++ != 0)
+                {
+                    continue;
+                }
+                auto& rowValues = values[name];
+                for (size_t i = 1; i < header.size(); i++)
+                {
+                    rowValues[header[i]] = fields[i];
+                }
+                order.push_back(name);
+            }
+        }
+
+        std::vector<std::string> duplicates;
+        for (const auto& occurrence : occurrences)
+        {
+            if (occurrence.second > 1)
+            {
+                duplicates.push_back(occurrence.first);
+            }
+        }
+
+        std::vector<std::string> missing;
+        std::vector<std::string> unexpected;
+        std::string manifest = commandLine.GetString("manifest");
+        if (!manifest.empty())
+        {
+            std::vector<OFIQImageEntry> images;
+            if (!OFIQImageList::FromManifest(manifest, images, error))
+            {
+                std::cerr << "ERROR: " << error << std::endl;
+                return 1;
+            }
+
+            std::set<std::string> listed;
+            std::vector<std::string> manifestOrder;
+            for (const auto& image : images)
+            {
+                listed.insert(image.name);
+                if (values.find(image.name) == values.end())
+                {
+                    missing.push_back(image.name);
+                }
+                else
+                {
+                    manifestOrder.push_back(image.name);
+                }
+            }
+            for (const auto& name : order)
+            {
+                if (listed.find(name) == listed.end())
+                {
+                    unexpected.push_back(name);
+                    manifestOrder.push_back(name);
+                }
+            }
+            order.swap(manifestOrder);
+        }
+
+        std::ofstream csvStream(outputPath.c_str());
+        if (!csvStream.is_open())
+        {
+            std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+        if (columns.empty())
+        {
+            columns.push_back("Filename");
+        }
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            csvStream << (i == 0 ? "" : std::string(1, OFIQAssessmentCsv::separator)) << columns[i];
+        }
+        csvStream << std::endl;
+        for (const auto& name : order)
+        {
+            csvStream << name;
+            for (const auto& value : ToColumns(values[name], columns))
+            {
+                csvStream << OFIQAssessmentCsv::separator << value;
+            }
+            csvStream << std::endl;
+        }
+        csvStream.close();
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("output", outputPath);
+        report.Set("shards", shardPaths.size());
+        report.Set("rows", order.size());
+        report.Set("incomplete_shards", ToJson(incompleteShards));
+        report.Set("missing", ToJson(missing));
+        report.Set("duplicates", ToJson(duplicates));
+        report.Set("unexpected", ToJson(unexpected));
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+        }
+
+        std::cout << order.size() << " rows merged from " << shardPaths.size() << " shards into '" << outputPath << "'." << std::endl
+            << incompleteShards.size() << " incomplete shards, " << missing.size() << " missing, "
+            << duplicates.size() << " duplicated, " << unexpected.size() << " not in manifest." << std::endl;
+        for (const auto& name : missing)
+        {
+            std::cout << "MISSING: " << name << std::endl;
+        }
+        for (const auto& name : duplicates)
+        {
+            std::cout << "DUPLICATE: " << name << " (" << occurrences[name] << "x)" << std::endl;
+        }
+
+        return (incompleteShards.empty() && missing.empty() && duplicates.empty()) ? 0 : incompleteExitCode;
+    }
+
+private:
+    static std::vector<std::string> ToColumns(const std::map<std::string, std::string>& values, const std::vector<std::string>& columns)
+    {
+        std::vector<std::string> fields;
+        for (size_t i = 1; i < columns.size(); i++)
+        {
+            auto it = values.find(columns[i]);
+            fields.push_back(it != values.end() ? it->second : "-1");
+        }
+        return fields;
+    }
+
+    static OFIQJsonValue ToJson(const std::vector<std::string>& values)
+    {
+        OFIQJsonValue array = OFIQJsonValue::Array();
+        for (const auto& value : values)
+        {
+            array.Append(value);
+        }
+        return array;
+    }
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <OFIQBatch.h>
+#include <OFIQBenchmark.h>
+#include <OFIQCommandLine.h>
+#include <OFIQJson.h>
+#include <OFIQSharedMemoryRing.h>
+
+
+// --shm-ingest: assesses raw frames submitted by a local producer through a
+// shared memory ring (see OFIQSharedMemoryRing.h). The frames are passed to
+// OFIQ in place, without decoding or copying them, and the scores are
+// returned through the completion ring. The service runs until SIGINT or
+// SIGTERM.
+class OFIQSharedMemoryIngest
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --shm-ingest [--shm-name </ofiq-ingest>] [--config <ofiq_config.jaxn>]" << std::endl
+            << "           [--slots <8>] [--max-width <4096>] [--max-height <4096>]" << std::endl;
+    }
+
+#if defined(_WIN32)
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::cerr << "ERROR: --shm-ingest is only supported on Linux and macOS." << std::endl;
+        return 1;
+    }
+#else
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string name = commandLine.GetString("shm-name", "/ofiq-ingest");
+        int slots = commandLine.GetInt("slots", 8);
+        int maxWidth = commandLine.GetInt("max-width", 4096);
+        int maxHeight = commandLine.GetInt("max-height", 4096);
+        if (slots < 1 || maxWidth < 1 || maxHeight < 1 || maxWidth > UINT16_MAX || maxHeight > UINT16_MAX)
+        {
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::string error;
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(commandLine.GetString("config", "ofiq_config.jaxn"), error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "OFIQ initialized in " << runner.GetInitSeconds() << " s" << std::endl;
+
+        OFIQSharedMemoryRing ring;
+        uint64_t slotBytes = static_cast<uint64_t>(maxWidth) * static_cast<uint64_t>(maxHeight) * 3;
+        if (!ring.Create(name, static_cast<uint32_t>(slots), slotBytes, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        OFIQInstallStopHandler();
+        std::cout << "Listening on shared memory '" << name << "' with " << slots << " slots of "
+            << maxWidth << "x" << maxHeight << " RGB" << std::endl;
+
+        OFIQSharedMemory::Header& header = ring.GetHeader();
+        auto stop = [] { return OFIQStopRequested() != 0; };
+        size_t processed = 0;
+        size_t failed = 0;
+        double assessSeconds = 0.0;
+
+        uint64_t tail = header.submitTail.load(std::memory_order_relaxed);
+        while (OFIQSharedMemory::WaitFor(
+            [&] { return header.submitHead.load(std::memory_order_acquire) != tail; }, stop))
+        {
+            // The producer never has more frames in flight than there are
+            // slots, so the completion slot is free; the check protects the
+            // ring from a misbehaving producer.
+            if (!OFIQSharedMemory::WaitFor([&] {
+                    return header.completeHead.load(std::memory_order_relaxed)
+                        - header.completeTail.load(std::memory_order_acquire) < ring.GetSlotCount();
+                }, stop))
+            {
+                break;
+            }
+
+            // Work on a copy of the frame header, so that a producer
+            // rewriting the slot cannot change it between the checks below
+            // and its use.
+            const OFIQSharedMemory::Frame frame = ring.GetFrame(tail);
+            OFIQSharedMemory::Completion& completion = ring.GetCompletion(header.completeHead.load(std::memory_order_relaxed));
+            completion.sequence = frame.sequence;
+            completion.submitNanos = frame.submitNanos;
+            completion.scoreCount = 0;
+
+            OFIQBatchItem item;
+            uint64_t expectedBytes = static_cast<uint64_t>(frame.width) * frame.height * (frame.depth / 8);
+            if ((frame.depth != 24 && frame.depth != 8) || frame.width == 0 || frame.height == 0
+                || frame.byteCount != expectedBytes || expectedBytes > ring.GetSlotBytes())
+            {
+                item.info = "Invalid frame header.";
+            }
+            else
+            {
+                // Wrap the slot without taking ownership; the slot stays
+                // reserved until the completion has been published below.
+                item.image = OFIQ::Image(frame.width, frame.height, frame.depth,
+                    std::shared_ptr<uint8_t>(ring.GetPixels(tail), [](uint8_t*) {}));
+                runner.Assess(item);
+                item.image = OFIQ::Image();
+            }
+
+            completion.status = item.success ? 0 : 1;
+            completion.assessSeconds = item.assessSeconds;
+            for (const auto& [measure, result] : item.assessments.qAssessments)
+            {
+                if (completion.scoreCount == OFIQSharedMemory::maxScores)
+                {
+                    break;
+                }
+                OFIQSharedMemory::Score& score = completion.scores[completion.scoreCount++];
+                score.measure = static_cast<int32_t>(measure);
+                score.code = static_cast<int32_t>(result.code);
+                score.rawScore = result.rawScore;
+                score.scalar = result.scalar;
+            }
+
+            header.completeHead.fetch_add(1, std::memory_order_release);
+            header.submitTail.store(++tail, std::memory_order_release);
+
+            processed++;
+            assessSeconds += item.assessSeconds;
+            if (!item.success)
+            {
+                failed++;
+                std::cerr << "ERROR: Frame " << frame.sequence << ": " << item.info << std::endl;
+            }
+        }
+
+        std::cout << "Shutting down ..." << std::endl
+            << processed << " frames assessed, " << failed << " failed";
+        if (processed > 0)
+        {
+            std::cout << ", mean assessment time " << assessSeconds * 1000.0 / static_cast<double>(processed) << " ms";
+        }
+        std::cout << "." << std::endl;
+        return 0;
+    }
+#endif
+};
+
+// --shm-producer: test producer for --shm-ingest. Decodes the images of the
+// input once, then submits them as raw frames in a loop and reports the
+// achieved frames per second and the latency from submission to completion.
+class OFIQSharedMemoryProducer
+{
+public:
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --shm-producer --input <directory|manifest> [--shm-name </ofiq-ingest>]" << std::endl
+            << "           [--frames <1000>] [--report <report.json>]" << std::endl;
+    }
+
+#if defined(_WIN32)
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::cerr << "ERROR: --shm-producer is only supported on Linux and macOS." << std::endl;
+        return 1;
+    }
+#else
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::vector<OFIQImageEntry> entries;
+        if (!OFIQImageList::Collect(commandLine.GetString("input"), entries, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+        size_t frameCount = static_cast<size_t>(std::max(1, commandLine.GetInt("frames", 1000)));
+
+        OFIQSharedMemoryRing ring;
+        std::string name = commandLine.GetString("shm-name", "/ofiq-ingest");
+        if (!ring.Open(name, error))
+        {
+            std::cerr << "ERROR: " << error << " Is --shm-ingest running?" << std::endl;
+            return 1;
+        }
+
+        std::vector<OFIQ::Image> frames;
+        for (const auto& entry : entries)
+        {
+            OFIQ::Image image;
+            OFIQ::ReturnStatus status = OFIQ_LIB::readImage(entry.path, image);
+            uint64_t bytes = static_cast<uint64_t>(image.width) * image.height * (image.depth / 8);
+            if (status.code != OFIQ::ReturnCode::Success)
+            {
+                std::cerr << "WARNING: Skipping '" << entry.name << "': " << status.info << std::endl;
+            }
+            else if (bytes > ring.GetSlotBytes())
+            {
+                std::cerr << "WARNING: Skipping '" << entry.name << "', it does not fit into a slot." << std::endl;
+            }
+            else
+            {
+                frames.push_back(image);
+            }
+        }
+        if (frames.empty())
+        {
+            std::cerr << "ERROR: No frames to submit." << std::endl;
+            return 1;
+        }
+
+        OFIQSharedMemory::Header& header = ring.GetHeader();
+        if (!Attach(header, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        InstallStopHandler(header);
+
+        // Wait for the frames of a previous producer, then discard their
+        // completions.
+        auto consumerGone = [&] {
+            return header.consumerReady.load(std::memory_order_acquire) == 0 || OFIQStopRequested() != 0;
+        };
+        OFIQSharedMemory::WaitFor([&] {
+            return header.submitTail.load(std::memory_order_acquire) == header.submitHead.load(std::memory_order_relaxed);
+        }, consumerGone);
+        header.completeTail.store(header.completeHead.load(std::memory_order_acquire), std::memory_order_release);
+
+        uint64_t head = header.submitHead.load(std::memory_order_relaxed);
+        uint64_t completeTail = header.completeTail.load(std::memory_order_relaxed);
+        uint32_t slotCount = ring.GetSlotCount();
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t failed = 0;
+        std::vector<double> latencies;
+        latencies.reserve(frameCount);
+
+        auto start = std::chrono::steady_clock::now();
+        while (completed < frameCount && !OFIQStopRequested())
+        {
+            bool canSubmit = submitted < frameCount && head - completeTail < slotCount;
+            if (canSubmit)
+            {
+                const OFIQ::Image& image = frames[submitted % frames.size()];
+                OFIQSharedMemory::Frame& frame = ring.GetFrame(head);
+                frame.sequence = submitted;
+                frame.submitNanos = OFIQSharedMemory::NowNanos();
+                frame.width = image.width;
+                frame.height = image.height;
+                frame.depth = image.depth;
+                frame.byteCount = static_cast<uint32_t>(image.width) * image.height * (image.depth / 8);
+                memcpy(ring.GetPixels(head), image.data.get(), frame.byteCount);
+                header.submitHead.store(++head, std::memory_order_release);
+                submitted++;
+            }
+
+            uint64_t completeHead = header.completeHead.load(std::memory_order_acquire);
+            for (; completeTail != completeHead; completeTail++)
+            {
+                const OFIQSharedMemory::Completion& completion = ring.GetCompletion(completeTail);
+                latencies.push_back(static_cast<double>(OFIQSharedMemory::NowNanos() - completion.submitNanos) / 1.0e6);
+                if (completion.status != 0)
+                {
+                    failed++;
+                }
+                completed++;
+            }
+            header.completeTail.store(completeTail, std::memory_order_release);
+
+            if (!canSubmit && completed < frameCount)
+            {
+                bool ready = OFIQSharedMemory::WaitFor([&] {
+                    return header.completeHead.load(std::memory_order_acquire) != completeTail;
+                }, consumerGone);
+                if (!ready)
+                {
+                    if (!OFIQStopRequested())
+                    {
+                        std::cerr << "ERROR: The consumer has stopped." << std::endl;
+                    }
+                    break;
+                }
+            }
+        }
+        double seconds = OFIQSecondsSince(start);
+        Detach(header);
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("shm_name", name);
+        report.Set("slots", static_cast<size_t>(slotCount));
+        report.Set("frames", completed);
+        report.Set("failed", failed);
+        report.Set("seconds", seconds);
+        report.Set("frames_per_second", seconds > 0.0 ? static_cast<double>(completed) / seconds : 0.0);
+        report.Set("latency_p50_ms", OFIQBenchmark::Percentile(latencies, 50.0));
+        report.Set("latency_p95_ms", OFIQBenchmark::Percentile(latencies, 95.0));
+        report.Set("latency_p99_ms", OFIQBenchmark::Percentile(latencies, 99.0));
+        std::cout << report.ToString(true) << std::endl;
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+            return 1;
+        }
+        return completed == frameCount ? 0 : 1;
+    }
+
+private:
+    // Records this process as the producer of the ring. A producer that was
+    // killed or crashed leaves its process ID behind; it is taken over once
+    // that process no longer exists.
+    static bool Attach(OFIQSharedMemory::Header& header, std::string& error)
+    {
+        int32_t pid = static_cast<int32_t>(getpid());
+        int32_t expected = 0;
+        while (!header.producerPid.compare_exchange_strong(expected, pid, std::memory_order_acq_rel))
+        {
+            if (kill(static_cast<pid_t>(expected), 0) == 0 || errno != ESRCH)
+            {
+                error = "Another producer (process " + std::to_string(expected) + ") is attached.";
+                return false;
+            }
+            std::cerr << "WARNING: Taking over from producer process " << expected << ", which no longer exists." << std::endl;
+        }
+        return true;
+    }
+
+    static void Detach(OFIQSharedMemory::Header& header)
+    {
+        int32_t pid = static_cast<int32_t>(getpid());
+        header.producerPid.compare_exchange_strong(pid, 0, std::memory_order_acq_rel);
+    }
+
+    static OFIQSharedMemory::Header*& GetAttachedHeader()
+    {
+        static OFIQSharedMemory::Header* attachedHeader = nullptr;
+        return attachedHeader;
+    }
+
+    // Like OFIQInstallStopHandler, but also detaches from the ring right
+    // away, so that the next producer can attach even if this one does not
+    // get to shut down cleanly. The producer ID is a lock-free atomic, which
+    // is safe to use from a signal handler.
+    static void InstallStopHandler(OFIQSharedMemory::Header& header)
+    {
+        static_assert(std::atomic<int32_t>::is_always_lock_free, "The producer ID is updated from a signal handler.");
+        GetAttachedHeader() = &header;
+        auto onSignal = [](int) {
+            OFIQStopRequested() = 1;
+            if (GetAttachedHeader() != nullptr)
+            {
+                Detach(*GetAttachedHeader());
+            }
+        };
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+    }
+#endif
+};
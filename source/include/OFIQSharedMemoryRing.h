@@ -0,0 +1,333 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Layout of the shared memory segment used by --shm-ingest.
+//
+// The segment holds two single-producer/single-consumer rings with the same
+// number of slots:
+// - the submission ring, into which a local producer writes raw frames
+//   (RGB with 24 bits per pixel or grey with 8 bits per pixel, rows without
+//   padding), and
+// - the completion ring, into which the demonstrator writes the scores of
+//   each frame.
+// The demonstrator assesses a frame directly in its submission slot and only
+// releases the slot after the completion has been published, so a producer
+// must not touch a slot before its completion has been read.
+//
+// Heads and tails are monotonically increasing counters; the slot of a
+// counter is counter % slotCount.
+namespace OFIQSharedMemory
+{
+    constexpr uint32_t magic = 0x4f464951; // "OFIQ"
+    constexpr uint32_t version = 2;
+    constexpr uint32_t maxScores = 64;
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory rings need lock-free 64-bit atomics.");
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slotCount;
+        uint32_t reserved;
+        uint64_t slotBytes;
+        std::atomic<uint32_t> consumerReady;
+        // Process ID of the attached producer, 0 if none is attached.
+        std::atomic<int32_t> producerPid;
+        alignas(64) std::atomic<uint64_t> submitHead;
+        alignas(64) std::atomic<uint64_t> submitTail;
+        alignas(64) std::atomic<uint64_t> completeHead;
+        alignas(64) std::atomic<uint64_t> completeTail;
+    };
+
+    struct Frame
+    {
+        uint64_t sequence;
+        uint64_t submitNanos;
+        uint16_t width;
+        uint16_t height;
+        uint8_t depth;
+        uint8_t reserved[3];
+        uint32_t byteCount;
+    };
+
+    struct Score
+    {
+        int32_t measure;
+        int32_t code;
+        double rawScore;
+        double scalar;
+    };
+
+    struct Completion
+    {
+        uint64_t sequence;
+        uint64_t submitNanos;
+        int32_t status;
+        uint32_t scoreCount;
+        double assessSeconds;
+        Score scores[maxScores];
+    };
+
+    // Nanoseconds of the monotonic clock, which on Linux and macOS is shared
+    // by all processes of the host.
+    inline uint64_t NowNanos()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Polls a condition, first spinning, then yielding, then sleeping, so that
+    // an idle ring costs little CPU while a busy one keeps its latency low.
+    template <typename Predicate, typename StopPredicate>
+    bool WaitFor(Predicate ready, StopPredicate stop)
+    {
+        for (unsigned int round = 0; !ready(); round++)
+        {
+            if (stop())
+            {
+                return false;
+            }
+            if (round < 256)
+            {
+                continue;
+            }
+            if (round < 1024)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        return true;
+    }
+}
+
+#if !defined(_WIN32)
+
+// A mapping of the shared memory segment. The demonstrator creates the
+// segment, producers open it.
+class OFIQSharedMemoryRing
+{
+public:
+    OFIQSharedMemoryRing()
+        : m_base(nullptr)
+        , m_size(0)
+        , m_owner(false)
+    {
+        ;
+    }
+
+    ~OFIQSharedMemoryRing()
+    {
+        Unmap();
+    }
+
+    OFIQSharedMemoryRing(const OFIQSharedMemoryRing&) = delete;
+    OFIQSharedMemoryRing& operator=(const OFIQSharedMemoryRing&) = delete;
+
+    static size_t GetSegmentSize(uint32_t slotCount, uint64_t slotBytes)
+    {
+        return GetCompletionsOffset(slotCount, slotBytes) + slotCount * sizeof(OFIQSharedMemory::Completion);
+    }
+
+    bool Create(const std::string& name, uint32_t slotCount, uint64_t slotBytes, std::string& error)
+    {
+        Unmap();
+        if (slotCount == 0 || slotBytes == 0)
+        {
+            error = "The ring needs at least one slot of at least one byte.";
+            return false;
+        }
+
+        size_t size = GetSegmentSize(slotCount, slotBytes);
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(size)) != 0)
+        {
+            error = "Cannot create shared memory '" + name + "': " + strerror(errno);
+            if (fd >= 0)
+            {
+                close(fd);
+                shm_unlink(name.c_str());
+            }
+            return false;
+        }
+        if (!Map(fd, size, error))
+        {
+            shm_unlink(name.c_str());
+            return false;
+        }
+        m_name = name;
+        m_owner = true;
+
+        OFIQSharedMemory::Header* header = new (m_base) OFIQSharedMemory::Header();
+        header->magic = OFIQSharedMemory::magic;
+        header->version = OFIQSharedMemory::version;
+        header->slotCount = slotCount;
+        header->reserved = 0;
+        header->slotBytes = slotBytes;
+        header->producerPid = 0;
+        header->submitHead = 0;
+        header->submitTail = 0;
+        header->completeHead = 0;
+        header->completeTail = 0;
+        header->consumerReady.store(1, std::memory_order_release);
+        return true;
+    }
+
+    bool Open(const std::string& name, std::string& error)
+    {
+        Unmap();
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        struct stat status;
+        if (fd < 0 || fstat(fd, &status) != 0)
+        {
+            error = "Cannot open shared memory '" + name + "': " + strerror(errno);
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return false;
+        }
+        size_t size = static_cast<size_t>(status.st_size);
+        if (size < sizeof(OFIQSharedMemory::Header))
+        {
+            close(fd);
+            error = "Shared memory '" + name + "' is not initialized.";
+            return false;
+        }
+        if (!Map(fd, size, error))
+        {
+            return false;
+        }
+        m_name = name;
+
+        const OFIQSharedMemory::Header& header = GetHeader();
+        if (header.consumerReady.load(std::memory_order_acquire) == 0
+            || header.magic != OFIQSharedMemory::magic
+            || header.version != OFIQSharedMemory::version
+            || GetSegmentSize(header.slotCount, header.slotBytes) > size)
+        {
+            error = "Shared memory '" + name + "' is not an OFIQ ring of version " + std::to_string(OFIQSharedMemory::version) + ".";
+            Unmap();
+            return false;
+        }
+        return true;
+    }
+
+    OFIQSharedMemory::Header& GetHeader() const
+    {
+        return *reinterpret_cast<OFIQSharedMemory::Header*>(m_base);
+    }
+
+    uint32_t GetSlotCount() const
+    {
+        return GetHeader().slotCount;
+    }
+
+    uint64_t GetSlotBytes() const
+    {
+        return GetHeader().slotBytes;
+    }
+
+    OFIQSharedMemory::Frame& GetFrame(uint64_t counter) const
+    {
+        return *reinterpret_cast<OFIQSharedMemory::Frame*>(GetSlot(counter));
+    }
+
+    uint8_t* GetPixels(uint64_t counter) const
+    {
+        return GetSlot(counter) + sizeof(OFIQSharedMemory::Frame);
+    }
+
+    OFIQSharedMemory::Completion& GetCompletion(uint64_t counter) const
+    {
+        uint32_t slotCount = GetSlotCount();
+        auto* completions = reinterpret_cast<OFIQSharedMemory::Completion*>(
+            m_base + GetCompletionsOffset(slotCount, GetSlotBytes()));
+        return completions[counter % slotCount];
+    }
+
+private:
+    static size_t Align(size_t value)
+    {
+        return (value + 63) & ~static_cast<size_t>(63);
+    }
+
+    static size_t GetSlotStride(uint64_t slotBytes)
+    {
+        return Align(sizeof(OFIQSharedMemory::Frame) + static_cast<size_t>(slotBytes));
+    }
+
+    static size_t GetCompletionsOffset(uint32_t slotCount, uint64_t slotBytes)
+    {
+        return Align(sizeof(OFIQSharedMemory::Header)) + slotCount * GetSlotStride(slotBytes);
+    }
+
+    uint8_t* GetSlot(uint64_t counter) const
+    {
+        return m_base + Align(sizeof(OFIQSharedMemory::Header))
+            + (counter % GetSlotCount()) * GetSlotStride(GetSlotBytes());
+    }
+
+    bool Map(int fd, size_t size, std::string& error)
+    {
+        void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            error = std::string("Cannot map shared memory: ") + strerror(errno);
+            return false;
+        }
+        m_base = static_cast<uint8_t*>(base);
+        m_size = size;
+        return true;
+    }
+
+    void Unmap()
+    {
+        if (m_base != nullptr)
+        {
+            if (m_owner)
+            {
+                GetHeader().consumerReady.store(0, std::memory_order_release);
+            }
+            munmap(m_base, m_size);
+        }
+        if (m_owner)
+        {
+            shm_unlink(m_name.c_str());
+        }
+        m_base = nullptr;
+        m_size = 0;
+        m_owner = false;
+        m_name.clear();
+    }
+
+    uint8_t* m_base;
+    size_t m_size;
+    bool m_owner;
+    std::string m_name;
+};
+
+#endif
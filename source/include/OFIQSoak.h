@@ -0,0 +1,447 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <OFIQBatch.h>
+#include <OFIQBufferPool.h>
+#include <OFIQCommandLine.h>
+#include <OFIQDisplaySource.h>
+#include <OFIQHistory.h>
+#include <OFIQJson.h>
+#include <OFIQLogLimit.h>
+#include <OFIQOverlayRenderer.h>
+#include <OFIQProcessMemory.h>
+
+
+// --soak: shows and assesses a corpus over and over, the way the GUI does
+// during days of operation, and checks that memory does not grow. Every image
+// takes the steps of OFIQDemoFrame::DoLoadImage and of the assessment that
+// follows, without wxWidgets:
+// - it is decoded into the shown image and the display source is rendered
+//   and converted to RGB into a buffer reused while the size stays the same,
+//   as for the wxImage of the view,
+// - it is added to the history,
+// - it is assessed with preprocessing results, the display source is rendered
+//   again with all mask layers and the history entry is updated,
+// - the overlay is rendered with all layers, as when the image is saved,
+// - the log lines of these steps are appended to a log kept within the limit
+//   of the log window (OFIQLogLimit).
+// Only the wx widgets themselves (picture frame, assessment table, log
+// control) are left out.
+//
+// A sampler thread writes the RSS, the heap in use, the buffer pool cache and
+// the sizes of the log and the history to a CSV time series. After every
+// iteration, the free heap is returned to the system and RSS and heap are
+// sampled again; the growth per iteration is the slope of a least squares
+// line through these samples, leaving out the warm-up iterations in which
+// caches fill. If the RSS or the heap grows by more than the threshold per
+// iteration, the process exits with code 2.
+class OFIQSoak
+{
+public:
+    // Exit code signalling that memory grew beyond the threshold.
+    static constexpr int growthExitCode = 2;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --soak --input <directory|manifest>" << std::endl
+            << "           [--config <ofiq_config.jaxn>] [--iterations <10>] [--duration <seconds>]" << std::endl
+            << "           [--series <series.csv>] [--sample-interval <1.0>] [--report <report.json>]" << std::endl
+            << "           [--warmup-iterations <2>] [--max-growth-mib <1.0>] [--display-budget-mib <256>]" << std::endl;
+    }
+
+    // Slope of the least squares line through the points (x, y).
+    static double GetSlope(const std::vector<double>& x, const std::vector<double>& y)
+    {
+        size_t count = std::min(x.size(), y.size());
+        if (count < 2)
+        {
+            return 0.0;
+        }
+        double meanX = 0.0;
+        double meanY = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            meanX += x[i];
+            meanY += y[i];
+        }
+        meanX /= count;
+        meanY /= count;
+        double covariance = 0.0;
+        double variance = 0.0;
+        for (size_t i = 0; i < count; i++)
+        {
+            covariance += (x[i] - meanX) * (y[i] - meanY);
+            variance += (x[i] - meanX) * (x[i] - meanX);
+        }
+        return variance > 0.0 ? covariance / variance : 0.0;
+    }
+
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string error;
+        std::vector<OFIQImageEntry> images;
+        if (!OFIQImageList::Collect(commandLine.GetString("input"), images, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+        if (images.empty())
+        {
+            std::cerr << "ERROR: The soak corpus is empty." << std::endl;
+            return 1;
+        }
+
+        const double duration = commandLine.GetDouble("duration", 0.0);
+        const int iterations = std::max(1, commandLine.GetInt("iterations", duration > 0.0 ? INT32_MAX : 10));
+        const int warmupIterations = std::max(0, commandLine.GetInt("warmup-iterations", 2));
+        const double sampleInterval = std::max(0.05, commandLine.GetDouble("sample-interval", 1.0));
+        const double maxGrowthBytes = commandLine.GetDouble("max-growth-mib", 1.0) * 1024.0 * 1024.0;
+        const size_t displayBudgetBytes = static_cast<size_t>(std::max(16, commandLine.GetInt("display-budget-mib", 256))) * 1024 * 1024;
+
+        std::ofstream seriesStream;
+        std::string seriesPath = commandLine.GetString("series");
+        if (!seriesPath.empty())
+        {
+            seriesStream.open(seriesPath.c_str());
+            if (!seriesStream.is_open())
+            {
+                std::cerr << "ERROR: Cannot write '" << seriesPath << "'" << std::endl;
+                return 1;
+            }
+            seriesStream << "seconds,event,iteration,images,rss_bytes,heap_bytes,buffer_pool_cached_bytes,log_bytes,history_bytes" << std::endl;
+        }
+
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(commandLine.GetString("config", "ofiq_config.jaxn"), error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        runner.SetKeepPreprocessing(true);
+
+        OFIQOverlayOptions overlay;
+        overlay.landmarks = true;
+        overlay.segmentationMask = true;
+        overlay.occlusionMask = true;
+        overlay.landmarkedRegion = true;
+
+        View view(displayBudgetBytes);
+
+        Sampler sampler(seriesPath.empty() ? nullptr : &seriesStream);
+        sampler.Start(sampleInterval);
+        OFIQInstallStopHandler();
+
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<double> sampleIterations;
+        std::vector<double> rssSamples;
+        std::vector<double> heapSamples;
+        uint64_t startRss = OFIQProcessMemory::GetCurrentRss();
+        size_t failed = 0;
+        int iteration = 0;
+        while (iteration < iterations && !OFIQStopRequested()
+            && (duration <= 0.0 || OFIQSecondsSince(start) < duration))
+        {
+            sampler.SetIteration(iteration);
+            for (const auto& image : images)
+            {
+                if (!view.Show(runner, image.path, overlay))
+                {
+                    failed++;
+                }
+                sampler.AddImage();
+                sampler.SetSizes(view.GetLogBytes(), view.GetHistoryBytes());
+                if (OFIQStopRequested())
+                {
+                    break;
+                }
+            }
+            if (OFIQStopRequested())
+            {
+                break;
+            }
+            iteration++;
+
+            OFIQProcessMemory::ReleaseFreeHeap();
+            Sample sample = sampler.Record("iteration");
+            std::cerr << "Iteration " << iteration << ": RSS " << (sample.rss >> 20) << " MiB, heap "
+                << (sample.heap >> 20) << " MiB" << std::endl;
+            if (iteration > warmupIterations)
+            {
+                sampleIterations.push_back(static_cast<double>(iteration));
+                rssSamples.push_back(static_cast<double>(sample.rss));
+                heapSamples.push_back(static_cast<double>(sample.heap));
+            }
+        }
+        sampler.Stop();
+
+        double rssGrowth = GetSlope(sampleIterations, rssSamples);
+        double heapGrowth = GetSlope(sampleIterations, heapSamples);
+        bool evaluated = sampleIterations.size() >= 2;
+        bool passed = !evaluated || (rssGrowth <= maxGrowthBytes && heapGrowth <= maxGrowthBytes);
+
+        OFIQJsonValue soak = OFIQJsonValue::Object();
+        soak.Set("config", commandLine.GetString("config", "ofiq_config.jaxn"));
+        soak.Set("input", commandLine.GetString("input"));
+        soak.Set("corpus_size", images.size());
+        soak.Set("iterations", iteration);
+        soak.Set("warmup_iterations", warmupIterations);
+        soak.Set("images", sampler.GetImageCount());
+        soak.Set("failed", failed);
+        soak.Set("wall_seconds", OFIQSecondsSince(start));
+
+        OFIQJsonValue memory = OFIQJsonValue::Object();
+        memory.Set("start_rss_bytes", static_cast<double>(startRss));
+        memory.Set("end_rss_bytes", rssSamples.empty() ? 0.0 : rssSamples.back());
+        memory.Set("peak_rss_bytes", static_cast<double>(OFIQProcessMemory::GetPeakRss()));
+        memory.Set("end_heap_bytes", heapSamples.empty() ? 0.0 : heapSamples.back());
+        memory.Set("log_bytes", view.GetLogBytes());
+        memory.Set("max_log_bytes", OFIQLogLimit::defaultMaxCharacters);
+        memory.Set("history_bytes", view.GetHistoryBytes());
+        memory.Set("rss_growth_per_iteration_bytes", rssGrowth);
+        memory.Set("heap_growth_per_iteration_bytes", heapGrowth);
+        memory.Set("max_growth_per_iteration_bytes", maxGrowthBytes);
+        memory.Set("evaluated", evaluated);
+        memory.Set("passed", passed);
+
+        OFIQJsonValue report = OFIQJsonValue::Object();
+        report.Set("soak", soak);
+        report.Set("memory", memory);
+        report.Set("buffer_pool", OFIQBufferPool::Get().GetStats().ToJson());
+
+        std::string reportPath = commandLine.GetString("report");
+        if (!reportPath.empty() && !report.SaveToFile(reportPath))
+        {
+            std::cerr << "ERROR: Cannot write '" << reportPath << "'" << std::endl;
+            return 1;
+        }
+        std::cout << report.ToString();
+
+        if (!evaluated)
+        {
+            std::cerr << "WARNING: Fewer than two iterations after the warm-up; memory growth was not evaluated." << std::endl;
+        }
+        if (!passed)
+        {
+            std::cerr << "ERROR: Memory grew by more than " << maxGrowthBytes / (1024.0 * 1024.0)
+                << " MiB per iteration (RSS " << rssGrowth / 1024.0 << " KiB, heap " << heapGrowth / 1024.0 << " KiB)." << std::endl;
+            return growthExitCode;
+        }
+        return 0;
+    }
+
+private:
+    // The state of the GUI's image view without its widgets: the shown image
+    // and its results, the display source, the RGB buffer of the view, the
+    // history and the log.
+    class View
+    {
+    public:
+        explicit View(size_t displayBudgetBytes)
+            : m_displayBudgetBytes(displayBudgetBytes)
+        {
+            ;
+        }
+
+        // Loads, shows and assesses an image like the GUI does. Returns
+        // whether it was assessed.
+        bool Show(OFIQBatchRunner& runner, const std::string& path, const OFIQOverlayOptions& overlay)
+        {
+            Log("INFO: Loading image from '" + path + "' ...");
+            if (!m_image.imagePath.empty())
+            {
+                m_history.Update(m_image);
+            }
+            OFIQ::Image image;
+            OFIQ::ReturnStatus status = OFIQ_LIB::readImage(path, image);
+            if (status.code != OFIQ::ReturnCode::Success)
+            {
+                Log("ERROR: Loading image returned: " + status.info);
+                return false;
+            }
+            m_shownImage = image;
+            m_image = OFIQSessionData();
+            m_image.imagePath = path;
+            m_image.width = image.width;
+            m_image.height = image.height;
+            Render(OFIQOverlayOptions());
+            m_history.Visit(m_image);
+            Log("INFO: Image loaded.");
+
+            Log("INFO: OFIQ assessment ...");
+            OFIQBatchItem item;
+            item.image = m_shownImage;
+            runner.Assess(item);
+            if (!item.success)
+            {
+                Log("ERROR: " + item.info);
+                return false;
+            }
+            m_image.assessments = item.assessments;
+            m_image.preprocessing = item.preprocessing;
+            Render(overlay);
+            m_history.Update(m_image);
+            Log("INFO: OFIQ assessment done (" + std::to_string(item.assessSeconds) + " s)");
+
+            // The rendering of a saved image is released right away.
+            OFIQOverlayRenderer::Render(m_shownImage, m_image.preprocessing, overlay);
+            return true;
+        }
+
+        size_t GetLogBytes() const
+        {
+            return m_log.size();
+        }
+
+        size_t GetHistoryBytes() const
+        {
+            return m_history.GetBytes();
+        }
+
+    private:
+        void Render(const OFIQOverlayOptions& overlay)
+        {
+            bool proxyCreated = false;
+            if (!m_displaySource.Update(m_shownImage, m_image.preprocessing, overlay, m_displayBudgetBytes, proxyCreated))
+            {
+                return;
+            }
+            if (proxyCreated)
+            {
+                Log("INFO: Image exceeds the display memory budget; showing a proxy.");
+            }
+            const cv::Mat& displayImage = m_displaySource.GetImage();
+            m_rgb.resize(static_cast<size_t>(displayImage.cols) * displayImage.rows * 3);
+            m_displaySource.CopyRgb(m_rgb.data());
+        }
+
+        void Log(const std::string& line)
+        {
+            OFIQLogLimit::Append(m_log, line, OFIQLogLimit::defaultMaxCharacters);
+        }
+
+        size_t m_displayBudgetBytes;
+        OFIQ::Image m_shownImage;
+        OFIQSessionData m_image;
+        OFIQDisplaySource m_displaySource;
+        std::vector<uint8_t> m_rgb;
+        OFIQHistory m_history;
+        std::string m_log;
+    };
+
+    struct Sample
+    {
+        uint64_t rss = 0;
+        uint64_t heap = 0;
+    };
+
+    // Writes memory samples to the time series, periodically from its own
+    // thread and on request after every iteration.
+    class Sampler
+    {
+    public:
+        explicit Sampler(std::ostream* streamPtr)
+            : m_streamPtr(streamPtr)
+            , m_iteration(0)
+            , m_images(0)
+            , m_logBytes(0)
+            , m_historyBytes(0)
+            , m_stop(false)
+            , m_start(std::chrono::steady_clock::now())
+        {
+            ;
+        }
+
+        ~Sampler()
+        {
+            Stop();
+        }
+
+        void Start(double intervalSeconds)
+        {
+            m_thread = std::thread([this, intervalSeconds]()
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    while (!m_wakeUp.wait_for(lock, std::chrono::duration<double>(intervalSeconds), [this] { return m_stop; }))
+                    {
+                        lock.unlock();
+                        Record("sample");
+                        lock.lock();
+                    }
+                });
+        }
+
+        void Stop()
+        {
+            if (m_thread.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stop = true;
+                }
+                m_wakeUp.notify_all();
+                m_thread.join();
+            }
+        }
+
+        void SetIteration(int iteration)
+        {
+            m_iteration = iteration;
+        }
+
+        void AddImage()
+        {
+            m_images++;
+        }
+
+        void SetSizes(size_t logBytes, size_t historyBytes)
+        {
+            m_logBytes = logBytes;
+            m_historyBytes = historyBytes;
+        }
+
+        size_t GetImageCount() const
+        {
+            return m_images;
+        }
+
+        Sample Record(const char* event)
+        {
+            Sample sample;
+            sample.rss = OFIQProcessMemory::GetCurrentRss();
+            sample.heap = OFIQProcessMemory::GetHeapInUse();
+            if (m_streamPtr != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(m_streamMutex);
+                *m_streamPtr << OFIQSecondsSince(m_start) << "," << event << "," << m_iteration << "," << m_images
+                    << "," << sample.rss << "," << sample.heap << "," << OFIQBufferPool::Get().GetStats().cachedBytes
+                    << "," << m_logBytes << "," << m_historyBytes << std::endl;
+            }
+            return sample;
+        }
+
+    private:
+        std::ostream* m_streamPtr;
+        std::atomic<int> m_iteration;
+        std::atomic<size_t> m_images;
+        std::atomic<size_t> m_logBytes;
+        std::atomic<size_t> m_historyBytes;
+        bool m_stop;
+        const std::chrono::steady_clock::time_point m_start;
+        std::mutex m_mutex;
+        std::mutex m_streamMutex;
+        std::condition_variable m_wakeUp;
+        std::thread m_thread;
+    };
+};
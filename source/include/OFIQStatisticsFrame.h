@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <wx/wx.h>
+#include <wx/grid.h>
+#include <wx/sizer.h>
+#include <wx/timer.h>
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQStreamingStats.h>
+
+
+// Progress of a batch run shown by OFIQStatisticsFrame.
+struct OFIQBatchProgress
+{
+    std::atomic<size_t> total{ 0 };
+    std::atomic<size_t> done{ 0 };
+    std::atomic<bool> running{ false };
+};
+
+// Draws the histogram of one measure together with its 5%, 50% and 95%
+// quantiles.
+class OFIQHistogramPanel : public wxPanel
+{
+public:
+    OFIQHistogramPanel(wxWindow* parent)
+        : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxSize(400, 200))
+    {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, &OFIQHistogramPanel::OnPaint, this);
+        Bind(wxEVT_SIZE, [this](wxSizeEvent& event) { Refresh(); event.Skip(); });
+    }
+
+    void SetStats(const OFIQMeasureStats& stats)
+    {
+        m_stats = stats;
+        Refresh();
+    }
+
+private:
+    void OnPaint(wxPaintEvent& event)
+    {
+        wxPaintDC dc(this);
+        dc.SetBackground(*wxWHITE_BRUSH);
+        dc.Clear();
+
+        const wxSize size = GetClientSize();
+        const int margin = 20;
+        const int width = size.x - 2 * margin;
+        const int height = size.y - 2 * margin;
+        if (width <= 0 || height <= 0)
+        {
+            return;
+        }
+
+        const auto& histogram = m_stats.GetHistogram();
+        uint64_t maxCount = std::max<uint64_t>(1, *std::max_element(histogram.begin(), histogram.end()));
+        const double binWidth = static_cast<double>(width) / OFIQMeasureStats::binCount;
+
+        dc.SetPen(*wxGREY_PEN);
+        dc.SetBrush(wxBrush(wxColour(70, 130, 180)));
+        for (int i = 0; i < OFIQMeasureStats::binCount; i++)
+        {
+            int barHeight = static_cast<int>(std::round(static_cast<double>(histogram[i]) / maxCount * height));
+            int x = margin + static_cast<int>(i * binWidth);
+            int nextX = margin + static_cast<int>((i + 1) * binWidth);
+            dc.DrawRectangle(x, margin + height - barHeight, std::max(1, nextX - x), barHeight);
+        }
+
+        dc.SetPen(*wxBLACK_PEN);
+        dc.DrawLine(margin, margin + height, margin + width, margin + height);
+        dc.DrawText("0", margin, margin + height + 2);
+        dc.DrawText("100", margin + width - dc.GetTextExtent("100").x, margin + height + 2);
+        dc.DrawText(std::to_string(maxCount), margin, 2);
+
+        if (m_stats.GetCount() == 0)
+        {
+            return;
+        }
+        dc.SetPen(wxPen(*wxRED, 1, wxPENSTYLE_SHORT_DASH));
+        for (double quantile : { 0.05, 0.5, 0.95 })
+        {
+            double value = m_stats.GetQuantile(quantile);
+            int x = margin + static_cast<int>((value - OFIQMeasureStats::minValue)
+                / (OFIQMeasureStats::maxValue - OFIQMeasureStats::minValue) * width);
+            dc.DrawLine(x, margin, x, margin + height);
+        }
+    }
+
+    OFIQMeasureStats m_stats;
+};
+
+// A window showing the score distributions of a running or finished batch.
+// The view is refreshed from a snapshot of the streaming aggregates at a
+// fixed rate, independent of the number of results.
+class OFIQStatisticsFrame : public wxFrame
+{
+public:
+    static constexpr int refreshMilliseconds = 500;
+
+    OFIQStatisticsFrame(wxWindow* parent, const OFIQStreamingStats& stats, const OFIQBatchProgress& progress)
+        : wxFrame(parent, wxID_ANY, "Batch statistics", wxDefaultPosition, wxSize(760, 560))
+        , m_stats(stats)
+        , m_progress(progress)
+        , m_timer(this)
+        , m_queueStatusOwner(nullptr)
+        , m_queueStatusFunction(nullptr)
+    {
+        auto panel = new wxPanel(this, wxID_ANY);
+        auto sizer = new wxBoxSizer(wxVERTICAL);
+
+        m_progressTextPtr = new wxStaticText(panel, wxID_ANY, "No batch run.");
+        sizer->Add(m_progressTextPtr, 0, wxALL, 5);
+
+        m_queueTextPtr = new wxStaticText(panel, wxID_ANY, "");
+        sizer->Add(m_queueTextPtr, 0, wxLEFT | wxRIGHT | wxBOTTOM, 5);
+
+        m_measureChoicePtr = new wxChoice(panel, wxID_ANY);
+        sizer->Add(m_measureChoicePtr, 0, wxALL, 5);
+
+        m_histogramPtr = new OFIQHistogramPanel(panel);
+        sizer->Add(m_histogramPtr, 1, wxEXPAND | wxALL, 5);
+
+        m_tablePtr = new wxGrid(panel, wxID_ANY);
+        m_tablePtr->CreateGrid(0, 9);
+        m_tablePtr->EnableEditing(false);
+        m_tablePtr->HideRowLabels();
+        const char* labels[] = { "measure", "count", "mean", "min", "max", "p5", "p50", "p95", "failures" };
+        for (int i = 0; i < 9; i++)
+        {
+            m_tablePtr->SetColLabelValue(i, labels[i]);
+        }
+        sizer->Add(m_tablePtr, 1, wxEXPAND | wxALL, 5);
+        panel->SetSizer(sizer);
+
+        m_measureChoicePtr->Bind(wxEVT_CHOICE, [this](wxCommandEvent&) { RefreshStatistics(); });
+        Bind(wxEVT_TIMER, [this](wxTimerEvent&) { RefreshStatistics(); });
+        Bind(wxEVT_CLOSE_WINDOW, &OFIQStatisticsFrame::OnClose, this);
+        m_timer.Start(refreshMilliseconds);
+    }
+
+    // Binds the function describing the queue of the batch workers, shown
+    // below the progress.
+    void BindQueueStatus(void* owner, std::string(*function)(void*))
+    {
+        m_queueStatusOwner = owner;
+        m_queueStatusFunction = function;
+    }
+
+    // Refreshes the view from a snapshot of the statistics.
+    void RefreshStatistics()
+    {
+        if (!IsShown())
+        {
+            return;
+        }
+
+        OFIQStreamingStats snapshot(m_stats);
+        std::ostringstream progress;
+        progress << (m_progress.running ? "Running: " : "Done: ")
+            << m_progress.done << " of " << m_progress.total << " images, "
+            << snapshot.GetFailedImageCount() << " failed";
+        m_progressTextPtr->SetLabel(progress.str());
+        if (m_queueStatusFunction != nullptr)
+        {
+            m_queueTextPtr->SetLabel(m_queueStatusFunction(m_queueStatusOwner));
+        }
+
+        const auto& measures = snapshot.GetMeasures();
+        wxString selected = m_measureChoicePtr->GetStringSelection();
+        if (m_measureChoicePtr->GetCount() != measures.size())
+        {
+            m_measureChoicePtr->Clear();
+            for (const auto& measure : measures)
+            {
+                m_measureChoicePtr->Append(GetMeasureName(measure.first));
+            }
+            if (!selected.empty())
+            {
+                m_measureChoicePtr->SetStringSelection(selected);
+            }
+            if (m_measureChoicePtr->GetSelection() == wxNOT_FOUND && !measures.empty())
+            {
+                m_measureChoicePtr->SetSelection(0);
+            }
+            selected = m_measureChoicePtr->GetStringSelection();
+        }
+
+        int rows = static_cast<int>(measures.size());
+        if (m_tablePtr->GetNumberRows() != rows)
+        {
+            if (m_tablePtr->GetNumberRows() != 0)
+            {
+                m_tablePtr->DeleteRows(0, m_tablePtr->GetNumberRows(), false);
+            }
+            m_tablePtr->AppendRows(rows);
+        }
+
+        int row = 0;
+        for (const auto& [measure, stats] : measures)
+        {
+            std::string name = GetMeasureName(measure);
+            if (name == selected.ToStdString())
+            {
+                m_histogramPtr->SetStats(stats);
+            }
+            bool empty = stats.GetCount() == 0;
+            m_tablePtr->SetCellValue(row, 0, name);
+            m_tablePtr->SetCellValue(row, 1, std::to_string(stats.GetCount()));
+            m_tablePtr->SetCellValue(row, 2, empty ? "" : Format(stats.GetMean()));
+            m_tablePtr->SetCellValue(row, 3, empty ? "" : Format(stats.GetMin()));
+            m_tablePtr->SetCellValue(row, 4, empty ? "" : Format(stats.GetMax()));
+            m_tablePtr->SetCellValue(row, 5, empty ? "" : Format(stats.GetQuantile(0.05)));
+            m_tablePtr->SetCellValue(row, 6, empty ? "" : Format(stats.GetQuantile(0.5)));
+            m_tablePtr->SetCellValue(row, 7, empty ? "" : Format(stats.GetQuantile(0.95)));
+            m_tablePtr->SetCellValue(row, 8, FormatFailures(stats));
+            row++;
+        }
+        m_tablePtr->AutoSizeColumns(false);
+    }
+
+private:
+    void OnClose(wxCloseEvent& event)
+    {
+        if (event.CanVeto())
+        {
+            Hide();
+            event.Veto();
+        }
+        else
+        {
+            m_timer.Stop();
+            event.Skip();
+        }
+    }
+
+    static std::string Format(double value)
+    {
+        std::ostringstream stream;
+        stream.precision(1);
+        stream << std::fixed << value;
+        return stream.str();
+    }
+
+    static std::string FormatFailures(const OFIQMeasureStats& stats)
+    {
+        std::string text;
+        for (const auto& [code, count] : stats.GetFailures())
+        {
+            std::string name;
+            switch (static_cast<OFIQ::QualityMeasureReturnCode>(code))
+            {
+            case OFIQ::QualityMeasureReturnCode::FailureToAssess:
+                name = "FailureToAssess";
+                break;
+            case OFIQ::QualityMeasureReturnCode::NotInitialized:
+                name = "NotInitialized";
+                break;
+            default:
+                name = std::to_string(code);
+                break;
+            }
+            text += (text.empty() ? "" : ", ") + name + ": " + std::to_string(count);
+        }
+        return text;
+    }
+
+    const OFIQStreamingStats& m_stats;
+    const OFIQBatchProgress& m_progress;
+    wxTimer m_timer;
+    wxStaticText* m_progressTextPtr;
+    wxStaticText* m_queueTextPtr;
+    void* m_queueStatusOwner;
+    std::string(*m_queueStatusFunction)(void*);
+    wxChoice* m_measureChoicePtr;
+    OFIQHistogramPanel* m_histogramPtr;
+    wxGrid* m_tablePtr;
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQJson.h>
+
+
+// Approximate quantiles of a stream in bounded memory (a KLL-style sketch).
+// Values are collected in a hierarchy of compactors; a full compactor is
+// sorted and every other value is promoted to the next level with twice the
+// weight. Two sketches can be merged, e.g. the sketches of several workers.
+// The rank error is about 1/capacity of the number of values.
+class OFIQQuantileSketch
+{
+public:
+    explicit OFIQQuantileSketch(size_t capacity = 256)
+        : m_capacity(std::max<size_t>(capacity, 8))
+        , m_count(0)
+        , m_toggle(false)
+    {
+        ;
+    }
+
+    void Add(double value)
+    {
+        if (m_levels.empty())
+        {
+            m_levels.emplace_back();
+        }
+        m_levels[0].push_back(value);
+        m_count++;
+        Compact();
+    }
+
+    void Merge(const OFIQQuantileSketch& other)
+    {
+        if (m_levels.size() < other.m_levels.size())
+        {
+            m_levels.resize(other.m_levels.size());
+        }
+        for (size_t level = 0; level < other.m_levels.size(); level++)
+        {
+            m_levels[level].insert(m_levels[level].end(), other.m_levels[level].begin(), other.m_levels[level].end());
+        }
+        m_count += other.m_count;
+        Compact();
+    }
+
+    uint64_t GetCount() const
+    {
+        return m_count;
+    }
+
+    // Returns the value at the given quantile in [0, 1], or NaN if empty.
+    double GetQuantile(double quantile) const
+    {
+        std::vector<std::pair<double, uint64_t>> weighted;
+        uint64_t totalWeight = 0;
+        for (size_t level = 0; level < m_levels.size(); level++)
+        {
+            uint64_t weight = uint64_t(1) << level;
+            for (double value : m_levels[level])
+            {
+                weighted.emplace_back(value, weight);
+                totalWeight += weight;
+            }
+        }
+        if (weighted.empty())
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        std::sort(weighted.begin(), weighted.end());
+
+        double target = std::clamp(quantile, 0.0, 1.0) * static_cast<double>(totalWeight);
+        uint64_t cumulative = 0;
+        for (const auto& [value, weight] : weighted)
+        {
+            cumulative += weight;
+            if (static_cast<double>(cumulative) >= target)
+            {
+                return value;
+            }
+        }
+        return weighted.back().first;
+    }
+
+private:
+    // Lower levels get smaller capacities, as their items carry less weight.
+    size_t GetLevelCapacity(size_t level) const
+    {
+        size_t depth = m_levels.size() - 1 - level;
+        double capacity = static_cast<double>(m_capacity);
+        for (size_t i = 0; i < depth && capacity > 8.0; i++)
+        {
+            capacity *= 2.0 / 3.0;
+        }
+        return std::max<size_t>(static_cast<size_t>(capacity), 8);
+    }
+
+    void Compact()
+    {
+        for (size_t level = 0; level < m_levels.size(); level++)
+        {
+            if (m_levels[level].size() < GetLevelCapacity(level))
+            {
+                continue;
+            }
+            if (level + 1 == m_levels.size())
+            {
+                m_levels.emplace_back();
+            }
+            auto& values = m_levels[level];
+            std::sort(values.begin(), values.end());
+            // Keep the odd number of values at this level.
+            size_t keep = values.size() % 2;
+            size_t offset = m_toggle ? 1 : 0;
+            m_toggle = !m_toggle;
+            for (size_t i = keep + offset; i < values.size(); i += 2)
+            {
+                m_levels[level + 1].push_back(values[i]);
+            }
+            values.resize(keep);
+        }
+    }
+
+    size_t m_capacity;
+    uint64_t m_count;
+    bool m_toggle;
+    std::vector<std::vector<double>> m_levels;
+};
+
+// Streaming aggregates of the scalar values of one quality measure.
+class OFIQMeasureStats
+{
+public:
+    static constexpr int binCount = 20;
+    static constexpr double minValue = 0.0;
+    static constexpr double maxValue = 100.0;
+
+    OFIQMeasureStats()
+        : m_count(0)
+        , m_sum(0.0)
+        , m_min(std::numeric_limits<double>::infinity())
+        , m_max(-std::numeric_limits<double>::infinity())
+        , m_histogram(binCount, 0)
+    {
+        ;
+    }
+
+    void Add(const OFIQ::QualityMeasureResult& result)
+    {
+        if (result.code != OFIQ::QualityMeasureReturnCode::Success)
+        {
+            m_failures[static_cast<int>(result.code)]++;
+            return;
+        }
+        double value = result.scalar;
+        m_count++;
+        m_sum += value;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+        m_histogram[GetBin(value)]++;
+        m_sketch.Add(value);
+    }
+
+    void Merge(const OFIQMeasureStats& other)
+    {
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        for (int i = 0; i < binCount; i++)
+        {
+            m_histogram[i] += other.m_histogram[i];
+        }
+        for (const auto& [code, count] : other.m_failures)
+        {
+            m_failures[code] += count;
+        }
+        m_sketch.Merge(other.m_sketch);
+    }
+
+    static int GetBin(double value)
+    {
+        int bin = static_cast<int>((value - minValue) / (maxValue - minValue) * binCount);
+        return std::clamp(bin, 0, binCount - 1);
+    }
+
+    uint64_t GetCount() const { return m_count; }
+    double GetMean() const { return m_count > 0 ? m_sum / static_cast<double>(m_count) : 0.0; }
+    double GetMin() const { return m_count > 0 ? m_min : 0.0; }
+    double GetMax() const { return m_count > 0 ? m_max : 0.0; }
+    const std::vector<uint64_t>& GetHistogram() const { return m_histogram; }
+    double GetQuantile(double quantile) const { return m_sketch.GetQuantile(quantile); }
+
+    // Number of failed assessments per QualityMeasureReturnCode.
+    const std::map<int, uint64_t>& GetFailures() const { return m_failures; }
+
+    uint64_t GetFailureCount() const
+    {
+        uint64_t failures = 0;
+        for (const auto& failure : m_failures)
+        {
+            failures += failure.second;
+        }
+        return failures;
+    }
+
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("count", static_cast<size_t>(m_count));
+        json.Set("mean", GetMean());
+        json.Set("min", GetMin());
+        json.Set("max", GetMax());
+        OFIQJsonValue quantiles = OFIQJsonValue::Object();
+        if (m_count > 0)
+        {
+            for (int percentile : { 5, 25, 50, 75, 95 })
+            {
+                quantiles.Set("p" + std::to_string(percentile), GetQuantile(percentile / 100.0));
+            }
+        }
+        json.Set("quantiles", quantiles);
+        OFIQJsonValue histogram = OFIQJsonValue::Array();
+        for (uint64_t count : m_histogram)
+        {
+            histogram.Append(static_cast<size_t>(count));
+        }
+        json.Set("histogram", histogram);
+        OFIQJsonValue failures = OFIQJsonValue::Object();
+        for (const auto& [code, count] : m_failures)
+        {
+            failures.Set(std::to_string(code), static_cast<size_t>(count));
+        }
+        json.Set("failures", failures);
+        return json;
+    }
+
+private:
+    uint64_t m_count;
+    double m_sum;
+    double m_min;
+    double m_max;
+    std::vector<uint64_t> m_histogram;
+    std::map<int, uint64_t> m_failures;
+    OFIQQuantileSketch m_sketch;
+};
+
+// Aggregates of all measures of a batch, updated per image. Adding is
+// thread-safe; readers take a snapshot, so they never rescan results.
+class OFIQStreamingStats
+{
+public:
+    OFIQStreamingStats()
+        : m_images(0)
+        , m_failedImages(0)
+    {
+        ;
+    }
+
+    OFIQStreamingStats(const OFIQStreamingStats& other)
+    {
+        std::lock_guard<std::mutex> lock(other.m_mutex);
+        m_images = other.m_images;
+        m_failedImages = other.m_failedImages;
+        m_measures = other.m_measures;
+    }
+
+    OFIQStreamingStats& operator=(const OFIQStreamingStats&) = delete;
+
+    void Add(const OFIQ::FaceImageQualityAssessment& assessments, bool success)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images++;
+        if (!success)
+        {
+            m_failedImages++;
+        }
+        for (const auto& [measure, result] : assessments.qAssessments)
+        {
+            m_measures[measure].Add(result);
+        }
+    }
+
+    void Merge(const OFIQStreamingStats& other)
+    {
+        OFIQStreamingStats snapshot(other);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images += snapshot.m_images;
+        m_failedImages += snapshot.m_failedImages;
+        for (const auto& [measure, stats] : snapshot.m_measures)
+        {
+            m_measures[measure].Merge(stats);
+        }
+    }
+
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_images = 0;
+        m_failedImages = 0;
+        m_measures.clear();
+    }
+
+    // Only to be called on a snapshot.
+    uint64_t GetImageCount() const { return m_images; }
+    uint64_t GetFailedImageCount() const { return m_failedImages; }
+    const std::map<OFIQ::QualityMeasure, OFIQMeasureStats>& GetMeasures() const { return m_measures; }
+
+    OFIQJsonValue ToJson() const
+    {
+        OFIQStreamingStats snapshot(*this);
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("images", static_cast<size_t>(snapshot.m_images));
+        json.Set("failed_images", static_cast<size_t>(snapshot.m_failedImages));
+        OFIQJsonValue measures = OFIQJsonValue::Object();
+        for (const auto& [measure, stats] : snapshot.m_measures)
+        {
+            measures.Set(GetMeasureName(measure), stats.ToJson());
+        }
+        json.Set("measures", measures);
+        return json;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    uint64_t m_images;
+    uint64_t m_failedImages;
+    std::map<OFIQ::QualityMeasure, OFIQMeasureStats> m_measures;
+};
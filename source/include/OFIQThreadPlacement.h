@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQCommandLine.h>
+#include <OFIQJson.h>
+
+
+// How many OFIQ instances run in parallel and where their threads run.
+struct OFIQThreadSettings
+{
+    // Number of assessment workers, each with its own OFIQ instance.
+    int workers = 1;
+    // Threads each worker may use inside one assessment; 0 keeps the default.
+    int intraOpThreads = 0;
+    // CPUs the workers are pinned to, e.g. "0-15,32-47"; empty for no pinning.
+    std::string affinity;
+    // NUMA node whose CPUs the workers are pinned to; -1 for any node.
+    int numaNode = -1;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "           [--workers <1>] [--intra-op-threads <n>] [--affinity <cpu list>] [--numa-node <n>]" << std::endl;
+    }
+
+    static OFIQThreadSettings FromCommandLine(const OFIQCommandLine& commandLine)
+    {
+        OFIQThreadSettings settings;
+        settings.workers = std::max(1, commandLine.GetInt("workers", 1));
+        settings.intraOpThreads = std::max(0, commandLine.GetInt("intra-op-threads", 0));
+        settings.affinity = commandLine.GetString("affinity");
+        settings.numaNode = commandLine.GetInt("numa-node", -1);
+        return settings;
+    }
+};
+
+// Places the assessment workers on CPUs. The CPUs selected by --affinity
+// and/or --numa-node are split into contiguous blocks, one per worker (if
+// there are fewer CPUs than workers, workers share CPUs round robin). A worker
+// pins its thread before it initializes OFIQ: the inference thread pools
+// created during initialization inherit the affinity of the creating thread,
+// and the models are allocated on the worker's NUMA node by first touch.
+//
+// The intra-op thread count is applied process-wide to OpenCV and, through
+// OMP_NUM_THREADS, to OpenMP, and must therefore be set before the first
+// OFIQ instance is created. The ONNX Runtime sessions inside OFIQ size their
+// pools themselves; with pinning, those pools stay on the worker's CPUs.
+class OFIQThreadPlacement
+{
+public:
+    bool Initialize(const OFIQThreadSettings& settings, std::string& error)
+    {
+        m_settings = settings;
+        m_workerCpus.assign(static_cast<size_t>(std::max(1, settings.workers)), std::vector<int>());
+
+        if (settings.intraOpThreads > 0)
+        {
+            std::string threads = std::to_string(settings.intraOpThreads);
+#if defined(_WIN32)
+            _putenv_s("OMP_NUM_THREADS", threads.c_str());
+#else
+            setenv("OMP_NUM_THREADS", threads.c_str(), 1);
+#endif
+            cv::setNumThreads(settings.intraOpThreads);
+        }
+
+        if (settings.affinity.empty() && settings.numaNode < 0)
+        {
+            return true;
+        }
+#if !defined(__linux__)
+        error = "--affinity and --numa-node are only supported on Linux.";
+        return false;
+#else
+        std::vector<int> cpus;
+        if (!settings.affinity.empty() && !ParseCpuList(settings.affinity, cpus))
+        {
+            error = "Invalid CPU list '" + settings.affinity + "'";
+            return false;
+        }
+        if (settings.numaNode >= 0)
+        {
+            std::vector<int> nodeCpus;
+            if (!GetNumaNodeCpus(settings.numaNode, nodeCpus))
+            {
+                error = "Cannot read the CPUs of NUMA node " + std::to_string(settings.numaNode);
+                return false;
+            }
+            if (cpus.empty())
+            {
+                cpus = nodeCpus;
+            }
+            else
+            {
+                std::vector<int> common;
+                std::set_intersection(cpus.begin(), cpus.end(), nodeCpus.begin(), nodeCpus.end(), std::back_inserter(common));
+                cpus = common;
+            }
+        }
+        if (cpus.empty())
+        {
+            error = "No CPUs selected by --affinity and --numa-node.";
+            return false;
+        }
+
+        size_t workers = m_workerCpus.size();
+        for (size_t i = 0; i < workers; i++)
+        {
+            if (cpus.size() >= workers)
+            {
+                m_workerCpus[i].assign(cpus.begin() + i * cpus.size() / workers, cpus.begin() + (i + 1) * cpus.size() / workers);
+            }
+            else
+            {
+                m_workerCpus[i].push_back(cpus[i % cpus.size()]);
+            }
+        }
+        return true;
+#endif
+    }
+
+    const OFIQThreadSettings& GetSettings() const
+    {
+        return m_settings;
+    }
+
+    size_t GetWorkerCount() const
+    {
+        return m_workerCpus.size();
+    }
+
+    // The CPUs of a worker; empty if workers are not pinned.
+    const std::vector<int>& GetWorkerCpus(size_t worker) const
+    {
+        return m_workerCpus.at(worker % m_workerCpus.size());
+    }
+
+    // Pins the calling thread to the CPUs of the worker. Does nothing if the
+    // workers are not pinned.
+    bool PinWorker(size_t worker, std::string& error) const
+    {
+        const auto& cpus = GetWorkerCpus(worker);
+        if (cpus.empty())
+        {
+            return true;
+        }
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus)
+        {
+            CPU_SET(cpu, &set);
+        }
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (result != 0)
+        {
+            error = "Cannot pin worker " + std::to_string(worker) + " to CPUs " + FormatCpuList(cpus);
+            return false;
+        }
+        return true;
+#else
+        error = "CPU affinity is only supported on Linux.";
+        return false;
+#endif
+    }
+
+    // The settings and the resulting placement, for reports.
+    OFIQJsonValue ToJson() const
+    {
+        OFIQJsonValue json = OFIQJsonValue::Object();
+        json.Set("workers", m_workerCpus.size());
+        // Only OpenCV and OpenMP are set; ONNX Runtime sizes its own pools.
+        json.Set("opencv_omp_threads", m_settings.intraOpThreads);
+        json.Set("affinity", m_settings.affinity);
+        json.Set("numa_node", m_settings.numaNode);
+        OFIQJsonValue workerCpus = OFIQJsonValue::Array();
+        for (const auto& cpus : m_workerCpus)
+        {
+            workerCpus.Append(FormatCpuList(cpus));
+        }
+        json.Set("worker_cpus", workerCpus);
+        return json;
+    }
+
+    std::string ToString() const
+    {
+        std::ostringstream stream;
+        stream << m_workerCpus.size() << " worker(s), OpenCV/OpenMP threads "
+            << (m_settings.intraOpThreads > 0 ? std::to_string(m_settings.intraOpThreads) : std::string("default"));
+        for (size_t i = 0; i < m_workerCpus.size(); i++)
+        {
+            if (!m_workerCpus[i].empty())
+            {
+                stream << ", worker " << i << " on CPUs " << FormatCpuList(m_workerCpus[i]);
+            }
+        }
+        return stream.str();
+    }
+
+    // Parses a CPU list in the format of the kernel, e.g. "0-3,8,10-11".
+    // The CPUs are returned sorted and without duplicates; CPUs that do not
+    // fit into a cpu_set_t are rejected.
+    static bool ParseCpuList(const std::string& text, std::vector<int>& cpus)
+    {
+        std::set<int> parsed;
+        std::stringstream stream(text);
+        std::string range;
+        while (std::getline(stream, range, ','))
+        {
+            range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+            if (range.empty())
+            {
+                continue;
+            }
+            size_t dash = range.find('-');
+            try
+            {
+                size_t used = 0;
+                int first = std::stoi(range.substr(0, dash), &used);
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first || last >= maxCpus
+                    || used != (dash == std::string::npos ? range.size() : dash))
+                {
+                    return false;
+                }
+                for (int cpu = first; cpu <= last; cpu++)
+                {
+                    parsed.insert(cpu);
+                }
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+        }
+        cpus.assign(parsed.begin(), parsed.end());
+        return !cpus.empty();
+    }
+
+    static std::string FormatCpuList(const std::vector<int>& cpus)
+    {
+        std::string text;
+        for (size_t i = 0; i < cpus.size(); )
+        {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            {
+                j++;
+            }
+            text += (text.empty() ? "" : ",") + std::to_string(cpus[i]);
+            if (j > i)
+            {
+                text += "-" + std::to_string(cpus[j]);
+            }
+            i = j + 1;
+        }
+        return text;
+    }
+
+    static bool GetNumaNodeCpus(int node, std::vector<int>& cpus)
+    {
+        std::ifstream stream("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string text;
+        return std::getline(stream, text) && ParseCpuList(text, cpus);
+    }
+
+private:
+#if defined(__linux__)
+    static constexpr int maxCpus = CPU_SETSIZE;
+#else
+    static constexpr int maxCpus = 1024;
+#endif
+
+    OFIQThreadSettings m_settings;
+    std::vector<std::vector<int>> m_workerCpus;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <wx/wx.h>
+#include <wx/sizer.h>
+#include <wx/spinctrl.h>
+
+#include <OFIQThreadPlacement.h>
+
+
+// Edits the thread settings used by OFIQ > Assess folder: the number of
+// workers, the intra-op threads and the CPUs the workers are pinned to.
+class OFIQThreadSettingsDialog : public wxDialog
+{
+public:
+    OFIQThreadSettingsDialog(wxWindow* parent, const OFIQThreadSettings& settings)
+        : wxDialog(parent, wxID_ANY, "Thread settings")
+    {
+        wxFlexGridSizer* gridSizer = new wxFlexGridSizer(2, wxSize(10, 5));
+        gridSizer->AddGrowableCol(1);
+
+        m_workersPtr = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+            wxSP_ARROW_KEYS, 1, 256, settings.workers);
+        m_intraOpThreadsPtr = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+            wxSP_ARROW_KEYS, 0, 256, settings.intraOpThreads);
+        m_affinityPtr = new wxTextCtrl(this, wxID_ANY, settings.affinity);
+        m_affinityPtr->SetHint("e.g. 0-15,32-47");
+        m_numaNodePtr = new wxSpinCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+            wxSP_ARROW_KEYS, -1, 63, settings.numaNode);
+
+        AddRow(gridSizer, "Workers:", m_workersPtr);
+        AddRow(gridSizer, "Intra-op threads (0: default):", m_intraOpThreadsPtr);
+        AddRow(gridSizer, "Pin to CPUs (empty: no pinning):", m_affinityPtr);
+        AddRow(gridSizer, "NUMA node (-1: any):", m_numaNodePtr);
+
+        wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+        sizer->Add(gridSizer, 1, wxEXPAND | wxALL, 10);
+        sizer->Add(new wxStaticText(this, wxID_ANY,
+            "Each worker runs its own OFIQ instance. The selected CPUs are split\n"
+            "among the workers. Changes apply to the next initialization."),
+            0, wxLEFT | wxRIGHT, 10);
+        sizer->Add(CreateStdDialogButtonSizer(wxOK | wxCANCEL), 0, wxEXPAND | wxALL, 10);
+        SetSizerAndFit(sizer);
+
+        Bind(wxEVT_BUTTON, &OFIQThreadSettingsDialog::OnOk, this, wxID_OK);
+    }
+
+    const OFIQThreadSettings& GetSettings() const
+    {
+        return m_settings;
+    }
+
+private:
+    void AddRow(wxFlexGridSizer* gridSizer, const wxString& label, wxWindow* controlPtr)
+    {
+        gridSizer->Add(new wxStaticText(this, wxID_ANY, label), 0, wxALIGN_CENTER_VERTICAL);
+        gridSizer->Add(controlPtr, 1, wxEXPAND);
+    }
+
+    void OnOk(wxCommandEvent& event)
+    {
+        OFIQThreadSettings settings;
+        settings.workers = m_workersPtr->GetValue();
+        settings.intraOpThreads = m_intraOpThreadsPtr->GetValue();
+        settings.affinity = m_affinityPtr->GetValue().ToStdString();
+        settings.numaNode = m_numaNodePtr->GetValue();
+
+        // Validate the CPU selection before the dialog closes.
+        std::string error;
+        OFIQThreadPlacement placement;
+        OFIQThreadSettings placementSettings = settings;
+        placementSettings.intraOpThreads = 0;
+        if (!placement.Initialize(placementSettings, error))
+        {
+            wxMessageBox(error, "Thread settings", wxOK | wxICON_ERROR, this);
+            return;
+        }
+
+        m_settings = settings;
+        event.Skip();
+    }
+
+    OFIQThreadSettings m_settings;
+    wxSpinCtrl* m_workersPtr;
+    wxSpinCtrl* m_intraOpThreadsPtr;
+    wxTextCtrl* m_affinityPtr;
+    wxSpinCtrl* m_numaNodePtr;
+};
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/wx.h>
+#include <wx/dcbuffer.h>
+#include <wx/scrolwin.h>
+#include <wx/timer.h>
+
+#include <OFIQThumbnailCache.h>
+
+#include <opencv2/opencv.hpp>
+
+
+// A virtual grid of thumbnails. Only the cells in view are painted, and only
+// their thumbnails are requested from a pool of loader threads, most recent
+// request first, so the view keeps up when scrolling through thousands of
+// images. Bitmaps of cells far from the view are released beyond a fixed
+// number. Cells show the unified quality score as a coloured badge once it is
+// known.
+class OFIQThumbnailPanel : public wxScrolledWindow
+{
+public:
+    static constexpr int labelHeight = 18;
+    static constexpr int padding = 6;
+    static constexpr size_t bitmapCapacity = 2000;
+
+    OFIQThumbnailPanel(wxWindow* parent, std::shared_ptr<OFIQThumbnailCache> cachePtr)
+        : wxScrolledWindow(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxVSCROLL | wxFULL_REPAINT_ON_RESIZE)
+        , m_cachePtr(cachePtr)
+        , m_loadedCount(0)
+        , m_selected(-1)
+        , m_generation(0)
+        , m_cachedCount(0)
+        , m_decodedCount(0)
+        , m_stop(false)
+        , m_openOwner(nullptr)
+        , m_onOpenBinding(nullptr)
+    {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        SetScrollRate(0, 20);
+        Bind(wxEVT_PAINT, &OFIQThumbnailPanel::OnPaint, this);
+        Bind(wxEVT_SIZE, &OFIQThumbnailPanel::OnSize, this);
+        Bind(wxEVT_LEFT_DOWN, &OFIQThumbnailPanel::OnLeftDown, this);
+
+        unsigned int loaders = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+        for (unsigned int i = 0; i < loaders; i++)
+        {
+            m_loaders.emplace_back(&OFIQThumbnailPanel::LoaderLoop, this);
+        }
+    }
+
+    ~OFIQThumbnailPanel()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_requestAvailable.notify_all();
+        for (auto& loader : m_loaders)
+        {
+            loader.join();
+        }
+    }
+
+    // Registers the callback invoked with the path of a clicked thumbnail.
+    void BindOpen(void* owner, void (*onOpenBinding)(void*, const std::string&))
+    {
+        m_openOwner = owner;
+        m_onOpenBinding = onOpenBinding;
+    }
+
+    void SetPaths(const std::vector<std::string>& paths)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests.clear();
+            m_generation++;
+        }
+        m_paths = paths;
+        m_cells.assign(paths.size(), Cell());
+        m_indices.clear();
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            m_indices[paths[i]] = i;
+        }
+        m_loadedCount = 0;
+        m_selected = -1;
+        m_cachedCount = 0;
+        m_decodedCount = 0;
+        UpdateVirtualSize();
+        Scroll(0, 0);
+        Refresh();
+    }
+
+    // Marks the image as the one shown and scrolls it into view.
+    void Select(const std::string& path)
+    {
+        auto it = m_indices.find(path);
+        m_selected = it != m_indices.end() ? static_cast<int>(it->second) : -1;
+        if (m_selected >= 0)
+        {
+            wxRect cell = GetCellRect(static_cast<size_t>(m_selected));
+            int scrollX, scrollY;
+            GetScrollPixelsPerUnit(&scrollX, &scrollY);
+            int firstY = GetViewStart().y * std::max(1, scrollY);
+            if (cell.y < firstY || cell.GetBottom() > firstY + GetClientSize().y)
+            {
+                Scroll(0, cell.y / std::max(1, scrollY));
+            }
+        }
+        Refresh();
+    }
+
+    void SetScore(const std::string& path, double score)
+    {
+        auto it = m_indices.find(path);
+        if (it != m_indices.end())
+        {
+            m_cells[it->second].score = score;
+            RefreshRect(ToScrolled(GetCellRect(it->second)));
+        }
+    }
+
+    size_t GetCount() const
+    {
+        return m_paths.size();
+    }
+
+    // Thumbnails taken from the cache and decoded since SetPaths.
+    size_t GetCachedCount() const
+    {
+        return m_cachedCount;
+    }
+
+    size_t GetDecodedCount() const
+    {
+        return m_decodedCount;
+    }
+
+    // Colour of the badge of a unified quality score in [0, 100].
+    static wxColour GetScoreColour(double score)
+    {
+        if (score < 40.0)
+        {
+            return wxColour(220, 50, 47);
+        }
+        if (score < 70.0)
+        {
+            return wxColour(230, 160, 0);
+        }
+        return wxColour(40, 160, 60);
+    }
+
+private:
+    struct Cell
+    {
+        wxBitmap bitmap;
+        bool loaded = false;
+        bool failed = false;
+        double score = -1.0;
+    };
+
+    struct Request
+    {
+        size_t index;
+        std::string path;
+        uint64_t generation;
+    };
+
+    int GetCellWidth() const
+    {
+        return m_cachePtr->GetSize() + 2 * padding;
+    }
+
+    int GetCellHeight() const
+    {
+        return m_cachePtr->GetSize() + 2 * padding + labelHeight;
+    }
+
+    int GetColumnCount() const
+    {
+        return std::max(1, GetClientSize().x / GetCellWidth());
+    }
+
+    // The rectangle of a cell in virtual (unscrolled) coordinates.
+    wxRect GetCellRect(size_t index) const
+    {
+        int columns = GetColumnCount();
+        int column = static_cast<int>(index % columns);
+        int row = static_cast<int>(index / columns);
+        return wxRect(column * GetCellWidth(), row * GetCellHeight(), GetCellWidth(), GetCellHeight());
+    }
+
+    wxRect ToScrolled(const wxRect& rect) const
+    {
+        return wxRect(CalcScrolledPosition(rect.GetPosition()), rect.GetSize());
+    }
+
+    void UpdateVirtualSize()
+    {
+        int columns = GetColumnCount();
+        int rows = static_cast<int>((m_paths.size() + columns - 1) / columns);
+        SetVirtualSize(columns * GetCellWidth(), rows * GetCellHeight());
+    }
+
+    void OnSize(wxSizeEvent& event)
+    {
+        UpdateVirtualSize();
+        event.Skip();
+    }
+
+    void OnLeftDown(wxMouseEvent& event)
+    {
+        wxPoint position = CalcUnscrolledPosition(event.GetPosition());
+        int column = position.x / GetCellWidth();
+        size_t index = static_cast<size_t>(position.y / GetCellHeight()) * GetColumnCount() + column;
+        if (column < GetColumnCount() && index < m_paths.size())
+        {
+            m_selected = static_cast<int>(index);
+            Refresh();
+            if (m_onOpenBinding != nullptr)
+            {
+                m_onOpenBinding(m_openOwner, m_paths[index]);
+            }
+        }
+        event.Skip();
+    }
+
+    void OnPaint(wxPaintEvent& event)
+    {
+        wxAutoBufferedPaintDC dc(this);
+        DoPrepareDC(dc);
+        dc.SetBackground(wxBrush(GetBackgroundColour()));
+        dc.Clear();
+        if (m_paths.empty())
+        {
+            return;
+        }
+
+        // The range of cells in view.
+        wxPoint top = CalcUnscrolledPosition(wxPoint(0, 0));
+        int columns = GetColumnCount();
+        size_t first = static_cast<size_t>(std::max(0, top.y / GetCellHeight())) * columns;
+        size_t last = std::min(m_paths.size(),
+            static_cast<size_t>((top.y + GetClientSize().y) / GetCellHeight() + 1) * columns);
+
+        std::vector<size_t> missing;
+        dc.SetFont(GetFont().Smaller());
+        for (size_t i = first; i < last; i++)
+        {
+            DrawCell(dc, i);
+            if (!m_cells[i].loaded && !m_cells[i].failed)
+            {
+                missing.push_back(i);
+            }
+        }
+        RequestCells(missing);
+        Evict(first, last);
+    }
+
+    void DrawCell(wxDC& dc, size_t index)
+    {
+        const Cell& cell = m_cells[index];
+        wxRect rect = GetCellRect(index);
+        int size = m_cachePtr->GetSize();
+        if (static_cast<int>(index) == m_selected)
+        {
+            dc.SetPen(*wxTRANSPARENT_PEN);
+            dc.SetBrush(wxBrush(wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHT)));
+            dc.DrawRectangle(rect);
+        }
+
+        if (cell.loaded)
+        {
+            dc.DrawBitmap(cell.bitmap,
+                rect.x + padding + (size - cell.bitmap.GetWidth()) / 2,
+                rect.y + padding + (size - cell.bitmap.GetHeight()) / 2, false);
+        }
+        else
+        {
+            dc.SetPen(*wxLIGHT_GREY_PEN);
+            dc.SetBrush(*wxTRANSPARENT_BRUSH);
+            dc.DrawRectangle(rect.x + padding, rect.y + padding, size, size);
+            if (cell.failed)
+            {
+                dc.DrawText("?", rect.x + padding + size / 2 - 3, rect.y + padding + size / 2 - 8);
+            }
+        }
+
+        if (cell.score >= 0.0)
+        {
+            int radius = std::max(6, size / 12);
+            dc.SetPen(*wxWHITE_PEN);
+            dc.SetBrush(wxBrush(GetScoreColour(cell.score)));
+            dc.DrawCircle(rect.x + padding + size - radius, rect.y + padding + radius, radius);
+        }
+
+        wxString label(std::filesystem::path(m_paths[index]).filename().string());
+        while (label.length() > 4 && dc.GetTextExtent(label).x > rect.width - 4)
+        {
+            label = label.Left(label.length() - 4) + "...";
+        }
+        dc.SetTextForeground(static_cast<int>(index) == m_selected
+            ? wxSystemSettings::GetColour(wxSYS_COLOUR_HIGHLIGHTTEXT) : GetForegroundColour());
+        dc.DrawText(label, rect.x + (rect.width - dc.GetTextExtent(label).x) / 2, rect.y + 2 * padding + size);
+    }
+
+    // Replaces the pending requests by the missing cells in view.
+    void RequestCells(const std::vector<size_t>& indices)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests.clear();
+            // Loaders take from the back; request the first cells in view last.
+            for (auto it = indices.rbegin(); it != indices.rend(); ++it)
+            {
+                m_requests.push_back({ *it, m_paths[*it], m_generation });
+            }
+        }
+        m_requestAvailable.notify_all();
+    }
+
+    // Releases the bitmaps of the cells farthest from the view above the
+    // capacity.
+    void Evict(size_t first, size_t last)
+    {
+        if (m_loadedCount <= bitmapCapacity)
+        {
+            return;
+        }
+        std::vector<std::pair<size_t, size_t>> loaded;
+        for (size_t i = 0; i < m_cells.size(); i++)
+        {
+            if (m_cells[i].loaded && (i < first || i >= last))
+            {
+                loaded.emplace_back(i < first ? first - i : i - last + 1, i);
+            }
+        }
+        std::sort(loaded.rbegin(), loaded.rend());
+        for (size_t i = 0; i < loaded.size() && m_loadedCount > bitmapCapacity * 3 / 4; i++)
+        {
+            Cell& cell = m_cells[loaded[i].second];
+            cell.bitmap = wxBitmap();
+            cell.loaded = false;
+            m_loadedCount--;
+        }
+    }
+
+    void LoaderLoop()
+    {
+        while (true)
+        {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_requestAvailable.wait(lock, [this] { return m_stop || !m_requests.empty(); });
+                if (m_stop)
+                {
+                    return;
+                }
+                request = m_requests.back();
+                m_requests.pop_back();
+            }
+
+            // Decoding runs on the loader. The pixels are handed over as a
+            // cv::Mat, whose reference count is thread-safe; the bitmap must be
+            // created on the GUI thread.
+            cv::Mat thumbnail;
+            bool fromCache = false;
+            bool loaded = m_cachePtr->Load(request.path, thumbnail, fromCache);
+            double score = -1.0;
+            m_cachePtr->LoadScore(request.path, score);
+            cv::Mat rgb;
+            if (loaded)
+            {
+                cv::cvtColor(thumbnail, rgb, cv::COLOR_BGR2RGB);
+            }
+            CallAfter([this, request, rgb, loaded, fromCache, score]()
+                {
+                    OnLoaded(request, rgb, loaded, fromCache, score);
+                });
+        }
+    }
+
+    void OnLoaded(const Request& request, const cv::Mat& rgb, bool loaded, bool fromCache, double score)
+    {
+        if (request.generation != m_generation || request.index >= m_cells.size())
+        {
+            return;
+        }
+        Cell& cell = m_cells[request.index];
+        if (cell.loaded)
+        {
+            return;
+        }
+        cell.failed = !loaded;
+        if (loaded)
+        {
+            wxImage image(rgb.cols, rgb.rows, false);
+            for (int y = 0; y < rgb.rows; y++)
+            {
+                memcpy(image.GetData() + static_cast<size_t>(y) * rgb.cols * 3, rgb.ptr(y), static_cast<size_t>(rgb.cols) * 3);
+            }
+            cell.bitmap = wxBitmap(image);
+            cell.loaded = true;
+            m_loadedCount++;
+            (fromCache ? m_cachedCount : m_decodedCount)++;
+        }
+        if (score >= 0.0)
+        {
+            cell.score = score;
+        }
+        RefreshRect(ToScrolled(GetCellRect(request.index)));
+    }
+
+    std::shared_ptr<OFIQThumbnailCache> m_cachePtr;
+    std::vector<std::string> m_paths;
+    std::map<std::string, size_t> m_indices;
+    std::vector<Cell> m_cells;
+    size_t m_loadedCount;
+    int m_selected;
+    // Identifies the folder, so that results for a previous folder are dropped.
+    uint64_t m_generation;
+    size_t m_cachedCount;
+    size_t m_decodedCount;
+
+    // Shared with the loaders.
+    std::mutex m_mutex;
+    std::condition_variable m_requestAvailable;
+    std::vector<Request> m_requests;
+    bool m_stop;
+    std::vector<std::thread> m_loaders;
+
+    void* m_openOwner;
+    void (*m_onOpenBinding)(void*, const std::string&);
+};
+
+// A window with the thumbnails of the images of a folder; clicking a
+// thumbnail loads the image into the main window.
+class OFIQThumbnailFrame : public wxFrame
+{
+public:
+    OFIQThumbnailFrame(wxWindow* parent, std::shared_ptr<OFIQThumbnailCache> cachePtr)
+        : wxFrame(parent, wxID_ANY, "Thumbnails", wxDefaultPosition, wxSize(720, 600))
+        , m_timer(this)
+    {
+        auto panel = new wxPanel(this, wxID_ANY);
+        auto sizer = new wxBoxSizer(wxVERTICAL);
+        m_statusTextPtr = new wxStaticText(panel, wxID_ANY, "No folder.");
+        sizer->Add(m_statusTextPtr, 0, wxALL, 5);
+        m_thumbnailsPtr = new OFIQThumbnailPanel(panel, cachePtr);
+        sizer->Add(m_thumbnailsPtr, 1, wxEXPAND);
+        panel->SetSizer(sizer);
+
+        Bind(wxEVT_TIMER, [this](wxTimerEvent&) { RefreshStatus(); });
+        Bind(wxEVT_CLOSE_WINDOW, &OFIQThumbnailFrame::OnClose, this);
+    }
+
+    OFIQThumbnailPanel* GetThumbnails() const
+    {
+        return m_thumbnailsPtr;
+    }
+
+    void SetFolder(const std::string& directory, const std::vector<std::string>& paths)
+    {
+        m_directory = directory;
+        m_thumbnailsPtr->SetPaths(paths);
+        SetTitle("Thumbnails - " + wxString(directory));
+        RefreshStatus();
+        m_timer.Start(500);
+    }
+
+private:
+    void RefreshStatus()
+    {
+        m_statusTextPtr->SetLabel(wxString::Format("%zu images, %zu thumbnails from the cache, %zu decoded",
+            m_thumbnailsPtr->GetCount(), m_thumbnailsPtr->GetCachedCount(), m_thumbnailsPtr->GetDecodedCount()));
+    }
+
+    void OnClose(wxCloseEvent& event)
+    {
+        if (event.CanVeto())
+        {
+            Hide();
+            event.Veto();
+        }
+        else
+        {
+            m_timer.Stop();
+            event.Skip();
+        }
+    }
+
+    std::string m_directory;
+    OFIQThumbnailPanel* m_thumbnailsPtr;
+    wxStaticText* m_statusTextPtr;
+    wxTimer m_timer;
+};
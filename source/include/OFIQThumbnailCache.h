@@ -0,0 +1,267 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <ofiq_lib.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <OFIQShard.h>
+
+
+// Thumbnails of image files, stored in a cache directory so that a folder is
+// decoded only once. A cache entry is keyed by the path, the modification
+// time and the size of the image file, so a changed file gets a new
+// thumbnail. Next to a thumbnail, the unified quality score of the image can
+// be stored once it has been assessed.
+//
+// Thumbnails are decoded at reduced resolution: for JPEG, cv::IMREAD_REDUCED_*
+// lets the decoder skip most of the inverse DCT work, which makes decoding a
+// large photo several times faster than a full decode. Every image is decoded
+// once.
+//
+// All methods may be called from several threads; entries are written to a
+// temporary file and renamed, so readers never see a partial entry.
+class OFIQThumbnailCache
+{
+public:
+    explicit OFIQThumbnailCache(const std::string& directory, int size = 128)
+        : m_directory(directory)
+        , m_size(std::max(16, size))
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(m_directory, ec);
+    }
+
+    int GetSize() const
+    {
+        return m_size;
+    }
+
+    const std::string& GetDirectory() const
+    {
+        return m_directory;
+    }
+
+    // Returns the thumbnail (BGR, long edge at most GetSize()) of an image
+    // file, from the cache or by decoding the file. fromCache tells which.
+    bool Load(const std::string& imagePath, cv::Mat& thumbnail, bool& fromCache) const
+    {
+        std::string key;
+        if (!GetKey(imagePath, key))
+        {
+            return false;
+        }
+
+        std::string entryPath = GetEntryPath(key, ".jpg");
+        thumbnail = cv::imread(entryPath, cv::IMREAD_COLOR);
+        fromCache = !thumbnail.empty();
+        if (fromCache)
+        {
+            return true;
+        }
+
+        if (!Decode(imagePath, m_size, thumbnail))
+        {
+            return false;
+        }
+        std::vector<uint8_t> encoded;
+        if (cv::imencode(".jpg", thumbnail, encoded, { cv::IMWRITE_JPEG_QUALITY, 85 }))
+        {
+            WriteEntry(entryPath, encoded.data(), encoded.size());
+        }
+        return true;
+    }
+
+    // The unified quality score stored for the image, if it was assessed in
+    // its current version.
+    bool LoadScore(const std::string& imagePath, double& score) const
+    {
+        std::string key;
+        if (!GetKey(imagePath, key))
+        {
+            return false;
+        }
+        std::ifstream stream(GetEntryPath(key, ".score").c_str());
+        return static_cast<bool>(stream >> score);
+    }
+
+    bool SaveScore(const std::string& imagePath, double score) const
+    {
+        std::string key;
+        if (!GetKey(imagePath, key))
+        {
+            return false;
+        }
+        std::string text = std::to_string(score) + "\n";
+        return WriteEntry(GetEntryPath(key, ".score"), reinterpret_cast<const uint8_t*>(text.data()), text.size());
+    }
+
+    // Stores the unified quality score of an assessment, if it has one.
+    bool SaveScore(const std::string& imagePath, const OFIQ::FaceImageQualityAssessment& assessments, double& score) const
+    {
+        return GetUnifiedScore(assessments, score) && SaveScore(imagePath, score);
+    }
+
+    static bool GetUnifiedScore(const OFIQ::FaceImageQualityAssessment& assessments, double& score)
+    {
+        auto it = assessments.qAssessments.find(OFIQ::QualityMeasure::UnifiedQualityScore);
+        if (it == assessments.qAssessments.end() || it->second.code != OFIQ::QualityMeasureReturnCode::Success)
+        {
+            return false;
+        }
+        score = it->second.scalar;
+        return true;
+    }
+
+    // Decodes an image with its long edge reduced to at most maxSize, with a
+    // single decode. For JPEG files, the size is read from the frame header
+    // and the strongest decoder reduction (1/8, 1/4, 1/2) that still yields
+    // at least maxSize pixels is used; other formats are decoded at full
+    // size, as OpenCV only reduces them after decoding anyway. The rest is
+    // done by area interpolation.
+    static bool Decode(const std::string& imagePath, int maxSize, cv::Mat& thumbnail)
+    {
+        int flag = cv::IMREAD_COLOR;
+        int width = 0;
+        int height = 0;
+        if (ReadJpegSize(imagePath, width, height))
+        {
+            const int longEdge = std::max(width, height);
+            const std::pair<int, int> reductions[] = {
+                { 8, cv::IMREAD_REDUCED_COLOR_8 }, { 4, cv::IMREAD_REDUCED_COLOR_4 }, { 2, cv::IMREAD_REDUCED_COLOR_2 } };
+            for (const auto& [factor, reducedFlag] : reductions)
+            {
+                // The decoder rounds the reduced size up.
+                if ((longEdge + factor - 1) / factor >= maxSize)
+                {
+                    flag = reducedFlag;
+                    break;
+                }
+            }
+        }
+
+        cv::Mat decoded = cv::imread(imagePath, flag);
+        if (decoded.empty())
+        {
+            return false;
+        }
+
+        double scale = static_cast<double>(maxSize) / std::max(decoded.cols, decoded.rows);
+        if (scale >= 1.0)
+        {
+            thumbnail = decoded;
+            return true;
+        }
+        cv::Size size(std::max(1, static_cast<int>(decoded.cols * scale + 0.5)), std::max(1, static_cast<int>(decoded.rows * scale + 0.5)));
+        cv::resize(decoded, thumbnail, size, 0, 0, cv::INTER_AREA);
+        return true;
+    }
+
+    // Reads the size of a JPEG file from its frame header, skipping the
+    // segments before it. Returns false for other files.
+    static bool ReadJpegSize(const std::string& imagePath, int& width, int& height)
+    {
+        std::ifstream stream(imagePath.c_str(), std::ios::binary);
+        uint8_t header[4];
+        if (!stream.read(reinterpret_cast<char*>(header), 2) || header[0] != 0xff || header[1] != 0xd8)
+        {
+            return false;
+        }
+        while (stream.read(reinterpret_cast<char*>(header), 4))
+        {
+            if (header[0] != 0xff)
+            {
+                return false;
+            }
+            const uint8_t marker = header[1];
+            const int length = (header[2] << 8) | header[3];
+            // Start of frame, except DHT (c4), JPG (c8) and DAC (cc).
+            if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+            {
+                uint8_t frame[5];
+                if (!stream.read(reinterpret_cast<char*>(frame), 5))
+                {
+                    return false;
+                }
+                height = (frame[1] << 8) | frame[2];
+                width = (frame[3] << 8) | frame[4];
+                return width > 0 && height > 0;
+            }
+            if (marker == 0xd9 || marker == 0xda || length < 2)
+            {
+                return false;
+            }
+            stream.seekg(length - 2, std::ios::cur);
+        }
+        return false;
+    }
+
+private:
+    static bool GetKey(const std::string& imagePath, std::string& key)
+    {
+        std::error_code ec;
+        auto path = std::filesystem::absolute(imagePath, ec);
+        auto size = std::filesystem::file_size(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+        auto modified = std::filesystem::last_write_time(path, ec);
+        if (ec)
+        {
+            return false;
+        }
+        uint64_t hash = OFIQShardSpec::Hash(path.u8string() + "|" + std::to_string(modified.time_since_epoch().count())
+            + "|" + std::to_string(size));
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+        key = text;
+        return true;
+    }
+
+    // Entries are spread over 256 subdirectories, so that no directory gets
+    // too large for folders of many thousand images.
+    std::string GetEntryPath(const std::string& key, const std::string& extension) const
+    {
+        return (std::filesystem::path(m_directory) / key.substr(0, 2) / (key + extension)).u8string();
+    }
+
+    static bool WriteEntry(const std::string& entryPath, const uint8_t* data, size_t size)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(entryPath).parent_path(), ec);
+        // The temporary name is unique per thread, so concurrent writers of
+        // the same entry do not interfere.
+        std::string temporaryPath = entryPath + "." + std::to_string(
+            std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        {
+            std::ofstream stream(temporaryPath.c_str(), std::ios::binary);
+            stream.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+            if (!stream.good())
+            {
+                stream.close();
+                std::filesystem::remove(temporaryPath, ec);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporaryPath, entryPath, ec);
+        if (ec)
+        {
+            std::filesystem::remove(temporaryPath, ec);
+            return false;
+        }
+        return true;
+    }
+
+    std::string m_directory;
+    int m_size;
+};
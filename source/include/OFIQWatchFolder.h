@@ -0,0 +1,457 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <OFIQBatch.h>
+#include <OFIQBoundedQueue.h>
+#include <OFIQCommandLine.h>
+#include <OFIQMetrics.h>
+
+
+// An image that has been completely written into the watched directory.
+struct OFIQWatchItem
+{
+    std::string path;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// --watch: assesses images as they are dropped into a directory. Files are
+// picked up once they are closed after writing (or moved into the directory),
+// so partially written files are never read. Files found by rescanning the
+// directory have no such event; they are picked up once their size and
+// modification time stay the same for settleSeconds. Arrivals go into a
+// bounded queue: if images arrive faster than they are assessed, the queue
+// fills up, a warning is printed and reading new events pauses until there is
+// room again, while the status line keeps updating. Events the kernel drops
+// meanwhile are recovered by rescanning the directory. Results are appended to
+// the CSV output as they complete. The mode runs until SIGINT or SIGTERM and
+// then assesses the queued images.
+class OFIQWatchFolder
+{
+public:
+    static constexpr double statusSeconds = 1.0;
+    static constexpr double settleSeconds = 1.0;
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "Usage: OFIQDemonstrator --watch --input <directory> --output <results.csv>" << std::endl
+            << "           [--config <ofiq_config.jaxn>] [--queue <64>] [--existing] [--append]" << std::endl;
+        OFIQPrefilterSettings::PrintUsage(stream);
+        OFIQDownscaleSettings::PrintUsage(stream);
+        OFIQIsolationSettings::PrintUsage(stream);
+        stream << "       Subdirectories are not watched. --existing also assesses the images already in the directory." << std::endl
+            << "       --append adds the results to an existing output instead of refusing to overwrite it." << std::endl;
+    }
+
+#if !defined(__linux__)
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::cerr << "ERROR: --watch is only supported on Linux." << std::endl;
+        return 1;
+    }
+#else
+    static int Run(const OFIQCommandLine& commandLine)
+    {
+        std::string directory = commandLine.GetString("input");
+        std::string outputPath = commandLine.GetString("output");
+        int capacity = commandLine.GetInt("queue", 64);
+        if (directory.empty() || !std::filesystem::is_directory(directory) || outputPath.empty() || capacity < 1)
+        {
+            std::cerr << "ERROR: --input must be an existing directory and --output must be given." << std::endl;
+            PrintUsage(std::cerr);
+            return 1;
+        }
+
+        std::string error;
+        OFIQPrefilterSettings prefilter;
+        OFIQDownscaleSettings downscale;
+        if (!OFIQPrefilterSettings::FromCommandLine(commandLine, prefilter, error)
+            || !OFIQDownscaleSettings::FromCommandLine(commandLine, downscale, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        OFIQIsolationSettings isolation = OFIQIsolationSettings::FromCommandLine(commandLine);
+        isolation.workerArguments = prefilter.ToArguments();
+        for (const auto& argument : downscale.ToArguments())
+        {
+            isolation.workerArguments.push_back(argument);
+        }
+
+        OFIQBatchRunner runner;
+        if (!runner.Initialize(commandLine.GetString("config", "ofiq_config.jaxn"), error, isolation))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+        runner.SetPrefilter(prefilter);
+        runner.SetDownscale(downscale);
+        std::cout << "OFIQ initialized in " << runner.GetInitSeconds() << " s" << std::endl;
+
+        // The results of earlier runs are kept: an existing output is only
+        // continued with --append, e.g. after restarting the service.
+        std::error_code ec;
+        bool append = std::filesystem::is_regular_file(outputPath, ec) && std::filesystem::file_size(outputPath, ec) > 0 && !ec;
+        if (append && !commandLine.HasOption("append"))
+        {
+            std::cerr << "ERROR: '" << outputPath << "' already holds results; use --append to add to them." << std::endl;
+            return 1;
+        }
+        std::ofstream csvStream(outputPath.c_str(), append ? std::ios::app : std::ios::out);
+        if (!csvStream.is_open())
+        {
+            std::cerr << "ERROR: Cannot write '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+        OFIQAssessmentCsvWriter csvWriter(csvStream);
+        csvWriter.SetStatusColumns(prefilter.enabled);
+        if (append && !csvWriter.Continue(outputPath, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            return 1;
+        }
+
+        int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0 || inotify_add_watch(fd, directory.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+        {
+            std::cerr << "ERROR: Cannot watch '" << directory << "'" << std::endl;
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            return 1;
+        }
+
+        OFIQInstallStopHandler();
+        std::cout << "Watching '" << directory << "' (queue of " << capacity << " images)" << std::endl;
+
+        OFIQBoundedQueue<OFIQWatchItem> queue(static_cast<size_t>(capacity));
+        OFIQMetricsGauge queueGauge("ofiq_queue_depth", "Items waiting in a queue.", "queue=\"watch\"",
+            [&queue] { return static_cast<double>(queue.Size()); });
+        std::atomic<size_t> assessed{ 0 };
+        std::atomic<size_t> failed{ 0 };
+        std::atomic<size_t> rejected{ 0 };
+        std::atomic<double> lastLagSeconds{ 0.0 };
+
+        std::thread worker([&]()
+            {
+                OFIQWatchItem item;
+                while (queue.Pop(item))
+                {
+                    auto result = runner.Process(item.path);
+                    if (result.rejected)
+                    {
+                        rejected++;
+                        std::cerr << "REJECTED: " << item.path << ": " << result.info << std::endl;
+                    }
+                    else if (!result.success)
+                    {
+                        failed++;
+                        std::cerr << "ERROR: " << item.path << ": " << result.info << std::endl;
+                    }
+                    auto exportStart = std::chrono::steady_clock::now();
+                    csvWriter.Write(item.path, result.assessments,
+                        OFIQAssessmentCsv::GetStatus(result.success, result.rejected), result.info);
+                    csvStream.flush();
+                    OFIQMetrics::Get().ObserveStage(OFIQStage::Export, OFIQSecondsSince(exportStart));
+                    lastLagSeconds = OFIQSecondsSince(item.arrival);
+                    assessed++;
+                }
+            });
+
+        Watcher watcher(directory, queue);
+        if (commandLine.HasOption("existing"))
+        {
+            watcher.Rescan();
+        }
+
+        auto lastStatus = std::chrono::steady_clock::now();
+        bool watching = true;
+        while (watching && !OFIQStopRequested())
+        {
+            // While arrivals wait for room in the queue, the events are left
+            // in the kernel and the loop only retries the queue.
+            watcher.PushPending();
+            bool reading = !watcher.HasPending();
+            pollfd pfd = { fd, POLLIN, 0 };
+            int ready = poll(&pfd, reading ? 1 : 0, reading ? 250 : 50);
+            if (reading && ready > 0 && (pfd.revents & POLLIN) != 0)
+            {
+                watching = watcher.ReadEvents(fd);
+            }
+            watcher.CheckUnsettled();
+
+            if (OFIQSecondsSince(lastStatus) >= statusSeconds)
+            {
+                lastStatus = std::chrono::steady_clock::now();
+                size_t depth = queue.Size();
+                watcher.UpdateBackpressure(depth);
+                std::cerr << "queue " << depth << "/" << queue.Capacity()
+                    << ", received " << watcher.GetReceivedCount()
+                    << ", assessed " << assessed
+                    << ", failed " << failed
+                    << ", rejected " << rejected
+                    << ", lag " << lastLagSeconds << " s" << std::endl;
+            }
+        }
+
+        close(fd);
+        std::cout << "Stopping, assessing " << queue.Size() + watcher.GetPendingCount() << " queued images ..." << std::endl;
+        watcher.FlushPending();
+        queue.Close();
+        worker.join();
+        csvWriter.Finish();
+
+        std::cout << assessed << " images assessed, " << failed << " failed, "
+            << rejected << " rejected by the pre-filter (saving about "
+            << runner.GetPrefilterStats().GetSavedSeconds() << " s), "
+            << watcher.GetOverflowCount() << " event overflows, "
+            << watcher.GetSaturationCount() << " times the queue was full." << std::endl;
+        return csvStream.good() ? 0 : 1;
+    }
+
+private:
+    // Turns inotify events into queue items, applying backpressure.
+    class Watcher
+    {
+    public:
+        Watcher(const std::string& directory, OFIQBoundedQueue<OFIQWatchItem>& queue)
+            : m_directory(directory)
+            , m_queue(queue)
+            , m_received(0)
+            , m_overflows(0)
+            , m_saturations(0)
+            , m_saturated(false)
+        {
+            ;
+        }
+
+        // Reads the available events until an arrival does not fit into the
+        // queue. Returns false if the watched directory is gone.
+        bool ReadEvents(int fd)
+        {
+            alignas(inotify_event) char buffer[64 * 1024];
+            while (m_pending.empty())
+            {
+                ssize_t length = read(fd, buffer, sizeof(buffer));
+                if (length <= 0)
+                {
+                    return true;
+                }
+                for (char* position = buffer; position < buffer + length; )
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+                    position += sizeof(inotify_event) + event->len;
+
+                    if ((event->mask & IN_Q_OVERFLOW) != 0)
+                    {
+                        m_overflows++;
+                        std::cerr << "WARNING: Events were dropped by the kernel; rescanning '" << m_directory << "'" << std::endl;
+                        Rescan();
+                    }
+                    else if ((event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0)
+                    {
+                        std::cerr << "ERROR: '" << m_directory << "' is no longer available." << std::endl;
+                        return false;
+                    }
+                    else if (event->len > 0 && (event->mask & IN_ISDIR) == 0)
+                    {
+                        std::filesystem::path path = std::filesystem::path(m_directory) / event->name;
+                        if ((event->mask & (IN_DELETE | IN_MOVED_FROM)) != 0)
+                        {
+                            // Keeps m_seen to the files in the directory.
+                            m_seen.erase(path.u8string());
+                            m_unsettled.erase(path.u8string());
+                        }
+                        else if (OFIQImageList::IsImageFile(path))
+                        {
+                            m_unsettled.erase(path.u8string());
+                            Enqueue(path.u8string());
+                        }
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Picks up the images of the directory that have not been received
+        // yet, e.g. after the kernel event queue overflowed, once they are
+        // no longer being written (see CheckUnsettled).
+        void Rescan()
+        {
+            std::set<std::string> present;
+            std::error_code ec;
+            auto now = std::chrono::steady_clock::now();
+            for (const auto& entry : std::filesystem::directory_iterator(m_directory, ec))
+            {
+                if (!entry.is_regular_file() || !OFIQImageList::IsImageFile(entry.path()))
+                {
+                    continue;
+                }
+                std::string path = entry.path().u8string();
+                present.insert(path);
+                FileState state;
+                if (m_seen.find(path) == m_seen.end() && m_unsettled.find(path) == m_unsettled.end()
+                    && GetFileState(path, state))
+                {
+                    state.checked = now;
+                    m_unsettled[path] = state;
+                }
+            }
+            // Drop files removed while no events were read.
+            for (auto it = m_seen.begin(); it != m_seen.end(); )
+            {
+                it = present.find(*it) == present.end() ? m_seen.erase(it) : std::next(it);
+            }
+        }
+
+        // Enqueues rescanned files whose size and modification time have
+        // not changed for settleSeconds; files still changing are checked
+        // again later.
+        void CheckUnsettled()
+        {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::string> settled;
+            for (auto it = m_unsettled.begin(); it != m_unsettled.end(); )
+            {
+                if (std::chrono::duration<double>(now - it->second.checked).count() < settleSeconds)
+                {
+                    ++it;
+                    continue;
+                }
+                FileState state;
+                if (!GetFileState(it->first, state))
+                {
+                    it = m_unsettled.erase(it);
+                    continue;
+                }
+                if (state.size == it->second.size && state.modified == it->second.modified)
+                {
+                    settled.push_back(it->first);
+                    it = m_unsettled.erase(it);
+                    continue;
+                }
+                state.checked = now;
+                it->second = state;
+                ++it;
+            }
+            std::sort(settled.begin(), settled.end());
+            for (const auto& path : settled)
+            {
+                Enqueue(path);
+            }
+        }
+
+        // Moves arrivals waiting for room into the queue without blocking.
+        void PushPending()
+        {
+            while (!m_pending.empty() && m_queue.TryPush(m_pending.front()))
+            {
+                m_pending.pop_front();
+            }
+        }
+
+        // Blocks until all waiting arrivals are in the queue, when stopping.
+        void FlushPending()
+        {
+            while (!m_pending.empty() && m_queue.Push(m_pending.front()))
+            {
+                m_pending.pop_front();
+            }
+        }
+
+        bool HasPending() const
+        {
+            return !m_pending.empty();
+        }
+
+        // Re-arms the saturation warning once the queue has drained to half.
+        void UpdateBackpressure(size_t depth)
+        {
+            if (m_saturated && m_pending.empty() && depth <= m_queue.Capacity() / 2)
+            {
+                m_saturated = false;
+                std::cerr << "Queue drained to " << depth << ", ingest keeps up again." << std::endl;
+            }
+        }
+
+        size_t GetReceivedCount() const { return m_received; }
+        size_t GetPendingCount() const { return m_pending.size(); }
+        size_t GetOverflowCount() const { return m_overflows; }
+        size_t GetSaturationCount() const { return m_saturations; }
+
+    private:
+        struct FileState
+        {
+            off_t size = 0;
+            // Modification time in nanoseconds.
+            int64_t modified = 0;
+            std::chrono::steady_clock::time_point checked;
+        };
+
+        static bool GetFileState(const std::string& path, FileState& state)
+        {
+            struct stat status;
+            if (stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+            {
+                return false;
+            }
+            state.size = status.st_size;
+            state.modified = static_cast<int64_t>(status.st_mtim.tv_sec) * 1000000000 + status.st_mtim.tv_nsec;
+            return true;
+        }
+
+        void Enqueue(const std::string& path)
+        {
+            m_seen.insert(path);
+            m_received++;
+            OFIQWatchItem item{ path, std::chrono::steady_clock::now() };
+            if (m_pending.empty() && m_queue.TryPush(item))
+            {
+                return;
+            }
+            if (!m_saturated)
+            {
+                m_saturated = true;
+                m_saturations++;
+                std::cerr << "WARNING: Images arrive faster than they are assessed; the queue is full ("
+                    << m_queue.Capacity() << ") and reading new events pauses." << std::endl;
+            }
+            m_pending.push_back(item);
+        }
+
+        std::string m_directory;
+        OFIQBoundedQueue<OFIQWatchItem>& m_queue;
+        // Arrivals received while the queue was full.
+        std::deque<OFIQWatchItem> m_pending;
+        // Images of the directory that have been received; entries are
+        // removed when the file is deleted or moved away.
+        std::set<std::string> m_seen;
+        // Rescanned files waiting to be no longer written.
+        std::map<std::string, FileState> m_unsettled;
+        size_t m_received;
+        size_t m_overflows;
+        size_t m_saturations;
+        bool m_saturated;
+    };
+#endif
+};
@@ -0,0 +1,476 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ofiq_lib.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+#endif
+
+#include <OFIQAssessmentCsv.h>
+#include <OFIQCommandLine.h>
+#include <OFIQJson.h>
+
+
+// Converts the "scores" object of a JSON response (see OFIQAssessmentsToJson)
+// back into quality assessments. Unknown measures are skipped.
+inline void OFIQAssessmentsFromJson(const OFIQJsonValue& scores, OFIQ::FaceImageQualityAssessment& assessments)
+{
+    static const std::map<std::string, int> measureCodes = []()
+        {
+            std::map<std::string, int> codes;
+            for (const auto& [code, name] : measurementMapping)
+            {
+                codes[name] = code;
+            }
+            return codes;
+        }();
+
+    const double notANumber = std::nan("");
+    for (const auto& [name, score] : scores.GetMembers())
+    {
+        auto it = measureCodes.find(name);
+        if (it == measureCodes.end() || it->second == -1)
+        {
+            continue;
+        }
+        OFIQ::QualityMeasureResult result;
+        result.rawScore = score.Get("rawScore").AsNumber(notANumber);
+        result.scalar = score.Get("scalar").AsNumber(notANumber);
+        result.code = static_cast<OFIQ::QualityMeasureReturnCode>(static_cast<int>(score.Get("code").AsNumber(0.0)));
+        assessments.qAssessments[static_cast<OFIQ::QualityMeasure>(it->second)] = result;
+    }
+}
+
+// Whether the OFIQ instances of a headless mode run in child processes
+// (--isolated), and how long an image may take there (--worker-timeout).
+struct OFIQIsolationSettings
+{
+    bool enabled = false;
+    double timeoutSeconds = 120.0;
+    std::string programPath;
+    // Further options for the worker processes, e.g. the pre-filter settings.
+    std::vector<std::string> workerArguments;
+
+    static OFIQIsolationSettings FromCommandLine(const OFIQCommandLine& commandLine)
+    {
+        OFIQIsolationSettings settings;
+        settings.enabled = commandLine.HasOption("isolated");
+        settings.timeoutSeconds = std::max(1.0, commandLine.GetDouble("worker-timeout", settings.timeoutSeconds));
+        settings.programPath = commandLine.GetProgramPath();
+        return settings;
+    }
+
+    static void PrintUsage(std::ostream& stream)
+    {
+        stream << "           [--isolated [--worker-timeout <120>]]" << std::endl;
+    }
+};
+
+// The answer of a worker process for one image.
+struct OFIQWorkerResult
+{
+    bool success = false;
+    bool rejected = false;
+    std::string info;
+    OFIQ::FaceImageQualityAssessment assessments;
+    double decodeSeconds = 0.0;
+    double prefilterSeconds = 0.0;
+    double downscaleSeconds = 0.0;
+    double assessSeconds = 0.0;
+    double roundTripSeconds = 0.0;
+};
+
+#if !defined(_WIN32)
+
+// One OFIQ instance in a child process, so that an image crashing OFIQ or
+// ONNX Runtime only takes down the child. The child is the demonstrator
+// itself in --worker mode (see OFIQWorker), connected by a socket pair and
+// exchanging one JSON line per message:
+//   worker: {"ready": true, "init_seconds": ...} or {"ready": false, "error": ...}
+//   parent: {"path": "<image>"}
+//   worker: {"success": ..., "rejected": ..., "info": ..., "decode_seconds": ...,
+//            "prefilter_seconds": ..., "downscale_seconds": ..., "assess_seconds": ..., "scores": {...}}
+//
+// If the child dies or does not answer within the timeout while assessing an
+// image, the image is reported as failed, the child is killed if necessary
+// and a new one is started for the next image.
+class OFIQWorkerProcess
+{
+public:
+    OFIQWorkerProcess(const OFIQIsolationSettings& settings, const std::string& configPath)
+        : m_settings(settings)
+        , m_configPath(configPath)
+        , m_pid(-1)
+        , m_fd(-1)
+        , m_initSeconds(0.0)
+        , m_crashes(0)
+        , m_timeouts(0)
+        , m_restarts(0)
+    {
+        ;
+    }
+
+    ~OFIQWorkerProcess()
+    {
+        Stop();
+    }
+
+    OFIQWorkerProcess(const OFIQWorkerProcess&) = delete;
+    OFIQWorkerProcess& operator=(const OFIQWorkerProcess&) = delete;
+
+    // Starts the child and waits until it has initialized OFIQ.
+    bool Start(std::string& error)
+    {
+        Stop();
+
+        // Both ends are closed on exec, so that children started by other
+        // threads at the same time do not inherit them; otherwise the end of
+        // the connection would not be noticed when this child dies.
+        int fds[2];
+#if defined(SOCK_CLOEXEC)
+        int result = socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+#else
+        int result = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        if (result == 0)
+        {
+            fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        if (result != 0)
+        {
+            error = std::string("Cannot create worker connection: ") + strerror(errno);
+            return false;
+        }
+
+        // Everything the child needs is prepared before fork, as only
+        // async-signal-safe calls are allowed between fork and exec.
+        const int childFd = 3;
+        std::string executable = GetExecutablePath(m_settings.programPath);
+        std::vector<std::string> arguments = { executable, "--worker", "--config", m_configPath,
+            "--worker-fd", std::to_string(childFd) };
+        arguments.insert(arguments.end(), m_settings.workerArguments.begin(), m_settings.workerArguments.end());
+        std::vector<char*> argv;
+        for (auto& argument : arguments)
+        {
+            argv.push_back(&argument[0]);
+        }
+        argv.push_back(nullptr);
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            error = std::string("Cannot start worker process: ") + strerror(errno);
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+        if (pid == 0)
+        {
+            // dup2 clears close-on-exec on the copy.
+            if (fds[1] != childFd)
+            {
+                dup2(fds[1], childFd);
+            }
+            else
+            {
+                fcntl(childFd, F_SETFD, 0);
+            }
+            execv(executable.c_str(), argv.data());
+            _exit(127);
+        }
+
+        close(fds[1]);
+        m_pid = pid;
+        m_fd = fds[0];
+        m_buffer.clear();
+
+        // Initializing OFIQ loads all models, which may take a while on a
+        // busy machine; it is not limited by the assessment timeout.
+        std::string line;
+        bool timedOut = false;
+        if (!ReadLine(line, std::max(300.0, m_settings.timeoutSeconds), timedOut))
+        {
+            error = timedOut ? "Worker process did not finish initialization." : "Worker process " + Reap() + " during initialization.";
+            Kill();
+            return false;
+        }
+        OFIQJsonValue ready;
+        std::string parseError;
+        if (!OFIQJsonValue::Parse(line, ready, parseError) || !ready.Get("ready").AsBool())
+        {
+            error = "Worker process failed to initialize: " + (ready.Get("error").IsString() ? ready.Get("error").AsString() : line);
+            Kill();
+            return false;
+        }
+        m_initSeconds = ready.Get("init_seconds").AsNumber();
+        return true;
+    }
+
+    // Closes the connection, upon which the child exits. A child that does
+    // not exit within a few seconds is killed.
+    void Stop()
+    {
+        if (m_pid <= 0)
+        {
+            return;
+        }
+        close(m_fd);
+        m_fd = -1;
+        auto start = std::chrono::steady_clock::now();
+        while (waitpid(m_pid, nullptr, WNOHANG) == 0)
+        {
+            if (std::chrono::steady_clock::now() - start > std::chrono::seconds(5))
+            {
+                kill(m_pid, SIGKILL);
+                waitpid(m_pid, nullptr, 0);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        m_pid = -1;
+    }
+
+    bool IsRunning() const
+    {
+        return m_pid > 0;
+    }
+
+    // Assesses an image in the child. A child that is not running, e.g.
+    // because its restart failed, is started first.
+    OFIQWorkerResult Process(const std::string& path)
+    {
+        OFIQWorkerResult result;
+        if (!IsRunning() && !Restart(result.info))
+        {
+            result.info = "Worker process not available: " + result.info;
+            return result;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        OFIQJsonValue request = OFIQJsonValue::Object();
+        request.Set("path", path);
+        std::string line;
+        bool timedOut = false;
+        bool answered = WriteLine(request.ToString(false)) && ReadLine(line, m_settings.timeoutSeconds, timedOut);
+        result.roundTripSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (!answered)
+        {
+            if (timedOut)
+            {
+                m_timeouts++;
+                result.info = "Worker process did not answer within " + std::to_string(static_cast<int>(m_settings.timeoutSeconds))
+                    + " s and was killed.";
+                Kill();
+            }
+            else
+            {
+                m_crashes++;
+                result.info = "Worker process " + Reap() + ".";
+            }
+            std::cerr << "WARNING: " << path << ": " << result.info << " Restarting it." << std::endl;
+            std::string error;
+            if (!Restart(error))
+            {
+                result.info += " Restart failed: " + error;
+            }
+            return result;
+        }
+
+        OFIQJsonValue response;
+        std::string error;
+        if (!OFIQJsonValue::Parse(line, response, error))
+        {
+            result.info = "Invalid response of worker process: " + error;
+            return result;
+        }
+        result.success = response.Get("success").AsBool();
+        result.rejected = response.Get("rejected").AsBool();
+        result.info = response.Get("info").AsString();
+        result.decodeSeconds = response.Get("decode_seconds").AsNumber();
+        result.prefilterSeconds = response.Get("prefilter_seconds").AsNumber();
+        result.downscaleSeconds = response.Get("downscale_seconds").AsNumber();
+        result.assessSeconds = response.Get("assess_seconds").AsNumber();
+        OFIQAssessmentsFromJson(response.Get("scores"), result.assessments);
+        return result;
+    }
+
+    double GetInitSeconds() const
+    {
+        return m_initSeconds;
+    }
+
+    size_t GetCrashCount() const
+    {
+        return m_crashes;
+    }
+
+    size_t GetTimeoutCount() const
+    {
+        return m_timeouts;
+    }
+
+    size_t GetRestartCount() const
+    {
+        return m_restarts;
+    }
+
+    // The path of the running executable; argv[0] may be relative to a
+    // directory that is no longer current, or only a name found in PATH.
+    static std::string GetExecutablePath(const std::string& programPath)
+    {
+#if defined(__APPLE__)
+        char path[4096];
+        uint32_t size = sizeof(path);
+        if (_NSGetExecutablePath(path, &size) == 0)
+        {
+            return path;
+        }
+#else
+        std::error_code ec;
+        auto path = std::filesystem::read_symlink("/proc/self/exe", ec);
+        if (!ec)
+        {
+            return path.u8string();
+        }
+#endif
+        return programPath;
+    }
+
+private:
+    bool Restart(std::string& error)
+    {
+        m_restarts++;
+        return Start(error);
+    }
+
+    void Kill()
+    {
+        if (m_pid <= 0)
+        {
+            return;
+        }
+        kill(m_pid, SIGKILL);
+        waitpid(m_pid, nullptr, 0);
+        close(m_fd);
+        m_fd = -1;
+        m_pid = -1;
+    }
+
+    // Waits for a child that closed the connection and describes how it
+    // ended.
+    std::string Reap()
+    {
+        int status = 0;
+        pid_t pid = m_pid;
+        close(m_fd);
+        m_fd = -1;
+        m_pid = -1;
+        if (waitpid(pid, &status, 0) != pid)
+        {
+            return "closed the connection";
+        }
+        if (WIFSIGNALED(status))
+        {
+            int signal = WTERMSIG(status);
+            return "crashed (signal " + std::to_string(signal) + ", " + strsignal(signal) + ")";
+        }
+        return "exited with code " + std::to_string(WEXITSTATUS(status));
+    }
+
+    bool WriteLine(const std::string& line)
+    {
+        std::string data = line + "\n";
+        size_t written = 0;
+        while (written < data.size())
+        {
+            ssize_t count = send(m_fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            written += static_cast<size_t>(count);
+        }
+        return true;
+    }
+
+    bool ReadLine(std::string& line, double timeoutSeconds, bool& timedOut)
+    {
+        auto start = std::chrono::steady_clock::now();
+        timedOut = false;
+        while (true)
+        {
+            auto end = m_buffer.find('\n');
+            if (end != std::string::npos)
+            {
+                line = m_buffer.substr(0, end);
+                m_buffer.erase(0, end + 1);
+                return true;
+            }
+
+            double remaining = timeoutSeconds - std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (remaining <= 0.0)
+            {
+                timedOut = true;
+                return false;
+            }
+            pollfd entry = { m_fd, POLLIN, 0 };
+            int ready = poll(&entry, 1, static_cast<int>(std::ceil(remaining * 1000.0)));
+            if (ready < 0 && errno != EINTR)
+            {
+                return false;
+            }
+            if (ready <= 0)
+            {
+                continue;
+            }
+
+            char chunk[4096];
+            ssize_t count = read(m_fd, chunk, sizeof(chunk));
+            if (count < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (count <= 0)
+            {
+                return false;
+            }
+            m_buffer.append(chunk, static_cast<size_t>(count));
+        }
+    }
+
+    OFIQIsolationSettings m_settings;
+    std::string m_configPath;
+    pid_t m_pid;
+    int m_fd;
+    std::string m_buffer;
+    double m_initSeconds;
+    size_t m_crashes;
+    size_t m_timeouts;
+    size_t m_restarts;
+};
+
+#endif
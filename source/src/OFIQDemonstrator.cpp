@@ -1,5 +1,10 @@
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <functional>
 #include <set>
+#include <sstream>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <ofiq_lib.h>
@@ -10,10 +15,40 @@
 #include <wx/grid.h>
 #include <wx/splitter.h>
 #include <wx/listctrl.h>
+#include <wx/dirdlg.h>
+#include <wx/timer.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
 #ifndef WX_PRECOMP
 #include <wx/wx.h>
 #endif
 #include <OFIQPictureFrame.h>
+#include <OFIQGLPictureFrame.h>
+#include <OFIQAssessmentCsv.h>
+#include <OFIQBatch.h>
+#include <OFIQBenchmark.h>
+#include <OFIQCommandLine.h>
+#include <OFIQConfigCompare.h>
+#include <OFIQDisplayProxy.h>
+#include <OFIQDisplaySource.h>
+#include <OFIQDownscaleCompare.h>
+#include <OFIQHistory.h>
+#include <OFIQLogLimit.h>
+#include <OFIQMetrics.h>
+#include <OFIQOverlayRenderer.h>
+#include <OFIQPriorityQueue.h>
+#include <OFIQResultStore.h>
+#include <OFIQService.h>
+#include <OFIQSession.h>
+#include <OFIQShardMerge.h>
+#include <OFIQSharedMemoryIngest.h>
+#include <OFIQSoak.h>
+#include <OFIQStatisticsFrame.h>
+#include <OFIQStreamingStats.h>
+#include <OFIQThreadPlacement.h>
+#include <OFIQThreadSettingsDialog.h>
+#include <OFIQThumbnailBrowser.h>
+#include <OFIQWatchFolder.h>
 
 #include <opencv2/opencv.hpp>
 
@@ -24,12 +59,19 @@ class OFIQDemoApp : public wxApp
 {
 public:
     virtual bool OnInit();
+    virtual int OnRun();
+
+private:
+    std::unique_ptr<OFIQCommandLine> m_headlessCommandLine;
 };
 
+int RunHeadless(const OFIQCommandLine& commandLine);
+
 class OFIQDemoFrame : public wxFrame
 {
 public:
     OFIQDemoFrame();
+    ~OFIQDemoFrame();
 
 protected:
     void OnMouseMoved(wxMouseEvent& event);
@@ -42,11 +84,20 @@ private:
     bool IsKeyPressed(int keyCode);
 
     void OnLoadImage(wxCommandEvent& event);
+    void OnBrowseFolder(wxCommandEvent& event);
+    void OnHistoryBack(wxCommandEvent& event);
+    void OnHistoryForward(wxCommandEvent& event);
     void OnSaveImage(wxCommandEvent& event);
     void OnSaveAssessment(wxCommandEvent& event);
+    void OnOpenSession(wxCommandEvent& event);
+    void OnSaveSession(wxCommandEvent& event);
     void OnSpecifyConfigPath(wxCommandEvent& event);
     void OnOfiqInit(wxCommandEvent& event);
     void OnOfiqAssess(wxCommandEvent& event);
+    void OnOfiqAssessSelection(wxCommandEvent& event);
+    void OnOfiqAssessFolder(wxCommandEvent& event);
+    void OnThreadSettings(wxCommandEvent& event);
+    void OnShowStatistics(wxCommandEvent& event);
     void OnExit(wxCommandEvent& event);
     void OnAbout(wxCommandEvent& event);
 
@@ -66,24 +117,51 @@ private:
     void OnShowSegmentationMask(wxCommandEvent& event);
     void OnShowOcclusionMask(wxCommandEvent& event);
     void OnShowLandmarkedRegion(wxCommandEvent& event);
+    void OnUseOpenGL(wxCommandEvent& event);
+    void OnLimitRenderRate(wxCommandEvent& event);
+    void OnDisplayBudget(wxCommandEvent& event);
+    void OnIdle(wxIdleEvent& event);
+    void OnRenderTimer(wxTimerEvent& event);
 
     bool DoLoadImage(const std::string& path);
     bool DoSaveImage(const std::string& path);
     bool DoSaveAssessment(const std::string& path);
+    bool DoOpenSession(const std::string& path);
+    bool DoSaveSession(const std::string& path);
+    bool DoRestoreSession(const OFIQSessionData& session);
+    OFIQSessionData GetSessionData() const;
+    bool DoGoHistory(int offset);
+    void DoRememberImage();
+    void DoUpdateHistoryStatus();
     bool DoOfiqInit();
-
-    void CreateCvImage();
-    void UpdateOriginal();
-    void UpdateFaces();
-    void UpdateLandmarks();
-    void UpdateSegmentationMask();
-    void UpdateOcclusionMask();
-    void UpdateLandmarkedRegion();
+    bool DoAssessRegion(const wxRect& region);
+    bool DoCropRegion(const wxRect& region, wxRect& crop, OFIQ::Image& cropImage);
+    static void MapCropResults(const wxRect& crop, int width, int height, OFIQ::FaceImageQualityPreprocessingResult& preprocessing);
+    void DoShowRegionResults(const OFIQ::FaceImageQualityAssessment& assessments,
+        const OFIQ::FaceImageQualityPreprocessingResult& preprocessing, const wxRect& crop, double seconds);
+    void DoStopBatch();
+    bool DoScheduleAssessment(const wxRect& region = wxRect());
+    void OnScheduledAssessment(const OFIQBatchItem& item, const OFIQ::Image& source, const wxRect& crop, double waitSeconds);
+    static std::string OnQueueStatusBinding(void* owner);
+    static void OnThumbnailBinding(void* owner, const std::string& path);
+    void DoCacheScore(const std::string& path, const OFIQ::FaceImageQualityAssessment& assessments);
+
+    static void OnSelectionBinding(void* owner, const wxRect& selection);
+    void OnRegionSelected(const wxRect& selection);
+    static void OnScaleBinding(void* owner, double scale);
+    static wxImage OnTileBinding(void* owner, const wxRect& region);
+
+    OFIQOverlayOptions GetOverlayOptions() const;
     void CreateWxImage();
+    static wxImage ToWxImage(const cv::Mat& cvImage);
+    void DoUpdateDisplaySource();
 
     void DoUpdatePreferredScalingFactor();
     void DoInitImage();
     void DoUpdateImage();
+    void DoUpdateGeometry();
+    void DoRenderPending();
+    void DoUpdateZoomStatus();
     void DoClearAssessmentTable();
     void DoShowAssessmentTable();
     void DoClearPreprocessing();
@@ -99,7 +177,10 @@ private:
     wxFileDialog* m_imageFileDialogPtr;
     wxFileDialog* m_imageSaveFileDialogPtr;
     wxFileDialog* m_csvSaveFileDialogPtr;
+    wxFileDialog* m_sessionFileDialogPtr;
+    wxFileDialog* m_sessionSaveFileDialogPtr;
     OFIQPictureFrame* m_pictureFramePtr;
+    OFIQGLPictureFrame* m_glPictureFramePtr;
     wxGrid* m_assessmentTablePtr;
     wxTextCtrl* m_logOutputPtr;
 
@@ -108,10 +189,10 @@ private:
     std::string m_ofiqConfigPath;
     std::shared_ptr<OFIQ::Interface> m_ofiqPtr;
     bool m_ofiqInitialized;
+    OFIQThreadSettings m_threadSettings;
 
     std::string m_imagePath;
     OFIQ::Image m_ofiqImage;
-    cv::Mat m_cvImage;
     wxImage m_wxImage;
     bool m_imageLoaded;
 
@@ -121,10 +202,48 @@ private:
     bool m_showSegmentationMask;
     bool m_showOcclusionMask;
     bool m_showLandmarkedRegion;
+    bool m_useOpenGL;
+
+    // Render requests only mark the view as dirty; the view is rendered once
+    // per idle cycle, at most m_maxRenderRate times per second if limited.
+    bool m_renderPending;
+    bool m_limitRenderRate;
+    double m_maxRenderRate;
+    std::chrono::steady_clock::time_point m_lastRender;
+    wxTimer m_renderTimer;
+    size_t m_renderCount;
+    size_t m_coalescedRenderCount;
+
+    // Above the display memory budget the view is rendered from a reduced
+    // proxy of the image and its masks, and from full-resolution tiles of the
+    // part in view at high zoom. m_wxImage is converted from the display
+    // source.
+    size_t m_displayBudgetBytes;
+    OFIQDisplaySource m_displaySource;
 
     OFIQ::FaceImageQualityAssessment m_assessments;
     OFIQ::FaceImageQualityPreprocessingResult m_preprocessing;
 
+    wxRect m_selection;
+    double m_selectionPadding;
+    double m_lastFullAssessmentSeconds;
+
+    OFIQHistory m_history;
+
+    // A job run by a batch worker; the runner is null if no worker could
+    // be initialized.
+    using AssessmentJob = std::function<void(OFIQBatchRunner*)>;
+
+    std::thread m_batchThread;
+    std::shared_ptr<OFIQPriorityQueue<AssessmentJob>> m_schedulerPtr;
+    std::atomic<bool> m_batchCancel;
+    OFIQBatchProgress m_batchProgress;
+    OFIQStreamingStats m_batchStats;
+    OFIQStatisticsFrame* m_statisticsFramePtr;
+
+    std::shared_ptr<OFIQThumbnailCache> m_thumbnailCachePtr;
+    OFIQThumbnailFrame* m_thumbnailFramePtr;
+
     DECLARE_EVENT_TABLE()
 };
 
@@ -142,17 +261,29 @@ END_EVENT_TABLE()
 enum
 {
     ID_LoadImage = 1,
+    ID_BrowseFolder,
+    ID_HistoryBack,
+    ID_HistoryForward,
     ID_SaveImage,
     ID_SaveAssessment,
+    ID_OpenSession,
+    ID_SaveSession,
     ID_SpecifyConfigPath,
     ID_Initialize,
     ID_Assess,
+    ID_AssessSelection,
+    ID_AssessFolder,
+    ID_ThreadSettings,
+    ID_ShowStatistics,
     ID_ShowOriginal,
     ID_ShowFaces,
     ID_ShowLandmarks,
     ID_ShowSegmentationMask,
     ID_ShowOcclusionMask,
     ID_ShowLandmarkedRegion,
+    ID_UseOpenGL,
+    ID_LimitRenderRate,
+    ID_DisplayBudget,
     ID_Log,
     ID_Zoom_1_4,
     ID_Zoom_1_2,
@@ -162,62 +293,150 @@ enum
     ID_TopButton
 };
 
-const std::map<int, std::string> measurementMapping = {
-    {0x41, "UnifiedQualityScore"},
-    {0x42, "BackgroundUniformity"},
-    {0x43, "IlluminationUniformity"},
-    {-0x44, "Luminance"},
-    {0x44, "LuminanceMean"},
-    {0x45, "LuminanceVariance"},
-    {0x46, "UnderExposurePrevention"},
-    {0x47, "OverExposurePrevention"},
-    {0x48, "DynamicRange"},
-    {0x49, "Sharpness"},
-    {0x4a, "CompressionArtifacts"},
-    {0x4b, "NaturalColour"},
-    {0x4c, "SingleFacePresent"},
-    {0x4d, "EyesOpen"},
-    {0x4e, "MouthClosed"},
-    {0x4f, "EyesVisible"},
-    {0x50, "MouthOcclusionPrevention"},
-    {0x51, "FaceOcclusionPrevention"},
-    {0x52, "InterEyeDistance"},
-    {0x53, "HeadSize"},
-    {-0x54, "CropOfTheFaceImage"},
-    {0x54, "LeftwardCropOfTheFaceImage"},
-    {0x55, "RightwardCropOfTheFaceImage"},
-    {0x56, "DownwardCropOfTheFaceImage"},
-    {0x57, "UpwardCropOfTheFaceImage"},
-    {-0x58, "HeadPose"},
-    {0x58, "HeadPoseYaw"},
-    {0x59, "HeadPosePitch"},
-    {0x5a, "HeadPoseRoll"},
-    {0x5b, "ExpressionNeutrality"},
-    {0x5c, "NoHeadCoverings"},
-    {-1, "NotSet"}
-};
+wxIMPLEMENT_APP_NO_MAIN(OFIQDemoApp);
+
+#if defined(__WXMSW__)
+// GUI subsystem builds on Windows enter through WinMain and reach the headless
+// modes via OFIQDemoApp::OnInit.
+wxIMPLEMENT_WXWIN_MAIN
+#endif
+
+// Headless modes are dispatched before wxWidgets is initialized so that they
+// also run on machines without a display.
+int main(int argc, char* argv[])
+{
+    OFIQCommandLine commandLine(argc, argv);
+    if (commandLine.IsHeadless())
+    {
+        return RunHeadless(commandLine);
+    }
+    return wxEntry(argc, argv);
+}
+
+int RunHeadless(const OFIQCommandLine& commandLine)
+{
+    try
+    {
+        // Publishes the metrics of every mode until it returns.
+        OFIQMetricsExporter metricsExporter;
+        std::string error;
+        if (!metricsExporter.Start(commandLine, error))
+        {
+            std::cerr << "ERROR: " << error << std::endl;
+            OFIQMetricsExporter::PrintUsage(std::cerr);
+            return 1;
+        }
 
-wxIMPLEMENT_APP(OFIQDemoApp);
+        const std::string& mode = commandLine.GetMode();
+        if (mode == "batch")
+        {
+            return OFIQBatch::Run(commandLine);
+        }
+        if (mode == "benchmark")
+        {
+            return OFIQBenchmark::Run(commandLine);
+        }
+        if (mode == "compare")
+        {
+            return OFIQConfigCompare::Run(commandLine);
+        }
+        if (mode == "downscale-compare")
+        {
+            return OFIQDownscaleCompare::Run(commandLine);
+        }
+        if (mode == "merge")
+        {
+            return OFIQShardMerge::Run(commandLine);
+        }
+        if (mode == "serve")
+        {
+            return OFIQService::Run(commandLine);
+        }
+        if (mode == "shm-ingest")
+        {
+            return OFIQSharedMemoryIngest::Run(commandLine);
+        }
+        if (mode == "shm-producer")
+        {
+            return OFIQSharedMemoryProducer::Run(commandLine);
+        }
+        if (mode == "soak")
+        {
+            return OFIQSoak::Run(commandLine);
+        }
+        if (mode == "store")
+        {
+            return OFIQResultStoreTool::Run(commandLine);
+        }
+        if (mode == "watch")
+        {
+            return OFIQWatchFolder::Run(commandLine);
+        }
+        if (mode == "worker")
+        {
+            return OFIQWorker::Run(commandLine);
+        }
+        std::cerr << "ERROR: Unknown mode --" << mode << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+    }
+    return 1;
+}
 
 bool OFIQDemoApp::OnInit()
 {
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++)
+    {
+        args.push_back(argv[i].ToStdString());
+    }
+    OFIQCommandLine commandLine(argv[0].ToStdString(), args);
+    if (commandLine.IsHeadless())
+    {
+        m_headlessCommandLine = std::make_unique<OFIQCommandLine>(commandLine);
+        return true;
+    }
+
     OFIQDemoFrame* frame = new OFIQDemoFrame();
     frame->Show(true);
     return true;
 }
 
+int OFIQDemoApp::OnRun()
+{
+    if (m_headlessCommandLine != nullptr)
+    {
+        return RunHeadless(*m_headlessCommandLine);
+    }
+    return wxApp::OnRun();
+}
+
 OFIQDemoFrame::OFIQDemoFrame()
     : wxFrame(NULL, wxID_ANY, "OFIQ Demonstrator")
+    , m_renderTimer(this)
 {
     wxMenu* menuFile = new wxMenu();
     menuFile->Append(ID_LoadImage, "&Load...\tCtrl-L",
         "Loads an image for OFIQ assessment");
+    menuFile->Append(ID_BrowseFolder, "&Browse folder...\tCtrl-F",
+        "Shows the thumbnails of the images of a folder");
+    menuFile->Append(ID_HistoryBack, "&Back\tAlt-Left",
+        "Shows the previous image with its assessment");
+    menuFile->Append(ID_HistoryForward, "&Forward\tAlt-Right",
+        "Shows the next image with its assessment");
     menuFile->AppendSeparator();
     menuFile->Append(ID_SaveImage, "&Save Image...\tCtrl-S",
         "Saves the visualized image");
     menuFile->Append(ID_SaveAssessment, "&Export Assesment...\tCtrl-E",
         "Exports the quality assessment in CSV format");
     menuFile->AppendSeparator();
+    menuFile->Append(ID_OpenSession, "&Open Session...\tCtrl-O",
+        "Restores image, preprocessing results and assessment of a saved session");
+    menuFile->Append(ID_SaveSession, "Save Sessio&n...\tCtrl-Shift-S",
+        "Saves image path, preprocessing results and assessment");
+    menuFile->AppendSeparator();
     menuFile->Append(wxID_EXIT);
 
     wxMenu* menuOfiq = new wxMenu();
@@ -227,6 +446,13 @@ OFIQDemoFrame::OFIQDemoFrame()
         "Initialize OFIQ using specified config file");
     menuOfiq->Append(ID_Assess, "&Assess...\tCtrl-A",
         "Assess loaded image using OFIQ");
+    menuOfiq->Append(ID_AssessSelection, "Assess &selection...\tCtrl-R",
+        "Assess only a padded crop around the selected face or region");
+    menuOfiq->AppendSeparator();
+    menuOfiq->Append(ID_AssessFolder, "Assess &folder...\tCtrl-B",
+        "Assess all images of a folder in the background");
+    menuOfiq->Append(ID_ThreadSettings, "&Thread settings...",
+        "Number of workers, intra-op threads and CPU pinning for assessing folders");
 
     m_scaleFactor = 1.0;
     m_zoomFactor = 1.05;
@@ -237,6 +463,13 @@ OFIQDemoFrame::OFIQDemoFrame()
     m_showSegmentationMask = false;
     m_showOcclusionMask = false;
     m_showLandmarkedRegion = false;
+    m_useOpenGL = false;
+    m_renderPending = false;
+    m_limitRenderRate = false;
+    m_maxRenderRate = 30.0;
+    m_renderCount = 0;
+    m_coalescedRenderCount = 0;
+    m_displayBudgetBytes = 256 * 1024 * 1024;
 
     wxMenu* menuView = new wxMenu();
     wxMenu* menuZoom = new wxMenu();
@@ -251,6 +484,7 @@ OFIQDemoFrame::OFIQDemoFrame()
     menuZoom->Append(zoom_2_1);
     menuZoom->Append(zoom_4_1);
     menuView->AppendSubMenu(menuZoom, wxT("Zoom"));
+    menuView->Append(ID_ShowStatistics, wxT("Batch statistics...\tCtrl-T"));
     menuView->AppendSeparator();
     wxMenuItem* showOriginalItem = new wxMenuItem(menuView, ID_ShowOriginal, wxT("Show original"), "", wxITEM_CHECK);
     menuView->Append(showOriginalItem);
@@ -276,6 +510,19 @@ OFIQDemoFrame::OFIQDemoFrame()
     menuView->Append(showLandmarkedRegionItem);
     showLandmarkedRegionItem->SetCheckable(true);
     showLandmarkedRegionItem->Check(m_showLandmarkedRegion);
+    menuView->AppendSeparator();
+    wxMenuItem* useOpenGLItem = new wxMenuItem(menuView, ID_UseOpenGL, wxT("Use OpenGL canvas"),
+        "Zoom, pan and blend the masks on the GPU", wxITEM_CHECK);
+    menuView->Append(useOpenGLItem);
+    useOpenGLItem->SetCheckable(true);
+    useOpenGLItem->Check(m_useOpenGL);
+    wxMenuItem* limitRenderRateItem = new wxMenuItem(menuView, ID_LimitRenderRate, wxT("Limit redraws to 30 per second"),
+        "Redraw the image at most 30 times per second while zooming", wxITEM_CHECK);
+    menuView->Append(limitRenderRateItem);
+    limitRenderRateItem->SetCheckable(true);
+    limitRenderRateItem->Check(m_limitRenderRate);
+    menuView->Append(ID_DisplayBudget, wxT("Display memory budget..."),
+        "Show large images from a reduced proxy above this budget");
 
     wxMenu* menuHelp = new wxMenu();
     menuHelp->Append(wxID_ABOUT);
@@ -288,15 +535,24 @@ OFIQDemoFrame::OFIQDemoFrame()
 
     SetMenuBar(menuBar);
 
-    CreateStatusBar(2);
+    CreateStatusBar(3);
     SetStatusText("", 0);
 
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnLoadImage, this, ID_LoadImage);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnBrowseFolder, this, ID_BrowseFolder);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnHistoryBack, this, ID_HistoryBack);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnHistoryForward, this, ID_HistoryForward);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnSaveImage, this, ID_SaveImage);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnSaveAssessment, this, ID_SaveAssessment);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnOpenSession, this, ID_OpenSession);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnSaveSession, this, ID_SaveSession);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnSpecifyConfigPath, this, ID_SpecifyConfigPath);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnOfiqInit, this, ID_Initialize);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnOfiqAssess, this, ID_Assess);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnOfiqAssessSelection, this, ID_AssessSelection);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnOfiqAssessFolder, this, ID_AssessFolder);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnThreadSettings, this, ID_ThreadSettings);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnShowStatistics, this, ID_ShowStatistics);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnAbout, this, wxID_ABOUT);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnExit, this, wxID_EXIT);
 
@@ -312,10 +568,30 @@ OFIQDemoFrame::OFIQDemoFrame()
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnShowSegmentationMask, this, ID_ShowSegmentationMask);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnShowOcclusionMask, this, ID_ShowOcclusionMask);
     Bind(wxEVT_MENU, &OFIQDemoFrame::OnShowLandmarkedRegion, this, ID_ShowLandmarkedRegion);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnUseOpenGL, this, ID_UseOpenGL);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnLimitRenderRate, this, ID_LimitRenderRate);
+    Bind(wxEVT_MENU, &OFIQDemoFrame::OnDisplayBudget, this, ID_DisplayBudget);
+    Bind(wxEVT_IDLE, &OFIQDemoFrame::OnIdle, this);
+    Bind(wxEVT_TIMER, &OFIQDemoFrame::OnRenderTimer, this, m_renderTimer.GetId());
 
     m_ofiqConfigPath = "ofiq_config.jaxn";
     m_ofiqInitialized = false;
 
+    m_selectionPadding = 0.5;
+    m_lastFullAssessmentSeconds = -1.0;
+    DoUpdateHistoryStatus();
+
+    m_batchCancel = false;
+    m_statisticsFramePtr = new OFIQStatisticsFrame(this, m_batchStats, m_batchProgress);
+    m_statisticsFramePtr->BindQueueStatus(this, &OFIQDemoFrame::OnQueueStatusBinding);
+
+    wxFileName thumbnailDirectory(wxStandardPaths::Get().GetUserDir(wxStandardPaths::Dir_Cache), "");
+    thumbnailDirectory.AppendDir("OFIQDemonstrator");
+    thumbnailDirectory.AppendDir("thumbnails");
+    m_thumbnailCachePtr = std::make_shared<OFIQThumbnailCache>(thumbnailDirectory.GetPath().ToStdString());
+    m_thumbnailFramePtr = new OFIQThumbnailFrame(this, m_thumbnailCachePtr);
+    m_thumbnailFramePtr->GetThumbnails()->BindOpen(this, &OFIQDemoFrame::OnThumbnailBinding);
+
     m_configFileDialogPtr = new wxFileDialog(this,
         "Open config file",
         "",
@@ -340,6 +616,18 @@ OFIQDemoFrame::OFIQDemoFrame()
         "",
         "CSV file (*.csv)|*.csv", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
 
+    m_sessionFileDialogPtr = new wxFileDialog(this,
+        "Open Session",
+        "",
+        "",
+        "OFIQ session (*.ofiqs)|*.ofiqs", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+
+    m_sessionSaveFileDialogPtr = new wxFileDialog(this,
+        "Save Session",
+        "",
+        "",
+        "OFIQ session (*.ofiqs)|*.ofiqs", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+
     wxSystemAppearance appearance = wxSystemSettings::GetAppearance();
     if (!appearance.IsDark())
     {
@@ -356,9 +644,15 @@ OFIQDemoFrame::OFIQDemoFrame()
     auto leftPanel = new wxPanel(verticalSplitterWindow, wxID_ANY);
     m_pictureFramePtr = new OFIQPictureFrame();
     m_pictureFramePtr->Create(leftPanel);
+    m_pictureFramePtr->BindSelection(this, &OFIQDemoFrame::OnSelectionBinding);
+    m_pictureFramePtr->BindTiles(this, &OFIQDemoFrame::OnTileBinding);
+    m_glPictureFramePtr = new OFIQGLPictureFrame(leftPanel);
+    m_glPictureFramePtr->BindScale(this, &OFIQDemoFrame::OnScaleBinding);
+    m_glPictureFramePtr->Show(false);
     m_imageLoaded = false;
     auto leftPanelSizer = new wxBoxSizer(wxHORIZONTAL);
     leftPanelSizer->Add(m_pictureFramePtr, 1, wxEXPAND);
+    leftPanelSizer->Add(m_glPictureFramePtr, 1, wxEXPAND);
     leftPanel->SetSizer(leftPanelSizer);
 
     // Create the right panel
@@ -393,6 +687,12 @@ OFIQDemoFrame::OFIQDemoFrame()
     SetSize(WIDTH, HEIGHT);
 }
 
+OFIQDemoFrame::~OFIQDemoFrame()
+{
+    m_renderTimer.Stop();
+    DoStopBatch();
+}
+
 void OFIQDemoFrame::OnMouseMoved(wxMouseEvent& event)
 {
     SetFocus();
@@ -524,13 +824,13 @@ void OFIQDemoFrame::OnShowOriginal(wxCommandEvent& event)
 void OFIQDemoFrame::OnShowFaces(wxCommandEvent& event)
 {
     m_showFaces = event.IsChecked();
-    DoUpdateImage();
+    DoUpdateGeometry();
 }
 
 void OFIQDemoFrame::OnShowLandmarks(wxCommandEvent& event)
 {
     m_showLandmarks = event.IsChecked();
-    DoUpdateImage();
+    DoUpdateGeometry();
 }
 
 void OFIQDemoFrame::OnShowSegmentationMask(wxCommandEvent& event)
@@ -551,6 +851,61 @@ void OFIQDemoFrame::OnShowLandmarkedRegion(wxCommandEvent& event)
     DoUpdateImage();
 }
 
+void OFIQDemoFrame::OnUseOpenGL(wxCommandEvent& event)
+{
+    m_useOpenGL = event.IsChecked();
+    m_pictureFramePtr->Show(!m_useOpenGL);
+    m_glPictureFramePtr->Show(m_useOpenGL);
+    m_glPictureFramePtr->GetParent()->Layout();
+
+    if (m_useOpenGL && !m_glPictureFramePtr->IsSupported())
+    {
+        LOG_ERROR("OpenGL canvas not available: " + m_glPictureFramePtr->GetError());
+        m_useOpenGL = false;
+        GetMenuBar()->Check(ID_UseOpenGL, false);
+        m_glPictureFramePtr->Show(false);
+        m_pictureFramePtr->Show(true);
+        m_glPictureFramePtr->GetParent()->Layout();
+    }
+    else if (m_useOpenGL)
+    {
+        LOG_INFO("Using the OpenGL canvas; region selection is only available on the default canvas.");
+    }
+    DoUpdateImage();
+}
+
+void OFIQDemoFrame::OnLimitRenderRate(wxCommandEvent& event)
+{
+    m_limitRenderRate = event.IsChecked();
+}
+
+void OFIQDemoFrame::OnDisplayBudget(wxCommandEvent& event)
+{
+    long megabytes = wxGetNumberFromUser(
+        "Images whose display buffers exceed the budget are shown from a reduced proxy;\n"
+        "the full resolution is used for the part in view at high zoom.",
+        "Budget (MiB):", "Display memory budget",
+        static_cast<long>(m_displayBudgetBytes / (1024 * 1024)), 16, 65536, this);
+    if (megabytes < 0)
+    {
+        return;
+    }
+    m_displayBudgetBytes = static_cast<size_t>(megabytes) * 1024 * 1024;
+    LOG_INFO("Display memory budget set to " + std::to_string(megabytes) + " MiB.");
+    DoUpdateImage();
+}
+
+void OFIQDemoFrame::OnIdle(wxIdleEvent& event)
+{
+    DoRenderPending();
+    event.Skip();
+}
+
+void OFIQDemoFrame::OnRenderTimer(wxTimerEvent& event)
+{
+    DoRenderPending();
+}
+
 bool OFIQDemoFrame::IsKeyPressed(int keyCode)
 {
     return m_pressedKeyCodes.find(keyCode) != m_pressedKeyCodes.end();
@@ -570,6 +925,66 @@ void OFIQDemoFrame::OnLoadImage(wxCommandEvent& event)
     }
 }
 
+void OFIQDemoFrame::OnBrowseFolder(wxCommandEvent& event)
+{
+    wxString defaultPath = m_imagePath.empty() ? wxString() : wxFileName(m_imagePath).GetPath();
+    wxDirDialog dialog(this, "Browse folder", defaultPath, wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dialog.ShowModal() == wxID_CANCEL)
+    {
+        return;
+    }
+
+    std::string error;
+    std::vector<OFIQImageEntry> images;
+    std::string directory = dialog.GetPath().ToStdString();
+    if (!OFIQImageList::FromDirectory(directory, images, error))
+    {
+        LOG_ERROR(error);
+        return;
+    }
+    std::vector<std::string> paths;
+    paths.reserve(images.size());
+    for (const auto& image : images)
+    {
+        paths.push_back(image.path);
+    }
+    m_thumbnailFramePtr->SetFolder(directory, paths);
+    m_thumbnailFramePtr->GetThumbnails()->Select(m_imagePath);
+    m_thumbnailFramePtr->Show();
+    m_thumbnailFramePtr->Raise();
+    LOG_INFO("Browsing " + std::to_string(paths.size()) + " images of '" + directory + "'.");
+}
+
+void OFIQDemoFrame::OnThumbnailBinding(void* owner, const std::string& path)
+{
+    auto frame = static_cast<OFIQDemoFrame*>(owner);
+    wxBusyCursor wait;
+    frame->DoLoadImage(path);
+}
+
+void OFIQDemoFrame::OnHistoryBack(wxCommandEvent& event)
+{
+    wxBusyCursor wait;
+    DoGoHistory(-1);
+}
+
+void OFIQDemoFrame::OnHistoryForward(wxCommandEvent& event)
+{
+    wxBusyCursor wait;
+    DoGoHistory(1);
+}
+
+// Stores the unified score of an assessment of the whole image, shown as a
+// badge in the thumbnail browser.
+void OFIQDemoFrame::DoCacheScore(const std::string& path, const OFIQ::FaceImageQualityAssessment& assessments)
+{
+    double score;
+    if (m_thumbnailCachePtr->SaveScore(path, assessments, score))
+    {
+        m_thumbnailFramePtr->GetThumbnails()->SetScore(path, score);
+    }
+}
+
 void OFIQDemoFrame::OnSaveImage(wxCommandEvent& event)
 {
     if (m_imageSaveFileDialogPtr->ShowModal() == wxID_CANCEL)
@@ -598,6 +1013,34 @@ void OFIQDemoFrame::OnSaveAssessment(wxCommandEvent& event)
     }
 }
 
+void OFIQDemoFrame::OnOpenSession(wxCommandEvent& event)
+{
+    if (m_sessionFileDialogPtr->ShowModal() == wxID_CANCEL)
+    {
+        return;
+    }
+    else
+    {
+        wxBusyCursor wait;
+        std::string session_path = m_sessionFileDialogPtr->GetPath().ToStdString();
+        DoOpenSession(session_path);
+    }
+}
+
+void OFIQDemoFrame::OnSaveSession(wxCommandEvent& event)
+{
+    if (m_sessionSaveFileDialogPtr->ShowModal() == wxID_CANCEL)
+    {
+        return;
+    }
+    else
+    {
+        wxBusyCursor wait;
+        std::string session_path = m_sessionSaveFileDialogPtr->GetPath().ToStdString();
+        DoSaveSession(session_path);
+    }
+}
+
 void OFIQDemoFrame::OnSpecifyConfigPath(wxCommandEvent& event)
 {
     if (m_configFileDialogPtr->ShowModal() == wxID_CANCEL)
@@ -630,6 +1073,11 @@ void OFIQDemoFrame::OnOfiqAssess(wxCommandEvent& event)
         return;
     }
 
+    if (DoScheduleAssessment())
+    {
+        return;
+    }
+
     if (!m_ofiqInitialized)
     {
         m_ofiqInitialized = DoOfiqInit();
@@ -639,8 +1087,10 @@ void OFIQDemoFrame::OnOfiqAssess(wxCommandEvent& event)
     }
 
     uint32_t resultRequestsMask = static_cast<int>(OFIQ::PreprocessingResultType::All);
+    auto start = std::chrono::steady_clock::now();
     auto result = m_ofiqPtr->vectorQualityWithPreprocessingResults(
         m_ofiqImage, m_assessments, m_preprocessing, resultRequestsMask);
+    m_lastFullAssessmentSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
     if (result.code != OFIQ::ReturnCode::Success)
     {
         LOG_ERROR("OFIQ assessment returned: " + result.info);
@@ -648,399 +1098,830 @@ void OFIQDemoFrame::OnOfiqAssess(wxCommandEvent& event)
 
     DoUpdateImage();
     DoShowAssessmentTable();
+    DoCacheScore(m_imagePath, m_assessments);
 
-    LOG_INFO("OFIQ assessment done");
+    LOG_INFO("OFIQ assessment done (" + std::to_string(m_lastFullAssessmentSeconds) + " s)");
 }
 
-bool OFIQDemoFrame::DoLoadImage(const std::string& path)
+void OFIQDemoFrame::OnOfiqAssessSelection(wxCommandEvent& event)
 {
-    LOG_INFO("Loading image from '" + path + "' ...");
+    wxBusyCursor wait;
 
-    OFIQ::ReturnStatus retStatus = OFIQ_LIB::readImage(path, m_ofiqImage);
-    if (retStatus.code != OFIQ::ReturnCode::Success)
+    LOG_INFO("OFIQ assessment of selection ...");
+
+    if (!m_imageLoaded)
     {
-        LOG_ERROR("Loading image returned: " + retStatus.info);
-        return false;
+        LOG_ERROR("No image loaded.");
+        return;
     }
 
-    this->m_imagePath = path;
-
-    DoClearAssessmentTable();
-    DoClearPreprocessing();
+    if (m_selection.IsEmpty())
+    {
+        LOG_ERROR("No region selected. Click a detected face or drag a rectangle.");
+        return;
+    }
 
-    DoUpdatePreferredScalingFactor();
-    DoInitImage();
+    if (DoScheduleAssessment(m_selection))
+    {
+        return;
+    }
 
-    LOG_INFO("Image loaded.");
+    if (!m_ofiqInitialized)
+    {
+        m_ofiqInitialized = DoOfiqInit();
+        if (!m_ofiqInitialized) {
+            return;
+        }
+    }
 
-    return m_imageLoaded;
+    if (DoAssessRegion(m_selection))
+    {
+        DoUpdateImage();
+        DoShowAssessmentTable();
+        LOG_INFO("OFIQ assessment of selection done");
+    }
 }
 
-bool OFIQDemoFrame::DoSaveImage(const std::string& path)
+void OFIQDemoFrame::OnOfiqAssessFolder(wxCommandEvent& event)
 {
-    LOG_INFO("Saving image to '" + path + "' ...");
-
-    bool flag = cv::imwrite(path, m_cvImage);
-
-    if (flag)
+    if (m_batchProgress.running)
     {
-        LOG_INFO("Image saved.");
+        LOG_ERROR("A batch is already running.");
+        return;
     }
-    else
+
+    wxDirDialog dialog(this, "Assess folder", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dialog.ShowModal() == wxID_CANCEL)
     {
-        LOG_ERROR("Saving image failed.");
+        return;
     }
 
-    return flag;
-}
-
-bool OFIQDemoFrame::DoSaveAssessment(const std::string& path)
-{
-    const static char sep = ';';
-
-    LOG_INFO("Exporting assessment to '" + path + "' ...");
+    std::string error;
+    std::vector<OFIQImageEntry> images;
+    std::string directory = dialog.GetPath().ToStdString();
+    if (!OFIQImageList::FromDirectory(directory, images, error))
+    {
+        LOG_ERROR(error);
+        return;
+    }
 
-    std::ofstream csv_stream(path.c_str());
-    if (csv_stream.is_open())
+    OFIQThreadPlacement placement;
+    if (!placement.Initialize(m_threadSettings, error))
     {
-        csv_stream << "Filename";
+        LOG_ERROR(error);
+        return;
+    }
 
-        for (auto q : m_assessments.qAssessments)
+    DoStopBatch();
+    m_batchStats.Clear();
+    m_batchCancel = false;
+    m_batchProgress.total = images.size();
+    m_batchProgress.done = 0;
+    m_batchProgress.running = true;
+    LOG_INFO("Assessing " + std::to_string(images.size()) + " images of '" + directory + "' in the background ...");
+    LOG_INFO("Batch threads: " + placement.ToString());
+
+    // The batch uses its own OFIQ instances, one per worker, so that the image
+    // view stays usable while the batch runs. Each worker pins its thread
+    // before initializing OFIQ and then runs the jobs of the scheduler, where
+    // interactive assessments go ahead of the queued batch images. Only a few
+    // batch images are queued at a time, so cancelling is quick.
+    std::string configPath = m_ofiqConfigPath;
+    auto scheduler = std::make_shared<OFIQPriorityQueue<AssessmentJob>>(16, 2 * placement.GetWorkerCount());
+    m_schedulerPtr = scheduler;
+    m_batchThread = std::thread([this, configPath, placement, scheduler, images]()
+    {
+        std::vector<std::thread> workers;
+        for (size_t worker = 0; worker < placement.GetWorkerCount(); worker++)
         {
-            auto measureId = static_cast<int>(q.first);
-            csv_stream << sep << measurementMapping.at(measureId);
+            workers.emplace_back([this, &placement, &configPath, scheduler, worker]()
+            {
+                std::string batchError;
+                OFIQBatchRunner runner;
+                if (!placement.PinWorker(worker, batchError) || !runner.Initialize(configPath, batchError))
+                {
+                    CallAfter([this, batchError]() { LOG_ERROR(batchError); });
+                    m_batchCancel = true;
+                    scheduler->Close();
+                    return;
+                }
+                AssessmentJob job;
+                while (scheduler->Pop(job))
+                {
+                    job(&runner);
+                }
+            });
         }
 
-        for (auto q : m_assessments.qAssessments)
+        for (const auto& image : images)
         {
-            auto measureId = static_cast<int>(q.first);
-            csv_stream << sep << measurementMapping.at(measureId) << ".scalar";
+            std::string path = image.path;
+            bool queued = !m_batchCancel && scheduler->Push(OFIQPriority::Batch, [this, path](OFIQBatchRunner* runner)
+            {
+                if (runner == nullptr || m_batchCancel)
+                {
+                    return;
+                }
+                auto item = runner->Process(path);
+                m_batchStats.Add(item.assessments, item.success);
+                m_batchProgress.done++;
+                double score;
+                if (m_thumbnailCachePtr->SaveScore(path, item.assessments, score))
+                {
+                    CallAfter([this, path, score]() { m_thumbnailFramePtr->GetThumbnails()->SetScore(path, score); });
+                }
+            });
+            if (!queued)
+            {
+                break;
+            }
         }
-
-        csv_stream << std::endl;
-
-        csv_stream << m_imagePath;
-
-        for (auto q : m_assessments.qAssessments)
+        scheduler->Close();
+        for (auto& worker : workers)
         {
-            csv_stream << sep << q.second.rawScore;
+            worker.join();
         }
 
-        for (auto q : m_assessments.qAssessments)
+        // Jobs left after a worker failed to initialize.
+        AssessmentJob job;
+        while (scheduler->Pop(job))
         {
-            csv_stream << sep << q.second.scalar;
+            job(nullptr);
         }
 
-        csv_stream << std::endl;
+        m_batchProgress.running = false;
+        size_t done = m_batchProgress.done;
+        CallAfter([this, done]() { LOG_INFO("Batch finished after " + std::to_string(done) + " images."); });
+    });
 
-        csv_stream.close();
-        LOG_INFO("Assessment exported.");
-    }
-    else
+    m_statisticsFramePtr->Show();
+    m_statisticsFramePtr->Raise();
+}
+
+void OFIQDemoFrame::OnThreadSettings(wxCommandEvent& event)
+{
+    OFIQThreadSettingsDialog dialog(this, m_threadSettings);
+    if (dialog.ShowModal() != wxID_OK)
     {
-        LOG_ERROR("Failed to write assessment.");
+        return;
     }
 
+    // The intra-op threads take effect when OFIQ is initialized.
+    if (dialog.GetSettings().intraOpThreads != m_threadSettings.intraOpThreads)
+    {
+        m_ofiqInitialized = false;
+    }
+    m_threadSettings = dialog.GetSettings();
 
-    return true;
+    OFIQThreadPlacement placement;
+    std::string error;
+    if (placement.Initialize(m_threadSettings, error))
+    {
+        LOG_INFO("Thread settings: " + placement.ToString());
+    }
 }
 
-bool OFIQDemoFrame::DoOfiqInit()
+void OFIQDemoFrame::OnShowStatistics(wxCommandEvent& event)
 {
-    LOG_INFO("OFIQ initialization ...");
+    m_statisticsFramePtr->Show();
+    m_statisticsFramePtr->Raise();
+    m_statisticsFramePtr->RefreshStatistics();
+}
 
-    if (!std::filesystem::is_regular_file(m_ofiqConfigPath))
+void OFIQDemoFrame::DoStopBatch()
+{
+    if (m_batchThread.joinable())
     {
-        LOG_ERROR("Not an existing file: " + m_ofiqConfigPath);
-        return false;
+        m_batchCancel = true;
+        m_batchThread.join();
     }
+}
 
-    auto path = std::filesystem::absolute(m_ofiqConfigPath);
-    auto configDir = path.parent_path().u8string();
-    auto configFile = path.filename().u8string();
-
-    m_ofiqPtr = OFIQ::Interface::getImplementation();
-    auto ret = m_ofiqPtr->initialize(configDir, configFile);
-    if (ret.code != OFIQ::ReturnCode::Success)
+// Assesses the image, or the padded crop around the region if one is given.
+bool OFIQDemoFrame::DoScheduleAssessment(const wxRect& region)
+{
+    // While a batch runs, the assessment is handed to the next free batch
+    // worker ahead of the queued batch images instead of competing with the
+    // workers for the CPUs.
+    if (!m_batchProgress.running || m_schedulerPtr == nullptr)
     {
-        LOG_ERROR("Not an existing file: " + m_ofiqConfigPath);
         return false;
     }
 
-    LOG_INFO("OFIQ initialization done");
-
-    return true;
-}
-
-void OFIQDemoFrame::UpdateOriginal()
-{
-    if (m_showOriginal)
+    OFIQ::Image source = m_ofiqImage;
+    OFIQ::Image image = source;
+    wxRect crop;
+    if (!region.IsEmpty() && !DoCropRegion(region, crop, image))
     {
-        auto channels = m_ofiqImage.depth / 8;
-        bool isRGB = (channels == 3);
+        // The error has been reported; there is nothing to assess.
+        return true;
+    }
 
-        memcpy(m_cvImage.data, m_ofiqImage.data.get(), m_ofiqImage.size());
-        if (!isRGB)
+    auto queued = std::chrono::steady_clock::now();
+    size_t batchWaiting = m_schedulerPtr->Size(OFIQPriority::Batch);
+    bool scheduled = m_schedulerPtr->TryPush(OFIQPriority::Interactive, [this, source, image, crop, queued](OFIQBatchRunner* runner)
+    {
+        double waitSeconds = OFIQSecondsSince(queued);
+        OFIQBatchItem item;
+        item.image = image;
+        if (runner == nullptr)
         {
-            cv::cvtColor(m_cvImage, m_cvImage, cv::COLOR_GRAY2BGR);
+            item.info = "No batch worker available.";
         }
         else
         {
-            cv::cvtColor(m_cvImage, m_cvImage, cv::COLOR_BGR2RGB);
+            runner->SetKeepPreprocessing(true);
+            runner->Assess(item);
+            runner->SetKeepPreprocessing(false);
         }
-    }
-    else
+        if (!crop.IsEmpty())
+        {
+            MapCropResults(crop, source.width, source.height, item.preprocessing);
+        }
+        CallAfter([this, item, source, crop, waitSeconds]() { OnScheduledAssessment(item, source, crop, waitSeconds); });
+    });
+    if (scheduled)
     {
-        memset(m_cvImage.data, 255, m_ofiqImage.size());
+        LOG_INFO("OFIQ assessment queued ahead of " + std::to_string(batchWaiting) + " batch images ...");
     }
+    return scheduled;
 }
 
-void OFIQDemoFrame::UpdateFaces()
+void OFIQDemoFrame::OnScheduledAssessment(const OFIQBatchItem& item, const OFIQ::Image& source, const wxRect& crop, double waitSeconds)
 {
-    if (!m_showFaces)
+    if (source.data != m_ofiqImage.data)
     {
+        LOG_INFO("OFIQ assessment discarded, another image has been loaded meanwhile.");
         return;
     }
-
-    int width = m_ofiqImage.width;
-    int height = m_ofiqImage.height;
-    const cv::Scalar faceColour(0, 0, 255);
-    int thickness = (int)std::ceil(0.01 * (height < width ? height : width));
-
-    for (auto face : m_preprocessing.m_faces)
+    if (!item.success)
     {
-        cv::Rect cvRect(face.xleft, face.ytop, face.width, face.height);
-        cv::rectangle(m_cvImage, cvRect, faceColour, thickness);
+        LOG_ERROR(item.info);
     }
-}
 
-void OFIQDemoFrame::UpdateLandmarks()
-{
-    if (!m_showLandmarks)
+    if (!crop.IsEmpty())
     {
+        DoShowRegionResults(item.assessments, item.preprocessing, crop, item.assessSeconds);
+        DoUpdateImage();
+        DoShowAssessmentTable();
+        LOG_INFO("OFIQ assessment of selection done (waited " + std::to_string(waitSeconds) + " s for a batch worker)");
         return;
     }
 
-    const cv::Vec3b FACE_CONTOUR_COLOR(255, 255, 0);
-    const cv::Vec3b EYE_BROWS_COLOR(255, 0, 0);
-    const cv::Vec3b NOSE_COLOR(0, 0, 0);
-    const cv::Vec3b OUTER_BOUNDARY_OF_EYES_COLOR(128, 0, 128);
-    const cv::Vec3b OUTER_BOUNDARY_OF_LIPS_COLOR(0, 0, 255);
-    const cv::Vec3b INNER_BOUNDARY_OF_LIPS_COLOR(0, 255, 0);
-    const cv::Vec3b PUPILS_COLOR(255, 255, 255);
+    m_assessments = item.assessments;
+    m_preprocessing = item.preprocessing;
+    m_lastFullAssessmentSeconds = item.assessSeconds;
+    DoUpdateImage();
+    DoShowAssessmentTable();
+    DoCacheScore(m_imagePath, m_assessments);
 
-    const int height = m_cvImage.rows;
-    const int width = m_cvImage.cols;
-    const int radius = (int)std::ceil(0.005 * (height < width ? height : width));
-    const auto& landmarks = m_preprocessing.m_landmarks.landmarks;
-    const auto& lmtypes = m_preprocessing.m_landmarks.type;
+    LOG_INFO("OFIQ assessment done (" + std::to_string(item.assessSeconds) + " s, waited "
+        + std::to_string(waitSeconds) + " s for a batch worker)");
+}
 
-    for (size_t lm_label = 0; lm_label < landmarks.size(); lm_label++)
+std::string OFIQDemoFrame::OnQueueStatusBinding(void* owner)
+{
+    auto frame = static_cast<OFIQDemoFrame*>(owner);
+    if (frame->m_schedulerPtr == nullptr)
     {
-        cv::Vec3b color;
-        if (lm_label < 33)
-        {
-            color = FACE_CONTOUR_COLOR;
-        }
-        else if (lm_label < 47)
-        {
-            color = EYE_BROWS_COLOR;
-        }
-        else if (lm_label < 60)
-        {
-            color = NOSE_COLOR;
-        }
-        else if (lm_label < 76)
-        {
-            color = OUTER_BOUNDARY_OF_EYES_COLOR;
-        }
-        else if (lm_label < 88)
-        {
-            color = OUTER_BOUNDARY_OF_LIPS_COLOR;
-        }
-        else if (lm_label < 96)
-        {
-            color = INNER_BOUNDARY_OF_LIPS_COLOR;
-        }
-        else
+        return "";
+    }
+
+    std::ostringstream status;
+    status.precision(0);
+    status << std::fixed << "Queue wait:";
+    for (size_t i = 0; i < OFIQPriorityCount; i++)
+    {
+        auto priority = static_cast<OFIQPriority>(i);
+        auto waits = frame->m_schedulerPtr->GetWaitStats(priority);
+        status << (i > 0 ? "; " : " ") << GetPriorityName(priority)
+            << " " << frame->m_schedulerPtr->Size(priority) << " waiting, " << waits.count << " done";
+        if (waits.count > 0)
         {
-            color = PUPILS_COLOR;
+            status << ", p50 " << waits.GetQuantileSeconds(0.50) * 1000.0
+                << " ms, p95 " << waits.GetQuantileSeconds(0.95) * 1000.0
+                << " ms, max " << waits.maxSeconds * 1000.0 << " ms";
         }
-        auto& lm = landmarks[lm_label];
-        cv::circle(m_cvImage, cv::Point(lm.x, lm.y), radius, color, -1);
     }
+    return status.str();
+}
+
+void OFIQDemoFrame::OnSelectionBinding(void* owner, const wxRect& selection)
+{
+    static_cast<OFIQDemoFrame*>(owner)->OnRegionSelected(selection);
+}
+
+wxImage OFIQDemoFrame::OnTileBinding(void* owner, const wxRect& region)
+{
+    auto frame = static_cast<OFIQDemoFrame*>(owner);
+    OFIQ::Image image;
+    OFIQ::FaceImageQualityPreprocessingResult preprocessing;
+    OFIQDisplayProxy::Crop(frame->m_ofiqImage, frame->m_preprocessing,
+        cv::Rect(region.x, region.y, region.width, region.height), image, preprocessing);
+    OFIQOverlayOptions options = frame->GetOverlayOptions();
+    options.faces = false;
+    options.landmarks = false;
+    return ToWxImage(OFIQOverlayRenderer::Render(image, preprocessing, options));
 }
 
-void OFIQDemoFrame::UpdateSegmentationMask()
+void OFIQDemoFrame::OnScaleBinding(void* owner, double scale)
 {
-    if (!m_showSegmentationMask || m_preprocessing.m_segmentationMaskPtr == nullptr)
+    auto frame = static_cast<OFIQDemoFrame*>(owner);
+    frame->m_scaleFactor = scale;
+    frame->DoUpdateZoomStatus();
+}
+
+void OFIQDemoFrame::OnRegionSelected(const wxRect& selection)
+{
+    if (!m_imageLoaded)
     {
         return;
     }
 
-    const static int labelCount = 24;
-    const static cv::Vec3b colorMap[] = {
-        cv::Vec3b(128, 128, 128), // 0: background
-        cv::Vec3b(255, 85, 0), // 1: face_skin
-        cv::Vec3b(255, 170, 0), // 2: left eye brow
-        cv::Vec3b(255, 0, 85), // 3: right eye brow
-        cv::Vec3b(255, 0, 170), // 4: left eye
-        cv::Vec3b(0, 255, 0), // 5: right eye
-        cv::Vec3b(0, 255, 255), // 6: eyeglasses
-        cv::Vec3b(170, 255, 0), // 7: left ear
-        cv::Vec3b(0, 255, 85), // 8: right ear
-        cv::Vec3b(0, 255, 170), // 9: earring
-        cv::Vec3b(0, 0, 255), // 10: nose
-        cv::Vec3b(85, 0, 255), // 11: mouth
-        cv::Vec3b(170, 0, 255), // 12: upper lip
-        cv::Vec3b(0, 85, 255), // 13: lower lip
-        cv::Vec3b(0, 170, 255), // 14: neck
-        cv::Vec3b(255, 255, 0), // 15: necklace
-        cv::Vec3b(255, 255, 85), // 16: clothing
-        cv::Vec3b(255, 255, 170), // 17: hair
-        cv::Vec3b(255, 0, 255), // 18: head covering
-        cv::Vec3b(255, 85, 255), // 19:
-        cv::Vec3b(255, 170, 255), // 20:
-        cv::Vec3b(85, 255, 255), // 21:
-        cv::Vec3b(170, 255, 255), // 22:
-        cv::Vec3b(85, 255, 0) }; // 23:
-
-    int height = m_cvImage.rows;
-    int width = m_cvImage.cols;
-    double alpha = 0.3;
-    double beta = 1.0 - alpha;
-
-    cv::Mat overlay(height, width, CV_8UC3);
-    for (int y = 0; y < height; y++)
-    {
-        for (int x = 0; x < width; x++)
+    wxRect imageRect(0, 0, m_ofiqImage.width, m_ofiqImage.height);
+
+    if (selection.IsEmpty())
+    {
+        // A click selects the detected face box containing the clicked pixel.
+        m_selection = wxRect();
+        for (size_t i = 0; i < m_preprocessing.m_faces.size(); i++)
         {
-            cv::Vec3b& color = overlay.at<cv::Vec3b>(cv::Point(x, y));
-            auto val = m_preprocessing.m_segmentationMaskPtr.get()[y * width + x];
-            if (val >= labelCount)
-            {
-                color[0] = 255;
-                color[1] = 255;
-                color[2] = 255;
-            }
-            else
+            const auto& face = m_preprocessing.m_faces[i];
+            wxRect faceRect(face.xleft, face.ytop, face.width, face.height);
+            if (faceRect.Contains(selection.GetPosition()))
             {
-                color[0] = colorMap[val][0];
-                color[1] = colorMap[val][1];
-                color[2] = colorMap[val][2];
+                m_selection = faceRect.Intersect(imageRect);
+                LOG_INFO("Face " + std::to_string(i) + " selected.");
+                break;
             }
         }
     }
+    else
+    {
+        m_selection = wxRect(selection).Intersect(imageRect);
+        LOG_INFO("Region selected: " + std::to_string(m_selection.width) + "x" + std::to_string(m_selection.height)
+            + " at (" + std::to_string(m_selection.x) + ", " + std::to_string(m_selection.y) + ").");
+    }
 
-    cv::addWeighted(overlay, alpha, m_cvImage, beta, 0.0, m_cvImage);
+    if (m_selection.IsEmpty())
+    {
+        m_pictureFramePtr->ClearSelection();
+    }
+    else
+    {
+        m_pictureFramePtr->SetSelection(m_selection);
+    }
 }
 
-void OFIQDemoFrame::UpdateOcclusionMask()
+bool OFIQDemoFrame::DoLoadImage(const std::string& path)
 {
-    if (!m_showOcclusionMask || m_preprocessing.m_occlusionMaskPtr == nullptr)
+    LOG_INFO("Loading image from '" + path + "' ...");
+
+    DoRememberImage();
+    OFIQ::ReturnStatus retStatus = OFIQ_LIB::readImage(path, m_ofiqImage);
+    if (retStatus.code != OFIQ::ReturnCode::Success)
     {
-        return;
+        LOG_ERROR("Loading image returned: " + retStatus.info);
+        return false;
     }
 
-    const cv::Vec3b foregroundColor(0, 0, 255);
-    const cv::Vec3b backgroundColor(255, 255, 255);
-    int height = m_cvImage.rows;
-    int width = m_cvImage.cols;
-    double alpha = 0.3;
-    double beta = 1.0 - alpha;
+    this->m_imagePath = path;
 
-    cv::Mat overlay(height, width, CV_8UC3);
-    for (int y = 0; y < height; y++)
+    DoClearAssessmentTable();
+    DoClearPreprocessing();
+    m_selection = wxRect();
+    m_pictureFramePtr->ClearSelection();
+    m_lastFullAssessmentSeconds = -1.0;
+
+    DoUpdatePreferredScalingFactor();
+    DoInitImage();
+    m_thumbnailFramePtr->GetThumbnails()->Select(path);
+    m_history.Visit(GetSessionData());
+    DoUpdateHistoryStatus();
+
+    LOG_INFO("Image loaded.");
+
+    return m_imageLoaded;
+}
+
+bool OFIQDemoFrame::DoSaveImage(const std::string& path)
+{
+    LOG_INFO("Saving image to '" + path + "' ...");
+
+    // The view draws faces and landmarks as vectors, the saved image gets
+    // them rasterised.
+    cv::Mat image = OFIQOverlayRenderer::Render(m_ofiqImage, m_preprocessing, GetOverlayOptions());
+    bool flag = cv::imwrite(path, image);
+
+    if (flag)
     {
-        for (int x = 0; x < width; x++)
-        {
-            cv::Vec3b& color = overlay.at<cv::Vec3b>(cv::Point(x, y));
-            auto val = m_preprocessing.m_occlusionMaskPtr.get()[y * width + x];
-            if (val)
-            {
-                color = foregroundColor;
-            }
-            else
-            {
-                color = backgroundColor;
-            }
-        }
+        LOG_INFO("Image saved.");
+    }
+    else
+    {
+        LOG_ERROR("Saving image failed.");
     }
-    cv::addWeighted(overlay, alpha, m_cvImage, beta, 0.0, m_cvImage);
+
+    return flag;
 }
 
-void OFIQDemoFrame::UpdateLandmarkedRegion()
+bool OFIQDemoFrame::DoOpenSession(const std::string& path)
 {
-    if (!m_showLandmarkedRegion || m_preprocessing.m_landmarkedRegionPtr == nullptr)
+    LOG_INFO("Opening session '" + path + "' ...");
+    auto start = std::chrono::steady_clock::now();
+
+    std::string error;
+    OFIQSessionData session;
+    if (!OFIQSession::Load(path, session, error))
     {
-        return;
+        LOG_ERROR(error);
+        return false;
     }
 
-    const cv::Vec3b foregroundColor(255, 0, 0);
-    const cv::Vec3b backgroundColor(255, 255, 255);
-    int height = m_cvImage.rows;
-    int width = m_cvImage.cols;
-    double alpha = 0.3;
-    double beta = 1.0 - alpha;
+    uint64_t imageHash = 0;
+    if (!OFIQSession::HashFile(session.imagePath, imageHash, error))
+    {
+        LOG_ERROR("Image of the session not found: " + error);
+        return false;
+    }
+    if (imageHash != session.imageHash)
+    {
+        // The assessment belongs to the former content of the file.
+        LOG_ERROR("The image '" + session.imagePath + "' has changed since the session was saved; its assessment is discarded.");
+        session.assessments = OFIQ::FaceImageQualityAssessment();
+        session.preprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+    }
 
-    cv::Mat overlay(height, width, CV_8UC3);
-    for (int y = 0; y < height; y++)
+    DoRememberImage();
+    if (!DoRestoreSession(session))
+    {
+        return false;
+    }
+    m_history.Visit(session);
+    DoUpdateHistoryStatus();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    LOG_INFO("Session restored (" + std::to_string(seconds) + " s).");
+    return true;
+}
+
+// Shows the image of a session with its assessment and preprocessing
+// results; the image is read from its file.
+bool OFIQDemoFrame::DoRestoreSession(const OFIQSessionData& session)
+{
+    OFIQ::Image image;
+    OFIQ::ReturnStatus retStatus = OFIQ_LIB::readImage(session.imagePath, image);
+    if (retStatus.code != OFIQ::ReturnCode::Success)
+    {
+        LOG_ERROR("Loading image returned: " + retStatus.info);
+        return false;
+    }
+    bool hasResults = !session.assessments.qAssessments.empty() || !session.preprocessing.m_faces.empty();
+    if (hasResults && (image.width != session.width || image.height != session.height))
+    {
+        LOG_ERROR("The image size does not match the session.");
+        return false;
+    }
+
+    m_ofiqImage = image;
+    m_imagePath = session.imagePath;
+    m_assessments = session.assessments;
+    m_preprocessing = session.preprocessing;
+    m_selection = wxRect();
+    m_pictureFramePtr->ClearSelection();
+    m_lastFullAssessmentSeconds = -1.0;
+
+    DoUpdatePreferredScalingFactor();
+    DoInitImage();
+    if (m_assessments.qAssessments.empty())
+    {
+        DoClearAssessmentTable();
+    }
+    else
+    {
+        DoShowAssessmentTable();
+    }
+    m_thumbnailFramePtr->GetThumbnails()->Select(m_imagePath);
+    return true;
+}
+
+// The state of the image view as a session.
+OFIQSessionData OFIQDemoFrame::GetSessionData() const
+{
+    OFIQSessionData session;
+    session.imagePath = m_imagePath;
+    session.width = m_ofiqImage.width;
+    session.height = m_ofiqImage.height;
+    session.assessments = m_assessments;
+    session.preprocessing = m_preprocessing;
+    return session;
+}
+
+// Stores the assessment of the image shown in the history before another
+// image is shown.
+void OFIQDemoFrame::DoRememberImage()
+{
+    if (m_imageLoaded)
+    {
+        m_history.Update(GetSessionData());
+    }
+}
+
+bool OFIQDemoFrame::DoGoHistory(int offset)
+{
+    if (!m_history.CanGo(offset))
+    {
+        return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+
+    DoRememberImage();
+    std::string error;
+    OFIQSessionData session;
+    bool imageChanged = false;
+    if (!m_history.Peek(offset, session, imageChanged, error))
+    {
+        LOG_ERROR(error);
+        return false;
+    }
+    if (imageChanged)
+    {
+        // The assessment belongs to the former content of the file.
+        LOG_INFO("The image '" + session.imagePath + "' has changed, its assessment is discarded.");
+        session.assessments = OFIQ::FaceImageQualityAssessment();
+        session.preprocessing = OFIQ::FaceImageQualityPreprocessingResult();
+    }
+
+    // The position only moves once the image is shown; otherwise the view
+    // keeps the current image and its entry.
+    bool restored = DoRestoreSession(session);
+    if (restored)
+    {
+        m_history.Move(offset);
+    }
+    if (restored && imageChanged)
+    {
+        DoRememberImage();
+    }
+    DoUpdateHistoryStatus();
+    if (restored)
+    {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        LOG_INFO("Image '" + session.imagePath + "' shown from history (" + std::to_string(seconds) + " s).");
+    }
+    return restored;
+}
+
+void OFIQDemoFrame::DoUpdateHistoryStatus()
+{
+    std::ostringstream status;
+    status.precision(1);
+    status << std::fixed << "History " << m_history.GetPosition() << "/" << m_history.GetCount()
+        << ", " << m_history.GetBytes() / 1024.0 << " KiB";
+    SetStatusText(status.str(), 2);
+    GetMenuBar()->Enable(ID_HistoryBack, m_history.CanGo(-1));
+    GetMenuBar()->Enable(ID_HistoryForward, m_history.CanGo(1));
+}
+
+bool OFIQDemoFrame::DoSaveSession(const std::string& path)
+{
+    LOG_INFO("Saving session to '" + path + "' ...");
+
+    if (!m_imageLoaded)
     {
-        for (int x = 0; x < width; x++)
+        LOG_ERROR("No image loaded.");
+        return false;
+    }
+
+    std::string error;
+    OFIQSessionData session;
+    session.imagePath = std::filesystem::absolute(m_imagePath).u8string();
+    if (!OFIQSession::HashFile(m_imagePath, session.imageHash, error))
+    {
+        LOG_ERROR(error);
+        return false;
+    }
+    session.width = m_ofiqImage.width;
+    session.height = m_ofiqImage.height;
+    session.assessments = m_assessments;
+    session.preprocessing = m_preprocessing;
+
+    if (!OFIQSession::Save(path, session, error))
+    {
+        LOG_ERROR(error);
+        return false;
+    }
+    LOG_INFO("Session saved.");
+    return true;
+}
+
+bool OFIQDemoFrame::DoSaveAssessment(const std::string& path)
+{
+    LOG_INFO("Exporting assessment to '" + path + "' ...");
+
+    std::ofstream csv_stream(path.c_str());
+    if (csv_stream.is_open())
+    {
+        auto measures = OFIQAssessmentCsv::GetMeasures(m_assessments);
+        OFIQAssessmentCsv::WriteHeader(csv_stream, measures);
+        OFIQAssessmentCsv::WriteRow(csv_stream, m_imagePath, m_assessments, measures);
+
+        csv_stream.close();
+        LOG_INFO("Assessment exported.");
+    }
+    else
+    {
+        LOG_ERROR("Failed to write assessment.");
+    }
+
+
+    return true;
+}
+
+bool OFIQDemoFrame::DoOfiqInit()
+{
+    LOG_INFO("OFIQ initialization ...");
+
+    OFIQ::ReturnStatus ret(OFIQ::ReturnCode::Success);
+    m_ofiqPtr = OFIQCreateInterface(m_ofiqConfigPath, ret);
+    if (m_ofiqPtr == nullptr)
+    {
+        LOG_ERROR(ret.info.empty() ? "OFIQ initialization failed." : ret.info);
+        return false;
+    }
+
+    LOG_INFO("OFIQ initialization done");
+
+    return true;
+}
+
+bool OFIQDemoFrame::DoAssessRegion(const wxRect& region)
+{
+    wxRect crop;
+    OFIQ::Image cropImage;
+    if (!DoCropRegion(region, crop, cropImage))
+    {
+        return false;
+    }
+
+    OFIQ::FaceImageQualityAssessment assessments;
+    OFIQ::FaceImageQualityPreprocessingResult preprocessing;
+    uint32_t resultRequestsMask = static_cast<int>(OFIQ::PreprocessingResultType::All);
+    auto start = std::chrono::steady_clock::now();
+    auto result = m_ofiqPtr->vectorQualityWithPreprocessingResults(
+        cropImage, assessments, preprocessing, resultRequestsMask);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (result.code != OFIQ::ReturnCode::Success)
+    {
+        LOG_ERROR("OFIQ assessment returned: " + result.info);
+    }
+
+    MapCropResults(crop, m_ofiqImage.width, m_ofiqImage.height, preprocessing);
+    DoShowRegionResults(assessments, preprocessing, crop, seconds);
+    return result.code == OFIQ::ReturnCode::Success;
+}
+
+// Copies the region of the image, padded so that the face detector sees
+// some context around the face.
+bool OFIQDemoFrame::DoCropRegion(const wxRect& region, wxRect& crop, OFIQ::Image& cropImage)
+{
+    const int width = m_ofiqImage.width;
+    const int height = m_ofiqImage.height;
+    const int channels = m_ofiqImage.depth / 8;
+
+    int padding = static_cast<int>(std::ceil(m_selectionPadding * std::max(region.width, region.height)));
+    crop = region;
+    crop.Inflate(padding);
+    crop.Intersect(wxRect(0, 0, width, height));
+    if (crop.IsEmpty())
+    {
+        LOG_ERROR("Selected region is outside of the image.");
+        return false;
+    }
+
+    size_t cropRowBytes = static_cast<size_t>(crop.width) * channels;
+    size_t imageRowBytes = static_cast<size_t>(width) * channels;
+    std::shared_ptr<uint8_t> cropData(new uint8_t[cropRowBytes * crop.height], std::default_delete<uint8_t[]>());
+    for (int y = 0; y < crop.height; y++)
+    {
+        memcpy(cropData.get() + y * cropRowBytes,
+            m_ofiqImage.data.get() + (crop.y + y) * imageRowBytes + static_cast<size_t>(crop.x) * channels,
+            cropRowBytes);
+    }
+    cropImage = OFIQ::Image(
+        static_cast<uint16_t>(crop.width), static_cast<uint16_t>(crop.height), m_ofiqImage.depth, cropData);
+    return true;
+}
+
+// Maps the preprocessing results of a crop back onto the full image of the
+// given size.
+void OFIQDemoFrame::MapCropResults(const wxRect& crop, int width, int height, OFIQ::FaceImageQualityPreprocessingResult& preprocessing)
+{
+    for (auto& face : preprocessing.m_faces)
+    {
+        face.xleft = static_cast<int16_t>(face.xleft + crop.x);
+        face.ytop = static_cast<int16_t>(face.ytop + crop.y);
+    }
+    for (auto& landmark : preprocessing.m_landmarks.landmarks)
+    {
+        landmark.x = static_cast<int16_t>(landmark.x + crop.x);
+        landmark.y = static_cast<int16_t>(landmark.y + crop.y);
+    }
+    for (auto maskPtr : { &preprocessing.m_segmentationMaskPtr,
+                          &preprocessing.m_occlusionMaskPtr,
+                          &preprocessing.m_landmarkedRegionPtr })
+    {
+        if (*maskPtr == nullptr)
         {
-            cv::Vec3b& color = overlay.at<cv::Vec3b>(cv::Point(x, y));
-            auto val = m_preprocessing.m_landmarkedRegionPtr.get()[y * width + x];
-            if (val)
-            {
-                color = foregroundColor;
-            }
-            else
-            {
-                color = backgroundColor;
-            }
+            continue;
+        }
+        std::shared_ptr<uint8_t> fullMask(new uint8_t[static_cast<size_t>(width) * height], std::default_delete<uint8_t[]>());
+        memset(fullMask.get(), 0, static_cast<size_t>(width) * height);
+        for (int y = 0; y < crop.height; y++)
+        {
+            memcpy(fullMask.get() + static_cast<size_t>(crop.y + y) * width + crop.x,
+                maskPtr->get() + static_cast<size_t>(y) * crop.width,
+                crop.width);
         }
+        *maskPtr = fullMask;
     }
-    cv::addWeighted(overlay, alpha, m_cvImage, beta, 0.0, m_cvImage);
 }
 
-void OFIQDemoFrame::CreateCvImage()
+void OFIQDemoFrame::DoShowRegionResults(const OFIQ::FaceImageQualityAssessment& assessments,
+    const OFIQ::FaceImageQualityPreprocessingResult& preprocessing, const wxRect& crop, double seconds)
 {
-    auto width = m_ofiqImage.width;
-    auto height = m_ofiqImage.height;
-    auto channels = m_ofiqImage.depth / 8;
-    bool isRGB = (channels == 3);
+    m_assessments = assessments;
+    m_preprocessing = preprocessing;
 
-    m_cvImage = cv::Mat(height, width, isRGB ? CV_8UC3 : CV_8UC1);
+    std::string timing = "Crop " + std::to_string(crop.width) + "x" + std::to_string(crop.height)
+        + " assessed in " + std::to_string(seconds) + " s";
+    if (m_lastFullAssessmentSeconds > 0.0 && seconds > 0.0)
+    {
+        timing += " (full frame: " + std::to_string(m_lastFullAssessmentSeconds) + " s, speed-up "
+            + std::to_string(m_lastFullAssessmentSeconds / seconds) + "x)";
+    }
+    else
+    {
+        timing += " (no full-frame assessment to compare with)";
+    }
+    LOG_INFO(timing);
+    SetStatusText(timing, 1);
+}
 
-    UpdateOriginal();
-    UpdateFaces();
-    UpdateLandmarks();
-    UpdateSegmentationMask();
-    UpdateOcclusionMask();
-    UpdateLandmarkedRegion();
+OFIQOverlayOptions OFIQDemoFrame::GetOverlayOptions() const
+{
+    OFIQOverlayOptions options;
+    options.original = m_showOriginal;
+    options.faces = m_showFaces;
+    options.landmarks = m_showLandmarks;
+    options.segmentationMask = m_showSegmentationMask;
+    options.occlusionMask = m_showOcclusionMask;
+    options.landmarkedRegion = m_showLandmarkedRegion;
+    return options;
 }
 
 void OFIQDemoFrame::CreateWxImage()
 {
-    int width = m_cvImage.cols;
-    int height = m_cvImage.rows;
-    int channels = m_cvImage.channels();
-    uint8_t* data = (uint8_t*)m_cvImage.data;
-    int depth = channels * 8;
-    m_wxImage = wxImage(width, height, true);
-    for (int i = 0; i < height; i++)
+    // The picture frame is given m_wxImage again after every render, so a
+    // buffer of the same size is overwritten instead of allocating a new one.
+    const cv::Mat& image = m_displaySource.GetImage();
+    if (!m_wxImage.IsOk() || m_wxImage.GetWidth() != image.cols || m_wxImage.GetHeight() != image.rows)
     {
-        for (int j = 0; j < width; j++)
-        {
-            int r, g, b;
-            b = data[i * width * channels + j * channels + 0];
-            g = data[i * width * channels + j * channels + 1];
-            r = data[i * width * channels + j * channels + 2];
-            m_wxImage.SetRGB(j, i, r, g, b);
-        }
+        m_wxImage = wxImage(image.cols, image.rows, false);
     }
+    m_displaySource.CopyRgb(m_wxImage.GetData());
+}
 
-    m_pictureFramePtr->LoadImage(m_wxImage);
+wxImage OFIQDemoFrame::ToWxImage(const cv::Mat& cvImage)
+{
+    int width = cvImage.cols;
+    int height = cvImage.rows;
+    wxImage image(width, height, false);
+    cv::Mat rgb(height, width, CV_8UC3, image.GetData());
+    cv::cvtColor(cvImage, rgb, cv::COLOR_BGR2RGB);
+    return image;
+}
+
+// Renders the display source and m_wxImage again if the image, the masks,
+// the mask layers or the budget have changed since the last render. Zooming
+// and toggling faces or landmarks reuse them.
+void OFIQDemoFrame::DoUpdateDisplaySource()
+{
+    bool proxyCreated = false;
+    bool rendered = m_displaySource.Update(m_ofiqImage, m_preprocessing, GetOverlayOptions(), m_displayBudgetBytes, proxyCreated);
+    if (!rendered && m_wxImage.IsOk())
+    {
+        return;
+    }
+    if (proxyCreated)
+    {
+        const OFIQ::Image& proxyImage = m_displaySource.GetProxyImage();
+        LOG_INFO("Image exceeds the display memory budget; showing a proxy at "
+            + std::to_string(proxyImage.width) + "x" + std::to_string(proxyImage.height) + ".");
+    }
+    CreateWxImage();
+    m_pictureFramePtr->SetTileCacheCapacity(m_displayBudgetBytes / 4);
+    m_pictureFramePtr->ClearTiles();
 }
 
 void OFIQDemoFrame::DoUpdatePreferredScalingFactor()
@@ -1054,18 +1935,109 @@ void OFIQDemoFrame::DoUpdatePreferredScalingFactor()
 void OFIQDemoFrame::DoInitImage()
 {
     wxBusyCursor wait; // Assumingly, the wait cursor is shown for the time the object is alive.
-    CreateCvImage();
-    CreateWxImage();
-    m_pictureFramePtr->LoadImage(m_wxImage, m_scaleFactor);
+    if (m_useOpenGL)
+    {
+        // Textures are only uploaded if the image or the masks have changed.
+        m_glPictureFramePtr->SetContent(m_ofiqImage, m_preprocessing);
+        m_glPictureFramePtr->SetLayers(GetOverlayOptions());
+        m_glPictureFramePtr->SetScale(m_scaleFactor);
+    }
+    else
+    {
+        DoUpdateDisplaySource();
+        // A bitmap of the whole scaled image is only kept if it fits into
+        // half of the budget, otherwise only the part in view is scaled.
+        double scaledBytes = 4.0 * (m_ofiqImage.width * m_scaleFactor) * (m_ofiqImage.height * m_scaleFactor);
+        double proxyScale = m_displaySource.GetProxyScale();
+        if (proxyScale < 1.0 || scaledBytes > m_displayBudgetBytes / 2.0)
+        {
+            m_pictureFramePtr->LoadSource(m_wxImage, proxyScale, wxSize(m_ofiqImage.width, m_ofiqImage.height), m_scaleFactor);
+        }
+        else
+        {
+            m_pictureFramePtr->LoadImage(m_wxImage, m_scaleFactor);
+        }
+        m_pictureFramePtr->SetGeometry(m_preprocessing, wxSize(m_ofiqImage.width, m_ofiqImage.height));
+        m_pictureFramePtr->ShowGeometry(m_showFaces, m_showLandmarks);
+    }
     m_imageLoaded = true;
-    SetStatusText(std::to_string(static_cast<int>(std::round(m_scaleFactor * 100.0))) + "%", 0);
+    m_renderPending = false;
+    m_lastRender = std::chrono::steady_clock::now();
+    m_renderCount++;
+    DoUpdateZoomStatus();
 }
 
 void OFIQDemoFrame::DoUpdateImage()
 {
-    if (m_imageLoaded)
+    if (!m_imageLoaded)
     {
-        DoInitImage();
+        return;
+    }
+    // The requested state (scale factor, layers) is already stored in the
+    // members; a render that is still pending will pick it up.
+    if (m_renderPending)
+    {
+        m_coalescedRenderCount++;
+        return;
+    }
+    m_renderPending = true;
+    wxWakeUpIdle();
+}
+
+void OFIQDemoFrame::DoRenderPending()
+{
+    if (!m_renderPending || !m_imageLoaded)
+    {
+        return;
+    }
+    if (m_limitRenderRate && m_maxRenderRate > 0.0)
+    {
+        double interval = 1.0 / m_maxRenderRate;
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_lastRender).count();
+        if (elapsed < interval)
+        {
+            if (!m_renderTimer.IsRunning())
+            {
+                m_renderTimer.StartOnce(std::max(1, static_cast<int>(std::ceil((interval - elapsed) * 1000.0))));
+            }
+            return;
+        }
+    }
+    DoInitImage();
+}
+
+void OFIQDemoFrame::DoUpdateZoomStatus()
+{
+    std::string status = std::to_string(static_cast<int>(std::round(m_scaleFactor * 100.0))) + "%";
+    double proxyScale = m_displaySource.GetProxyScale();
+    if (!m_useOpenGL && proxyScale < 1.0)
+    {
+        const OFIQ::Image& proxyImage = m_displaySource.GetProxyImage();
+        status += m_scaleFactor > proxyScale
+            ? ", full-resolution tiles"
+            : ", proxy " + std::to_string(proxyImage.width) + "x" + std::to_string(proxyImage.height);
+    }
+    else
+    {
+        status += ", full resolution";
+    }
+    if (m_coalescedRenderCount > 0)
+    {
+        status += " (" + std::to_string(m_renderCount) + " renders, "
+            + std::to_string(m_coalescedRenderCount) + " coalesced)";
+    }
+    SetStatusText(status, 0);
+}
+
+void OFIQDemoFrame::DoUpdateGeometry()
+{
+    if (m_useOpenGL)
+    {
+        m_glPictureFramePtr->SetLayers(GetOverlayOptions());
+    }
+    else
+    {
+        m_pictureFramePtr->ShowGeometry(m_showFaces, m_showLandmarks);
     }
 }
 
@@ -1125,6 +2097,13 @@ void OFIQDemoFrame::LOG(const std::string& msg, const std::string& prefix)
     time_t timestamp;
     time(&timestamp);
     *m_logOutputPtr << strtok(ctime(&timestamp), "\n") << " " << prefix << ": " << msg.c_str() << "\n";
+    // The log window keeps only the latest lines, so that it does not grow
+    // with every image while the demonstrator runs for days.
+    if (static_cast<size_t>(m_logOutputPtr->GetLastPosition()) > OFIQLogLimit::defaultMaxCharacters)
+    {
+        std::string text = m_logOutputPtr->GetValue().ToStdString();
+        m_logOutputPtr->Remove(0, static_cast<long>(OFIQLogLimit::GetTrimLength(text, OFIQLogLimit::defaultMaxCharacters)));
+    }
 }
 
 void OFIQDemoFrame::LOG_INFO(const std::string& info_message)